@@ -16,8 +16,12 @@
 #include <string>
 
 #include <entwine/builder/builder.hpp>
+#include <entwine/builder/checkpoint.hpp>
+#include <entwine/builder/coordinator.hpp>
+#include <entwine/builder/telemetry.hpp>
 #include <entwine/builder/thread-pools.hpp>
 #include <entwine/io/io.hpp>
+#include <entwine/io/memory-driver.hpp>
 #include <entwine/types/bounds.hpp>
 #include <entwine/types/files.hpp>
 #include <entwine/types/metadata.hpp>
@@ -68,10 +72,52 @@ void Build::addArgs()
     m_ap.add(
             "--dataType",
             "Data type for serialized point cloud data.  Valid values are "
-            "\"laszip\" or \"binary\".  Default: \"laszip\".\n"
+            "\"laszip\" or \"binary\", or \"null\" to discard point data "
+            "for profiling.  Default: \"laszip\".\n"
             "Example: --dataType binary",
             [this](Json::Value v) { m_json["dataType"] = v.asString(); });
 
+    m_ap.add(
+            "--hierarchyType",
+            "Storage format of the hierarchy.  Valid values are \"json\" or "
+            "\"binary\".  Default: \"json\".\n"
+            "Example: --hierarchyType binary",
+            [this](Json::Value v) { m_json["hierarchyType"] = v.asString(); });
+
+    m_ap.add(
+            "--pointOrder",
+            "Ordering of points within each serialized node.  Valid values "
+            "are \"gpstime\", \"morton\", or \"none\".  Default: "
+            "\"gpstime\" if GpsTime exists, otherwise \"none\".\n"
+            "Example: --pointOrder morton",
+            [this](Json::Value v) { m_json["pointOrder"] = v.asString(); });
+
+    m_ap.add(
+            "--packThreshold",
+            "Nodes at or below the pack depth containing at most this many "
+            "points are appended to a shared pack file per subtree rather "
+            "than written individually.  Default: 0 (disabled).\n"
+            "Example: --packThreshold 4096",
+            [this](Json::Value v) { m_json["packThreshold"] = extract(v); });
+
+    m_ap.add(
+            "--packDepth",
+            "Depth of the subtree roots used to group packed nodes.  "
+            "Default: 8.\n"
+            "Example: --packDepth 10",
+            [this](Json::Value v) { m_json["packDepth"] = extract(v); });
+
+    m_ap.add(
+            "--zoneMaps",
+            "If present, the range of values of each attribute is recorded "
+            "for every node, so that filtered queries may skip nodes which "
+            "cannot contain matching points.",
+            [this](Json::Value v)
+            {
+                checkEmpty(v);
+                m_json["zoneMaps"] = true;
+            });
+
     m_ap.add(
             "--ticks",
             "Number of voxels in each spatial dimension for data nodes.  "
@@ -126,18 +172,36 @@ void Build::addArgs()
             [this](Json::Value v) { m_json["run"] = extract(v); });
 
     m_ap.add(
-            "--resetFiles",
-            "Reset the memory pool after \"n\" files\n"
-            "Example: --resetFiles 100",
-            [this](Json::Value v) { m_json["resetFiles"] = extract(v); });
+            "--checkpointFiles",
+            "Commit a resumable checkpoint of the build after every \"n\" "
+            "files\n"
+            "Example: --checkpointFiles 100",
+            [this](Json::Value v) { m_json["checkpointFiles"] = extract(v); });
+
+    m_ap.add(
+            "--checkpointMinutes",
+            "Commit a resumable checkpoint of the build after every \"n\" "
+            "minutes\n"
+            "Example: --checkpointMinutes 30",
+            [this](Json::Value v)
+            {
+                m_json["checkpointMinutes"] = extract(v);
+            });
 
     m_ap.add(
             "--subset",
             "-s",
-            "A partial task specification for this build\n"
-            "Example: --subset 1 4",
+            "A partial task specification for this build.  With --plan, "
+            "only the subset ID is given\n"
+            "Example: --subset 1 4, --subset 3 --plan plan.json",
             [this](Json::Value v)
             {
+                if (v.isString())
+                {
+                    m_json["subset"]["id"] = extract(v);
+                    return;
+                }
+
                 if (!v.isArray() || v.size() != 2)
                 {
                     throw std::runtime_error("Invalid subset specification");
@@ -148,6 +212,22 @@ void Build::addArgs()
                 m_json["subset"]["of"] = of;
             });
 
+    m_ap.add(
+            "--plan",
+            "The output of `entwine plan`, from which the bounds of the "
+            "subset given by --subset are taken\n"
+            "Example: --subset 3 --plan plan.json",
+            [this](Json::Value v) { m_json["plan"] = v.asString(); });
+
+    m_ap.add(
+            "--work",
+            "A local directory shared by several build processes, which "
+            "together build every subset of --plan and then merge them.  "
+            "Each process claims subsets from this directory until none "
+            "remain.\n"
+            "Example: --plan plan.json --work ~/entwine/work",
+            [this](Json::Value v) { m_json["work"] = v.asString(); });
+
     m_ap.add(
             "--overflowDepth",
             "Depth at which nodes may overflow",
@@ -178,6 +258,20 @@ void Build::addArgs()
             "logging (default: 10).",
             [this](Json::Value v) { m_json["progressInterval"] = extract(v); });
 
+    m_ap.add(
+            "--metrics",
+            "Local path to which build metrics are written at each progress "
+            "interval\n"
+            "Example: --metrics ~/metrics.jsonl",
+            [this](Json::Value v) { m_json["metrics"] = v.asString(); });
+
+    m_ap.add(
+            "--metricsFormat",
+            "Format of the metrics output: \"json\" to append one JSON "
+            "object per line, or \"prometheus\" to replace the file with a "
+            "Prometheus text exposition (default: json).",
+            [this](Json::Value v) { m_json["metricsFormat"] = v.asString(); });
+
     addArbiter();
 }
 
@@ -185,6 +279,33 @@ void Build::run()
 {
     m_json["verbose"] = true;
 
+    if (m_json.isMember("work"))
+    {
+        Coordinator coordinator(m_json);
+        const bool merged(coordinator.go());
+
+        std::cout << "\nBuilt " << coordinator.built() << " of " <<
+            coordinator.of() << " subsets." << std::endl;
+        if (merged) std::cout << "Merge complete." << std::endl;
+        return;
+    }
+
+    if (m_json.isMember("plan"))
+    {
+        auto a(makeArbiter(m_json["arbiter"]));
+        const Json::Value plan(parse(a->get(m_json["plan"].asString())));
+        const Json::UInt64 id(m_json["subset"]["id"].asUInt64());
+
+        if (!id || id > plan["subsets"].size())
+        {
+            throw std::runtime_error("Invalid subset ID for this plan");
+        }
+
+        m_json["subset"] = plan["subsets"][Json::ArrayIndex(id - 1)]["subset"];
+        if (!m_json.isMember("bounds")) m_json["bounds"] = plan["bounds"];
+        m_json.removeMember("plan");
+    }
+
     Config config(m_json);
     auto builder(makeUnique<Builder>(config));
 
@@ -204,6 +325,35 @@ void Build::run()
 
     std::cout << "Save complete.\n";
 
+    const Checkpoint& checkpoints(builder->checkpoints());
+    if (checkpoints.count())
+    {
+        const Checkpoint::Stats& totals(checkpoints.totals());
+        std::cout << "\tCheckpoints: " << checkpoints.count() << " (" <<
+            commify(totals.bytes / 1024 / 1024) << "MB, " <<
+            commify(totals.totalMs()) << "ms)" << std::endl;
+    }
+
+    const Json::Value t(builder->telemetry().throughput());
+    auto n([](const Json::Value& v)
+    {
+        return commify(static_cast<std::size_t>(v.asDouble()));
+    });
+
+    std::cout << "\tThroughput (" << builder->metadata().dataIo().type() <<
+        "):\n" <<
+        "\t\tInsert: " << n(t["insert"]["rate"]) << " points/s\n" <<
+        "\t\tEncode: " << n(t["encode"]["rate"]) << " points/s per thread, " <<
+            n(t["encode"]["seconds"]) << "s total\n" <<
+        "\t\tUpload: " << n(t["upload"]["rate"].asDouble() / 1048576) <<
+            " MB/s per thread, " << n(t["upload"]["seconds"]) << "s total\n" <<
+        "\t\tStarts: " << n(t["files"]["started"]) << " files, " <<
+            n(t["files"]["p50"].asDouble() * 1000) << "ms median, " <<
+            n(t["files"]["p99"].asDouble() * 1000) << "ms p99\n" <<
+        "\t\tWaits:  " << n(t["wait"]["budget"]) << "s budget, " <<
+            n(t["wait"]["write"]) << "s write, " <<
+            n(t["wait"]["spin"]) << "s spin" << std::endl;
+
     const PointStats stats(files.pointStats());
 
     if (alreadyInserted)
@@ -283,9 +433,15 @@ void Build::log(const Builder& b) const
             b.threadPools().clipPool().numThreads() << "]" <<
         std::endl;
 
-    if (uint64_t rf = b.resetFiles())
+    const Checkpoint& checkpoints(b.checkpoints());
+    if (checkpoints.files())
     {
-        std::cout << "\tReset files: " << rf << std::endl;
+        std::cout << "\tCheckpoint files: " << checkpoints.files() << std::endl;
+    }
+    if (checkpoints.minutes())
+    {
+        std::cout << "\tCheckpoint minutes: " << checkpoints.minutes() <<
+            std::endl;
     }
 
     std::cout <<
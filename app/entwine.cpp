@@ -11,7 +11,9 @@
 #include "build.hpp"
 #include "entwine.hpp"
 #include "convert.hpp"
+#include "generate.hpp"
 #include "merge.hpp"
+#include "plan.hpp"
 #include "scan.hpp"
 #include "update.hpp"
 
@@ -23,6 +25,7 @@
 #include <string>
 #include <vector>
 
+#include <entwine/io/memory-driver.hpp>
 #include <entwine/third/arbiter/arbiter.hpp>
 #include <entwine/types/defs.hpp>
 #include <entwine/util/stack-trace.hpp>
@@ -41,12 +44,16 @@ namespace
             t(3) + "Build an EPT dataset\n" +
             t(2) + "scan\n" +
             t(3) + "Aggregate information about an unindexed dataset\n" +
+            t(2) + "plan\n" +
+            t(3) + "Partition a dataset into balanced subsets\n" +
             t(2) + "merge\n" +
             t(3) + "Merge colocated entwine subsets\n" +
             t(2) + "convert\n" +
             t(3) + "Convert an entwine dataset to a different format\n" +
             t(2) + "update\n" +
-            t(3) + "Update a development EPT dataset to current EPT\n";
+            t(3) + "Update a development EPT dataset to current EPT\n" +
+            t(2) + "generate\n" +
+            t(3) + "Generate a synthetic point cloud for benchmarking\n";
     }
 
     std::mutex mutex;
@@ -94,8 +101,8 @@ void App::addConfig()
             "Example: --config template.json -i in.laz -o out",
             [this](Json::Value v)
             {
-                arbiter::Arbiter a(m_json["arbiter"]);
-                m_json = merge(m_json, parse(a.get(v.asString())));
+                auto a(makeArbiter(m_json["arbiter"]));
+                m_json = merge(m_json, parse(a->get(v.asString())));
             });
 }
 
@@ -313,6 +320,10 @@ int main(int argc, char** argv)
         {
             entwine::app::Build().go(args);
         }
+        else if (app == "plan")
+        {
+            entwine::app::Plan().go(args);
+        }
         else if (app == "merge")
         {
             entwine::app::Merge().go(args);
@@ -325,6 +336,10 @@ int main(int argc, char** argv)
         {
             entwine::app::Update().go(args);
         }
+        else if (app == "generate")
+        {
+            entwine::app::Generate().go(args);
+        }
         else
         {
             if (app != "help" && app != "-h" && app != "--help")
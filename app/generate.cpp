@@ -0,0 +1,102 @@
+/******************************************************************************
+* Copyright (c) 2018, Connor Manning (connor@hobu.co)
+*
+* Entwine -- Point cloud indexing
+*
+* Entwine is available under the terms of the LGPL2 license. See COPYING
+* for specific license text and more information.
+*
+******************************************************************************/
+
+#include "generate.hpp"
+
+#include <iostream>
+#include <string>
+
+#include <json/json.h>
+
+#include <entwine/types/bounds.hpp>
+#include <entwine/util/generator.hpp>
+#include <entwine/util/time.hpp>
+
+namespace entwine
+{
+namespace app
+{
+
+void Generate::addArgs()
+{
+    m_ap.setUsage("entwine generate <output path> (<options>)");
+
+    addOutput(
+            "Output directory for generated LAZ files, which may be any "
+            "writable path including an in-memory path of the form mem://",
+            true);
+    addConfig();
+
+    m_ap.add(
+            "--type",
+            "Distribution of the generated points: terrain, urban, or "
+            "forest.  Default: terrain.\n"
+            "Example: --type forest",
+            [this](Json::Value v) { m_json["type"] = v.asString(); });
+
+    m_ap.add(
+            "--bounds",
+            "-b",
+            "XY extents of the generated data.  Default: [0,0,1000,1000].\n"
+            "Example: --bounds 0 0 30000 30000, or --bounds "
+            "\"[0,0,30000,30000]\"",
+            [this](Json::Value v)
+            {
+                if (v.isArray()) m_json["bounds"] = v;
+                else m_json["bounds"] = parse(v.asString());
+            });
+
+    m_ap.add(
+            "--density",
+            "-d",
+            "Points per square unit.  Default: 10.\n"
+            "Example: --density 25",
+            [this](Json::Value v)
+            {
+                m_json["density"] = parse(v.asString()).asDouble();
+            });
+
+    m_ap.add(
+            "--filePoints",
+            "Maximum points per generated file.  The bounds are split into "
+            "a square grid of as few tiles as possible within this limit.  "
+            "Default: 2000000.\n"
+            "Example: --filePoints 10000000",
+            [this](Json::Value v) { m_json["filePoints"] = extract(v); });
+
+    m_ap.add(
+            "--seed",
+            "Seed for the generated data.  Default: 42.\n"
+            "Example: --seed 7",
+            [this](Json::Value v) { m_json["seed"] = extract(v); });
+
+    addTmp();
+    addSimpleThreads();
+    addArbiter();
+}
+
+void Generate::run()
+{
+    m_json["verbose"] = true;
+
+    Generator generator(m_json);
+
+    const auto start(now());
+    const uint64_t points(generator.go());
+    const double seconds(since<std::chrono::milliseconds>(start) / 1000.0);
+
+    std::cout << "Generated " << commify(points) << " points in " <<
+        generator.tiles() << " files in " << seconds << " seconds." <<
+        std::endl;
+}
+
+} // namespace app
+} // namespace entwine
+
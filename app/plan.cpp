@@ -0,0 +1,112 @@
+/******************************************************************************
+* Copyright (c) 2018, Connor Manning (connor@hobu.co)
+*
+* Entwine -- Point cloud indexing
+*
+* Entwine is available under the terms of the LGPL2 license. See COPYING
+* for specific license text and more information.
+*
+******************************************************************************/
+
+#include "plan.hpp"
+
+#include <cmath>
+#include <iostream>
+#include <string>
+
+#include <entwine/builder/config.hpp>
+#include <entwine/builder/plan.hpp>
+#include <entwine/io/memory-driver.hpp>
+#include <entwine/types/metadata.hpp>
+
+namespace entwine
+{
+namespace app
+{
+
+void Plan::addArgs()
+{
+    m_ap.setUsage("entwine plan <path(s)> -o <plan.json> -n <count>");
+
+    addInput(
+            "File paths or directory entries, or the path to an `entwine "
+            "scan` output file.  Per-file bounds and point counts are used "
+            "to balance the subsets.\n"
+            "Example: --input path.laz, --input autzen/scan.json",
+            true);
+
+    addOutput(
+            "Path at which the plan will be written in JSON format.  Subset "
+            "builds may then use it with `entwine build --plan`.\n"
+            "Example: --output plan.json");
+
+    addConfig();
+    addTmp();
+    addReprojection();
+    addSimpleThreads();
+    addNoTrustHeaders();
+    addAbsolute();
+
+    m_ap.add(
+            "--subsets",
+            "-n",
+            "The number of subsets, which need not be a power of four.\n"
+            "Example: --subsets 12",
+            [this](Json::Value v) { m_json["subsets"] = extract(v); });
+
+    m_ap.add(
+            "--splits",
+            "Depth of the grid whose cells form the subsets.  Default: "
+            "chosen from the number of subsets.\n"
+            "Example: --splits 5",
+            [this](Json::Value v) { m_json["splits"] = extract(v); });
+
+    addArbiter();
+}
+
+void Plan::run()
+{
+    m_json["verbose"] = true;
+
+    const uint64_t of(m_json["subsets"].asUInt64());
+    const uint64_t splits(m_json["splits"].asUInt64());
+    if (!m_json.isMember("output"))
+    {
+        throw std::runtime_error("Plan output path required");
+    }
+
+    const Config config(
+            merge(
+                Config::defaults(),
+                Config::defaultBuildParams(),
+                Config(m_json).prepare().json()));
+    const Metadata metadata(config);
+
+    const entwine::Plan plan(metadata, of, splits);
+
+    // Subset builds must use the same cube, so record the bounds from which
+    // it was derived.
+    Json::Value json(plan.toJson());
+    json["bounds"] = config["bounds"];
+
+    makeArbiter(m_json["arbiter"])->put(
+            config.output(),
+            json.toStyledString());
+
+    std::cout << "\nPlan:" << std::endl;
+    std::cout << "\tSubsets: " << plan.of() << std::endl;
+    std::cout << "\tSplits: " << plan.splits() << std::endl;
+
+    for (const auto& part : plan.parts())
+    {
+        std::cout << "\t\t" << part.id << ": " <<
+            commify(std::llround(part.points)) << " points, " <<
+            part.files.size() << " files, " << part.bounds << std::endl;
+    }
+
+    std::cout << "\nWritten to " << config.output() << std::endl;
+}
+
+} // namespace app
+} // namespace entwine
+
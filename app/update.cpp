@@ -32,7 +32,7 @@ void Update::run()
 {
     m_config = Config(m_json);
 
-    m_arbiter = makeUnique<arbiter::Arbiter>(m_config["arbiter"]);
+    m_arbiter = makeArbiter(m_config["arbiter"]);
     m_ep = makeUnique<arbiter::Endpoint>(
             m_arbiter->getEndpoint(m_config.output()));
     m_pool = makeUnique<Pool>(std::max<uint64_t>(4, m_config.totalThreads()));
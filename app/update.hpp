@@ -31,7 +31,7 @@ private:
     void copyHierarchy() const;
     void copyFileMetadata() const;
 
-    std::unique_ptr<arbiter::Arbiter> m_arbiter;
+    std::shared_ptr<arbiter::Arbiter> m_arbiter;
     std::unique_ptr<arbiter::Endpoint> m_ep;
     std::unique_ptr<Pool> m_pool;
     Config m_config;
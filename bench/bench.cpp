@@ -0,0 +1,108 @@
+/******************************************************************************
+* Copyright (c) 2018, Connor Manning (connor@hobu.co)
+*
+* Entwine -- Point cloud indexing
+*
+* Entwine is available under the terms of the LGPL2 license. See COPYING
+* for specific license text and more information.
+*
+******************************************************************************/
+
+#include "bench.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+
+namespace entwine
+{
+namespace bench
+{
+
+double Result::median() const
+{
+    if (seconds.empty()) return 0;
+
+    std::vector<double> sorted(seconds);
+    std::sort(sorted.begin(), sorted.end());
+
+    const std::size_t mid(sorted.size() / 2);
+    return sorted.size() % 2 ?
+        sorted[mid] : (sorted[mid - 1] + sorted[mid]) / 2.0;
+}
+
+double Result::min() const
+{
+    if (seconds.empty()) return 0;
+    return *std::min_element(seconds.begin(), seconds.end());
+}
+
+Json::Value Result::toJson() const
+{
+    Json::Value json;
+    json["name"] = name;
+    json["unit"] = unit;
+    json["items"] = (Json::UInt64)items;
+    json["medianSeconds"] = median();
+    json["minSeconds"] = min();
+    json["itemsPerSecond"] = median() > 0 ? items / median() : 0.0;
+    for (const double s : seconds) json["seconds"].append(s);
+    return json;
+}
+
+void Suite::add(std::string name, std::string unit, Fn fn)
+{
+    m_entries.push_back(Entry { name, unit, fn });
+}
+
+std::vector<Result> Suite::run() const
+{
+    std::vector<Result> results;
+
+    for (const Entry& entry : m_entries)
+    {
+        if (entry.name.find(m_options.filter) == std::string::npos) continue;
+
+        Result result;
+        result.name = entry.name;
+        result.unit = entry.unit;
+
+        // One untimed repetition to warm caches and lazily initialized state.
+        {
+            Run warmup;
+            entry.fn(warmup);
+        }
+
+        for (uint64_t i(0); i < m_options.reps; ++i)
+        {
+            Run run;
+            entry.fn(run);
+
+            if (i && run.items() != result.items)
+            {
+                throw std::runtime_error(
+                        "Inconsistent item count in " + entry.name);
+            }
+
+            result.items = run.items();
+            result.seconds.push_back(run.seconds());
+        }
+
+        const double median(result.median());
+        std::cout << std::left << std::setw(32) << result.name <<
+            std::right << std::fixed << std::setprecision(4) <<
+            std::setw(10) << median << "s " <<
+            std::setprecision(0) << std::setw(14) <<
+            (median > 0 ? result.items / median : 0.0) << " " <<
+            result.unit << "/s" << std::endl;
+
+        results.push_back(result);
+    }
+
+    return results;
+}
+
+} // namespace bench
+} // namespace entwine
+
@@ -0,0 +1,115 @@
+/******************************************************************************
+* Copyright (c) 2018, Connor Manning (connor@hobu.co)
+*
+* Entwine -- Point cloud indexing
+*
+* Entwine is available under the terms of the LGPL2 license. See COPYING
+* for specific license text and more information.
+*
+******************************************************************************/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <json/json.h>
+
+#include <entwine/util/time.hpp>
+
+namespace entwine
+{
+namespace bench
+{
+
+struct Options
+{
+    // Points per repetition for point-oriented benchmarks.
+    uint64_t points = 1000000;
+    uint64_t reps = 5;
+    uint64_t threads = 8;
+    uint64_t seed = 42;
+
+    // Only benchmarks whose names contain this string are run.
+    std::string filter;
+
+    // Local scratch directory for benchmarks which write output.
+    std::string tmp;
+};
+
+// A single timed repetition.  Only the time between start() and stop() is
+// measured, so setup and teardown may be excluded.  Multiple start/stop
+// intervals accumulate.
+class Run
+{
+public:
+    void start() { m_start = now(); }
+    void stop()
+    {
+        m_seconds += std::chrono::duration<double>(now() - m_start).count();
+    }
+
+    // The number of items processed, from which throughput is derived.
+    void items(uint64_t n) { m_items = n; }
+
+    double seconds() const { return m_seconds; }
+    uint64_t items() const { return m_items; }
+
+private:
+    TimePoint m_start;
+    double m_seconds = 0;
+    uint64_t m_items = 0;
+};
+
+struct Result
+{
+    std::string name;
+    std::string unit;
+    std::vector<double> seconds;
+    uint64_t items = 0;
+
+    double median() const;
+    double min() const;
+
+    Json::Value toJson() const;
+};
+
+class Suite
+{
+public:
+    using Fn = std::function<void(Run& run)>;
+
+    Suite(const Options& options) : m_options(options) { }
+
+    const Options& options() const { return m_options; }
+
+    // Register a benchmark.  _unit_ names the items it reports, e.g. "points".
+    void add(std::string name, std::string unit, Fn fn);
+
+    // Run all benchmarks matching the filter, printing a summary of each as
+    // it completes.
+    std::vector<Result> run() const;
+
+private:
+    struct Entry
+    {
+        std::string name;
+        std::string unit;
+        Fn fn;
+    };
+
+    const Options m_options;
+    std::vector<Entry> m_entries;
+};
+
+// Benchmark registration, by area.
+void addBuilderBenchmarks(Suite& suite);
+void addIoBenchmarks(Suite& suite);
+void addReaderBenchmarks(Suite& suite);
+
+} // namespace bench
+} // namespace entwine
+
@@ -0,0 +1,364 @@
+/******************************************************************************
+* Copyright (c) 2018, Connor Manning (connor@hobu.co)
+*
+* Entwine -- Point cloud indexing
+*
+* Entwine is available under the terms of the LGPL2 license. See COPYING
+* for specific license text and more information.
+*
+******************************************************************************/
+
+#include "bench.hpp"
+#include "synthetic.hpp"
+
+#include <thread>
+#include <vector>
+
+#include <entwine/builder/clipper.hpp>
+#include <entwine/builder/hierarchy.hpp>
+#include <entwine/builder/registry.hpp>
+#include <entwine/builder/thread-pools.hpp>
+#include <entwine/third/arbiter/arbiter.hpp>
+#include <entwine/types/key.hpp>
+#include <entwine/types/vector-point-table.hpp>
+#include <entwine/util/executor.hpp>
+#include <entwine/util/generator.hpp>
+#include <entwine/util/pool.hpp>
+#include <entwine/util/unique.hpp>
+
+namespace entwine
+{
+namespace bench
+{
+
+namespace
+{
+    const arbiter::Arbiter a;
+
+    // Keeps results observable so that timed loops aren't optimized away.
+    volatile uint64_t sink(0);
+
+    arbiter::Endpoint scratch(const Options& options, const std::string name)
+    {
+        const std::string path(arbiter::util::join(options.tmp, name) + "/");
+        for (const std::string dir : { "", "ept-data", "ept-hierarchy" })
+        {
+            arbiter::fs::mkdirp(path + dir);
+        }
+        return a.getEndpoint(path);
+    }
+
+    void keyInit(const Synthetic& s, const Options& options, Run& run)
+    {
+        auto table(s.table(options.points));
+
+        std::vector<Point> points;
+        points.reserve(options.points);
+        for (uint64_t i(0); i < options.points; ++i)
+        {
+            pdal::PointRef pr(*table, i);
+            points.emplace_back(
+                    pr.getFieldAs<double>(DimId::X),
+                    pr.getFieldAs<double>(DimId::Y),
+                    pr.getFieldAs<double>(DimId::Z));
+        }
+
+        Key key(s.metadata());
+        uint64_t total(0);
+
+        run.start();
+        for (const Point& p : points)
+        {
+            key.init(p);
+            total += key.position().x;
+        }
+        run.stop();
+
+        sink = total;
+        run.items(points.size());
+    }
+
+    // Each thread inserts its own slice of the same dataset, so threads
+    // contend for the same chunks just as files covering the same area do.
+    void insertAll(
+            const Synthetic& s,
+            const Options& options,
+            Registry& registry,
+            VectorPointTable& table)
+    {
+        const uint64_t threads(options.threads);
+        const uint64_t per(options.points / threads);
+        std::vector<std::thread> workers;
+
+        for (uint64_t t(0); t < threads; ++t)
+        {
+            workers.emplace_back([&, t]()
+            {
+                Clipper clipper(registry, t);
+                const uint64_t begin(t * per);
+                const uint64_t end(
+                        t + 1 == threads ? options.points : begin + per);
+                s.insert(registry, clipper, table, begin, end);
+            });
+        }
+        for (auto& w : workers) w.join();
+    }
+
+    void chunkInsert(const Synthetic& s, const Options& options, Run& run)
+    {
+        auto table(s.table(options.points));
+        const arbiter::Endpoint out(scratch(options, "insert"));
+        const arbiter::Endpoint tmp(a.getEndpoint(options.tmp));
+
+        ThreadPools pools(options.threads);
+        Registry registry(
+                s.metadata(),
+                out,
+                tmp,
+                pools,
+                s.config().maxWriteBytes());
+
+        run.start();
+        insertAll(s, options, registry, *table);
+        run.stop();
+
+        pools.join();
+        run.items(options.points);
+    }
+
+    // Insertion through to every chunk being written.  With the null data
+    // type this is the cost of the tree alone, and the difference from the
+    // other types is the cost of serialization.
+    void pipeline(
+            const Synthetic& s,
+            const Options& options,
+            const std::string type,
+            Run& run)
+    {
+        auto table(s.table(options.points));
+        const arbiter::Endpoint out(scratch(options, "pipeline-" + type));
+        const arbiter::Endpoint tmp(a.getEndpoint(options.tmp));
+
+        ThreadPools pools(options.threads);
+        Registry registry(
+                s.metadata(),
+                out,
+                tmp,
+                pools,
+                s.config().maxWriteBytes());
+
+        run.start();
+        insertAll(s, options, registry, *table);
+        pools.join();
+        run.stop();
+
+        run.items(options.points);
+    }
+
+    // Build a complete dataset, reporting the number of data objects written,
+    // which packing should reduce far below one per chunk.
+    void packObjects(
+            const Synthetic& s,
+            const Options& options,
+            const std::string name,
+            Run& run)
+    {
+        const std::string path(arbiter::util::join(options.tmp, name) + "/");
+
+        // Local packs are appended in place, so start from nothing.
+        for (const std::string& f : a.resolve(path + "**"))
+        {
+            arbiter::fs::remove(f);
+        }
+
+        run.start();
+        s.build(path, options.points);
+        run.stop();
+
+        run.items(a.resolve(path + "ept-data/*").size());
+    }
+
+    // Every thread repeatedly runs the pipeline of a tiny file, so the time
+    // is dominated by opening the file and preparing its reader, which is
+    // what limits builds of many small files at high thread counts.
+    void fileStart(const std::string& path, const Options& options, Run& run)
+    {
+        const uint64_t threads(options.threads);
+        const uint64_t per(64);
+
+        Json::Value pipeline;
+        pipeline[0]["type"] = "readers.las";
+        pipeline[0]["filename"] = path;
+
+        const Schema schema({
+            DimInfo(DimId::X),
+            DimInfo(DimId::Y),
+            DimInfo(DimId::Z)
+        });
+
+        std::vector<std::thread> workers;
+
+        run.start();
+        for (uint64_t t(0); t < threads; ++t)
+        {
+            workers.emplace_back([&]()
+            {
+                VectorPointTable table(schema);
+                table.setProcess([]() { });
+                for (uint64_t i(0); i < per; ++i)
+                {
+                    Executor::get().run(table, pipeline);
+                }
+            });
+        }
+        for (auto& w : workers) w.join();
+        run.stop();
+
+        run.items(threads * per);
+    }
+
+    // Release every chunk held by a clipper, which hands each to the writer.
+    void clipperClip(const Synthetic& s, const Options& options, Run& run)
+    {
+        auto table(s.table(options.points));
+        const arbiter::Endpoint out(scratch(options, "clip"));
+        const arbiter::Endpoint tmp(a.getEndpoint(options.tmp));
+
+        ThreadPools pools(options.threads);
+        Registry registry(
+                s.metadata(),
+                out,
+                tmp,
+                pools,
+                s.config().maxWriteBytes());
+
+        auto clipper(makeUnique<Clipper>(registry, 0));
+        s.insert(registry, *clipper, *table, 0, options.points);
+
+        run.start();
+        clipper.reset();
+        pools.clipPool().await();
+        run.stop();
+
+        pools.join();
+        run.items(options.points);
+    }
+
+    void hierarchySave(const Synthetic& s, const Options& options, Run& run)
+    {
+        const arbiter::Endpoint out(scratch(options, "hierarchy"));
+        Pool pool(options.threads);
+
+        // A full octree to depth 6, and a sparse scattering of deeper nodes
+        // proportional to the point count.
+        Hierarchy hierarchy;
+        uint64_t nodes(0);
+        for (uint64_t d(0); d <= 6; ++d)
+        {
+            const uint64_t n(1ULL << d);
+            for (uint64_t x(0); x < n; ++x)
+            for (uint64_t y(0); y < n; ++y)
+            for (uint64_t z(0); z < n; ++z)
+            {
+                hierarchy.set(Dxyz(d, x, y, z), 1 + x + y + z);
+                ++nodes;
+            }
+        }
+
+        for (uint64_t i(0); i < options.points / 100; ++i)
+        {
+            const uint64_t d(7 + i % 6);
+            const uint64_t n(1ULL << d);
+            const Dxyz key(d, (i * 7919) % n, (i * 104729) % n, (i * 31) % n);
+            if (!hierarchy.get(key))
+            {
+                hierarchy.set(key, 1 + i % 1000);
+                ++nodes;
+            }
+        }
+
+        hierarchy.setStep(6);
+
+        run.start();
+        hierarchy.save(s.metadata(), out.getSubEndpoint("ept-hierarchy"), pool);
+        run.stop();
+
+        run.items(nodes);
+    }
+}
+
+void addBuilderBenchmarks(Suite& suite)
+{
+    const Options& options(suite.options());
+    auto s(std::make_shared<Synthetic>(options));
+
+    suite.add("key-init", "points", [s, &options](Run& run)
+    {
+        keyInit(*s, options, run);
+    });
+
+    suite.add("chunk-insert-contended", "points", [s, &options](Run& run)
+    {
+        chunkInsert(*s, options, run);
+    });
+
+    suite.add("clipper-clip", "points", [s, &options](Run& run)
+    {
+        clipperClip(*s, options, run);
+    });
+
+    suite.add("hierarchy-save", "nodes", [s, &options](Run& run)
+    {
+        hierarchySave(*s, options, run);
+    });
+
+    // A single 100-point tile, generated lazily.
+    const std::string dir(arbiter::util::join(options.tmp, "files") + "/");
+    auto generated(std::make_shared<bool>(false));
+
+    suite.add("file-start", "files", [dir, generated, &options](Run& run)
+    {
+        if (!*generated)
+        {
+            Json::Value json;
+            json["output"] = dir;
+            json["bounds"] = Bounds(0, 0, 10, 10).toJson();
+            json["density"] = 1;
+            json["seed"] = (Json::UInt64)options.seed;
+            Generator(json).go();
+            *generated = true;
+        }
+
+        fileStart(dir + "0.laz", options, run);
+    });
+
+    for (const std::string type : { "null", "binary", "laszip" })
+    {
+        auto typed(std::make_shared<Synthetic>(options, type));
+        suite.add("pipeline-" + type, "points", [=, &options](Run& run)
+        {
+            pipeline(*typed, options, type, run);
+        });
+    }
+
+    auto packed(std::make_shared<Synthetic>(options, "laszip", true));
+    suite.add("pipeline-laszip-packed", "points", [packed, &options](Run& run)
+    {
+        pipeline(*packed, options, "laszip-packed", run);
+    });
+
+    auto flat(std::make_shared<Synthetic>(options, "laszip"));
+    suite.add("pack-objects-flat", "objects", [flat, &options](Run& run)
+    {
+        packObjects(*flat, options, "objects-flat", run);
+    });
+
+    suite.add("pack-objects-packed", "objects", [packed, &options](Run& run)
+    {
+        packObjects(*packed, options, "objects-packed", run);
+    });
+}
+
+} // namespace bench
+} // namespace entwine
+
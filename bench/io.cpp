@@ -0,0 +1,142 @@
+/******************************************************************************
+* Copyright (c) 2018, Connor Manning (connor@hobu.co)
+*
+* Entwine -- Point cloud indexing
+*
+* Entwine is available under the terms of the LGPL2 license. See COPYING
+* for specific license text and more information.
+*
+******************************************************************************/
+
+#include "bench.hpp"
+#include "synthetic.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include <entwine/io/io.hpp>
+#include <entwine/third/arbiter/arbiter.hpp>
+#include <entwine/types/vector-point-table.hpp>
+
+namespace entwine
+{
+namespace bench
+{
+
+namespace
+{
+    const arbiter::Arbiter a;
+
+    // Points per encoded chunk, roughly matching a full chunk at depth.
+    const uint64_t chunkPoints(65536);
+
+    using Encoded = std::vector<std::vector<char>>;
+
+    // Split the synthetic points into chunk-sized blocks, laid out as the
+    // chunk writer would hand them to the serializer.
+    std::vector<MemBlock> blocks(const Synthetic& s, const Options& options)
+    {
+        auto table(s.table(options.points));
+        const uint64_t pointSize(s.metadata().schema().pointSize());
+
+        std::vector<MemBlock> result;
+        for (uint64_t i(0); i < options.points; ++i)
+        {
+            if (i % chunkPoints == 0)
+            {
+                result.emplace_back(pointSize, chunkPoints);
+            }
+            std::memcpy(result.back().next(), table->getPoint(i), pointSize);
+        }
+        return result;
+    }
+
+    Encoded encode(
+            const Synthetic& s,
+            const Options& options,
+            std::vector<MemBlock>& grids,
+            Run* run = nullptr)
+    {
+        const Metadata& metadata(s.metadata());
+        const arbiter::Endpoint tmp(a.getEndpoint(options.tmp));
+        const DataIo& io(metadata.dataIo());
+
+        MemBlock overflow(metadata.schema().pointSize(), 1);
+        Encoded result;
+
+        if (run) run->start();
+        for (MemBlock& grid : grids)
+        {
+            BlockPointTable table(metadata.schema(), grid, overflow);
+            result.push_back(*io.encode(
+                        nullptr,
+                        tmp,
+                        "bench-" + io.type(),
+                        metadata.boundsCubic(),
+                        table));
+        }
+        if (run) run->stop();
+
+        return result;
+    }
+
+    void encodeRun(const Synthetic& s, const Options& options, Run& run)
+    {
+        std::vector<MemBlock> grids(blocks(s, options));
+        encode(s, options, grids, &run);
+        run.items(options.points);
+    }
+
+    void decodeRun(const Synthetic& s, const Options& options, Run& run)
+    {
+        std::vector<MemBlock> grids(blocks(s, options));
+
+        // Decoding consumes its input, so hand it a fresh copy.
+        Encoded encoded(encode(s, options, grids));
+        grids.clear();
+
+        const Metadata& metadata(s.metadata());
+        const arbiter::Endpoint tmp(a.getEndpoint(options.tmp));
+        const DataIo& io(metadata.dataIo());
+
+        uint64_t points(0);
+        VectorPointTable table(metadata.schema(), chunkPoints);
+        table.setProcess([&]() { points += table.numPoints(); });
+
+        run.start();
+        for (std::vector<char>& data : encoded)
+        {
+            io.decode(tmp, "bench-" + io.type(), data, table);
+        }
+        run.stop();
+
+        run.items(points);
+    }
+
+    void add(Suite& suite, const std::string type)
+    {
+        const Options& options(suite.options());
+        auto s(std::make_shared<Synthetic>(options, type));
+
+        suite.add(type + "-encode", "points", [s, &options](Run& run)
+        {
+            encodeRun(*s, options, run);
+        });
+
+        suite.add(type + "-decode", "points", [s, &options](Run& run)
+        {
+            decodeRun(*s, options, run);
+        });
+    }
+}
+
+void addIoBenchmarks(Suite& suite)
+{
+    add(suite, "binary");
+    add(suite, "laszip");
+}
+
+} // namespace bench
+} // namespace entwine
+
@@ -0,0 +1,139 @@
+/******************************************************************************
+* Copyright (c) 2018, Connor Manning (connor@hobu.co)
+*
+* Entwine -- Point cloud indexing
+*
+* Entwine is available under the terms of the LGPL2 license. See COPYING
+* for specific license text and more information.
+*
+******************************************************************************/
+
+#include "bench.hpp"
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <json/json.h>
+
+#include <entwine/third/arbiter/arbiter.hpp>
+#include <entwine/types/version.hpp>
+#include <entwine/util/json.hpp>
+
+#include "../app/arg-parser.hpp"
+
+using namespace entwine;
+
+namespace
+{
+    uint64_t extract(const Json::Value& v)
+    {
+        return parse(v.asString()).asUInt64();
+    }
+}
+
+int main(int argc, char** argv)
+{
+    bench::Options options;
+    options.tmp = arbiter::util::join(
+            arbiter::fs::getTempPath(),
+            "entwine-bench");
+    std::string output;
+
+    ArgParser ap;
+    ap.setUsage("entwine-bench (<options>)");
+
+    ap.add(
+            "--points",
+            "-n",
+            "Points per repetition for point-oriented benchmarks.  "
+            "Default: 1000000.\n"
+            "Example: --points 250000",
+            [&](Json::Value v) { options.points = extract(v); });
+
+    ap.add(
+            "--reps",
+            "-r",
+            "Timed repetitions of each benchmark, from which the median is "
+            "reported.  Default: 5.\n"
+            "Example: --reps 9",
+            [&](Json::Value v) { options.reps = extract(v); });
+
+    ap.add(
+            "--threads",
+            "-t",
+            "Threads for the contended and pooled benchmarks.  Default: 8.\n"
+            "Example: --threads 16",
+            [&](Json::Value v) { options.threads = extract(v); });
+
+    ap.add(
+            "--seed",
+            "Seed for the synthetic dataset.  Default: 42.\n"
+            "Example: --seed 7",
+            [&](Json::Value v) { options.seed = extract(v); });
+
+    ap.add(
+            "--filter",
+            "-f",
+            "Only run benchmarks whose names contain this string.\n"
+            "Example: --filter encode",
+            [&](Json::Value v) { options.filter = v.asString(); });
+
+    ap.add(
+            "--output",
+            "-o",
+            "Path to which JSON results are written.  If omitted, results "
+            "are written to stdout after the summary.\n"
+            "Example: --output ~/bench/results.json",
+            [&](Json::Value v) { output = v.asString(); });
+
+    ap.add(
+            "--tmp",
+            "Local scratch directory.  Default: the system temporary "
+            "directory.\n"
+            "Example: --tmp /mnt/scratch/",
+            [&](Json::Value v) { options.tmp = v.asString(); });
+
+    const std::vector<std::string> args(argv + 1, argv + argc);
+
+    try
+    {
+        if (!args.empty() && !ap.handle(args)) return 0;
+
+        options.tmp = arbiter::fs::expandTilde(options.tmp) + "/";
+        arbiter::fs::mkdirp(options.tmp);
+
+        if (!options.reps) throw std::runtime_error("Invalid --reps");
+        if (!options.threads) throw std::runtime_error("Invalid --threads");
+
+        bench::Suite suite(options);
+        bench::addBuilderBenchmarks(suite);
+        bench::addIoBenchmarks(suite);
+        bench::addReaderBenchmarks(suite);
+
+        Json::Value json;
+        json["entwineVersion"] = currentEntwineVersion().toString();
+        json["options"]["points"] = (Json::UInt64)options.points;
+        json["options"]["reps"] = (Json::UInt64)options.reps;
+        json["options"]["threads"] = (Json::UInt64)options.threads;
+        json["options"]["seed"] = (Json::UInt64)options.seed;
+        json["results"] = Json::arrayValue;
+
+        for (const bench::Result& result : suite.run())
+        {
+            json["results"].append(result.toJson());
+        }
+
+        if (output.empty()) std::cout << json.toStyledString();
+        else arbiter::Arbiter().put(output, json.toStyledString());
+    }
+    catch (std::exception& e)
+    {
+        std::cout << "Encountered an error: " << e.what() << std::endl;
+        std::cout << "Exiting." << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
+
@@ -0,0 +1,223 @@
+/******************************************************************************
+* Copyright (c) 2018, Connor Manning (connor@hobu.co)
+*
+* Entwine -- Point cloud indexing
+*
+* Entwine is available under the terms of the LGPL2 license. See COPYING
+* for specific license text and more information.
+*
+******************************************************************************/
+
+#include "bench.hpp"
+#include "synthetic.hpp"
+
+#include <entwine/io/memory-driver.hpp>
+#include <entwine/reader/chunk-reader.hpp>
+#include <entwine/reader/filter.hpp>
+#include <entwine/reader/query.hpp>
+#include <entwine/reader/reader.hpp>
+#include <entwine/third/arbiter/arbiter.hpp>
+#include <entwine/types/dir.hpp>
+
+namespace entwine
+{
+namespace bench
+{
+
+namespace
+{
+    // Keeps results observable so that timed loops aren't optimized away.
+    volatile uint64_t sink(0);
+
+    // Read each octant of the dataset with a cold cache, so every chunk is
+    // fetched, decoded, and filtered.
+    void queryRun(
+            const std::string& path,
+            const Options& options,
+            Run& run,
+            std::shared_ptr<arbiter::Arbiter> a =
+                std::shared_ptr<arbiter::Arbiter>())
+    {
+        Reader reader(path, options.tmp, std::shared_ptr<Cache>(), a);
+        const Bounds& bounds(reader.metadata().boundsCubic());
+
+        uint64_t points(0);
+
+        run.start();
+        for (std::size_t i(0); i < dirEnd(); ++i)
+        {
+            Json::Value json;
+            json["bounds"] = bounds.get(toDir(i)).toJson();
+
+            auto query(reader.read(json));
+            query->run();
+            points += query->points();
+        }
+        run.stop();
+
+        run.items(points);
+    }
+
+    // Copy a local dataset into the in-memory store, from which it may be read
+    // through a throttled arbiter as if it were remote.
+    void toMemory(const std::string& path, const std::string& mem)
+    {
+        const arbiter::Arbiter local;
+        auto a(makeArbiter());
+
+        for (const std::string& file : local.resolve(path + "**"))
+        {
+            a->put(mem + file.substr(path.size()), local.getBinary(file));
+        }
+    }
+
+    // Read from a store with remote-like latency per request, where the
+    // number of objects fetched dominates.
+    std::shared_ptr<arbiter::Arbiter> throttled()
+    {
+        Json::Value json;
+        json["mem"]["latency"] = 10;
+        return makeArbiter(json);
+    }
+
+    // Selects about half of the points.
+    Json::Value filterJson()
+    {
+        Json::Value json;
+        json["Intensity"]["$gt"] = 2047;
+        json["Z"]["$lt"] = 60;
+        return json;
+    }
+
+    // The per-point filter, as a baseline for filterRun.
+    void filterCheck(const Synthetic& s, const Options& options, Run& run)
+    {
+        auto table(s.table(options.points));
+        const Filter filter(
+                s.metadata(),
+                s.metadata().boundsCubic(),
+                filterJson());
+
+        pdal::PointRef pr(*table, 0);
+        uint64_t passed(0);
+
+        run.start();
+        for (uint64_t i(0); i < options.points; ++i)
+        {
+            pr.setPointId(i);
+            if (filter.check(pr)) ++passed;
+        }
+        run.stop();
+
+        sink = passed;
+        run.items(options.points);
+    }
+
+    void load(
+            const Reader& reader,
+            const ChunkKey& c,
+            std::vector<std::unique_ptr<ChunkReader>>& chunks)
+    {
+        if (!reader.hierarchy().count(c.get())) return;
+        chunks.push_back(makeUnique<ChunkReader>(reader, c.get()));
+
+        for (std::size_t i(0); i < dirEnd(); ++i)
+        {
+            load(reader, c.getStep(toDir(i)), chunks);
+        }
+    }
+
+    // The same filter compiled and run over the columns of every chunk of the
+    // dataset, which is loaded up front.
+    void filterRun(const std::string& path, const Options& options, Run& run)
+    {
+        const Reader reader(path, options.tmp);
+        const Metadata& metadata(reader.metadata());
+        const Filter filter(metadata, metadata.boundsCubic(), filterJson());
+
+        std::vector<std::unique_ptr<ChunkReader>> chunks;
+        load(reader, ChunkKey(metadata), chunks);
+
+        uint64_t points(0);
+        uint64_t passed(0);
+
+        run.start();
+        for (auto& chunk : chunks)
+        {
+            const FilterProgram::Mask mask(filter.select(*chunk, true));
+            for (const uint8_t selected : mask) passed += selected ? 1 : 0;
+            points += mask.size();
+        }
+        run.stop();
+
+        sink = passed;
+        run.items(points);
+    }
+}
+
+void addReaderBenchmarks(Suite& suite)
+{
+    const Options& options(suite.options());
+    auto s(std::make_shared<Synthetic>(options));
+
+    // The dataset is built lazily, so it is skipped if filtered out.
+    const std::string path(arbiter::util::join(options.tmp, "dataset") + "/");
+    auto built(std::make_shared<bool>(false));
+
+    suite.add("query-run", "points", [s, &options, path, built](Run& run)
+    {
+        if (!*built)
+        {
+            s->build(path, options.points);
+            *built = true;
+        }
+
+        queryRun(path, options, run);
+    });
+
+    // The same dataset, flat and packed, read through a throttled store.
+    for (const bool packed : { false, true })
+    {
+        const std::string name(packed ? "packed" : "flat");
+        const std::string path(
+                arbiter::util::join(options.tmp, "read-" + name) + "/");
+        const std::string mem("mem://bench-read-" + name + "/");
+        auto typed(std::make_shared<Synthetic>(options, "laszip", packed));
+        auto copied(std::make_shared<bool>(false));
+
+        suite.add(
+                "pack-read-" + name,
+                "points",
+                [typed, &options, path, mem, copied](Run& run)
+        {
+            if (!*copied)
+            {
+                typed->build(path, options.points);
+                toMemory(path, mem);
+                *copied = true;
+            }
+
+            queryRun(mem, options, run, throttled());
+        });
+    }
+
+    suite.add("filter-check", "points", [s, &options](Run& run)
+    {
+        filterCheck(*s, options, run);
+    });
+
+    suite.add("filter-run", "points", [s, &options, path, built](Run& run)
+    {
+        if (!*built)
+        {
+            s->build(path, options.points);
+            *built = true;
+        }
+
+        filterRun(path, options, run);
+    });
+}
+
+} // namespace bench
+} // namespace entwine
+
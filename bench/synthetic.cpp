@@ -0,0 +1,176 @@
+/******************************************************************************
+* Copyright (c) 2018, Connor Manning (connor@hobu.co)
+*
+* Entwine -- Point cloud indexing
+*
+* Entwine is available under the terms of the LGPL2 license. See COPYING
+* for specific license text and more information.
+*
+******************************************************************************/
+
+#include "synthetic.hpp"
+
+#include <cmath>
+#include <random>
+
+#include <entwine/builder/clipper.hpp>
+#include <entwine/builder/registry.hpp>
+#include <entwine/builder/thread-pools.hpp>
+#include <entwine/third/arbiter/arbiter.hpp>
+#include <entwine/types/key.hpp>
+#include <entwine/types/scale-offset.hpp>
+#include <entwine/types/schema.hpp>
+#include <entwine/types/voxel.hpp>
+#include <entwine/util/json.hpp>
+#include <entwine/util/unique.hpp>
+
+namespace entwine
+{
+namespace bench
+{
+
+namespace
+{
+    const Bounds bounds(0, 0, 0, 1000, 1000, 100);
+
+    Config makeConfig(
+            const Options& options,
+            const std::string dataType,
+            const bool packed)
+    {
+        Schema schema(DimList {
+            DimInfo(DimId::X, DimType::Signed32, 0.01, 500),
+            DimInfo(DimId::Y, DimType::Signed32, 0.01, 500),
+            DimInfo(DimId::Z, DimType::Signed32, 0.01, 50),
+            DimInfo(DimId::Intensity)
+        });
+
+        Json::Value json;
+        json["output"] = options.tmp;
+        json["tmp"] = options.tmp;
+        json["bounds"] = bounds.toJson();
+        json["schema"] = schema.toJson();
+        json["dataType"] = dataType;
+        json["ticks"] = 128;
+        json["threads"] = (Json::UInt64)options.threads;
+
+        if (packed)
+        {
+            json["packThreshold"] = 4096;
+            json["packDepth"] = 3;
+        }
+
+        return entwine::merge(
+                Config::defaults(),
+                Config::defaultBuildParams(),
+                json);
+    }
+
+    double terrain(const double x, const double y)
+    {
+        return 50 +
+            20 * std::sin(x / 97.0) * std::cos(y / 113.0) +
+            5 * std::sin(x / 13.0 + y / 17.0);
+    }
+}
+
+Synthetic::Synthetic(
+        const Options& options,
+        const std::string dataType,
+        const bool packed)
+    : m_options(options)
+    , m_config(makeConfig(options, dataType, packed))
+    , m_metadata(makeUnique<Metadata>(m_config))
+{ }
+
+std::unique_ptr<VectorPointTable> Synthetic::table(const uint64_t np) const
+{
+    auto table(makeUnique<VectorPointTable>(m_metadata->schema(), np));
+
+    std::mt19937_64 gen(m_options.seed);
+    std::uniform_real_distribution<double> xy(0, 1000);
+    std::normal_distribution<double> noise(0, 0.5);
+    std::uniform_int_distribution<int> intensity(0, 4095);
+
+    for (uint64_t i(0); i < np; ++i)
+    {
+        const double x(xy(gen));
+        const double y(xy(gen));
+        const double z(
+                std::max(0.0, std::min(99.99, terrain(x, y) + noise(gen))));
+
+        pdal::PointRef pr(*table, i);
+        pr.setField(DimId::X, x);
+        pr.setField(DimId::Y, y);
+        pr.setField(DimId::Z, z);
+        pr.setField(DimId::Intensity, intensity(gen));
+    }
+
+    return table;
+}
+
+uint64_t Synthetic::insert(
+        Registry& registry,
+        Clipper& clipper,
+        VectorPointTable& table,
+        const uint64_t begin,
+        const uint64_t end) const
+{
+    std::unique_ptr<ScaleOffset> so(m_metadata->outSchema().scaleOffset());
+
+    Voxel voxel;
+    Key key(*m_metadata);
+
+    for (uint64_t i(begin); i < end; ++i)
+    {
+        pdal::PointRef pr(table, i);
+        voxel.initShallow(pr, table.getPoint(i));
+        if (so) voxel.clip(*so);
+
+        key.init(voxel.point());
+        registry.addPoint(voxel, key, clipper);
+    }
+
+    return end - begin;
+}
+
+void Synthetic::build(const std::string& out, const uint64_t np) const
+{
+    Config config(m_config);
+    config["output"] = out;
+
+    arbiter::Arbiter a;
+    const arbiter::Endpoint outEp(a.getEndpoint(out));
+    const arbiter::Endpoint tmpEp(a.getEndpoint(m_options.tmp));
+
+    for (const std::string dir : { "ept-data", "ept-hierarchy", "ept-sources" })
+    {
+        arbiter::fs::mkdirp(arbiter::util::join(out, dir));
+    }
+
+    ThreadPools pools(m_options.threads);
+    auto table(this->table(np));
+
+    {
+        Registry registry(
+                *m_metadata,
+                outEp,
+                tmpEp,
+                pools,
+                config.maxWriteBytes());
+
+        {
+            Clipper clipper(registry, 0);
+            insert(registry, clipper, *table, 0, np);
+        }
+
+        pools.cycle();
+        registry.save();
+    }
+
+    m_metadata->save(outEp, config);
+}
+
+} // namespace bench
+} // namespace entwine
+
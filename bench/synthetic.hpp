@@ -0,0 +1,71 @@
+/******************************************************************************
+* Copyright (c) 2018, Connor Manning (connor@hobu.co)
+*
+* Entwine -- Point cloud indexing
+*
+* Entwine is available under the terms of the LGPL2 license. See COPYING
+* for specific license text and more information.
+*
+******************************************************************************/
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include <entwine/builder/config.hpp>
+#include <entwine/types/metadata.hpp>
+#include <entwine/types/vector-point-table.hpp>
+
+#include "bench.hpp"
+
+namespace entwine
+{
+
+class Clipper;
+class Registry;
+
+namespace bench
+{
+
+// A reproducible synthetic dataset: gently rolling terrain over a 1km square,
+// with scaled XYZ and an Intensity attribute.  Points depend only on the seed
+// and their index, so every run of a benchmark sees identical data.
+//
+// If _packed_, chunks of at most 4096 points from depth 3 down are packed.
+class Synthetic
+{
+public:
+    Synthetic(
+            const Options& options,
+            std::string dataType = "binary",
+            bool packed = false);
+
+    const Config& config() const { return m_config; }
+    const Metadata& metadata() const { return *m_metadata; }
+
+    // A table of _np_ points laid out in the absolute schema of our metadata.
+    std::unique_ptr<VectorPointTable> table(uint64_t np) const;
+
+    // Insert points [begin, end) of _table_, as the builder does for each
+    // file, returning the number of points inserted.
+    uint64_t insert(
+            Registry& registry,
+            Clipper& clipper,
+            VectorPointTable& table,
+            uint64_t begin,
+            uint64_t end) const;
+
+    // Build a complete dataset of _np_ points at the local path _out_.
+    void build(const std::string& out, uint64_t np) const;
+
+private:
+    const Options& m_options;
+    const Config m_config;
+    std::unique_ptr<Metadata> m_metadata;
+};
+
+} // namespace bench
+} // namespace entwine
+
@@ -10,17 +10,22 @@
 
 #include <entwine/builder/builder.hpp>
 
+#include <atomic>
 #include <chrono>
 #include <limits>
 #include <numeric>
 #include <random>
 #include <thread>
 
+#include <entwine/builder/checkpoint.hpp>
 #include <entwine/builder/clipper.hpp>
 #include <entwine/builder/heuristics.hpp>
 #include <entwine/builder/registry.hpp>
 #include <entwine/builder/sequence.hpp>
+#include <entwine/builder/telemetry.hpp>
 #include <entwine/builder/thread-pools.hpp>
+#include <entwine/io/ensure.hpp>
+#include <entwine/io/memory-driver.hpp>
 #include <entwine/third/arbiter/arbiter.hpp>
 #include <entwine/types/bounds.hpp>
 #include <entwine/types/file-info.hpp>
@@ -32,6 +37,7 @@
 #include <entwine/types/vector-point-table.hpp>
 #include <entwine/util/executor.hpp>
 #include <entwine/util/json.hpp>
+#include <entwine/util/metrics.hpp>
 #include <entwine/util/pool.hpp>
 #include <entwine/util/unique.hpp>
 
@@ -43,7 +49,6 @@ using namespace arbiter;
 namespace
 {
     const std::size_t inputRetryLimit(16);
-    std::size_t reawakened(0);
 }
 
 Builder::Builder(const Config& config, std::shared_ptr<arbiter::Arbiter> a)
@@ -52,13 +57,15 @@ Builder::Builder(const Config& config, std::shared_ptr<arbiter::Arbiter> a)
                 Config::defaultBuildParams(),
                 config.prepare().json()))
     , m_interval(m_config.progressInterval())
-    , m_arbiter(a ? a : std::make_shared<arbiter::Arbiter>(m_config["arbiter"]))
+    , m_arbiter(a ? a : makeArbiter(m_config["arbiter"]))
     , m_out(makeUnique<Endpoint>(m_arbiter->getEndpoint(m_config.output())))
     , m_tmp(makeUnique<Endpoint>(m_arbiter->getEndpoint(m_config.tmp())))
+    , m_checkpoint(makeUnique<Checkpoint>(m_config, *m_arbiter, *m_out, *m_tmp))
     , m_threadPools(
             makeUnique<ThreadPools>(
                 m_config.workThreads(),
-                m_config.clipThreads()))
+                m_config.clipThreads(),
+                m_config.uploadThreads()))
     , m_isContinuation(m_config.isContinuation())
     , m_sleepCount(m_config.sleepCount())
     , m_metadata(m_isContinuation ?
@@ -69,12 +76,14 @@ Builder::Builder(const Config& config, std::shared_ptr<arbiter::Arbiter> a)
                 *m_out,
                 *m_tmp,
                 *m_threadPools,
-                m_isContinuation))
+                m_config.maxWriteBytes(),
+                m_isContinuation,
+                m_checkpoint->enabled() ? &m_checkpoint->stage() : nullptr,
+                m_config.retry()))
     , m_sequence(makeUnique<Sequence>(*m_metadata, m_mutex))
+    , m_telemetry(makeUnique<Telemetry>(m_config))
     , m_verbose(m_config.verbose())
     , m_start(now())
-    , m_reset(now())
-    , m_resetFiles(m_config["resetFiles"].asUInt64())
 {
     prepareEndpoints();
 }
@@ -85,9 +94,8 @@ Builder::~Builder()
 void Builder::go(std::size_t max)
 {
     m_start = now();
-    m_reset = m_start;
 
-    bool done(false);
+    std::atomic<bool> done(false);
     const auto& files(m_metadata->files());
 
     const std::size_t alreadyInserted(files.pointStats().inserts());
@@ -95,7 +103,12 @@ void Builder::go(std::size_t max)
     Pool p(2);
     p.add([this, max, &done]()
     {
-        doRun(max);
+        try { doRun(max); }
+        catch (...)
+        {
+            done = true;
+            throw;
+        }
         done = true;
     });
 
@@ -109,6 +122,9 @@ void Builder::go(std::size_t max)
         const double totalPoints(files.totalPoints());
         const double megsPerHour(3600.0 / 1000000.0);
 
+        using metrics::Counter;
+        metrics::Snapshot previous(metrics::snapshot());
+
         while (!done)
         {
             const auto t(since<ms>(m_start));
@@ -124,8 +140,10 @@ void Builder::go(std::size_t max)
                         (files.pointStats().inserts() + alreadyInserted) /
                         totalPoints);
 
-                const auto info(ReffedChunk::latchInfo());
-                reawakened += info.read;
+                const metrics::Snapshot current(metrics::snapshot());
+                const metrics::Snapshot delta(current - previous);
+                const auto writes(m_registry->writeInfo());
+                previous = current;
 
                 if (verbose())
                 {
@@ -137,26 +155,32 @@ void Builder::go(std::size_t max)
                             "M/h" <<
                         " I: " << commify(inserts) <<
                         " P: " << std::round(progress * 100.0) << "%" <<
-                        " W: " << info.written <<
-                        " R: " << info.read <<
-                        " A: " << commify(info.alive) <<
+                        " W: " << delta[Counter::ChunksWritten] <<
+                        " R: " << delta[Counter::ChunksWoken] <<
+                        " A: " << commify(
+                                current[Counter::ChunksCreated] -
+                                current[Counter::ChunksDestroyed]) <<
+                        " Q: " << writes.encoding << "/" << writes.uploading <<
+                            "(" << commify(writes.bytes / 1024 / 1024) <<
+                            "MB)" <<
                         std::endl;
                 }
 
                 last = inserts;
+                m_telemetry->sample(*this);
             }
         }
     });
 
     p.join();
-}
+    m_telemetry->sample(*this);
 
-void Builder::cycle()
-{
-    if (verbose()) std::cout << "\tCycling memory pool" << std::endl;
-    m_threadPools->cycle();
-    m_reset = now();
-    if (verbose()) std::cout << "\tCycled" << std::endl;
+    // A failure here, for example in writing chunks, means the output is
+    // incomplete, so the build must not appear to have succeeded.
+    if (p.errors().size())
+    {
+        throw std::runtime_error("Build failed: " + p.errors().front());
+    }
 }
 
 void Builder::doRun(const std::size_t max)
@@ -168,15 +192,9 @@ void Builder::doRun(const std::size_t max)
 
     while (auto o = m_sequence->next(max))
     {
-        /*
-        if (
-                (m_resetFiles && m_sequence->added() > m_resetFiles &&
-                     (m_sequence->added() - 1) % m_resetFiles == 0) ||
-                since<std::chrono::minutes>(m_reset) >= m_resetMinutes)
-        {
-            cycle();
-        }
-        */
+        // The file just taken from the sequence is not yet counted as added,
+        // so a checkpoint here captures only the files before it.
+        if (m_checkpoint->due(m_sequence->added() - 1)) checkpoint();
 
         const Origin origin(*o);
         FileInfo& info(m_metadata->mutableFiles().get(origin));
@@ -236,39 +254,10 @@ void Builder::doRun(const std::size_t max)
 void Builder::insertPath(const Origin originId, FileInfo& info)
 {
     const std::string rawPath(info.path());
-    std::size_t tries(0);
-    std::unique_ptr<arbiter::fs::LocalHandle> localHandle;
-
-    do
-    {
-        if (tries) std::this_thread::sleep_for(std::chrono::seconds(tries));
-
-        try
-        {
-            localHandle = m_arbiter->getLocalHandle(rawPath, *m_tmp);
-        }
-        catch (const std::exception& e)
-        {
-            if (verbose())
-            {
-                std::cout <<
-                    "Failed GET " << tries << " of " << rawPath << ": " <<
-                    e.what() << std::endl;
-            }
-        }
-        catch (...)
-        {
-            if (verbose())
-            {
-                std::cout <<
-                    "Failed GET " << tries << " of " << rawPath << ": " <<
-                    "unknown error" << std::endl;
-            }
-        }
-    }
-    while (!localHandle && ++tries < inputRetryLimit);
 
-    if (!localHandle) throw std::runtime_error("No local handle: " + rawPath);
+    RetryPolicy policy(m_config.retry());
+    policy.tries = inputRetryLimit;
+    auto localHandle(ensureLocalHandle(*m_arbiter, rawPath, *m_tmp, policy));
 
     const std::string& localPath(localHandle->localPath());
 
@@ -281,6 +270,7 @@ void Builder::insertPath(const Origin originId, FileInfo& info)
     table.setProcess([this, &table, &clipper, &inserted, &pointId, &originId]()
     {
         inserted += table.numPoints();
+        metrics::add(metrics::Counter::PointsRead, table.numPoints());
 
         if (inserted > m_sleepCount)
         {
@@ -293,6 +283,7 @@ void Builder::insertPath(const Origin originId, FileInfo& info)
         Voxel voxel;
 
         PointStats pointStats;
+        uint64_t rejected(0);
         const Bounds& boundsConforming(m_metadata->boundsConforming());
         const Bounds* boundsSubset(m_metadata->boundsSubset());
 
@@ -314,13 +305,26 @@ void Builder::insertPath(const Origin originId, FileInfo& info)
                 if (!boundsSubset || boundsSubset->contains(point))
                 {
                     key.init(point);
-                    m_registry->addPoint(voxel, key, clipper);
-                    pointStats.addInsert();
+                    if (m_registry->addPoint(voxel, key, clipper))
+                    {
+                        pointStats.addInsert();
+                    }
+                    else
+                    {
+                        // Separated from its neighbors only beyond the
+                        // deepest node the hierarchy can describe, for
+                        // example one of many duplicates of a point.
+                        pointStats.addOutOfBounds();
+                        ++rejected;
+                    }
                 }
             }
             else if (m_metadata->primary()) pointStats.addOutOfBounds();
         }
 
+        metrics::add(metrics::Counter::PointsInserted, pointStats.inserts());
+        metrics::add(metrics::Counter::PointsRejected, rejected);
+
         if (originId != invalidOrigin)
         {
             m_metadata->mutableFiles().add(clipper.origin(), pointStats);
@@ -347,11 +351,17 @@ void Builder::save(const std::string to)
 
 void Builder::save(const arbiter::Endpoint& ep)
 {
+    const TimePoint start(now());
     m_threadPools->join();
     m_threadPools->workPool().resize(m_threadPools->size());
     m_threadPools->go();
+    const uint64_t quiesceMs(since<std::chrono::milliseconds>(start));
 
-    if (verbose()) std::cout << "Reawakened: " << reawakened << std::endl;
+    if (verbose())
+    {
+        std::cout << "Reawakened: " <<
+            m_telemetry->total(metrics::Counter::ChunksWoken) << std::endl;
+    }
 
     if (!m_metadata->subset())
     {
@@ -365,17 +375,91 @@ void Builder::save(const arbiter::Endpoint& ep)
         }
     }
 
-    if (verbose()) std::cout << "Saving registry..." << std::endl;
-    m_registry->save();
+    if (!m_checkpoint->enabled())
+    {
+        saveTo(ep);
+        return;
+    }
+
+    // Chunks have been written to the staging area, so the final state is
+    // committed like any other checkpoint.
+    const TimePoint saveStart(now());
+    saveTo(m_checkpoint->stage());
+    const uint64_t saveMs(since<std::chrono::milliseconds>(saveStart));
+
+    m_checkpoint->commit(
+            m_threadPools->workPool(),
+            m_sequence->added(),
+            quiesceMs,
+            saveMs);
+}
+
+void Builder::checkpoint()
+{
+    if (verbose()) std::cout << "Checkpointing..." << std::endl;
+
+    const TimePoint start(now());
+    m_threadPools->cycle();
+    const uint64_t quiesceMs(since<std::chrono::milliseconds>(start));
+
+    // Don't analyze the hierarchy of a partial build, since the result would
+    // be fixed for the remainder of the build.
+    if (!m_metadata->subset() && m_config.hierarchyStep())
+    {
+        m_registry->hierarchy().setStep(m_config.hierarchyStep());
+    }
+
+    const TimePoint saveStart(now());
+    saveTo(m_checkpoint->stage());
+    const uint64_t saveMs(since<std::chrono::milliseconds>(saveStart));
+
+    const Checkpoint::Stats stats(
+            m_checkpoint->commit(
+                m_threadPools->workPool(),
+                m_sequence->added() - 1,
+                quiesceMs,
+                saveMs));
+
+    if (verbose())
+    {
+        std::cout << "\tCheckpoint " << m_checkpoint->count() << ": " <<
+            commify(stats.files) << " files, " <<
+            commify(stats.bytes / 1024 / 1024) << "MB in " <<
+            commify(stats.totalMs()) << "ms" <<
+            " (quiesce " << commify(stats.quiesceMs) << "ms," <<
+            " save " << commify(stats.saveMs) << "ms," <<
+            " commit " << commify(stats.commitMs) << "ms)" << std::endl;
+    }
+}
+
+void Builder::saveTo(const arbiter::Endpoint& ep)
+{
+    if (verbose())
+    {
+        const auto writes(m_registry->writeInfo());
+        std::cout << "Saving registry..." << std::endl;
+        if (m_metadata->packThreshold())
+        {
+            std::cout << "\tFiles: " << commify(writes.written) <<
+                " Packed nodes: " << commify(writes.packed) << std::endl;
+        }
+    }
+    m_registry->save(ep.getSubEndpoint("ept-hierarchy"));
 
     if (verbose()) std::cout << "Saving metadata..." << std::endl;
-    m_metadata->save(*m_out, m_config);
+    m_metadata->save(ep, m_config);
 }
 
-void Builder::merge(Builder& other, Clipper& clipper)
+void Builder::merge(const std::vector<std::unique_ptr<Builder>>& others)
 {
-    m_registry->merge(*other.m_registry, clipper);
-    m_metadata->merge(*other.m_metadata);
+    std::vector<const Registry*> registries;
+    for (const auto& other : others)
+    {
+        registries.push_back(other->m_registry.get());
+    }
+
+    m_registry->merge(registries);
+    for (const auto& other : others) m_metadata->merge(*other->m_metadata);
 }
 
 void Builder::prepareEndpoints()
@@ -418,7 +502,12 @@ void Builder::prepareEndpoints()
     }
 }
 
-void Builder::makeWhole() { m_metadata->makeWhole(); }
+void Builder::makeWhole()
+{
+    const std::string postfix(m_metadata->postfix());
+    m_metadata->makeWhole();
+    m_registry->makeWhole(postfix);
+}
 
 const Metadata& Builder::metadata() const           { return *m_metadata; }
 const Registry& Builder::registry() const           { return *m_registry; }
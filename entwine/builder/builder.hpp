@@ -40,6 +40,7 @@ namespace arbiter
 }
 
 class Bounds;
+class Checkpoint;
 class Clipper;
 class Executor;
 class FileInfo;
@@ -51,6 +52,7 @@ class Schema;
 class Sequence;
 class Structure;
 class Subset;
+class Telemetry;
 class ThreadPools;
 
 class Builder
@@ -68,8 +70,8 @@ public:
     // Perform indexing.  A _maxFileInsertions_ of zero inserts all files.
     void go(std::size_t maxFileInsertions = 0);
 
-    // Aggregate spatially segmented build.
-    void merge(Builder& other, Clipper& clipper);
+    // Aggregate spatially segmented builds.
+    void merge(const std::vector<std::unique_ptr<Builder>>& others);
 
     // Various getters.
     const Metadata& metadata() const;
@@ -93,7 +95,8 @@ public:
 
     bool verbose() const { return m_verbose; }
     void verbose(bool v) { m_verbose = v; }
-    uint64_t resetFiles() const { return m_resetFiles; }
+    const Checkpoint& checkpoints() const { return *m_checkpoint; }
+    const Telemetry& telemetry() const { return *m_telemetry; }
 
     const Config& inConfig() const { return m_config; }
 
@@ -109,7 +112,10 @@ private:
     void save(std::string to);
     void save(const arbiter::Endpoint& to);
 
-    void cycle();
+    // Quiesce, save our state into the checkpoint staging area, and commit it
+    // to the output.
+    void checkpoint();
+    void saveTo(const arbiter::Endpoint& to);
 
     // Insert points from a file.  Sets any previously unset FileInfo fields
     // based on file contents.
@@ -133,6 +139,7 @@ private:
     std::shared_ptr<arbiter::Arbiter> m_arbiter;
     std::unique_ptr<arbiter::Endpoint> m_out;
     std::unique_ptr<arbiter::Endpoint> m_tmp;
+    std::unique_ptr<Checkpoint> m_checkpoint;
 
     std::unique_ptr<ThreadPools> m_threadPools;
 
@@ -144,13 +151,11 @@ private:
 
     std::unique_ptr<Registry> m_registry;
     std::unique_ptr<Sequence> m_sequence;
+    std::unique_ptr<Telemetry> m_telemetry;
 
     bool m_verbose;
 
     TimePoint m_start;
-    TimePoint m_reset;
-    const int m_resetMinutes = 60;
-    const uint64_t m_resetFiles = 0;
 
     Builder(const Builder&);
     Builder& operator=(const Builder&);
@@ -0,0 +1,277 @@
+/******************************************************************************
+* Copyright (c) 2018, Connor Manning (connor@hobu.co)
+*
+* Entwine -- Point cloud indexing
+*
+* Entwine is available under the terms of the LGPL2 license. See COPYING
+* for specific license text and more information.
+*
+******************************************************************************/
+
+#include <entwine/builder/checkpoint.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <stdexcept>
+
+#include <entwine/builder/config.hpp>
+#include <entwine/io/ensure.hpp>
+#include <entwine/util/json.hpp>
+#include <entwine/util/pool.hpp>
+#include <entwine/util/unique.hpp>
+
+namespace entwine
+{
+
+namespace
+{
+    // A staging directory unique to this output and subset, since a single
+    // tmp directory may serve several builds.
+    std::string stageName(const Config& config, const arbiter::Endpoint& out)
+    {
+        std::ostringstream ss;
+        ss << "checkpoint-" << std::hex <<
+            std::hash<std::string>()(out.prefixedRoot() + config.postfix());
+        return ss.str();
+    }
+
+    // Top-level metadata is committed last, so that an output is never
+    // described by metadata newer than its data.
+    bool isTopLevel(const std::string& path)
+    {
+        return path.find('/') == std::string::npos;
+    }
+
+    uint64_t ms(const TimePoint start)
+    {
+        return since<std::chrono::milliseconds>(start);
+    }
+
+    bool localSize(const std::string& path, uint64_t& size)
+    {
+        std::ifstream stream(path, std::ios::in | std::ios::binary);
+        if (!stream.good()) return false;
+        stream.seekg(0, std::ios::end);
+        size = stream.tellg();
+        return true;
+    }
+}
+
+Json::Value Checkpoint::Stats::toJson() const
+{
+    Json::Value json;
+    json["files"] = (Json::UInt64)files;
+    json["bytes"] = (Json::UInt64)bytes;
+    json["quiesceMs"] = (Json::UInt64)quiesceMs;
+    json["saveMs"] = (Json::UInt64)saveMs;
+    json["commitMs"] = (Json::UInt64)commitMs;
+    return json;
+}
+
+Checkpoint::Checkpoint(
+        const Config& config,
+        const arbiter::Arbiter& a,
+        const arbiter::Endpoint& out,
+        const arbiter::Endpoint& tmp)
+    : m_files(config["checkpointFiles"].asUInt64())
+    , m_minutes(config["checkpointMinutes"].asUInt64())
+    , m_arbiter(a)
+    , m_out(out)
+    , m_root(
+            arbiter::fs::expandTilde(tmp.root()) +
+            stageName(config, out) + "/")
+    , m_manifest(m_root.substr(0, m_root.size() - 1) + ".json")
+    , m_retry(config.retry())
+    , m_last(now())
+{
+    // A previous run may have died mid-checkpoint.  This happens regardless
+    // of whether checkpoints are enabled for this run.
+    recover();
+
+    if (enabled())
+    {
+        const std::vector<std::string> dirs{
+            "ept-data", "ept-hierarchy", "ept-sources"
+        };
+
+        for (const std::string& dir : dirs)
+        {
+            if (!arbiter::fs::mkdirp(m_root + dir))
+            {
+                throw std::runtime_error("Couldn't create " + m_root + dir);
+            }
+        }
+
+        m_stage = makeUnique<arbiter::Endpoint>(m_arbiter.getEndpoint(m_root));
+    }
+}
+
+bool Checkpoint::due(const uint64_t added) const
+{
+    if (m_files && added >= m_lastAdded + m_files) return true;
+    if (!m_minutes) return false;
+
+    const int elapsed(since<std::chrono::minutes>(m_last));
+    return static_cast<uint64_t>(elapsed) >= m_minutes;
+}
+
+Checkpoint::Stats Checkpoint::commit(
+        Pool& pool,
+        const uint64_t added,
+        const uint64_t quiesceMs,
+        const uint64_t saveMs)
+{
+    const TimePoint start(now());
+
+    Stats stats;
+    stats.quiesceMs = quiesceMs;
+    stats.saveMs = saveMs;
+
+    const std::vector<std::string> files(list());
+
+    // Once the manifest exists, this checkpoint will be completed even if we
+    // die partway through moving the files.  Rename it into place so that it
+    // is never seen partially written.
+    {
+        Json::Value json;
+        for (const auto& f : files) json.append(f);
+
+        const std::string partial(m_manifest + ".partial");
+        std::ofstream stream(partial, std::ios::out | std::ios::trunc);
+        stream << toFastString(json);
+        stream.close();
+
+        if (!stream.good() ||
+                std::rename(partial.c_str(), m_manifest.c_str()) != 0)
+        {
+            throw std::runtime_error("Could not write checkpoint manifest");
+        }
+    }
+
+    promote(pool, files, &stats);
+    arbiter::fs::remove(m_manifest);
+
+    stats.commitMs = ms(start);
+
+    ++m_count;
+    m_totals.files += stats.files;
+    m_totals.bytes += stats.bytes;
+    m_totals.quiesceMs += stats.quiesceMs;
+    m_totals.saveMs += stats.saveMs;
+    m_totals.commitMs += stats.commitMs;
+
+    m_lastAdded = added;
+    m_last = now();
+    return stats;
+}
+
+std::vector<std::string> Checkpoint::list() const
+{
+    std::vector<std::string> files;
+    for (const std::string& path : m_arbiter.resolve(m_root + "**"))
+    {
+        if (path.size() > m_root.size() && path.find(m_root) == 0)
+        {
+            files.push_back(path.substr(m_root.size()));
+        }
+    }
+
+    std::stable_partition(
+            files.begin(),
+            files.end(),
+            [](const std::string& f) { return !isTopLevel(f); });
+
+    return files;
+}
+
+void Checkpoint::promote(
+        Pool& pool,
+        const std::vector<std::string>& files,
+        Stats* stats) const
+{
+    std::atomic<uint64_t> count(0);
+    std::atomic<uint64_t> bytes(0);
+    const std::size_t errors(pool.errors().size());
+
+    const auto move([this, &count, &bytes](const std::string& file)
+    {
+        const std::string src(m_root + file);
+
+        // Already moved by an interrupted commit.
+        uint64_t size(0);
+        if (!localSize(src, size)) return;
+
+        bool moved(false);
+        if (m_out.isLocal())
+        {
+            const std::string dst(
+                    arbiter::fs::expandTilde(m_out.root()) + file);
+            moved = std::rename(src.c_str(), dst.c_str()) == 0;
+        }
+
+        // Across filesystems, or to remote storage.
+        if (!moved)
+        {
+            const arbiter::Endpoint stage(m_arbiter.getEndpoint(m_root));
+            ensurePut(m_out, file, *ensureGet(stage, file, m_retry), m_retry);
+            arbiter::fs::remove(src);
+        }
+
+        ++count;
+        bytes += size;
+    });
+
+    // Nested data first, then top-level metadata once all else is in place.
+    const auto top(
+            std::find_if(files.begin(), files.end(), isTopLevel));
+
+    for (auto it(files.begin()); it != top; ++it)
+    {
+        const std::string file(*it);
+        pool.add([&move, file]() { move(file); });
+    }
+    pool.await();
+
+    for (auto it(top); it != files.end(); ++it) move(*it);
+
+    if (pool.errors().size() != errors)
+    {
+        throw std::runtime_error("Checkpoint commit failed");
+    }
+
+    if (stats)
+    {
+        stats->files = count;
+        stats->bytes = bytes;
+    }
+}
+
+void Checkpoint::recover()
+{
+    uint64_t size(0);
+    if (localSize(m_manifest, size))
+    {
+        std::ifstream stream(m_manifest);
+        const std::string s(
+                (std::istreambuf_iterator<char>(stream)),
+                std::istreambuf_iterator<char>());
+
+        std::vector<std::string> files;
+        for (const auto& f : parse(s)) files.push_back(f.asString());
+
+        // Recovery is rare, so only start threads for it when needed.
+        Pool pool(8);
+        promote(pool, files, nullptr);
+        arbiter::fs::remove(m_manifest);
+    }
+
+    // Anything else staged was never committed.
+    for (const std::string& file : list()) arbiter::fs::remove(m_root + file);
+}
+
+} // namespace entwine
+
@@ -0,0 +1,121 @@
+/******************************************************************************
+* Copyright (c) 2018, Connor Manning (connor@hobu.co)
+*
+* Entwine -- Point cloud indexing
+*
+* Entwine is available under the terms of the LGPL2 license. See COPYING
+* for specific license text and more information.
+*
+******************************************************************************/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <json/json.h>
+
+#include <entwine/io/ensure.hpp>
+#include <entwine/third/arbiter/arbiter.hpp>
+#include <entwine/util/time.hpp>
+
+namespace entwine
+{
+
+class Config;
+class Pool;
+
+// Periodic, crash-safe checkpoints of a running build.
+//
+// While checkpoints are enabled, chunk data is written to a local staging
+// directory rather than to the output, so the output only ever holds the
+// state of the most recent checkpoint.  At each checkpoint the builder
+// quiesces, saves its hierarchy and metadata into the staging directory, and
+// then commits: a manifest of the staged files is written atomically, the
+// files are moved into the output, and the manifest is removed.
+//
+// If the process dies after the manifest is written, construction of the next
+// Checkpoint for the same output completes the commit.  Anything staged
+// without a manifest is discarded, and the files which produced it are still
+// outstanding in the last committed metadata so they will be inserted again.
+class Checkpoint
+{
+public:
+    struct Stats
+    {
+        uint64_t files = 0;
+        uint64_t bytes = 0;
+
+        // Time spent draining in-flight work, saving state into the staging
+        // directory, and committing it to the output.
+        uint64_t quiesceMs = 0;
+        uint64_t saveMs = 0;
+        uint64_t commitMs = 0;
+
+        uint64_t totalMs() const { return quiesceMs + saveMs + commitMs; }
+        Json::Value toJson() const;
+    };
+
+    // Accepts the config keys "checkpointFiles" and "checkpointMinutes".
+    Checkpoint(
+            const Config& config,
+            const arbiter::Arbiter& a,
+            const arbiter::Endpoint& out,
+            const arbiter::Endpoint& tmp);
+
+    bool enabled() const { return m_files || m_minutes; }
+
+    uint64_t files() const { return m_files; }
+    uint64_t minutes() const { return m_minutes; }
+
+    // The staging directory, laid out just like the output.  Only valid if
+    // checkpoints are enabled.
+    const arbiter::Endpoint& stage() const { return *m_stage; }
+
+    // Returns true if a checkpoint should be taken, given the total number of
+    // files added to the build so far.
+    bool due(uint64_t added) const;
+
+    // Move everything staged into the output, once _added_ files have been
+    // added to the build.  The time taken by the other phases is supplied by
+    // the caller and recorded with the result.
+    Stats commit(
+            Pool& pool,
+            uint64_t added,
+            uint64_t quiesceMs,
+            uint64_t saveMs);
+
+    // Totals over all checkpoints taken.
+    uint64_t count() const { return m_count; }
+    const Stats& totals() const { return m_totals; }
+
+private:
+    std::vector<std::string> list() const;
+    void promote(
+            Pool& pool,
+            const std::vector<std::string>& files,
+            Stats* stats) const;
+    void recover();
+
+    const uint64_t m_files;
+    const uint64_t m_minutes;
+
+    const arbiter::Arbiter& m_arbiter;
+    const arbiter::Endpoint& m_out;
+    const std::string m_root;
+    const std::string m_manifest;
+    const RetryPolicy m_retry;
+    std::unique_ptr<arbiter::Endpoint> m_stage;
+
+    uint64_t m_lastAdded = 0;
+    TimePoint m_last;
+
+    uint64_t m_count = 0;
+    Stats m_totals;
+};
+
+} // namespace entwine
+
@@ -0,0 +1,333 @@
+/******************************************************************************
+* Copyright (c) 2018, Connor Manning (connor@hobu.co)
+*
+* Entwine -- Point cloud indexing
+*
+* Entwine is available under the terms of the LGPL2 license. See COPYING
+* for specific license text and more information.
+*
+******************************************************************************/
+
+#include <entwine/builder/chunk-writer.hpp>
+
+#include <entwine/io/io.hpp>
+#include <entwine/io/point-order.hpp>
+#include <entwine/types/schema.hpp>
+#include <entwine/util/metrics.hpp>
+#include <entwine/util/unique.hpp>
+
+namespace entwine
+{
+
+ChunkWriter::Snapshot::Snapshot(
+        const ChunkKey& key,
+        MemBlock& grid,
+        MemBlock& overflow)
+    : m_key(key)
+    , m_filename(m_key.toString() + m_key.metadata().postfix(m_key.depth()))
+    , m_grid(std::move(grid))
+    , m_overflow(std::move(overflow))
+    , m_bytes(
+            (m_grid.size() + m_overflow.size()) *
+            m_key.metadata().schema().pointSize())
+{ }
+
+ChunkWriter::ChunkWriter(
+        const Metadata& metadata,
+        const arbiter::Endpoint& out,
+        const arbiter::Endpoint& tmp,
+        Hierarchy& hierarchy,
+        ThreadPools& threadPools,
+        const uint64_t maxBytes,
+        const arbiter::Endpoint* stage,
+        const RetryPolicy& retry)
+    : m_metadata(metadata)
+    , m_out(out)
+    , m_tmp(tmp)
+    , m_stage(stage)
+    , m_hierarchy(hierarchy)
+    , m_threadPools(threadPools)
+    , m_maxBytes(maxBytes)
+    , m_retry(retry)
+    , m_packs(out, tmp, m_retry, stage)
+{ }
+
+std::unique_ptr<ChunkWriter::Snapshot> ChunkWriter::stage(
+        const ChunkKey& key,
+        MemBlock& grid,
+        MemBlock& overflow)
+{
+    auto snapshot(makeUnique<Snapshot>(key, grid, overflow));
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_pending.insert(snapshot->m_filename);
+    ++m_info.encoding;
+
+    return snapshot;
+}
+
+void ChunkWriter::submit(std::unique_ptr<Snapshot> s)
+{
+    std::shared_ptr<Snapshot> snapshot(std::move(s));
+    const uint64_t bytes(snapshot->bytes());
+
+    {
+        // A single snapshot larger than the entire budget is allowed through
+        // once nothing else is in flight.
+        metrics::ScopedTimer timer(metrics::Timer::BudgetWait);
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv.wait(lock, [this, bytes]()
+        {
+            return !m_info.bytes || m_info.bytes + bytes <= m_maxBytes;
+        });
+        m_info.bytes += bytes;
+    }
+
+    m_threadPools.encodePool().add([this, snapshot]() { encode(snapshot); });
+}
+
+void ChunkWriter::encode(std::shared_ptr<Snapshot> snapshot)
+{
+    const std::string filename(snapshot->m_filename);
+    const uint64_t raw(snapshot->bytes());
+
+    std::shared_ptr<std::vector<char>> data;
+    const Dxyz dxyz(snapshot->m_key.get());
+    const uint64_t points(
+            snapshot->m_grid.size() + snapshot->m_overflow.size());
+
+    try
+    {
+        metrics::ScopedTimer timer(metrics::Timer::Encode);
+
+        const ChunkKey& key(snapshot->m_key);
+
+        // A chunk is appended to a pack at most once.  One which was packed
+        // before has since been woken, and appending it again would orphan
+        // its previous bytes, growing the pack with every wake cycle, so it
+        // is written as its own file from then on.
+        const std::string pack(
+                unpacked(dxyz) ? "" : m_metadata.packName(dxyz, points));
+
+        BlockPointTable table(
+                m_metadata.schema(),
+                snapshot->m_grid,
+                snapshot->m_overflow);
+
+        order(
+                table,
+                m_metadata.schema(),
+                key.bounds(),
+                m_metadata.pointOrder());
+
+        if (m_metadata.zoneMaps())
+        {
+            m_hierarchy.setZoneMap(
+                    dxyz,
+                    ZoneMap(m_metadata.schema(), table, table.size()));
+        }
+
+        if (pack.size())
+        {
+            data = m_metadata.dataIo().encode(
+                    nullptr,
+                    m_tmp,
+                    filename,
+                    key.bounds(),
+                    table);
+
+            m_hierarchy.setPack(dxyz, m_packs.append(pack, *data));
+
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                ++m_info.packed;
+            }
+
+            metrics::add(metrics::Counter::ChunksWritten);
+            metrics::add(metrics::Counter::PointsEncoded, points);
+            metrics::add(metrics::Counter::BytesEncoded, data->size());
+
+            finish(filename, raw, false);
+            return;
+        }
+
+        // If a previous version of this chunk was packed, this write
+        // supersedes it.
+        m_hierarchy.erasePack(dxyz);
+
+        data = m_metadata.dataIo().encode(
+                &target(),
+                m_tmp,
+                filename,
+                key.bounds(),
+                table);
+    }
+    catch (...)
+    {
+        fail(filename);
+        finish(filename, raw, false);
+        throw;
+    }
+
+    metrics::add(metrics::Counter::ChunksWritten);
+    metrics::add(metrics::Counter::PointsEncoded, points);
+    if (data) metrics::add(metrics::Counter::BytesEncoded, data->size());
+
+    // Our raw data is no longer needed - release it and account for the
+    // encoded data instead.
+    snapshot->m_grid.clear();
+    snapshot->m_overflow.clear();
+
+    if (!data)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            ++m_info.written;
+        }
+
+        finish(filename, raw, false);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_info.bytes = m_info.bytes - raw + data->size();
+        --m_info.encoding;
+        ++m_info.uploading;
+        ++m_info.written;
+    }
+    m_cv.notify_all();
+
+    m_threadPools.uploadPool().add([this, filename, data]()
+    {
+        upload(filename, data);
+    });
+}
+
+void ChunkWriter::upload(
+        const std::string& filename,
+        std::shared_ptr<std::vector<char>> data)
+{
+    const uint64_t bytes(data->size());
+
+    try
+    {
+        metrics::ScopedTimer timer(metrics::Timer::Upload);
+        ensurePut(
+                target(),
+                filename + m_metadata.dataIo().extension(),
+                *data,
+                m_retry);
+    }
+    catch (...)
+    {
+        fail(filename);
+        finish(filename, bytes, true);
+        throw;
+    }
+
+    metrics::add(metrics::Counter::BytesUploaded, bytes);
+    finish(filename, bytes, true);
+}
+
+void ChunkWriter::finish(
+        const std::string& filename,
+        const uint64_t bytes,
+        const bool uploading)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_info.bytes -= bytes;
+        if (uploading) --m_info.uploading;
+        else --m_info.encoding;
+
+        const auto it(m_pending.find(filename));
+        if (it != m_pending.end()) m_pending.erase(it);
+    }
+    m_cv.notify_all();
+}
+
+void ChunkWriter::fail(const std::string& filename)
+{
+    std::string message("Failed to write " + filename);
+
+    try { throw; }
+    catch (std::exception& e) { message += ": " + std::string(e.what()); }
+    catch (...) { }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_errors.push_back(message);
+}
+
+bool ChunkWriter::pending(const ChunkKey& key) const
+{
+    const std::string filename(
+            key.toString() + m_metadata.postfix(key.depth()));
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_pending.count(filename);
+}
+
+void ChunkWriter::check() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_errors.empty()) return;
+
+    throw std::runtime_error(
+            m_errors.front() + " (" + std::to_string(m_errors.size()) +
+            " failed chunk writes)");
+}
+
+void ChunkWriter::await(const ChunkKey& key)
+{
+    const std::string filename(
+            key.toString() + m_metadata.postfix(key.depth()));
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cv.wait(lock, [this, &filename]() { return !m_pending.count(filename); });
+}
+
+void ChunkWriter::read(const ChunkKey& key, VectorPointTable& table) const
+{
+    const std::string filename(
+            key.toString() + m_metadata.postfix(key.depth()));
+
+    PackEntry entry;
+    if (m_hierarchy.getPack(key.get(), entry))
+    {
+        // An empty entry holds nothing to read.
+        if (!entry.size) return;
+        auto data(m_packs.read(entry));
+        m_metadata.dataIo().decode(m_tmp, filename, *data, table);
+    }
+    else if (
+            m_stage &&
+            m_stage->tryGetSize(filename + m_metadata.dataIo().extension()))
+    {
+        // Written since the last checkpoint.
+        m_metadata.dataIo().read(*m_stage, m_tmp, filename, table, m_retry);
+    }
+    else
+    {
+        m_metadata.dataIo().read(m_out, m_tmp, filename, table, m_retry);
+    }
+}
+
+bool ChunkWriter::unpacked(const Dxyz& dxyz)
+{
+    PackEntry entry;
+    const bool packed(m_hierarchy.getPack(dxyz, entry));
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (packed) m_unpacked.insert(dxyz);
+    return m_unpacked.count(dxyz);
+}
+
+ChunkWriter::Info ChunkWriter::info() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_info;
+}
+
+} // namespace entwine
+
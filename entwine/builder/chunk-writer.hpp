@@ -0,0 +1,159 @@
+/******************************************************************************
+* Copyright (c) 2018, Connor Manning (connor@hobu.co)
+*
+* Entwine -- Point cloud indexing
+*
+* Entwine is available under the terms of the LGPL2 license. See COPYING
+* for specific license text and more information.
+*
+******************************************************************************/
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <entwine/builder/hierarchy.hpp>
+#include <entwine/builder/thread-pools.hpp>
+#include <entwine/io/ensure.hpp>
+#include <entwine/io/pack.hpp>
+#include <entwine/third/arbiter/arbiter.hpp>
+#include <entwine/types/key.hpp>
+#include <entwine/types/metadata.hpp>
+#include <entwine/types/vector-point-table.hpp>
+
+namespace entwine
+{
+
+// Serializes released chunks in the background.  A released chunk's point
+// data is moved into a Snapshot, after which the chunk itself may be reset or
+// reawakened without waiting on its serialization.  Snapshots are encoded on
+// the encode pool and the results are uploaded on the upload pool.  The total
+// number of in-flight bytes is bounded, and submission blocks while that
+// budget is exhausted.
+//
+// If packing is enabled, small chunks are appended to a pack file rather than
+// uploaded, and their locations are recorded in the hierarchy.  A packed
+// chunk which is woken and written again is written as its own file, so
+// packs do not accumulate stale copies of chunks.
+//
+// If a _stage_ endpoint is given, chunks and pack segments are written there
+// instead of to the output until they are committed by a Checkpoint, and are
+// read back from there in the meantime.
+class ChunkWriter
+{
+public:
+    class Snapshot
+    {
+        friend class ChunkWriter;
+
+    public:
+        Snapshot(const ChunkKey& key, MemBlock& grid, MemBlock& overflow);
+
+        uint64_t bytes() const { return m_bytes; }
+
+    private:
+        const ChunkKey m_key;
+        const std::string m_filename;
+
+        MemBlock m_grid;
+        MemBlock m_overflow;
+        const uint64_t m_bytes;
+    };
+
+    struct Info
+    {
+        std::size_t encoding = 0;
+        std::size_t uploading = 0;
+        uint64_t bytes = 0;
+
+        // Number of chunks written as their own file, and into pack files.
+        uint64_t written = 0;
+        uint64_t packed = 0;
+    };
+
+    ChunkWriter(
+            const Metadata& metadata,
+            const arbiter::Endpoint& out,
+            const arbiter::Endpoint& tmp,
+            Hierarchy& hierarchy,
+            ThreadPools& threadPools,
+            uint64_t maxBytes,
+            const arbiter::Endpoint* stage = nullptr,
+            const RetryPolicy& retry = RetryPolicy());
+
+    // Take ownership of the point data of a chunk, which is expected to be
+    // locked by the caller.  Until this write completes, await(key) will
+    // block.  This call never blocks, so it is safe to hold chunk locks.
+    std::unique_ptr<Snapshot> stage(
+            const ChunkKey& key,
+            MemBlock& grid,
+            MemBlock& overflow);
+
+    // Queue a staged snapshot for serialization.  Blocks while the in-flight
+    // byte budget is exhausted, so chunk locks should not be held.
+    void submit(std::unique_ptr<Snapshot> snapshot);
+
+    // True if a write of the given chunk is in flight.
+    bool pending(const ChunkKey& key) const;
+
+    // Wait for any in-flight write of the given chunk to complete.
+    void await(const ChunkKey& key);
+
+    // Throw if any chunk has failed to be written.  Pool tasks only log their
+    // errors, so this must be checked before the output is considered valid.
+    void check() const;
+
+    // Read the previously written data of a chunk, which may be packed.
+    void read(const ChunkKey& key, VectorPointTable& table) const;
+
+    // Upload any pack files staged locally, or close those staged for a
+    // checkpoint.
+    void savePacks(Pool& pool) { m_packs.save(pool); }
+
+    // Queue depths of each stage and the total number of in-flight bytes.
+    Info info() const;
+
+private:
+    void encode(std::shared_ptr<Snapshot> snapshot);
+    void upload(
+            const std::string& filename,
+            std::shared_ptr<std::vector<char>> data);
+    void finish(const std::string& filename, uint64_t bytes, bool uploading);
+    void fail(const std::string& filename);
+
+    // True if this chunk has been packed before, and so must not be again.
+    bool unpacked(const Dxyz& dxyz);
+
+    // The endpoint to which chunks are currently written.
+    const arbiter::Endpoint& target() const
+    {
+        return m_stage ? *m_stage : m_out;
+    }
+
+    const Metadata& m_metadata;
+    const arbiter::Endpoint& m_out;
+    const arbiter::Endpoint& m_tmp;
+    const arbiter::Endpoint* const m_stage;
+    Hierarchy& m_hierarchy;
+    ThreadPools& m_threadPools;
+    const uint64_t m_maxBytes;
+    const RetryPolicy m_retry;
+    PackWriter m_packs;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::multiset<std::string> m_pending;
+    std::vector<std::string> m_errors;
+    std::set<Dxyz> m_unpacked;
+    Info m_info;
+};
+
+} // namespace entwine
+
@@ -11,29 +11,25 @@
 #include <entwine/builder/chunk.hpp>
 
 #include <entwine/io/io.hpp>
+#include <entwine/util/metrics.hpp>
 
 namespace entwine
 {
 
-namespace
-{
-    SpinLock spin;
-    ReffedChunk::Info info;
-}
-
 ReffedChunk::ReffedChunk(
         const ChunkKey& key,
         const arbiter::Endpoint& out,
         const arbiter::Endpoint& tmp,
-        Hierarchy& hierarchy)
+        Hierarchy& hierarchy,
+        ChunkWriter& writer)
     : m_key(key)
     , m_metadata(m_key.metadata())
     , m_out(out)
     , m_tmp(tmp)
     , m_hierarchy(hierarchy)
+    , m_writer(writer)
 {
-    SpinGuard lock(spin);
-    ++info.alive;
+    metrics::add(metrics::Counter::ChunksCreated);
 }
 
 ReffedChunk::ReffedChunk(const ReffedChunk& o)
@@ -41,7 +37,8 @@ ReffedChunk::ReffedChunk(const ReffedChunk& o)
             o.key(),
             o.out(),
             o.tmp(),
-            o.hierarchy())
+            o.hierarchy(),
+            o.writer())
 {
     // This happens only during the constructor of the chunk.
     assert(!o.m_chunk);
@@ -50,20 +47,46 @@ ReffedChunk::ReffedChunk(const ReffedChunk& o)
 
 ReffedChunk::~ReffedChunk()
 {
-    SpinGuard lock(spin);
-    --info.alive;
+    metrics::add(metrics::Counter::ChunksDestroyed);
 }
 
-bool ReffedChunk::insert(Voxel& voxel, Key& key, Clipper& clipper)
+Insertion ReffedChunk::insert(
+        Voxel& voxel,
+        Key& key,
+        Clipper& clipper,
+        const bool relocated)
 {
     if (clipper.insert(*this)) ref(clipper);
-    return m_chunk->insert(voxel, key, clipper);
+    return m_chunk->insert(voxel, key, clipper, relocated);
 }
 
 void ReffedChunk::ref(Clipper& clipper)
 {
+    // Chunks at Metadata::maxDepth have no children, so nothing deeper than
+    // the hierarchy can describe is ever created.
+    assert(m_key.depth() <= m_metadata.maxDepth());
+
     const Origin o(clipper.origin());
-    SpinGuard lock(m_spin);
+    UniqueSpin lock(m_spin);
+
+    // Our previous data may still be in the process of being written, in
+    // which case we need to wait for it.  That may span an entire encode and
+    // upload, so wait without holding our lock, and check again afterward
+    // since the chunk may have been released again in the meantime.
+    while (
+            !m_refs.count(o) &&
+            (!m_chunk || m_chunk->remote()) &&
+            m_writer.pending(m_key))
+    {
+        lock.unlock();
+
+        {
+            metrics::ScopedTimer timer(metrics::Timer::WriteWait);
+            m_writer.await(m_key);
+        }
+
+        lock.lock();
+    }
 
     if (!m_refs.count(o))
     {
@@ -84,10 +107,9 @@ void ReffedChunk::ref(Clipper& clipper)
 
             if (const uint64_t np = m_hierarchy.get(m_key.get()))
             {
-                {
-                    SpinGuard lock(spin);
-                    ++info.read;
-                }
+                metrics::ScopedTimer timer(metrics::Timer::Wakeup);
+                metrics::add(metrics::Counter::ChunksWoken);
+                metrics::add(metrics::Counter::PointsWoken, np);
 
                 VectorPointTable table(m_metadata.schema(), np);
                 table.setProcess([this, &table, &clipper]()
@@ -99,7 +121,9 @@ void ReffedChunk::ref(Clipper& clipper)
                     {
                         voxel.initShallow(it.pointRef(), it.data());
                         pk.init(voxel.point(), m_key.depth());
-                        if (!insert(voxel, pk, clipper))
+                        if (
+                                insert(voxel, pk, clipper, true) !=
+                                Insertion::Stored)
                         {
                             std::cout << "Unexpected wakeup: " << m_key.get() <<
                                 " " << voxel.point() << std::endl;
@@ -107,9 +131,7 @@ void ReffedChunk::ref(Clipper& clipper)
                     }
                 });
 
-                const auto filename(
-                        m_key.toString() + m_metadata.postfix(m_key.depth()));
-                m_metadata.dataIo().read(m_out, m_tmp, filename, table);
+                m_writer.read(m_key, table);
             }
         }
     }
@@ -118,7 +140,7 @@ void ReffedChunk::ref(Clipper& clipper)
 
 void ReffedChunk::unref(const Origin o)
 {
-    SpinGuard lock(m_spin);
+    UniqueSpin lock(m_spin);
 
     assert(m_chunk);
     assert(m_refs.count(o));
@@ -128,26 +150,38 @@ void ReffedChunk::unref(const Origin o)
         m_refs.erase(o);
         if (m_refs.empty())
         {
-            BlockPointTable table(
-                    m_metadata.schema(),
-                    m_chunk->gridBlock(),
-                    m_chunk->overflowBlock());
-
-            m_hierarchy.set(m_key.get(), table.size());
-
-            m_metadata.dataIo().write(
-                    m_out,
-                    m_tmp,
-                    m_key.toString() + m_metadata.postfix(m_key.depth()),
-                    m_key.bounds(),
-                    table);
+            Chunk& chunk(*m_chunk);
+            m_hierarchy.set(
+                    m_key.get(),
+                    chunk.gridBlock().size() + chunk.overflowBlock().size());
+
+            // Detach our point data while locked, but don't hold the lock
+            // while waiting for space in the write queue.
+            auto snapshot(
+                    m_writer.stage(
+                        m_key,
+                        chunk.gridBlock(),
+                        chunk.overflowBlock()));
+
+            chunk.reset();
+            lock.unlock();
+
+            m_writer.submit(std::move(snapshot));
+        }
+    }
+}
 
-            m_chunk->reset();
+ReffedChunk& ReffedChunk::step(const Point& p)
+{
+    SpinGuard lock(m_spin);
 
-            SpinGuard lock(spin);
-            ++info.written;
-        }
+    if (!m_chunk)
+    {
+        m_chunk = makeUnique<Chunk>(*this);
+        m_chunk->reset();
     }
+
+    return m_chunk->step(p);
 }
 
 bool ReffedChunk::empty()
@@ -165,15 +199,5 @@ bool ReffedChunk::empty()
     return false;
 }
 
-ReffedChunk::Info ReffedChunk::latchInfo()
-{
-    SpinGuard lock(spin);
-
-    Info result(info);
-    info.written = 0;
-    info.read = 0;
-    return result;
-}
-
 } // namespace entwine
 
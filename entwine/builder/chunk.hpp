@@ -14,6 +14,7 @@
 #include <cstddef>
 #include <utility>
 
+#include <entwine/builder/chunk-writer.hpp>
 #include <entwine/builder/clipper.hpp>
 #include <entwine/builder/hierarchy.hpp>
 #include <entwine/third/arbiter/arbiter.hpp>
@@ -29,6 +30,14 @@ namespace entwine
 
 class Chunk;
 
+// The outcome of inserting a point.
+enum class Insertion
+{
+    Stored,     // Stored in the chunk into which it was inserted.
+    Descended,  // Stored in a descendant of that chunk.
+    Rejected    // Discarded, since it would be deeper than Metadata::maxDepth.
+};
+
 class ReffedChunk
 {
 public:
@@ -36,19 +45,20 @@ public:
             const ChunkKey& key,
             const arbiter::Endpoint& out,
             const arbiter::Endpoint& tmp,
-            Hierarchy& hierarchy);
+            Hierarchy& hierarchy,
+            ChunkWriter& writer);
 
     ReffedChunk(const ReffedChunk& o);
     ~ReffedChunk();
 
-    struct Info
-    {
-        std::size_t written = 0;
-        std::size_t read = 0;
-        std::size_t alive = 0;
-    };
-
-    bool insert(Voxel& voxel, Key& key, Clipper& clipper);
+    // A _relocated_ point is one which is already part of the tree, being
+    // woken, merged, or pushed down from an ancestor.  These are never
+    // rejected, so only a point arriving from an input file may be lost.
+    Insertion insert(
+            Voxel& voxel,
+            Key& key,
+            Clipper& clipper,
+            bool relocated = false);
 
     void ref(Clipper& clipper);
     void unref(Origin o);
@@ -56,13 +66,16 @@ public:
 
     Chunk& chunk() { assert(m_chunk); return *m_chunk; }
 
+    // Get our child in the direction of _p_ without loading our own data,
+    // which is loaded by ref() if anything is ever inserted here.
+    ReffedChunk& step(const Point& p);
+
     const ChunkKey& key() const { return m_key; }
     const Metadata& metadata() const { return m_metadata; }
     const arbiter::Endpoint& out() const { return m_out; }
     const arbiter::Endpoint& tmp() const { return m_tmp; }
     Hierarchy& hierarchy() const { return m_hierarchy; }
-
-    static Info latchInfo();
+    ChunkWriter& writer() const { return m_writer; }
 
 private:
     ChunkKey m_key;
@@ -70,6 +83,7 @@ private:
     const arbiter::Endpoint& m_out;
     const arbiter::Endpoint& m_tmp;
     Hierarchy& m_hierarchy;
+    ChunkWriter& m_writer;
 
     SpinLock m_spin;
     std::unique_ptr<Chunk> m_chunk;
@@ -89,11 +103,15 @@ public:
         : m_ref(ref)
         , m_ticks(m_ref.metadata().ticks())
         , m_pointSize(m_ref.metadata().schema().pointSize())
+        , m_terminal(m_ref.key().depth() >= m_ref.metadata().maxDepth())
         , m_gridBlock(m_pointSize, 4096)
         , m_overflowBlock(m_pointSize, 1024)
     {
         init();
 
+        // The deepest chunks the hierarchy can describe have no children.
+        if (m_terminal) return;
+
         m_children.reserve(dirEnd());
         for (std::size_t d(0); d < dirEnd(); ++d)
         {
@@ -102,7 +120,8 @@ public:
                     key,
                     m_ref.out(),
                     m_ref.tmp(),
-                    m_ref.hierarchy());
+                    m_ref.hierarchy(),
+                    m_ref.writer());
 
             m_hasChildren = m_hasChildren || m_ref.hierarchy().get(key.get());
         }
@@ -139,11 +158,12 @@ public:
 
     ReffedChunk& step(const Point& p)
     {
+        assert(!m_terminal);
         const Dir dir(getDirection(m_ref.key().bounds().mid(), p));
         return m_children[toIntegral(dir)];
     }
 
-    bool insert(Voxel& voxel, Key& key, Clipper& clipper)
+    Insertion insert(Voxel& voxel, Key& key, Clipper& clipper, bool relocated)
     {
         const Xyz& pos(key.position());
         const std::size_t i((pos.y % m_ticks) * m_ticks + (pos.x % m_ticks));
@@ -154,17 +174,21 @@ public:
 
         if (dst.data())
         {
+            // A terminal chunk never displaces a point, since it would have
+            // nowhere deeper to go.
             const Point& mid(key.bounds().mid());
-            if (voxel.point().sqDist3d(mid) < dst.point().sqDist3d(mid))
+            if (
+                    !m_terminal &&
+                    voxel.point().sqDist3d(mid) < dst.point().sqDist3d(mid))
             {
                 if (!insertOverflow(dst, key, clipper))
                 {
                     key.step(dst.point());
-                    step(dst.point()).insert(dst, key, clipper);
+                    step(dst.point()).insert(dst, key, clipper, true);
                 }
 
                 dst.initDeep(voxel.point(), voxel.data(), m_pointSize);
-                return true;
+                return Insertion::Stored;
             }
         }
         else
@@ -174,19 +198,17 @@ public:
                 dst.setData(m_gridBlock.next());
             }
             dst.initDeep(voxel.point(), voxel.data(), m_pointSize);
-            return true;
+            return Insertion::Stored;
         }
 
-        if (insertOverflow(voxel, key, clipper))
-        {
-            return true;
-        }
-        else
-        {
-            key.step(voxel.point());
-            step(voxel.point()).insert(voxel, key, clipper);
-            return false;
-        }
+        if (m_terminal) return insertTerminal(voxel, key, relocated);
+
+        if (insertOverflow(voxel, key, clipper)) return Insertion::Stored;
+
+        key.step(voxel.point());
+        const Insertion result(
+                step(voxel.point()).insert(voxel, key, clipper, relocated));
+        return result == Insertion::Rejected ? result : Insertion::Descended;
     }
 
     MemBlock& gridBlock() { return m_gridBlock; }
@@ -218,6 +240,28 @@ private:
         return true;
     }
 
+    // A terminal chunk cannot split, so it keeps every relocated point in
+    // its overflow, which grows past the threshold by at most the overflow of
+    // its parent.  A new point is rejected once the threshold is reached.
+    Insertion insertTerminal(Voxel& voxel, Key& key, bool relocated)
+    {
+        SpinGuard lock(m_overflowSpin);
+
+        if (
+                !relocated &&
+                m_overflowBlock.size() >=
+                    m_ref.metadata().overflowThreshold())
+        {
+            return Insertion::Rejected;
+        }
+
+        Overflow overflow(key);
+        overflow.voxel.setData(m_overflowBlock.next());
+        overflow.voxel.initDeep(voxel.point(), voxel.data(), m_pointSize);
+        m_overflow->push_back(overflow);
+        return Insertion::Stored;
+    }
+
     void doOverflow(Clipper& clipper)
     {
         m_hasChildren = true;
@@ -226,7 +270,7 @@ private:
         {
             Overflow& o((*m_overflow)[i]);
             o.step();
-            step(o.voxel.point()).insert(o.voxel, o.key, clipper);
+            step(o.voxel.point()).insert(o.voxel, o.key, clipper, true);
         }
 
         m_overflow.reset();
@@ -236,6 +280,7 @@ private:
     const ReffedChunk& m_ref;
     const uint64_t m_ticks;
     const uint64_t m_pointSize;
+    const bool m_terminal;
     bool m_remote = false;
 
     SpinLock m_spin;
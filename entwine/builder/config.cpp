@@ -12,6 +12,7 @@
 
 #include <entwine/builder/scan.hpp>
 #include <entwine/io/ensure.hpp>
+#include <entwine/io/memory-driver.hpp>
 #include <entwine/third/arbiter/arbiter.hpp>
 
 namespace entwine
@@ -39,8 +40,8 @@ Config Config::fromScan(const std::string file) const
     // First grab the configuration portion, which contains things like the
     // pipeline/reprojection used to run this scan, and its results like the
     // scale/schema/SRS/bounds.
-    arbiter::Arbiter a(m_json["arbiter"]);
-    Config c(entwine::parse(ensureGet(a, file)));
+    auto a(makeArbiter(m_json["arbiter"]));
+    Config c(entwine::parse(ensureGet(*a, file, retry())));
 
     // Now we'll pluck out the file information.  Mirroring the EPT source
     // metadata format, we have a sparse list at `ept-sources/list.json` which
@@ -51,9 +52,9 @@ Config Config::fromScan(const std::string file) const
     // The primary builder is a) the sole builder if this is not a subset build
     // or b) the subset with ID 1.
     const std::string dir(file.substr(0, file.rfind(scanFile)));
-    arbiter::Endpoint ep(a.getEndpoint(dir));
+    arbiter::Endpoint ep(a->getEndpoint(dir));
 
-    FileInfoList list(Files::extract(ep, primary()));
+    FileInfoList list(Files::extract(ep, primary(), "", retry()));
     c["input"] = Files(list).toJson();
 
     return c;
@@ -157,7 +158,7 @@ Config Config::prepare() const
 FileInfoList Config::input() const
 {
     FileInfoList f;
-    arbiter::Arbiter arbiter(m_json["arbiter"]);
+    auto arbiter(makeArbiter(m_json["arbiter"]));
 
     auto insert([&](const Json::Value& j)
     {
@@ -188,7 +189,7 @@ FileInfoList Config::input() const
             }
         }
 
-        Paths current(arbiter.resolve(p, verbose()));
+        Paths current(arbiter->resolve(p, verbose()));
         std::sort(current.begin(), current.end());
         for (const auto& c : current)
         {
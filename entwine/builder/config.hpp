@@ -19,6 +19,8 @@
 #include <json/json.h>
 
 #include <entwine/builder/thread-pools.hpp>
+#include <entwine/io/ensure.hpp>
+#include <entwine/io/memory-driver.hpp>
 #include <entwine/third/arbiter/arbiter.hpp>
 #include <entwine/types/bounds.hpp>
 #include <entwine/types/defs.hpp>
@@ -112,8 +114,36 @@ public:
         else return t[1].asUInt64();
     }
 
+    std::size_t uploadThreads() const
+    {
+        return m_json.isMember("uploadThreads") ?
+            m_json["uploadThreads"].asUInt64() : heuristics::uploadThreads;
+    }
+
+    RetryPolicy retry() const { return RetryPolicy(m_json["retry"]); }
+
+    uint64_t maxWriteBytes() const
+    {
+        return m_json.isMember("maxWriteBytes") ?
+            m_json["maxWriteBytes"].asUInt64() : heuristics::maxWriteBytes;
+    }
+
+    uint64_t packThreshold() const
+    {
+        return m_json["packThreshold"].asUInt64();
+    }
+
+    uint64_t packDepth() const
+    {
+        return m_json.isMember("packDepth") ?
+            m_json["packDepth"].asUInt64() : heuristics::packDepth;
+    }
+
+    bool zoneMaps() const { return m_json["zoneMaps"].asBool(); }
+
     std::string dataType() const { return m_json["dataType"].asString(); }
     std::string hierType() const { return m_json["hierarchyType"].asString(); }
+    std::string pointOrder() const { return m_json["pointOrder"].asString(); }
 
     const Json::Value& json() const { return m_json; }
     Json::Value& json() { return m_json; }
@@ -136,7 +166,7 @@ public:
     bool isContinuation() const
     {
         return !force() &&
-            arbiter::Arbiter(m_json["arbiter"]).tryGetSize(
+            makeArbiter(m_json["arbiter"])->tryGetSize(
                     arbiter::util::join(
                         output(),
                         "ept" + postfix() + ".json"));
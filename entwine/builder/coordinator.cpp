@@ -0,0 +1,268 @@
+/******************************************************************************
+* Copyright (c) 2018, Connor Manning (connor@hobu.co)
+*
+* Entwine -- Point cloud indexing
+*
+* Entwine is available under the terms of the LGPL2 license. See COPYING
+* for specific license text and more information.
+*
+******************************************************************************/
+
+#include <entwine/builder/coordinator.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <entwine/builder/builder.hpp>
+#include <entwine/builder/merger.hpp>
+#include <entwine/io/memory-driver.hpp>
+#include <entwine/third/arbiter/arbiter.hpp>
+#include <entwine/util/json.hpp>
+
+namespace entwine
+{
+
+namespace
+{
+    const std::string mergeName("merge");
+
+    std::string hostname()
+    {
+#ifndef _WIN32
+        char buffer[256] = { 0 };
+        if (::gethostname(buffer, sizeof(buffer) - 1) == 0) return buffer;
+#endif
+        return "";
+    }
+
+    // The contents of our claim files, identifying this process.
+    std::string owner()
+    {
+#ifndef _WIN32
+        return hostname() + " " + std::to_string(::getpid());
+#else
+        throw std::runtime_error("Coordinated builds require POSIX");
+#endif
+    }
+
+    // A filename-safe form of our ownership.
+    std::string suffix()
+    {
+        std::string s(owner());
+        std::replace(s.begin(), s.end(), ' ', '-');
+        return s;
+    }
+
+    // Atomically create the file at _path_ with our ownership, failing if it
+    // already exists.
+    bool create(const std::string& path)
+    {
+#ifndef _WIN32
+        const int fd(::open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644));
+        if (fd < 0)
+        {
+            if (errno == EEXIST) return false;
+            throw std::runtime_error("Could not create " + path);
+        }
+
+        const std::string data(owner() + "\n");
+        const bool good(
+                ::write(fd, data.data(), data.size()) ==
+                static_cast<ssize_t>(data.size()));
+        ::close(fd);
+
+        if (!good) throw std::runtime_error("Could not write " + path);
+        return true;
+#else
+        throw std::runtime_error("Coordinated builds require POSIX");
+#endif
+    }
+}
+
+Coordinator::Coordinator(const Config& config)
+    : m_config(config.prepare())
+    , m_arbiter(makeArbiter(config["arbiter"]))
+    , m_plan(parse(m_arbiter->get(config["plan"].asString())))
+    , m_work(arbiter::fs::expandTilde(config["work"].asString()))
+    , m_of(m_plan["subsets"].size())
+    , m_verbose(config.verbose())
+{
+    if (m_work.empty()) throw std::runtime_error("Work directory required");
+    if (m_of <= 1) throw std::runtime_error("Invalid plan");
+
+    if (!arbiter::fs::mkdirp(m_work))
+    {
+        throw std::runtime_error("Couldn't create work directory");
+    }
+}
+
+Coordinator::~Coordinator()
+{
+#ifndef _WIN32
+    for (const auto& p : m_locks) ::close(p.second);
+#endif
+}
+
+bool Coordinator::go()
+{
+    for (uint64_t id(1); id <= m_of; ++id)
+    {
+        const std::string name(std::to_string(id));
+        if (done(name)) continue;
+
+        const Claim c(claim(name));
+        if (c == Claim::none) continue;
+
+        build(id, c == Claim::resumed);
+        markDone(name);
+        ++m_built;
+    }
+
+    // Subsets claimed by other processes may still be in progress, in which
+    // case the last of them to finish will perform the merge.
+    for (uint64_t id(1); id <= m_of; ++id)
+    {
+        if (!done(std::to_string(id))) return false;
+    }
+
+    if (done(mergeName) || claim(mergeName) == Claim::none) return false;
+
+    mergeAll();
+    markDone(mergeName);
+    return true;
+}
+
+Coordinator::Claim Coordinator::claim(const std::string& name)
+{
+#ifndef _WIN32
+    // Claim files are never removed, so every process locks the same file,
+    // and the lock is released by the kernel if its holder dies.
+    const std::string claimPath(path(name + ".claim"));
+    const int fd(::open(claimPath.c_str(), O_RDWR | O_CREAT, 0644));
+    if (fd < 0) throw std::runtime_error("Could not open " + claimPath);
+
+    if (::flock(fd, LOCK_EX | LOCK_NB) != 0)
+    {
+        const int err(errno);
+        ::close(fd);
+        if (err == EWOULDBLOCK) return Claim::none;
+        throw std::runtime_error("Could not lock " + claimPath);
+    }
+
+    // The previous holder may have finished between our check and our lock.
+    if (done(name))
+    {
+        ::close(fd);
+        return Claim::none;
+    }
+
+    // An unlocked claim which records an owner was abandoned by a process
+    // which died during its build.
+    struct stat st;
+    const bool resumed(::fstat(fd, &st) == 0 && st.st_size > 0);
+
+    const std::string data(owner() + "\n");
+    const bool good(
+            ::ftruncate(fd, 0) == 0 &&
+            ::write(fd, data.data(), data.size()) ==
+                static_cast<ssize_t>(data.size()));
+
+    if (!good)
+    {
+        ::close(fd);
+        throw std::runtime_error("Could not write " + claimPath);
+    }
+
+    m_locks[name] = fd;
+    return resumed ? Claim::resumed : Claim::fresh;
+#else
+    throw std::runtime_error("Coordinated builds require POSIX");
+#endif
+}
+
+void Coordinator::markDone(const std::string& name)
+{
+    // Write, then rename, so the done marker never appears partially written.
+    const std::string tmp(path(name + ".done-" + suffix()));
+    if (!create(tmp) || std::rename(tmp.c_str(), path(name + ".done").c_str()))
+    {
+        throw std::runtime_error("Could not mark " + name + " as done");
+    }
+
+    // Only release our claim once it is marked done.
+#ifndef _WIN32
+    const auto it(m_locks.find(name));
+    if (it != m_locks.end())
+    {
+        ::close(it->second);
+        m_locks.erase(it);
+    }
+#endif
+}
+
+bool Coordinator::done(const std::string& name) const
+{
+    return std::ifstream(path(name + ".done")).good();
+}
+
+void Coordinator::build(const uint64_t id, const bool resume)
+{
+    if (m_verbose)
+    {
+        std::cout << (resume ? "Resuming" : "Claimed") << " subset " <<
+            id << " / " << m_of << std::endl;
+    }
+
+    const Json::ArrayIndex index(id - 1);
+
+    Config c(m_config);
+    c.json().removeMember("plan");
+    c.json().removeMember("work");
+    c["subset"] = m_plan["subsets"][index]["subset"];
+    if (m_plan.isMember("bounds")) c["bounds"] = m_plan["bounds"];
+
+    // A fresh claim overwrites anything left behind by a previous run, while
+    // a resumed claim continues the build of the process which abandoned it.
+    c["force"] = !resume;
+
+    Builder(c, m_arbiter).go();
+
+    if (m_verbose)
+    {
+        std::cout << "Completed subset " << id << " / " << m_of << std::endl;
+    }
+}
+
+void Coordinator::mergeAll()
+{
+    Config c;
+    c["output"] = m_config.output();
+    c["arbiter"] = m_config["arbiter"];
+    c["verbose"] = m_verbose;
+    if (m_config.json().isMember("threads"))
+    {
+        c["threads"] = m_config["threads"];
+    }
+
+    if (m_verbose) std::cout << "Merging " << m_of << " subsets" << std::endl;
+    Merger(c).go();
+}
+
+std::string Coordinator::path(const std::string& name) const
+{
+    return arbiter::util::join(m_work, name);
+}
+
+} // namespace entwine
+
@@ -0,0 +1,83 @@
+/******************************************************************************
+* Copyright (c) 2018, Connor Manning (connor@hobu.co)
+*
+* Entwine -- Point cloud indexing
+*
+* Entwine is available under the terms of the LGPL2 license. See COPYING
+* for specific license text and more information.
+*
+******************************************************************************/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+
+#include <json/json.h>
+
+#include <entwine/builder/config.hpp>
+
+namespace entwine
+{
+
+namespace arbiter { class Arbiter; }
+
+// Coordinates any number of build processes which share a work directory and
+// an output.  The subsets of a Plan form the work queue: each process claims
+// the next unclaimed subset by taking an exclusive lock on its claim file in
+// the work directory, builds it, and then atomically marks it as done before
+// releasing the lock.  Once every subset is done, whichever process claims
+// the merge reconciles the shared nodes into the final output.
+//
+// A claim is held for exactly as long as its lock, which the kernel releases
+// if the claiming process dies.  An unlocked claim file which is not done was
+// therefore abandoned, and the next process to lock it continues that subset
+// build where it left off.  Claim files also record the host and process
+// which last held them, for diagnostics.
+class Coordinator
+{
+public:
+    // The config must specify a "plan", as produced by Plan::toJson, and a
+    // local "work" directory.
+    Coordinator(const Config& config);
+    ~Coordinator();
+
+    // Builds subsets until none are left unclaimed.  Returns true if this
+    // process also performed the merge.
+    bool go();
+
+    uint64_t of() const { return m_of; }
+
+    // The number of subsets built by this process.
+    uint64_t built() const { return m_built; }
+
+private:
+    enum class Claim { none, fresh, resumed };
+
+    Claim claim(const std::string& name);
+    void markDone(const std::string& name);
+    bool done(const std::string& name) const;
+
+    void build(uint64_t id, bool resume);
+    void mergeAll();
+
+    std::string path(const std::string& name) const;
+
+    const Config m_config;
+    std::shared_ptr<arbiter::Arbiter> m_arbiter;
+    const Json::Value m_plan;
+    const std::string m_work;
+    const uint64_t m_of;
+    const bool m_verbose;
+
+    uint64_t m_built = 0;
+
+    // Descriptors of the claim files we hold locked, by claim name.
+    std::map<std::string, int> m_locks;
+};
+
+} // namespace entwine
+
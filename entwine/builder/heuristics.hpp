@@ -10,6 +10,9 @@
 
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+
 namespace entwine
 {
 namespace heuristics
@@ -29,6 +32,19 @@ const std::size_t clipCacheSize(64);
 // work threads to clip threads.
 const float defaultWorkToClipRatio(0.33f);
 
+// Number of threads dedicated to uploading serialized chunks.  These are
+// IO-bound, so this count is independent of the CPU thread counts.
+const std::size_t uploadThreads(8);
+
+// Maximum number of bytes of chunk data, either raw or serialized, which may
+// be in flight between a chunk's release and the completion of its upload.
+// Releasing chunks will block while this budget is exhausted.
+const uint64_t maxWriteBytes(1ULL << 30);
+
+// When packing is enabled, chunks are grouped into one pack file per subtree
+// rooted at this depth.
+const uint64_t packDepth(8);
+
 // Max number of nodes to store in a single hierarchy file.
 const std::size_t maxHierarchyNodesPerFile(65536);
 
@@ -10,152 +10,467 @@
 
 #include <entwine/builder/hierarchy.hpp>
 
+#include <algorithm>
+
 #include <entwine/io/ensure.hpp>
 #include <entwine/types/metadata.hpp>
 #include <entwine/util/json.hpp>
+#include <entwine/util/unique.hpp>
 
 namespace entwine
 {
 
+namespace
+{
+    // Shards are selected by the high bits of a key's hash, and slots within
+    // a shard by its low bits.
+    const std::size_t shardBits(6);
+    const std::size_t shardCount(1 << shardBits);
+    const std::size_t minSlots(16);
+
+    // The depth of the root of the hierarchy file containing a node at depth
+    // _d_.  Subtree roots are the first node of their own file.
+    uint64_t fileDepth(const uint64_t d, const uint64_t step)
+    {
+        return step ? d - d % step : 0;
+    }
+
+    NodeKey ancestorOf(const Dxyz& k, const uint64_t d)
+    {
+        const uint64_t shift(k.d - d);
+        return NodeKey(
+                Dxyz(d, k.p.x >> shift, k.p.y >> shift, k.p.z >> shift));
+    }
+
+    Dxyz parentOf(const Dxyz& k)
+    {
+        return Dxyz(k.d - 1, k.p.x >> 1, k.p.y >> 1, k.p.z >> 1);
+    }
+
+    // A single hierarchy file entry.
+    struct Entry
+    {
+        Entry(const NodeKey& file, const NodeKey& key, int64_t count)
+            : file(file)
+            , key(key)
+            , count(count)
+        { }
+
+        NodeKey file;
+        NodeKey key;
+        int64_t count;
+    };
+
+    bool operator<(const Entry& a, const Entry& b)
+    {
+        return a.file < b.file || (a.file == b.file && a.key < b.key);
+    }
+}
+
+class Hierarchy::Shard
+{
+public:
+    void set(const NodeKey& key, const std::size_t hash, const uint64_t val)
+    {
+        SpinGuard lock(m_spin);
+
+        if ((m_size + 1) * 4 > m_slots.size() * 3) grow();
+
+        Slot& slot(m_slots[probe(key, hash)]);
+        if (slot.empty()) ++m_size;
+
+        slot.hi = key.hi();
+        slot.lo = key.lo();
+        slot.val = val;
+    }
+
+    uint64_t get(const NodeKey& key, const std::size_t hash) const
+    {
+        SpinGuard lock(m_spin);
+        if (m_slots.empty()) return 0;
+        return m_slots[probe(key, hash)].val;
+    }
+
+    std::size_t size() const
+    {
+        SpinGuard lock(m_spin);
+        return m_size;
+    }
+
+    void append(Snapshot& nodes) const
+    {
+        SpinGuard lock(m_spin);
+        for (const Slot& slot : m_slots)
+        {
+            if (!slot.empty())
+            {
+                nodes.emplace_back(NodeKey(slot.hi, slot.lo), slot.val);
+            }
+        }
+    }
+
+private:
+    // Every valid NodeKey has a nonzero marker bit, so an all-zero key marks
+    // an empty slot.
+    struct Slot
+    {
+        bool empty() const { return !hi && !lo; }
+
+        uint64_t hi = 0;
+        uint64_t lo = 0;
+        uint64_t val = 0;
+    };
+
+    // Linear probing: returns the slot holding this key, or the empty slot
+    // where it belongs.
+    std::size_t probe(const NodeKey& key, const std::size_t hash) const
+    {
+        const std::size_t mask(m_slots.size() - 1);
+        std::size_t i(hash & mask);
+
+        while (true)
+        {
+            const Slot& slot(m_slots[i]);
+            if (slot.empty() || (slot.hi == key.hi() && slot.lo == key.lo()))
+            {
+                return i;
+            }
+            i = (i + 1) & mask;
+        }
+    }
+
+    void grow()
+    {
+        std::vector<Slot> old(
+                std::max(m_slots.size() * 2, minSlots));
+        old.swap(m_slots);
+
+        for (const Slot& slot : old)
+        {
+            if (slot.empty()) continue;
+            const NodeKey key(slot.hi, slot.lo);
+            m_slots[probe(key, key.hash())] = slot;
+        }
+    }
+
+    mutable SpinLock m_spin;
+    std::vector<Slot> m_slots;
+    std::size_t m_size = 0;
+};
+
+Hierarchy::Hierarchy()
+{
+    for (std::size_t i(0); i < shardCount; ++i)
+    {
+        m_shards.push_back(makeUnique<Shard>());
+    }
+}
+
+Hierarchy::Hierarchy(const Json::Value& json)
+    : Hierarchy()
+{
+    for (const auto key : json.getMemberNames())
+    {
+        set(Dxyz(key), json[key].asUInt64());
+    }
+}
+
 Hierarchy::Hierarchy(
         const Metadata& m,
         const arbiter::Endpoint& ep,
-        const bool exists)
+        const bool exists,
+        const RetryPolicy& retry)
+    : Hierarchy()
+{
+    if (exists) load(m, ep, retry);
+}
+
+Hierarchy::~Hierarchy() { }
+
+Hierarchy::Shard& Hierarchy::shard(const NodeKey& key) const
+{
+    return *m_shards[key.hash() >> (64 - shardBits)];
+}
+
+void Hierarchy::set(const Dxyz& dxyz, const uint64_t val)
+{
+    const NodeKey key(dxyz);
+    shard(key).set(key, key.hash(), val);
+}
+
+uint64_t Hierarchy::get(const Dxyz& dxyz) const
+{
+    const NodeKey key(dxyz);
+    return shard(key).get(key, key.hash());
+}
+
+uint64_t Hierarchy::size() const
+{
+    uint64_t n(0);
+    for (const auto& s : m_shards) n += s->size();
+    return n;
+}
+
+Hierarchy::Snapshot Hierarchy::snapshot() const
+{
+    Snapshot nodes;
+    nodes.reserve(size());
+    for (const auto& s : m_shards) s->append(nodes);
+
+    std::sort(
+            nodes.begin(),
+            nodes.end(),
+            [](const Node& a, const Node& b) { return a.first < b.first; });
+
+    return nodes;
+}
+
+uint64_t Hierarchy::find(const Snapshot& nodes, const Dxyz& dxyz)
 {
-    if (exists) load(m, ep);
+    const NodeKey key(dxyz);
+    const auto it(
+            std::lower_bound(
+                nodes.begin(),
+                nodes.end(),
+                key,
+                [](const Node& n, const NodeKey& k) { return n.first < k; }));
+
+    if (it == nodes.end() || it->first != key) return 0;
+    return it->second;
+}
+
+Json::Value Hierarchy::toJson() const
+{
+    Json::Value json;
+    for (const auto& p : snapshot())
+    {
+        json[p.first.dxyz().toString()] = (Json::UInt64)p.second;
+    }
+    return json;
 }
 
 void Hierarchy::load(
         const Metadata& m,
         const arbiter::Endpoint& ep,
+        const RetryPolicy& retry,
         const Dxyz& root)
 {
-    const auto json(parse(ep.get(filename(m, root))));
+    const HierarchyNodes nodes(
+            decodeHierarchy(
+                m.hierarchyType(),
+                *ensureGet(ep, filename(m, root), retry)));
 
-    for (const auto s : json.getMemberNames())
+    for (auto& p : loadPackIndex(ep, root, m.postfix())) m_packs.insert(p);
+    if (m.zoneMaps())
     {
-        const Dxyz k(s);
-        assert(!m_map.count(k));
+        for (auto& p : loadZoneMaps(ep, root, m.postfix())) m_zones.insert(p);
+    }
+
+    for (const auto& p : nodes)
+    {
+        const Dxyz& k(p.first);
+        assert(!get(k));
 
-        int64_t n(json[s].asInt64());
-        if (n < 0) load(m, ep, k);
-        else m_map[k] = static_cast<uint64_t>(n);
+        const int64_t n(p.second);
+        if (n < 0) load(m, ep, retry, k);
+        else set(k, static_cast<uint64_t>(n));
     }
 }
 
-void Hierarchy::save(
-        const Metadata& m,
-        const arbiter::Endpoint& ep,
-        Pool& pool) const
+Hierarchy::Snapshot Hierarchy::reachable() const
 {
-    Json::Value json(Json::objectValue);
-    const ChunkKey k(m);
-    save(m, ep, pool, k, json);
+    // As with a traversal from the root, only nodes connected to the root by
+    // nonzero counts are included.  Nodes are sorted by depth, so each
+    // parent has been visited before its children.
+    const Snapshot nodes(snapshot());
 
-    const std::string f(filename(m, k));
-    pool.add([&ep, f, json]() { ensurePut(ep, f, json.toStyledString()); });
+    Snapshot result;
+    result.reserve(nodes.size());
 
-    pool.await();
+    for (const Node& node : nodes)
+    {
+        if (!node.second) continue;
+
+        const Dxyz k(node.first.dxyz());
+        if (k.d && !find(result, parentOf(k))) continue;
+
+        result.push_back(node);
+    }
+
+    return result;
 }
 
 void Hierarchy::save(
         const Metadata& m,
         const arbiter::Endpoint& ep,
         Pool& pool,
-        const ChunkKey& k,
-        Json::Value& curr) const
+        const RetryPolicy& retry) const
 {
-    const uint64_t n(get(k.dxyz()));
-    if (!n) return;
-
-    if (m_step && k.depth() && (k.depth() % m_step == 0))
+    const std::size_t errors(pool.errors().size());
+    const Snapshot nodes(reachable());
+    const uint64_t step(m_step);
+
+    // Tag each entry with the root of the file to which it belongs, so that
+    // sorting groups the entries of each file together.  The root of each
+    // subtree appears both as the first node of its own file and as a
+    // reference within the file above it.
+    std::vector<Entry> entries;
+    entries.reserve(nodes.size());
+
+    for (const Node& node : nodes)
     {
-        curr[k.toString()] = -1;
+        const Dxyz k(node.first.dxyz());
+        const uint64_t d(fileDepth(k.d, step));
 
-        Json::Value next;
-        next[k.toString()] = static_cast<Json::UInt64>(n);
+        entries.emplace_back(
+                ancestorOf(k, d),
+                node.first,
+                static_cast<int64_t>(node.second));
 
-        for (uint64_t dir(0); dir < 8; ++dir)
+        if (k.d && d == k.d)
         {
-            save(m, ep, pool, k.getStep(toDir(dir)), next);
+            entries.emplace_back(ancestorOf(k, k.d - step), node.first, -1);
         }
+    }
+
+    std::sort(entries.begin(), entries.end());
+
+    // The pack index and zone maps are sharded by hierarchy file.
+    const bool packed(m.packThreshold());
+    const bool zoned(m.zoneMaps());
 
-        const std::string f(filename(m, k));
-        pool.add([&ep, f, next]() { ensurePut(ep, f, toFastString(next)); });
+    PackMap packs;
+    ZoneMaps zones;
+    {
+        SpinGuard lock(m_spin);
+        if (packed) packs = m_packs;
+        if (zoned) zones = m_zones;
     }
-    else
+
+    using It = std::vector<Entry>::const_iterator;
+    const HierarchyType type(m.hierarchyType());
+
+    const auto write([&](const NodeKey& file, It begin, It end)
     {
-        curr[k.toString()] = static_cast<Json::UInt64>(n);
+        HierarchyNodes out;
+        PackMap filePacks;
+        ZoneMaps fileZones;
+
+        for (auto it(begin); it != end; ++it)
+        {
+            const Dxyz k(it->key.dxyz());
+            out[k] = it->count;
+
+            // References to further subtrees belong to those subtrees.
+            if (it->count < 0) continue;
 
-        for (uint64_t dir(0); dir < 8; ++dir)
+            const auto p(packs.find(k));
+            if (p != packs.end()) filePacks.insert(*p);
+
+            const auto z(zones.find(k));
+            if (z != zones.end()) fileZones.insert(*z);
+        }
+
+        const Dxyz root(file.dxyz());
+        ensurePut(
+                ep,
+                filename(m, root),
+                encodeHierarchy(type, out),
+                retry);
+
+        // Shards are written even if empty, since a previous build may have
+        // left entries for this subtree which no longer apply.
+        if (packed)
         {
-            save(m, ep, pool, k.getStep(toDir(dir)), curr);
+            ensurePut(
+                    ep,
+                    packIndexFilename(root, m.postfix()),
+                    toFastString(entwine::toJson(filePacks)),
+                    retry);
         }
-    }
-}
+        if (zoned)
+        {
+            ensurePut(
+                    ep,
+                    zoneMapFilename(root, m.postfix()),
+                    toFastString(entwine::toJson(fileZones)),
+                    retry);
+        }
+    });
 
-void Hierarchy::analyze(const Metadata& m, const bool verbose) const
-{
-    if (m_step) return;
-    if (m_map.size() <= heuristics::maxHierarchyNodesPerFile) return;
+    // The root file sorts first.
+    const NodeKey top((Dxyz()));
+    It split(entries.begin());
+    while (split != entries.end() && split->file == top) ++split;
 
-    AnalysisSet analysis;
-    std::vector<uint64_t> steps{ 5, 6, 8, 10 };
-    for (const uint64_t step : steps)
+    // Files are independent of one another, so all but the root are encoded
+    // and written concurrently.  The root file is written only once the rest
+    // have succeeded, so it never references a subtree which is missing.
+    for (It begin(split); begin != entries.end(); )
     {
-        Map analyzed;
-        const ChunkKey k(m);
-        analyzed[k.dxyz()] = 1;
-        analyze(m, step, k, k.dxyz(), analyzed);
+        It end(begin);
+        while (end != entries.end() && end->file == begin->file) ++end;
 
-        analysis.emplace(m_map, analyzed, step);
+        pool.add([&write, begin, end]() { write(begin->file, begin, end); });
+        begin = end;
     }
 
-    const auto& chosen(*analysis.begin());
+    pool.await();
 
-    if (verbose)
+    if (pool.errors().size() > errors)
     {
-        for (const auto& a : analysis) a.summarize();
-        std::cout << "Setting hierarchy step: " << chosen.step << std::endl;
+        throw std::runtime_error(
+                "Hierarchy save failed: " + pool.errors().back());
     }
 
-    m_step = chosen.step;
+    write(top, entries.begin(), split);
 }
 
-void Hierarchy::analyze(
-    const Metadata& m,
-    const uint64_t step,
-    const ChunkKey& k,
-    const Dxyz& curr,
-    Hierarchy::Map& map) const
+void Hierarchy::analyze(const Metadata& m, const bool verbose) const
 {
-    const uint64_t n(get(k.dxyz()));
-    if (!n) return;
+    if (m_step) return;
+    if (size() <= heuristics::maxHierarchyNodesPerFile) return;
+
+    const Snapshot nodes(reachable());
+    const std::vector<uint64_t> steps{ 5, 6, 8, 10 };
 
-    ++map[curr];
+    // The number of nodes in each file for every candidate step, gathered in
+    // a single pass over the nodes.
+    std::vector<std::map<NodeKey, uint64_t>> files(steps.size());
 
-    if (step && k.depth() && (k.depth() % step == 0))
+    for (const Node& node : nodes)
     {
-        const Dxyz next(k.dxyz());
-        map[next] = 1;
+        const Dxyz k(node.first.dxyz());
 
-        for (uint64_t dir(0); dir < 8; ++dir)
+        for (std::size_t i(0); i < steps.size(); ++i)
         {
-            analyze(m, step, k.getStep(toDir(dir)), next, map);
+            const uint64_t step(steps[i]);
+            const uint64_t d(fileDepth(k.d, step));
+
+            ++files[i][ancestorOf(k, d)];
+            if (k.d && d == k.d) ++files[i][ancestorOf(k, k.d - step)];
         }
     }
-    else
+
+    AnalysisSet analysis;
+    for (std::size_t i(0); i < steps.size(); ++i)
     {
-        for (uint64_t dir(0); dir < 8; ++dir)
-        {
-            analyze(m, step, k.getStep(toDir(dir)), curr, map);
-        }
+        analysis.emplace(files[i], steps[i]);
+    }
+
+    const auto& chosen(*analysis.begin());
+
+    if (verbose)
+    {
+        for (const auto& a : analysis) a.summarize();
+        std::cout << "Setting hierarchy step: " << chosen.step << std::endl;
     }
+
+    m_step = chosen.step;
 }
 
 Hierarchy::Analysis::Analysis(
-        const Hierarchy::Map& hierarchy,
-        const Hierarchy::Map& analyzed,
+        const std::map<NodeKey, uint64_t>& analyzed,
         uint64_t step)
     : step(step)
     , totalFiles(analyzed.size())
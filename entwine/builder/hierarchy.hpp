@@ -10,12 +10,21 @@
 
 #pragma once
 
+#include <cstdint>
 #include <map>
+#include <memory>
 #include <set>
+#include <utility>
+#include <vector>
 
 #include <entwine/builder/heuristics.hpp>
+#include <entwine/io/ensure.hpp>
+#include <entwine/io/hierarchy-io.hpp>
+#include <entwine/io/pack.hpp>
 #include <entwine/third/arbiter/arbiter.hpp>
 #include <entwine/types/key.hpp>
+#include <entwine/types/node-key.hpp>
+#include <entwine/types/zone-map.hpp>
 #include <entwine/util/pool.hpp>
 #include <entwine/util/spin-lock.hpp>
 
@@ -24,57 +33,84 @@ namespace entwine
 
 class Metadata;
 
+// Node counts are held in a sharded open-addressing hash table keyed by
+// packed NodeKeys, which costs a small fraction of the memory of a tree of
+// Dxyz keys and allows concurrent writers to proceed mostly uncontended.
+// Ordered traversals operate on sorted snapshots.
 class Hierarchy
 {
 public:
-    using Map = std::map<Dxyz, uint64_t>;
+    using Node = std::pair<NodeKey, uint64_t>;
+    using Snapshot = std::vector<Node>;
 
-    Hierarchy() { }
-    Hierarchy(const Json::Value& json)
-    {
-        for (const auto key : json.getMemberNames())
-        {
-            m_map[Dxyz(key)] = json[key].asUInt64();
-        }
-    }
+    Hierarchy();
+    Hierarchy(const Json::Value& json);
 
     Hierarchy(
             const Metadata& metadata,
             const arbiter::Endpoint& ep,
-            bool exists);
+            bool exists,
+            const RetryPolicy& retry = RetryPolicy());
+
+    ~Hierarchy();
+
+    void set(const Dxyz& key, uint64_t val);
+    uint64_t get(const Dxyz& key) const;
 
-    void set(const Dxyz& key, uint64_t val)
+    // Number of nodes.
+    uint64_t size() const;
+
+    // A copy of all nodes, sorted by depth and then in Morton order.
+    Snapshot snapshot() const;
+
+    // Chunks which have been written into a pack file rather than as their
+    // own file.
+    void setPack(const Dxyz& key, const PackEntry& entry)
     {
         SpinGuard lock(m_spin);
-        auto it(m_map.find(key));
-        if (it == m_map.end()) m_map[key] = val;
-        else it->second = val;
+        m_packs[key] = entry;
     }
 
-    uint64_t get(const Dxyz& key) const
+    void erasePack(const Dxyz& key)
     {
         SpinGuard lock(m_spin);
-        auto it(m_map.find(key));
-        if (it == m_map.end()) return 0;
-        else return it->second;
+        m_packs.erase(key);
     }
 
-    Json::Value toJson() const
+    bool getPack(const Dxyz& key, PackEntry& entry) const
     {
-        Json::Value json;
-        for (const auto& p : m_map)
-        {
-            json[p.first.toString()] = (Json::UInt64)p.second;
-        }
-        return json;
+        SpinGuard lock(m_spin);
+        auto it(m_packs.find(key));
+        if (it == m_packs.end()) return false;
+        entry = it->second;
+        return true;
     }
 
-    const Map& map() const { return m_map; }
+    const PackMap& packs() const { return m_packs; }
+
+    // Attribute summaries of each chunk, if enabled.
+    void setZoneMap(const Dxyz& key, const ZoneMap& zones)
+    {
+        SpinGuard lock(m_spin);
+        m_zones[key] = zones;
+    }
+
+    bool getZoneMap(const Dxyz& key, ZoneMap& zones) const
+    {
+        SpinGuard lock(m_spin);
+        auto it(m_zones.find(key));
+        if (it == m_zones.end()) return false;
+        zones = it->second;
+        return true;
+    }
+
+    Json::Value toJson() const;
 
     void save(
             const Metadata& metadata,
             const arbiter::Endpoint& top,
-            Pool& pool) const;
+            Pool& pool,
+            const RetryPolicy& retry = RetryPolicy()) const;
 
     void analyze(const Metadata& m, bool verbose) const;
     void setStep(uint64_t step) const { m_step = step; }
@@ -83,7 +119,7 @@ private:
     struct Analysis
     {
         Analysis() { }
-        Analysis(const Map& hierarchy, const Map& analyzed, uint64_t step);
+        Analysis(const std::map<NodeKey, uint64_t>& analyzed, uint64_t step);
 
         uint64_t step = 0;
         uint64_t totalFiles = 0;
@@ -101,37 +137,33 @@ private:
 
     using AnalysisSet = std::set<Analysis>;
 
-    std::string filename(const Metadata& m, const Dxyz& dxyz) const
-    {
-        return dxyz.toString() + m.postfix() + ".json";
-    }
+    class Shard;
+
+    Shard& shard(const NodeKey& key) const;
+
+    // Binary search of a snapshot, returning zero if the node is absent.
+    static uint64_t find(const Snapshot& nodes, const Dxyz& key);
 
-    std::string filename(const Metadata& m, const ChunkKey& k) const
+    // A snapshot of the nodes which are reachable from the root.
+    Snapshot reachable() const;
+
+    std::string filename(const Metadata& m, const Dxyz& dxyz) const
     {
-        return filename(m, k.dxyz());
+        return dxyz.toString() + m.postfix() +
+            hierarchyExtension(m.hierarchyType());
     }
 
     void load(
             const Metadata& metadata,
             const arbiter::Endpoint& endpoint,
+            const RetryPolicy& retry,
             const Dxyz& key = Dxyz());
 
-    void save(
-            const Metadata& metadata,
-            const arbiter::Endpoint& endpoint,
-            Pool& pool,
-            const ChunkKey& key,
-            Json::Value& json) const;
-
-    void analyze(
-            const Metadata& m,
-            uint64_t step,
-            const ChunkKey& key,
-            const Dxyz& curr,
-            Map& map) const;
+    std::vector<std::unique_ptr<Shard>> m_shards;
 
     mutable SpinLock m_spin;
-    Map m_map;
+    PackMap m_packs;
+    ZoneMaps m_zones;
     mutable uint64_t m_step = 0;
 };
 
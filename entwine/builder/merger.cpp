@@ -13,8 +13,8 @@
 #include <cassert>
 
 #include <entwine/builder/builder.hpp>
-#include <entwine/builder/clipper.hpp>
 #include <entwine/builder/thread-pools.hpp>
+#include <entwine/io/memory-driver.hpp>
 #include <entwine/types/metadata.hpp>
 #include <entwine/types/subset.hpp>
 #include <entwine/util/pool.hpp>
@@ -25,7 +25,7 @@ namespace entwine
 
 Merger::Merger(const Config& config)
     : m_config(merge(Config::defaults(), config.json()))
-    , m_arbiter(std::make_shared<arbiter::Arbiter>(config["arbiter"]))
+    , m_arbiter(makeArbiter(config["arbiter"]))
     , m_verbose(m_config.verbose())
     , m_threads(m_config.totalThreads())
     , m_pool(m_threads)
@@ -58,8 +58,6 @@ Merger::~Merger() { }
 
 void Merger::go()
 {
-    auto clipper(makeUnique<Clipper>(m_builder->registry()));
-
     m_id = 2;
     while (m_id <= m_of)
     {
@@ -109,10 +107,10 @@ void Merger::go()
             {
                 throw std::runtime_error("A subset could not be created");
             }
-
-            m_builder->merge(*v.at(i), *clipper);
         }
 
+        m_builder->merge(v);
+
         m_id += n;
     }
 
@@ -124,7 +122,6 @@ void Merger::go()
     m_builder->makeWhole();
 
     if (m_verbose) std::cout << "Merge complete.  Saving..." << std::endl;
-    clipper.reset();
     m_builder->save();
     m_builder.reset();
     if (m_verbose) std::cout << "\tFinal save complete." << std::endl;
@@ -0,0 +1,298 @@
+/******************************************************************************
+* Copyright (c) 2018, Connor Manning (connor@hobu.co)
+*
+* Entwine -- Point cloud indexing
+*
+* Entwine is available under the terms of the LGPL2 license. See COPYING
+* for specific license text and more information.
+*
+******************************************************************************/
+
+#include <entwine/builder/plan.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+
+#include <entwine/types/files.hpp>
+#include <entwine/types/metadata.hpp>
+#include <entwine/types/subset.hpp>
+
+namespace entwine
+{
+
+namespace
+{
+    const uint64_t maxSplits(12);
+
+    // Enough cells that each subset spans several of them, so the split
+    // boundaries can follow the data rather than being forced by the grid.
+    uint64_t defaultSplits(const uint64_t of)
+    {
+        uint64_t splits(0);
+        while ((1ULL << (splits * 2)) < of) ++splits;
+        return splits + 3;
+    }
+
+    uint64_t ceilDiv(const uint64_t n, const uint64_t d)
+    {
+        return (n + d - 1) / d;
+    }
+
+    // The range of grid cells [begin, end) touched by the span [lo, hi] along
+    // the given axis, clamped to the grid.
+    std::pair<uint64_t, uint64_t> range(
+            const std::vector<Point>& edges,
+            const double lo,
+            const double hi,
+            double Point::* axis)
+    {
+        const auto less([axis](double v, const Point& p)
+        {
+            return v < p.*axis;
+        });
+
+        const uint64_t cells(edges.size() - 1);
+        const auto first(edges.begin() + 1);
+        const auto last(edges.end() - 1);
+
+        uint64_t begin(std::upper_bound(first, edges.end(), lo, less) - first);
+        uint64_t end(
+                std::upper_bound(edges.begin(), last, hi, less) -
+                edges.begin());
+
+        begin = std::min(begin, cells - 1);
+        end = std::max(end, begin + 1);
+        return std::make_pair(begin, end);
+    }
+}
+
+Plan::Plan(const Metadata& metadata, const uint64_t of, const uint64_t splits)
+    : m_of(of)
+    , m_splits(splits ? splits : defaultSplits(of))
+    , m_edges(Subset::edges(metadata.boundsCubic(), m_splits))
+    , m_weights(cells() * cells(), 0)
+{
+    if (m_of <= 1) throw std::runtime_error("Invalid subset range");
+    if (m_splits > maxSplits) throw std::runtime_error("Invalid plan splits");
+    if (cells() * cells() < m_of)
+    {
+        throw std::runtime_error("Too many subsets for plan splits");
+    }
+
+    const Bounds& cube(metadata.boundsCubic());
+    for (const FileInfo& f : metadata.files().list())
+    {
+        const Bounds* b(f.bounds());
+        if (b && f.points() && cube.overlaps(*b, true))
+        {
+            spread(*b, f.points());
+        }
+    }
+
+    split(0, 0, cells(), cells(), m_of);
+
+    for (Part& part : m_parts)
+    {
+        const std::vector<uint64_t>& c(part.cells);
+        part.points = sum(c[0], c[1], c[2], c[3]);
+        part.bounds = Bounds(
+                Point(m_edges[c[0]].x, m_edges[c[1]].y, cube.min().z),
+                Point(m_edges[c[2]].x, m_edges[c[3]].y, cube.max().z));
+
+        // Match the selection performed by the build itself, where files
+        // without bounds are visited by every subset.
+        for (const FileInfo& f : metadata.files().list())
+        {
+            const Bounds* b(f.boundsEpsilon());
+            if (!b || part.bounds.overlaps(*b, true))
+            {
+                part.files.push_back(f.path());
+            }
+        }
+    }
+}
+
+double Plan::sum(
+        const uint64_t x0,
+        const uint64_t y0,
+        const uint64_t x1,
+        const uint64_t y1) const
+{
+    double total(0);
+    for (uint64_t y(y0); y < y1; ++y)
+    {
+        for (uint64_t x(x0); x < x1; ++x) total += m_weights[y * cells() + x];
+    }
+    return total;
+}
+
+void Plan::spread(const Bounds& bounds, const double points)
+{
+    const Point& min(bounds.min());
+    const Point& max(bounds.max());
+
+    const auto xr(range(m_edges, min.x, max.x, &Point::x));
+    const auto yr(range(m_edges, min.y, max.y, &Point::y));
+
+    // Weight each cell by its overlap with the file.  A file of zero area is
+    // spread evenly over the cells it touches.
+    std::vector<double> areas;
+    double total(0);
+
+    for (uint64_t y(yr.first); y < yr.second; ++y)
+    {
+        const double h(
+                std::min(max.y, m_edges[y + 1].y) -
+                std::max(min.y, m_edges[y].y));
+
+        for (uint64_t x(xr.first); x < xr.second; ++x)
+        {
+            const double w(
+                    std::min(max.x, m_edges[x + 1].x) -
+                    std::max(min.x, m_edges[x].x));
+
+            areas.push_back(std::max(w, 0.0) * std::max(h, 0.0));
+            total += areas.back();
+        }
+    }
+
+    auto area(areas.begin());
+    for (uint64_t y(yr.first); y < yr.second; ++y)
+    {
+        for (uint64_t x(xr.first); x < xr.second; ++x)
+        {
+            const double share(
+                    total > 0 ? *area / total : 1.0 / areas.size());
+            weight(x, y) += points * share;
+            ++area;
+        }
+    }
+}
+
+void Plan::split(
+        const uint64_t x0,
+        const uint64_t y0,
+        const uint64_t x1,
+        const uint64_t y1,
+        const uint64_t k)
+{
+    if (k == 1)
+    {
+        Part part;
+        part.id = m_parts.size() + 1;
+        part.cells = { x0, y0, x1, y1 };
+        m_parts.push_back(part);
+        return;
+    }
+
+    const uint64_t w(x1 - x0);
+    const uint64_t h(y1 - y0);
+    const uint64_t kl(k / 2);
+    const uint64_t kr(k - kl);
+
+    // Each side must retain at least as many cells as the subsets it will
+    // be divided into.
+    const auto bounds([&](bool x)
+    {
+        const uint64_t span(x ? w : h);
+        const uint64_t other(x ? h : w);
+        const uint64_t lo(ceilDiv(kl, other));
+        const uint64_t hi(span - std::min(span, ceilDiv(kr, other)));
+        return std::make_pair(lo, hi);
+    });
+
+    bool alongX(w >= h);
+    auto cuts(bounds(alongX));
+    if (cuts.first > cuts.second)
+    {
+        alongX = !alongX;
+        cuts = bounds(alongX);
+    }
+
+    if (cuts.first > cuts.second)
+    {
+        throw std::runtime_error("Could not split plan region");
+    }
+
+    const uint64_t span(alongX ? w : h);
+    const double total(sum(x0, y0, x1, y1));
+    const double fraction(static_cast<double>(kl) / k);
+
+    // Pick the boundary whose share of the points, or of the area if there
+    // are no points, is closest to the share of subsets on that side.
+    uint64_t best(cuts.first);
+    double bestError(std::numeric_limits<double>::max());
+    double before(0);
+
+    for (uint64_t c(1); c <= cuts.second; ++c)
+    {
+        before += alongX ?
+            sum(x0 + c - 1, y0, x0 + c, y1) :
+            sum(x0, y0 + c - 1, x1, y0 + c);
+
+        if (c < cuts.first) continue;
+
+        const double share(
+                total > 0 ? before / total : static_cast<double>(c) / span);
+        const double error(std::abs(share - fraction));
+
+        if (error < bestError)
+        {
+            best = c;
+            bestError = error;
+        }
+    }
+
+    if (alongX)
+    {
+        split(x0, y0, x0 + best, y1, kl);
+        split(x0 + best, y0, x1, y1, kr);
+    }
+    else
+    {
+        split(x0, y0, x1, y0 + best, kl);
+        split(x0, y0 + best, x1, y1, kr);
+    }
+}
+
+Json::Value Plan::subset(const uint64_t id) const
+{
+    if (!id || id > m_parts.size())
+    {
+        throw std::runtime_error("Invalid plan subset: " + std::to_string(id));
+    }
+
+    const Part& part(m_parts[id - 1]);
+
+    Json::Value json;
+    json["id"] = (Json::UInt64)id;
+    json["of"] = (Json::UInt64)m_of;
+    json["splits"] = (Json::UInt64)m_splits;
+    for (const uint64_t c : part.cells) json["cells"].append((Json::UInt64)c);
+    return json;
+}
+
+Json::Value Plan::toJson() const
+{
+    Json::Value json;
+    json["of"] = (Json::UInt64)m_of;
+    json["splits"] = (Json::UInt64)m_splits;
+
+    for (const Part& part : m_parts)
+    {
+        Json::Value entry;
+        entry["subset"] = subset(part.id);
+        entry["bounds"] = part.bounds.toJson();
+        entry["points"] = (Json::UInt64)std::llround(part.points);
+        for (const auto& path : part.files) entry["files"].append(path);
+        json["subsets"].append(entry);
+    }
+
+    return json;
+}
+
+} // namespace entwine
+
@@ -0,0 +1,89 @@
+/******************************************************************************
+* Copyright (c) 2018, Connor Manning (connor@hobu.co)
+*
+* Entwine -- Point cloud indexing
+*
+* Entwine is available under the terms of the LGPL2 license. See COPYING
+* for specific license text and more information.
+*
+******************************************************************************/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <json/json.h>
+
+#include <entwine/types/bounds.hpp>
+
+namespace entwine
+{
+
+class Metadata;
+
+// Partitions a dataset into subsets of roughly equal point counts, using the
+// bounds and point counts of each input file rather than splitting the cube
+// into equal areas.  The XY extents of the cube are divided into a grid at
+// depth _splits_, each file's points are spread over the grid cells it
+// overlaps in proportion to the overlapping area, and the grid is then
+// recursively split along its longer axis at the cell boundary which best
+// balances the estimated point counts on either side.
+//
+// Since each subset is a rectangle of grid cells, and the grid cells match
+// the nodes at depth _splits_ exactly, every deeper node belongs to a single
+// subset and the results may be merged as usual.
+class Plan
+{
+public:
+    struct Part
+    {
+        uint64_t id = 0;
+
+        // Grid cells covered by this subset: [xBegin, yBegin, xEnd, yEnd).
+        std::vector<uint64_t> cells;
+
+        Bounds bounds;
+        double points = 0;
+
+        // Paths of the input files overlapping this subset.
+        std::vector<std::string> files;
+    };
+
+    // If _splits_ is zero, a grid depth is chosen from the number of subsets.
+    Plan(const Metadata& metadata, uint64_t of, uint64_t splits = 0);
+
+    uint64_t of() const { return m_of; }
+    uint64_t splits() const { return m_splits; }
+    const std::vector<Part>& parts() const { return m_parts; }
+
+    // The subset specification for a build, with a one-based _id_.
+    Json::Value subset(uint64_t id) const;
+
+    Json::Value toJson() const;
+
+private:
+    uint64_t cells() const { return 1ULL << m_splits; }
+    double& weight(uint64_t x, uint64_t y)
+    {
+        return m_weights[y * cells() + x];
+    }
+    double sum(uint64_t x0, uint64_t y0, uint64_t x1, uint64_t y1) const;
+
+    void spread(const Bounds& bounds, double points);
+    void split(uint64_t x0, uint64_t y0, uint64_t x1, uint64_t y1, uint64_t k);
+
+    const uint64_t m_of;
+    const uint64_t m_splits;
+
+    // X and Y edges of the grid cells.
+    const std::vector<Point> m_edges;
+    std::vector<double> m_weights;
+
+    std::vector<Part> m_parts;
+};
+
+} // namespace entwine
+
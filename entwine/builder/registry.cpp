@@ -13,6 +13,7 @@
 #include <pdal/PointView.hpp>
 
 #include <entwine/builder/chunk.hpp>
+#include <entwine/io/ensure.hpp>
 #include <entwine/io/io.hpp>
 #include <entwine/third/arbiter/arbiter.hpp>
 #include <entwine/types/bounds.hpp>
@@ -31,61 +32,237 @@ Registry::Registry(
         const arbiter::Endpoint& out,
         const arbiter::Endpoint& tmp,
         ThreadPools& threadPools,
-        const bool exists)
+        const uint64_t maxWriteBytes,
+        const bool exists,
+        const arbiter::Endpoint* stage,
+        const RetryPolicy& retry)
     : m_metadata(metadata)
     , m_dataEp(out.getSubEndpoint("ept-data"))
     , m_hierEp(out.getSubEndpoint("ept-hierarchy"))
+    , m_stageEp(stage ?
+            makeUnique<arbiter::Endpoint>(stage->getSubEndpoint("ept-data")) :
+            nullptr)
     , m_tmp(tmp)
     , m_threadPools(threadPools)
-    , m_hierarchy(m_metadata, m_hierEp, exists)
-    , m_root(ChunkKey(metadata), m_dataEp, tmp, m_hierarchy)
+    , m_retry(retry)
+    , m_hierarchy(m_metadata, m_hierEp, exists, m_retry)
+    , m_writer(
+            m_metadata,
+            m_dataEp,
+            m_tmp,
+            m_hierarchy,
+            m_threadPools,
+            maxWriteBytes,
+            m_stageEp.get(),
+            m_retry)
+    , m_root(ChunkKey(metadata), m_dataEp, tmp, m_hierarchy, m_writer)
 { }
 
-void Registry::save() const
+void Registry::save()
 {
-    m_hierarchy.save(m_metadata, m_hierEp, m_threadPools.workPool());
+    save(m_hierEp);
 }
 
-void Registry::merge(const Registry& other, Clipper& clipper)
+void Registry::save(const arbiter::Endpoint& hierEp)
 {
-    for (const auto& p : other.hierarchy().map())
-    {
-        const Dxyz& dxyz(p.first);
-        const uint64_t np(p.second);
+    // Nothing may be saved that refers to chunks which failed to be written.
+    m_writer.check();
+    m_writer.savePacks(m_threadPools.workPool());
+    m_hierarchy.save(m_metadata, hierEp, m_threadPools.workPool(), m_retry);
+}
+
+void Registry::merge(const std::vector<const Registry*>& others)
+{
+    Pool& pool(m_threadPools.workPool());
+    const std::size_t errors(pool.errors().size());
+
+    // The sources of each shared node, ordered by depth.
+    std::map<NodeKey, std::vector<const Registry*>> shared;
 
-        if (dxyz.d < m_metadata.sharedDepth())
+    for (const Registry* other : others)
+    {
+        for (const auto& p : other->hierarchy().snapshot())
         {
-            VectorPointTable table(m_metadata.schema());
-            table.setProcess([this, &table, &clipper, &dxyz]()
+            const Dxyz dxyz(p.first.dxyz());
+            const uint64_t np(p.second);
+            if (!np) continue;
+
+            if (dxyz.d < m_metadata.sharedDepth())
             {
-                Voxel voxel;
-                Key pk(m_metadata);
+                shared[p.first].push_back(other);
+                continue;
+            }
 
-                for (auto it(table.begin()); it != table.end(); ++it)
-                {
-                    voxel.initShallow(it.pointRef(), it.data());
-                    const Point point(voxel.point());
-                    pk.init(point, dxyz.d);
+            // Deep nodes belong to exactly one subset.  These are registered
+            // before any points are reinserted, since reinsertion may push
+            // points down into them.
+            assert(!m_hierarchy.get(dxyz));
+            m_hierarchy.set(dxyz, np);
+
+            // Packs are named per subset, so entries remain valid as-is.
+            PackEntry entry;
+            if (other->hierarchy().getPack(dxyz, entry))
+            {
+                m_hierarchy.setPack(dxyz, entry);
+            }
+
+            ZoneMap zones;
+            if (other->hierarchy().getZoneMap(dxyz, zones))
+            {
+                m_hierarchy.setZoneMap(dxyz, zones);
+            }
+        }
+    }
+
+    // Shared nodes which we don't have yet are adopted from their first
+    // source by copying its data verbatim.  The remaining sources, if any,
+    // are then reinserted on top of it.
+    for (auto& p : shared)
+    {
+        const Dxyz dxyz(p.first.dxyz());
+        const Registry& other(*p.second.front());
 
-                    ReffedChunk* rc(&m_root);
-                    for (uint64_t d(0); d < dxyz.d; ++d)
-                    {
-                        rc = &rc->chunk().step(point);
-                    }
+        PackEntry entry;
+        if (m_hierarchy.get(dxyz) || other.hierarchy().getPack(dxyz, entry))
+        {
+            continue;
+        }
+
+        m_hierarchy.set(dxyz, other.hierarchy().get(dxyz));
+        p.second.erase(p.second.begin());
+
+        pool.add([this, &other, dxyz]() { adopt(other, dxyz); });
+    }
+
+    pool.await();
+
+    // Reinsertions proceed one depth at a time, since inserting a node's
+    // points traverses its ancestors and may push points into its
+    // descendants.  Within a depth, each node is reinserted by its own task.
+    for (uint64_t depth(0); depth < m_metadata.sharedDepth(); ++depth)
+    {
+        for (const auto& p : shared)
+        {
+            const Dxyz dxyz(p.first.dxyz());
+            if (dxyz.d != depth || p.second.empty()) continue;
 
-                    rc->insert(voxel, pk, clipper);
+            const std::vector<const Registry*>& sources(p.second);
+            pool.add([this, &sources, dxyz]()
+            {
+                Clipper clipper(*this);
+                for (const Registry* other : sources)
+                {
+                    reinsert(*other, dxyz, clipper);
                 }
             });
-
-            const auto filename(
-                    dxyz.toString() + other.metadata().postfix(dxyz.d));
-            m_metadata.dataIo().read(m_dataEp, m_tmp, filename, table);
         }
-        else
+
+        pool.await();
+    }
+
+    if (pool.errors().size() > errors)
+    {
+        throw std::runtime_error("Merge failed: " + pool.errors().back());
+    }
+}
+
+void Registry::adopt(const Registry& other, const Dxyz& dxyz)
+{
+    const std::string extension(m_metadata.dataIo().extension());
+    const std::string src(
+            dxyz.toString() + other.metadata().postfix(dxyz.d) + extension);
+    const std::string dst(
+            dxyz.toString() + m_metadata.postfix(dxyz.d) + extension);
+
+    ensurePut(m_dataEp, dst, *ensureGet(m_dataEp, src, m_retry), m_retry);
+
+    ZoneMap zones;
+    if (other.hierarchy().getZoneMap(dxyz, zones))
+    {
+        m_hierarchy.setZoneMap(dxyz, zones);
+    }
+}
+
+void Registry::reinsert(
+        const Registry& other,
+        const Dxyz& dxyz,
+        Clipper& clipper)
+{
+    VectorPointTable table(m_metadata.schema());
+    table.setProcess([this, &table, &clipper, &dxyz]()
+    {
+        Voxel voxel;
+        Key pk(m_metadata);
+
+        for (auto it(table.begin()); it != table.end(); ++it)
         {
-            assert(!m_hierarchy.get(dxyz));
-            m_hierarchy.set(dxyz, np);
+            voxel.initShallow(it.pointRef(), it.data());
+            const Point point(voxel.point());
+            pk.init(point, dxyz.d);
+
+            ReffedChunk* rc(&m_root);
+            for (uint64_t d(0); d < dxyz.d; ++d) rc = &rc->step(point);
+
+            rc->insert(voxel, pk, clipper, true);
         }
+    });
+
+    const auto filename(dxyz.toString() + other.metadata().postfix(dxyz.d));
+
+    PackEntry entry;
+    if (other.hierarchy().getPack(dxyz, entry))
+    {
+        m_metadata.dataIo().read(
+                m_dataEp,
+                m_tmp,
+                filename,
+                entry,
+                table,
+                m_retry);
+    }
+    else
+    {
+        m_metadata.dataIo().read(m_dataEp, m_tmp, filename, table, m_retry);
+    }
+}
+
+void Registry::makeWhole(const std::string& postfix)
+{
+    // Let all pending chunk writes land first.
+    m_threadPools.cycle();
+
+    Pool& pool(m_threadPools.workPool());
+    const std::size_t errors(pool.errors().size());
+    const std::string extension(m_metadata.dataIo().extension());
+
+    // Shared nodes were written under our subset postfix, so give them their
+    // final names.  Packed nodes are referenced by their pack entries.
+    for (const auto& p : m_hierarchy.snapshot())
+    {
+        const Dxyz dxyz(p.first.dxyz());
+        if (dxyz.d >= m_metadata.sharedDepth() || !p.second) continue;
+
+        PackEntry entry;
+        if (m_hierarchy.getPack(dxyz, entry)) continue;
+
+        const std::string src(dxyz.toString() + postfix + extension);
+        const std::string dst(dxyz.toString() + extension);
+
+        pool.add([this, src, dst]()
+        {
+            ensurePut(
+                    m_dataEp,
+                    dst,
+                    *ensureGet(m_dataEp, src, m_retry),
+                    m_retry);
+        });
+    }
+
+    pool.await();
+
+    if (pool.errors().size() > errors)
+    {
+        throw std::runtime_error("Merge failed: " + pool.errors().back());
     }
 }
 
@@ -14,11 +14,13 @@
 #include <memory>
 #include <mutex>
 #include <set>
+#include <string>
 #include <vector>
 
 #include <json/json.h>
 
 #include <entwine/builder/chunk.hpp>
+#include <entwine/builder/chunk-writer.hpp>
 #include <entwine/builder/clipper.hpp>
 #include <entwine/builder/hierarchy.hpp>
 #include <entwine/builder/thread-pools.hpp>
@@ -26,11 +28,6 @@
 #include <entwine/util/pool.hpp>
 #include <entwine/util/unique.hpp>
 
-namespace arbiter
-{
-    class Endpoint;
-}
-
 namespace entwine
 {
 
@@ -44,14 +41,32 @@ public:
             const arbiter::Endpoint& out,
             const arbiter::Endpoint& tmp,
             ThreadPools& threadPools,
-            bool exists = false);
-
-    void save() const;
-    void merge(const Registry& other, Clipper& clipper);
-
-    void addPoint(Voxel& voxel, Key& key, Clipper& clipper)
+            uint64_t maxWriteBytes,
+            bool exists = false,
+            const arbiter::Endpoint* stage = nullptr,
+            const RetryPolicy& retry = RetryPolicy());
+
+    // Save the hierarchy, to the output by default.  Chunks are written to
+    // the ept-data directory of _stage_, if given, until a checkpoint commits
+    // them.
+    void save();
+    void save(const arbiter::Endpoint& hierEp);
+
+    // Merge the registries of other subsets into this one.  Nodes deeper than
+    // the shared depth are unique to one subset, so only their hierarchy
+    // entries are copied.  Shared nodes which we do not yet contain are
+    // copied from their first source without decoding, and any further
+    // sources are reinserted concurrently, one task per node.
+    void merge(const std::vector<const Registry*>& others);
+
+    // Once merging is complete and our metadata no longer describes a
+    // subset, rename our shared nodes from their subset _postfix_.
+    void makeWhole(const std::string& postfix);
+
+    // Returns false if the point was rejected as too deep for the hierarchy.
+    bool addPoint(Voxel& voxel, Key& key, Clipper& clipper)
     {
-        m_root.insert(voxel, key, clipper);
+        return m_root.insert(voxel, key, clipper) != Insertion::Rejected;
     }
 
     void purge() { m_root.empty(); }
@@ -61,14 +76,21 @@ public:
 
     const Metadata& metadata() const { return m_metadata; }
     const Hierarchy& hierarchy() const { return m_hierarchy; }
+    ChunkWriter::Info writeInfo() const { return m_writer.info(); }
 
 private:
+    void adopt(const Registry& other, const Dxyz& dxyz);
+    void reinsert(const Registry& other, const Dxyz& dxyz, Clipper& clipper);
+
     const Metadata& m_metadata;
     const arbiter::Endpoint m_dataEp;
     const arbiter::Endpoint m_hierEp;
+    const std::unique_ptr<arbiter::Endpoint> m_stageEp;
     const arbiter::Endpoint& m_tmp;
     ThreadPools& m_threadPools;
+    const RetryPolicy m_retry;
     Hierarchy m_hierarchy;
+    ChunkWriter m_writer;
 
     ReffedChunk m_root;
 };
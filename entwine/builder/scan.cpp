@@ -17,6 +17,7 @@
 #include <pdal/util/OStream.hpp>
 
 #include <entwine/builder/thread-pools.hpp>
+#include <entwine/io/memory-driver.hpp>
 #include <entwine/types/reprojection.hpp>
 #include <entwine/types/srs.hpp>
 #include <entwine/types/vector-point-table.hpp>
@@ -39,8 +40,8 @@ namespace
 
 Scan::Scan(const Config config)
     : m_in(merge(Config::defaults(), config.json()))
-    , m_arbiter(m_in["arbiter"])
-    , m_tmp(m_arbiter.getEndpoint(m_in.tmp()))
+    , m_arbiter(makeArbiter(m_in["arbiter"]))
+    , m_tmp(m_arbiter->getEndpoint(m_in.tmp()))
     , m_re(m_in.reprojection())
     , m_files(m_in.input())
 {
@@ -75,8 +76,7 @@ Config Scan::go()
     std::string path(m_in.output());
     if (path.size())
     {
-        arbiter::Arbiter arbiter(m_in["arbiter"]);
-        arbiter::Endpoint ep(arbiter.getEndpoint(path));
+        arbiter::Endpoint ep(m_arbiter->getEndpoint(path));
 
         if (ep.isLocal())
         {
@@ -117,7 +117,7 @@ void Scan::add(FileInfo& f)
 
     m_pool->add([this, &f]()
     {
-        if (m_in.trustHeaders() && m_arbiter.isHttpDerived(f.path()))
+        if (m_in.trustHeaders() && m_arbiter->isHttpDerived(f.path()))
         {
             const std::string driver = pdal::StageFactory::inferReaderDriver(
                     f.path());
@@ -127,7 +127,7 @@ void Scan::add(FileInfo& f)
         }
         else
         {
-            auto localHandle(m_arbiter.getLocalHandle(f.path(), m_tmp));
+            auto localHandle(m_arbiter->getLocalHandle(f.path(), m_tmp));
             add(f, localHandle->localPath());
         }
     });
@@ -147,7 +147,8 @@ void Scan::addLas(FileInfo& f)
     uint32_t pointOffset(0);
     uint64_t evlrOffset(0);
 
-    std::string header(m_arbiter.get(f.path(), rangeHeaders(0, maxHeaderSize)));
+    std::string header(
+            m_arbiter->get(f.path(), rangeHeaders(0, maxHeaderSize)));
 
     std::stringstream headerStream(
             header,
@@ -180,14 +181,14 @@ void Scan::addLas(FileInfo& f)
     header = headerStream.str();
     std::vector<char> data(header.data(), header.data() + headerSize);
 
-    const auto vlrs = m_arbiter.getBinary(
+    const auto vlrs = m_arbiter->getBinary(
             f.path(),
             rangeHeaders(headerSize, pointOffset));
     data.insert(data.end(), vlrs.begin(), vlrs.end());
 
     if (minorVersion >= 4)
     {
-        const auto evlrs = m_arbiter.getBinary(
+        const auto evlrs = m_arbiter->getBinary(
                 f.path(),
                 rangeHeaders(evlrOffset));
         data.insert(data.end(), evlrs.begin(), evlrs.end());
@@ -206,7 +207,8 @@ void Scan::addLas(FileInfo& f)
 
 void Scan::addRanged(FileInfo& f)
 {
-    const auto data = m_arbiter.getBinary(f.path(), rangeHeaders(0, 16384));
+    const auto data =
+        m_arbiter->getBinary(f.path(), rangeHeaders(0, 16384));
 
     const std::string ext(arbiter::Arbiter::getExtension(f.path()));
     const std::string basename(
@@ -58,7 +58,7 @@ private:
     bool m_done = false;
     std::unique_ptr<Pool> m_pool;
     std::size_t m_index = 0;
-    arbiter::Arbiter m_arbiter;
+    std::shared_ptr<arbiter::Arbiter> m_arbiter;
     arbiter::Endpoint m_tmp;
     std::unique_ptr<Reprojection> m_re;
     mutable std::mutex m_mutex;
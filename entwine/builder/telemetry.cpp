@@ -0,0 +1,322 @@
+/******************************************************************************
+* Copyright (c) 2018, Connor Manning (connor@hobu.co)
+*
+* Entwine -- Point cloud indexing
+*
+* Entwine is available under the terms of the LGPL2 license. See COPYING
+* for specific license text and more information.
+*
+******************************************************************************/
+
+#include <entwine/builder/telemetry.hpp>
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include <unistd.h>
+#endif
+
+#include <entwine/builder/builder.hpp>
+#include <entwine/builder/config.hpp>
+#include <entwine/builder/registry.hpp>
+#include <entwine/builder/thread-pools.hpp>
+#include <entwine/third/arbiter/arbiter.hpp>
+#include <entwine/types/files.hpp>
+#include <entwine/types/metadata.hpp>
+#include <entwine/util/json.hpp>
+
+namespace entwine
+{
+
+namespace
+{
+    Telemetry::Format toFormat(const std::string& s)
+    {
+        if (s.empty() || s == "json") return Telemetry::Format::Json;
+        if (s == "prometheus") return Telemetry::Format::Prometheus;
+        throw std::runtime_error("Invalid metrics format: " + s);
+    }
+
+    uint64_t residentBytes()
+    {
+#ifdef __linux__
+        std::ifstream stream("/proc/self/statm");
+        uint64_t size(0), resident(0);
+        if (stream >> size >> resident)
+        {
+            return resident * ::sysconf(_SC_PAGESIZE);
+        }
+#endif
+        return 0;
+    }
+
+    bool isRate(const metrics::Counter c)
+    {
+        return c != metrics::Counter::ChunksCreated &&
+            c != metrics::Counter::ChunksDestroyed;
+    }
+
+    const std::string prefix("entwine_");
+
+    double seconds(const metrics::Histogram& h)
+    {
+        return h.sum / 1000000.0;
+    }
+
+    double rate(const double n, const double seconds)
+    {
+        return seconds > 0 ? n / seconds : 0.0;
+    }
+}
+
+Telemetry::Telemetry(const Config& config)
+    : m_path(arbiter::fs::expandTilde(config["metrics"].asString()))
+    , m_format(toFormat(config["metricsFormat"].asString()))
+    , m_start(now())
+    , m_baseline(metrics::snapshot())
+    , m_lastTime(m_start)
+    , m_last(m_baseline)
+{
+    if (enabled() && m_format == Format::Json)
+    {
+        // Truncate any previous output.
+        std::ofstream stream(m_path, std::ios::out | std::ios::trunc);
+        if (!stream.good())
+        {
+            throw std::runtime_error("Could not open metrics file " + m_path);
+        }
+    }
+}
+
+uint64_t Telemetry::total(const metrics::Counter c) const
+{
+    return metrics::snapshot()[c] - m_baseline[c];
+}
+
+void Telemetry::sample(const Builder& builder)
+{
+    if (!enabled()) return;
+
+    // This runs on the progress thread, where an exception would terminate
+    // the build, so a failed sample is only logged.  The next sample then
+    // covers its interval as well.
+    try
+    {
+        const TimePoint time(now());
+        const metrics::Snapshot current(metrics::snapshot());
+        const Json::Value g(gauges(builder));
+
+        if (m_format == Format::Json)
+        {
+            const double seconds(
+                    std::chrono::duration<double>(time - m_lastTime).count());
+            writeJson(current - m_baseline, current - m_last, seconds, g);
+        }
+        else
+        {
+            writePrometheus(current - m_baseline, g);
+        }
+
+        m_lastTime = time;
+        m_last = current;
+    }
+    catch (std::exception& e)
+    {
+        std::cout << "Failed to sample metrics: " << e.what() << std::endl;
+    }
+    catch (...)
+    {
+        std::cout << "Failed to sample metrics: unknown error" << std::endl;
+    }
+}
+
+Json::Value Telemetry::throughput() const
+{
+    using metrics::Counter;
+    using metrics::Timer;
+
+    const metrics::Snapshot d(metrics::snapshot() - m_baseline);
+    const double elapsed(
+            std::chrono::duration<double>(now() - m_start).count());
+
+    Json::Value json;
+    json["seconds"] = elapsed;
+
+    Json::Value& insert(json["insert"]);
+    insert["points"] = (Json::UInt64)d[Counter::PointsInserted];
+    insert["rate"] = rate(d[Counter::PointsInserted], elapsed);
+
+    Json::Value& encode(json["encode"]);
+    encode["chunks"] = (Json::UInt64)d[Counter::ChunksWritten];
+    encode["points"] = (Json::UInt64)d[Counter::PointsEncoded];
+    encode["bytes"] = (Json::UInt64)d[Counter::BytesEncoded];
+    encode["discardedBytes"] = (Json::UInt64)d[Counter::BytesDiscarded];
+    encode["seconds"] = seconds(d[Timer::Encode]);
+    encode["rate"] = rate(d[Counter::PointsEncoded], seconds(d[Timer::Encode]));
+
+    Json::Value& upload(json["upload"]);
+    upload["bytes"] = (Json::UInt64)d[Counter::BytesUploaded];
+    upload["seconds"] = seconds(d[Timer::Upload]);
+    upload["rate"] = rate(d[Counter::BytesUploaded], seconds(d[Timer::Upload]));
+
+    Json::Value& wakeup(json["wakeup"]);
+    wakeup["chunks"] = (Json::UInt64)d[Counter::ChunksWoken];
+    wakeup["points"] = (Json::UInt64)d[Counter::PointsWoken];
+    wakeup["seconds"] = seconds(d[Timer::Wakeup]);
+
+    const metrics::Histogram& start(d[Timer::FileStart]);
+    Json::Value& files(json["files"]);
+    files["started"] = (Json::UInt64)start.count;
+    files["seconds"] = seconds(start);
+    files["p50"] = start.quantile(0.5) / 1000000.0;
+    files["p99"] = start.quantile(0.99) / 1000000.0;
+
+    Json::Value& wait(json["wait"]);
+    wait["budget"] = seconds(d[Timer::BudgetWait]);
+    wait["write"] = seconds(d[Timer::WriteWait]);
+    wait["spin"] = seconds(d[Timer::SpinWait]);
+
+    return json;
+}
+
+Json::Value Telemetry::gauges(const Builder& builder) const
+{
+    ThreadPools& pools(builder.threadPools());
+    const ChunkWriter::Info writes(builder.registry().writeInfo());
+    const metrics::Snapshot current(metrics::snapshot());
+    const Files& files(builder.metadata().files());
+
+    Json::Value json;
+
+    const std::vector<std::pair<std::string, const Pool*>> p{
+        { "work", &pools.workPool() },
+        { "clip", &pools.clipPool() },
+        { "encode", &pools.encodePool() },
+        { "upload", &pools.uploadPool() }
+    };
+
+    for (const auto& pair : p)
+    {
+        json["pool_" + pair.first + "_queued"] =
+            (Json::UInt64)pair.second->queued();
+        json["pool_" + pair.first + "_running"] =
+            (Json::UInt64)pair.second->running();
+    }
+
+    json["chunks_alive"] = (Json::UInt64)(
+            current[metrics::Counter::ChunksCreated] -
+            current[metrics::Counter::ChunksDestroyed]);
+    json["writes_encoding"] = (Json::UInt64)writes.encoding;
+    json["writes_uploading"] = (Json::UInt64)writes.uploading;
+    json["write_bytes"] = (Json::UInt64)writes.bytes;
+    json["resident_bytes"] = (Json::UInt64)residentBytes();
+
+    const double totalPoints(files.totalPoints());
+    json["progress"] = totalPoints ?
+        files.pointStats().inserts() / totalPoints : 0.0;
+
+    return json;
+}
+
+void Telemetry::writeJson(
+        const metrics::Snapshot& total,
+        const metrics::Snapshot& interval,
+        const double seconds,
+        const Json::Value& gauges) const
+{
+    Json::Value json;
+    json["time"] = std::chrono::duration<double>(now() - m_start).count();
+    json["interval"] = seconds;
+
+    for (std::size_t i(0); i < metrics::counterCount; ++i)
+    {
+        const auto c(static_cast<metrics::Counter>(i));
+        const std::string name(metrics::name(c));
+
+        json["counters"][name] = (Json::UInt64)total[c];
+        if (isRate(c) && seconds > 0)
+        {
+            json["rates"][name] = interval[c] / seconds;
+        }
+    }
+
+    for (std::size_t i(0); i < metrics::timerCount; ++i)
+    {
+        const auto t(static_cast<metrics::Timer>(i));
+        json["timers"][metrics::name(t)] = interval[t].toJson();
+    }
+
+    json["gauges"] = gauges;
+
+    std::ofstream stream(m_path, std::ios::out | std::ios::app);
+    stream << toFastString(json);
+    if (!stream.good())
+    {
+        throw std::runtime_error("Could not write metrics to " + m_path);
+    }
+}
+
+void Telemetry::writePrometheus(
+        const metrics::Snapshot& total,
+        const Json::Value& gauges) const
+{
+    std::ostringstream ss;
+
+    for (std::size_t i(0); i < metrics::counterCount; ++i)
+    {
+        const auto c(static_cast<metrics::Counter>(i));
+        const std::string name(prefix + metrics::name(c) + "_total");
+        ss << "# TYPE " << name << " counter\n" <<
+            name << " " << total[c] << "\n";
+    }
+
+    for (std::size_t i(0); i < metrics::timerCount; ++i)
+    {
+        const auto t(static_cast<metrics::Timer>(i));
+        const metrics::Histogram& h(total[t]);
+        const std::string name(prefix + metrics::name(t) + "_seconds");
+
+        ss << "# TYPE " << name << " histogram\n";
+
+        uint64_t cumulative(0);
+        for (std::size_t b(0); b < metrics::Histogram::size - 1; ++b)
+        {
+            cumulative += h.buckets[b];
+            ss << name << "_bucket{le=\"" <<
+                metrics::Histogram::upper(b) / 1000000.0 << "\"} " <<
+                cumulative << "\n";
+        }
+
+        ss << name << "_bucket{le=\"+Inf\"} " << h.count << "\n" <<
+            name << "_sum " << h.sum / 1000000.0 << "\n" <<
+            name << "_count " << h.count << "\n";
+    }
+
+    for (const std::string& key : gauges.getMemberNames())
+    {
+        const std::string name(prefix + key);
+        ss << "# TYPE " << name << " gauge\n" <<
+            name << " " << gauges[key].asDouble() << "\n";
+    }
+
+    // Replace the previous sample atomically, since a collector may read it
+    // at any time.
+    const std::string partial(m_path + ".partial");
+    std::ofstream stream(partial, std::ios::out | std::ios::trunc);
+    stream << ss.str();
+    stream.close();
+
+    if (!stream.good() || std::rename(partial.c_str(), m_path.c_str()) != 0)
+    {
+        throw std::runtime_error("Could not write metrics to " + m_path);
+    }
+}
+
+} // namespace entwine
+
@@ -0,0 +1,84 @@
+/******************************************************************************
+* Copyright (c) 2018, Connor Manning (connor@hobu.co)
+*
+* Entwine -- Point cloud indexing
+*
+* Entwine is available under the terms of the LGPL2 license. See COPYING
+* for specific license text and more information.
+*
+******************************************************************************/
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include <json/json.h>
+
+#include <entwine/util/metrics.hpp>
+#include <entwine/util/time.hpp>
+
+namespace entwine
+{
+
+class Builder;
+class Config;
+
+// Periodic export of build metrics.  Each sample combines the process-wide
+// counters and timers of metrics::snapshot() with gauges read from a Builder:
+// thread pool queue depths, in-flight chunk writes, resident chunks, and
+// memory held.
+//
+// In the "json" format, each sample is appended to the output as a single
+// line, with timers and rates covering the interval since the previous
+// sample.  In the "prometheus" format, the output is atomically replaced by
+// the latest sample in the Prometheus text exposition format, for collection
+// by a node exporter's textfile collector.
+class Telemetry
+{
+public:
+    enum class Format { Json, Prometheus };
+
+    // Accepts the config keys "metrics", a local path, and "metricsFormat".
+    Telemetry(const Config& config);
+
+    bool enabled() const { return !m_path.empty(); }
+
+    // Counters accumulated since construction.
+    uint64_t total(metrics::Counter c) const;
+
+    // Write a sample if enabled.  Never throws: a sample which cannot be
+    // written is logged and skipped.
+    void sample(const Builder& builder);
+
+    // Where the time has gone since construction, separating insertion into
+    // the tree from chunk encoding and upload.  Timer totals are summed over
+    // all threads, so they may exceed the elapsed time.  Comparing a build
+    // against one with the "null" data type isolates the cost of the tree.
+    Json::Value throughput() const;
+
+private:
+    Json::Value gauges(const Builder& builder) const;
+
+    void writeJson(
+            const metrics::Snapshot& total,
+            const metrics::Snapshot& interval,
+            double seconds,
+            const Json::Value& gauges) const;
+
+    void writePrometheus(
+            const metrics::Snapshot& total,
+            const Json::Value& gauges) const;
+
+    const std::string m_path;
+    const Format m_format;
+
+    const TimePoint m_start;
+    const metrics::Snapshot m_baseline;
+
+    TimePoint m_lastTime;
+    metrics::Snapshot m_last;
+};
+
+} // namespace entwine
+
@@ -16,18 +16,31 @@ namespace entwine
 {
 
 ThreadPools::ThreadPools(const std::size_t t, const bool verbose)
-    : ThreadPools(getWorkThreads(t), getClipThreads(t), verbose)
+    : ThreadPools(
+            getWorkThreads(t),
+            getClipThreads(t),
+            heuristics::uploadThreads,
+            verbose)
 { }
 
 ThreadPools::ThreadPools(
         const std::size_t workThreads,
         const std::size_t clipThreads,
+        const std::size_t uploadThreads,
         const bool verbose)
     : m_workPool(std::max<std::size_t>(1, workThreads), 1, verbose)
     , m_clipPool(
             std::max<std::size_t>(4, clipThreads),
             std::max<std::size_t>(4, clipThreads) * m_workPool.numThreads(),
             verbose)
+    , m_encodePool(
+            m_clipPool.numThreads(),
+            m_clipPool.numThreads() * 4,
+            verbose)
+    , m_uploadPool(
+            std::max<std::size_t>(1, uploadThreads),
+            std::max<std::size_t>(1, uploadThreads) * 4,
+            verbose)
 { }
 
 std::size_t ThreadPools::getWorkThreads(
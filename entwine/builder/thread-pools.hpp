@@ -23,29 +23,39 @@ public:
     ThreadPools(
             std::size_t workThreads,
             std::size_t clipThreads,
+            std::size_t uploadThreads = heuristics::uploadThreads,
             bool verbose = true);
 
     Pool& workPool() { return m_workPool; }
     Pool& clipPool() { return m_clipPool; }
+    Pool& encodePool() { return m_encodePool; }
+    Pool& uploadPool() { return m_uploadPool; }
 
     const Pool& workPool() const { return m_workPool; }
     const Pool& clipPool() const { return m_clipPool; }
+    const Pool& encodePool() const { return m_encodePool; }
+    const Pool& uploadPool() const { return m_uploadPool; }
 
     std::size_t size() const
     {
         return m_workPool.numThreads() + m_clipPool.numThreads();
     }
 
+    // Each stage feeds the next, so joining in order drains all of them.
     void join()
     {
         m_workPool.join();
         m_clipPool.join();
+        m_encodePool.join();
+        m_uploadPool.join();
     }
 
     void go()
     {
         m_workPool.go();
         m_clipPool.go();
+        m_encodePool.go();
+        m_uploadPool.go();
     }
 
     void cycle()
@@ -65,6 +75,11 @@ public:
 private:
     Pool m_workPool;
     Pool m_clipPool;
+
+    // Chunk serialization is split into a CPU-bound encoding stage and an
+    // IO-bound upload stage - see ChunkWriter.
+    Pool m_encodePool;
+    Pool m_uploadPool;
 };
 
 } // namespace entwine
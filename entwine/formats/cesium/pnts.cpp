@@ -35,11 +35,18 @@ std::vector<char> Pnts::build()
         buildNormals(table);
     });
 
-    m_tileset.metadata().dataIo().read(
-            m_tileset.in().getSubEndpoint("ept-data"),
-            m_tileset.tmp(),
-            m_key.get().toString(),
-            table);
+    const auto dataEp(m_tileset.in().getSubEndpoint("ept-data"));
+    const DataIo& dataIo(m_tileset.metadata().dataIo());
+    const std::string filename(m_key.get().toString());
+
+    if (const PackEntry* entry = m_tileset.pack(m_key.get()))
+    {
+        dataIo.read(dataEp, m_tileset.tmp(), filename, *entry, table);
+    }
+    else
+    {
+        dataIo.read(dataEp, m_tileset.tmp(), filename, table, RetryPolicy());
+    }
 
     return buildFile();
 }
@@ -11,6 +11,7 @@
 #include <entwine/formats/cesium/pnts.hpp>
 #include <entwine/formats/cesium/tile.hpp>
 #include <entwine/formats/cesium/tileset.hpp>
+#include <entwine/io/memory-driver.hpp>
 
 namespace entwine
 {
@@ -18,10 +19,10 @@ namespace cesium
 {
 
 Tileset::Tileset(const Json::Value& config)
-    : m_arbiter(config["arbiter"])
-    , m_in(m_arbiter.getEndpoint(config["input"].asString()))
-    , m_out(m_arbiter.getEndpoint(config["output"].asString()))
-    , m_tmp(m_arbiter.getEndpoint(
+    : m_arbiter(makeArbiter(config["arbiter"]))
+    , m_in(m_arbiter->getEndpoint(config["input"].asString()))
+    , m_out(m_arbiter->getEndpoint(config["output"].asString()))
+    , m_tmp(m_arbiter->getEndpoint(
                 config.isMember("tmp") ?
                     config["tmp"].asString() : arbiter::fs::getTempPath()))
     , m_metadata(m_in)
@@ -81,16 +82,25 @@ ColorType Tileset::getColorType(const Json::Value& config) const
 
 Tileset::HierarchyTree Tileset::getHierarchyTree(const ChunkKey& root) const
 {
-    HierarchyTree h;
-    const std::string file("ept-hierarchy/" + root.get().toString() + ".json");
-    const Json::Value fetched(parse(m_in.get(file)));
+    const HierarchyType type(m_metadata.hierarchyType());
+    const std::string file(
+            "ept-hierarchy/" + root.get().toString() +
+            hierarchyExtension(type));
 
-    for (const std::string& key : fetched.getMemberNames())
+    // The pack entries of this subtree are stored beside its hierarchy file.
+    if (m_metadata.packThreshold())
     {
-        h[Dxyz(key)] = fetched[key].asInt64();
+        const PackMap packs(
+                loadPackIndex(
+                    m_in.getSubEndpoint("ept-hierarchy"),
+                    root.get(),
+                    m_metadata.postfix()));
+
+        std::lock_guard<std::mutex> lock(m_packMutex);
+        m_packs.insert(packs.begin(), packs.end());
     }
 
-    return h;
+    return decodeHierarchy(type, m_in.getBinary(file));
 }
 
 void Tileset::build() const
@@ -10,6 +10,10 @@
 
 #pragma once
 
+#include <mutex>
+
+#include <entwine/io/hierarchy-io.hpp>
+#include <entwine/io/pack.hpp>
 #include <entwine/third/arbiter/arbiter.hpp>
 #include <entwine/types/key.hpp>
 #include <entwine/types/metadata.hpp>
@@ -33,7 +37,7 @@ enum class ColorType
 // https://github.com/AnalyticalGraphicsInc/3d-tiles#tilesetjson
 class Tileset
 {
-    using HierarchyTree = std::map<Dxyz, int64_t>;
+    using HierarchyTree = HierarchyNodes;
 
 public:
     Tileset(const Json::Value& config);
@@ -58,6 +62,15 @@ public:
 
     Pool& threadPool() const { return m_threadPool; }
 
+    // Entries are loaded with their hierarchy subtree, before any of its
+    // tiles are built, and are never removed.
+    const PackEntry* pack(const Dxyz& key) const
+    {
+        std::lock_guard<std::mutex> lock(m_packMutex);
+        const auto it(m_packs.find(key));
+        return it != m_packs.end() ? &it->second : nullptr;
+    }
+
 private:
     void build(const ChunkKey& ck) const;
 
@@ -69,7 +82,7 @@ private:
     ColorType getColorType(const Json::Value& config) const;
     HierarchyTree getHierarchyTree(const ChunkKey& root) const;
 
-    arbiter::Arbiter m_arbiter;
+    std::shared_ptr<arbiter::Arbiter> m_arbiter;
     const arbiter::Endpoint m_in;
     const arbiter::Endpoint m_out;
     const arbiter::Endpoint m_tmp;
@@ -79,6 +92,8 @@ private:
     const bool m_truncate;
     const bool m_hasNormals;
     const double m_rootGeometricError;
+    mutable std::mutex m_packMutex;
+    mutable PackMap m_packs;
 
     mutable Pool m_threadPool;
 };
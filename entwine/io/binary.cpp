@@ -15,14 +15,16 @@
 #include <pdal/PointRef.hpp>
 
 #include <entwine/types/binary-point-table.hpp>
+#include <entwine/types/mapped-point-table.hpp>
 #include <entwine/types/scale-offset.hpp>
 #include <entwine/util/executor.hpp>
+#include <entwine/util/unique.hpp>
 
 namespace entwine
 {
 
-void Binary::write(
-        const arbiter::Endpoint& out,
+std::unique_ptr<std::vector<char>> Binary::encode(
+        const arbiter::Endpoint* out,
         const arbiter::Endpoint& tmp,
         const std::string& filename,
         const Bounds& bounds,
@@ -78,40 +80,73 @@ void Binary::write(
         }
     }
 
-    ensurePut(out, filename + ".bin", dst.data());
+    return makeUnique<std::vector<char>>(std::move(dst.data()));
+}
+
+std::unique_ptr<MappedPointTable> Binary::map(
+        const arbiter::Endpoint& out,
+        const std::string& filename) const
+{
+    std::unique_ptr<MappedPointTable> table;
+    if (!out.isLocal()) return table;
+
+    auto file(
+            MappedFile::create(
+                arbiter::fs::expandTilde(
+                    out.prefixedRoot() + filename + extension())));
+
+    if (file)
+    {
+        table = makeUnique<MappedPointTable>(
+                m_metadata.schema(),
+                m_metadata.outSchema(),
+                std::move(file));
+    }
+
+    return table;
 }
 
 void Binary::read(
         const arbiter::Endpoint& out,
         const arbiter::Endpoint& tmp,
         const std::string& filename,
+        VectorPointTable& dst,
+        const RetryPolicy& policy) const
+{
+    if (auto src = map(out, filename)) copy(*src, dst);
+    else DataIo::read(out, tmp, filename, dst, policy);
+}
+
+void Binary::decode(
+        const arbiter::Endpoint& tmp,
+        const std::string& filename,
+        std::vector<char>& data,
         VectorPointTable& dst) const
 {
-    VectorPointTable src(
+    MappedPointTable src(
+            m_metadata.schema(),
             m_metadata.outSchema(),
-            std::move(*ensureGet(out, filename + ".bin")));
-    const uint64_t np(src.capacity());
-    assert(np == table.capacity());
+            std::move(data));
+    copy(src, dst);
+}
 
-    // For reading, our destination schema will always be normalized (i.e. XYZ
-    // as doubles).  So we can just copy the full dimension list and then
-    // transform XYZ in place, if necessary.
+void Binary::copy(MappedPointTable& src, VectorPointTable& dst) const
+{
+    // Our destination schema is always normalized (i.e. XYZ as doubles), and
+    // the source table performs that conversion as each field is read.
     const auto& layout(m_metadata.schema().pdalLayout());
-    pdal::DimTypeList dimTypes(layout.dimTypes());
+    const pdal::DimTypeList dimTypes(layout.dimTypes());
 
+    const uint64_t np(src.size());
+    const uint64_t capacity(dst.capacity());
     pdal::PointRef srcPr(src, 0);
-    pdal::PointRef dstPr(dst, 0);
 
-    Point p;
-
-    const Schema& outSchema(m_metadata.outSchema());
-    std::unique_ptr<ScaleOffset> so(outSchema.scaleOffset());
+    uint64_t filled(0);
 
     for (uint64_t i(0); i < np; ++i)
     {
         srcPr.setPointId(i);
-        dstPr.setPointId(i);
-        char* pos(dst.getPoint(i));
+        char* pos(dst.getPoint(filled));
 
         for (const pdal::DimType& dim : dimTypes)
         {
@@ -121,21 +156,14 @@ void Binary::read(
                     dim.m_type);
         }
 
-        if (so)
+        if (++filled == capacity)
         {
-            p.x = dstPr.getFieldAs<double>(DimId::X);
-            p.y = dstPr.getFieldAs<double>(DimId::Y);
-            p.z = dstPr.getFieldAs<double>(DimId::Z);
-
-            p = Point::unscale(p, so->scale(), so->offset());
-
-            dstPr.setField(DimId::X, p.x);
-            dstPr.setField(DimId::Y, p.y);
-            dstPr.setField(DimId::Z, p.z);
+            dst.clear(filled);
+            filled = 0;
         }
     }
 
-    dst.clear(np);
+    if (filled) dst.clear(filled);
 }
 
 } // namespace entwine
@@ -24,8 +24,10 @@ public:
 
     virtual std::string type() const override { return "binary"; }
 
-    virtual void write(
-            const arbiter::Endpoint& out,
+    virtual std::string extension() const override { return ".bin"; }
+
+    virtual std::unique_ptr<std::vector<char>> encode(
+            const arbiter::Endpoint* out,
             const arbiter::Endpoint& tmp,
             const std::string& filename,
             const Bounds& bounds,
@@ -35,7 +37,21 @@ public:
             const arbiter::Endpoint& out,
             const arbiter::Endpoint& tmp,
             const std::string& filename,
+            VectorPointTable& table,
+            const RetryPolicy& policy) const override;
+
+    virtual void decode(
+            const arbiter::Endpoint& tmp,
+            const std::string& filename,
+            std::vector<char>& data,
             VectorPointTable& table) const override;
+
+    virtual std::unique_ptr<MappedPointTable> map(
+            const arbiter::Endpoint& out,
+            const std::string& filename) const override;
+
+private:
+    void copy(MappedPointTable& src, VectorPointTable& dst) const;
 };
 
 } // namespace entwine
@@ -10,134 +10,499 @@
 
 #include <entwine/io/ensure.hpp>
 
-#include <chrono>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <fstream>
 #include <iostream>
+#include <map>
 #include <mutex>
+#include <random>
+#include <sstream>
 #include <thread>
 
+#include <entwine/util/pool.hpp>
+#include <entwine/util/time.hpp>
+#include <entwine/util/unique.hpp>
+
+namespace entwine
+{
+
 namespace
 {
-    const std::size_t retries(40);
-    std::mutex mutex;
+    using ms = std::chrono::milliseconds;
+
+    const std::size_t maxLatencySamples(256);
+
+    // Hedged requests to a host with no concurrency limit are still bounded.
+    const std::size_t defaultHedgeThreads(64);
+
+    using Data = std::unique_ptr<std::vector<char>>;
+
+    // A name, unique across processes and calls, under which a local file is
+    // written in full before being renamed into place.
+    std::string staged(const std::string& path)
+    {
+        static const std::string process(
+                std::to_string(std::random_device()()));
+        static std::atomic<uint64_t> counter(0);
+
+        return path + ".tmp-" + process + "-" + std::to_string(++counter);
+    }
 
-    void sleep(std::size_t tried, std::string method, std::string path)
+    // Tracks the concurrency and latency of requests to a single host.
+    class Host
     {
-        std::this_thread::sleep_for(std::chrono::seconds(tried));
+    public:
+        void acquire(const std::size_t limit)
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cv.wait(lock, [this, limit]()
+            {
+                return !limit || m_active < limit;
+            });
+            ++m_active;
+        }
+
+        void release()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                --m_active;
+            }
+            m_cv.notify_one();
+        }
+
+        void record(const ms latency)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_latencies.push_back(latency);
+            if (m_latencies.size() > maxLatencySamples)
+            {
+                m_latencies.pop_front();
+            }
+        }
+
+        // Returns zero if there are not enough samples to estimate.
+        ms percentile(const double p, const std::size_t minSamples) const
+        {
+            std::vector<ms> v;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (m_latencies.size() < std::max<std::size_t>(minSamples, 1))
+                {
+                    return ms(0);
+                }
+                v.assign(m_latencies.begin(), m_latencies.end());
+            }
+
+            const std::size_t i(
+                    std::min<std::size_t>(v.size() * p, v.size() - 1));
+            std::nth_element(v.begin(), v.begin() + i, v.end());
+            return std::max(v[i], ms(1));
+        }
+
+        // Requests which may be raced against a duplicate run here, so that
+        // the caller may return as soon as either succeeds.  The number of
+        // threads follows the host's concurrency limit.
+        Pool& pool(const std::size_t limit)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!m_pool)
+            {
+                const std::size_t threads(limit ? limit : defaultHedgeThreads);
+                m_pool = makeUnique<Pool>(threads, threads, false);
+            }
+            return *m_pool;
+        }
+
+    private:
+        mutable std::mutex m_mutex;
+        std::condition_variable m_cv;
+        std::size_t m_active = 0;
+        std::deque<ms> m_latencies;
+        std::unique_ptr<Pool> m_pool;
+    };
+
+    class Slot
+    {
+    public:
+        Slot(Host* host, const std::size_t limit)
+            : m_host(host)
+        {
+            if (m_host) m_host->acquire(limit);
+        }
+
+        ~Slot() { if (m_host) m_host->release(); }
+
+    private:
+        Host* m_host;
+    };
+
+    std::mutex hostsMutex;
+    std::map<std::string, std::unique_ptr<Host>> hosts;
+
+    // Local endpoints are neither throttled nor hedged.
+    Host* getHost(const arbiter::Endpoint& ep)
+    {
+        if (ep.isLocal()) return nullptr;
+
+        const std::string root(ep.prefixedRoot());
+        const std::size_t protocol(root.find("://"));
+        const std::size_t begin(
+                protocol == std::string::npos ? 0 : protocol + 3);
+        const std::size_t end(root.find('/', begin));
+        const std::string name(root.substr(0, end));
+
+        std::lock_guard<std::mutex> lock(hostsMutex);
+        auto& host(hosts[name]);
+        if (!host) host = makeUnique<Host>();
+        return host.get();
+    }
+
+    Data timedGet(
+            const arbiter::Endpoint& ep,
+            const std::string& path,
+            Host* host,
+            const std::size_t limit)
+    {
+        Slot slot(host, limit);
+
+        const TimePoint start(now());
+        Data data(ep.tryGetBinary(path));
+        if (data && host) host->record(ms(since<ms>(start)));
+        return data;
+    }
+
+    struct Race
+    {
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::size_t running = 0;
+        Data data;
+
+        // When the first request acquired its slot and was actually sent.
+        bool started = false;
+        TimePoint start;
+
+        bool done() const { return data || !running; }
+    };
+
+    void run(
+            Pool& pool,
+            std::shared_ptr<Race> race,
+            const arbiter::Endpoint& ep,
+            const std::string& path,
+            Host* host,
+            const std::size_t limit)
+    {
+        {
+            std::lock_guard<std::mutex> lock(race->mutex);
+            ++race->running;
+        }
+
+        pool.add([race, ep, path, host, limit]()
+        {
+            Data data;
+
+            try
+            {
+                Slot slot(host, limit);
+
+                {
+                    std::lock_guard<std::mutex> lock(race->mutex);
+                    if (!race->started)
+                    {
+                        race->started = true;
+                        race->start = now();
+                    }
+                }
+                race->cv.notify_all();
+
+                // The other request may have succeeded while we waited.
+                bool skip(false);
+                {
+                    std::lock_guard<std::mutex> lock(race->mutex);
+                    skip = !!race->data;
+                }
+
+                if (!skip)
+                {
+                    const TimePoint start(now());
+                    data = ep.tryGetBinary(path);
+                    if (data) host->record(ms(since<ms>(start)));
+                }
+            }
+            catch (...) { }
+
+            {
+                std::lock_guard<std::mutex> lock(race->mutex);
+                --race->running;
+                if (data && !race->data) race->data = std::move(data);
+            }
+            race->cv.notify_all();
+        });
+    }
+
+    Data hedgedGet(
+            const arbiter::Endpoint& ep,
+            const std::string& path,
+            const RetryPolicy& p)
+    {
+        Host* host(getHost(ep));
+
+        const ms threshold(
+                host && p.hedgePercentile > 0 ?
+                    host->percentile(p.hedgePercentile, p.hedgeMinSamples) :
+                    ms(0));
+
+        // Without a latency estimate there is nothing to race, so the request
+        // is made directly from this thread.
+        if (threshold == ms(0)) return timedGet(ep, path, host, p.concurrency);
+
+        Pool& pool(host->pool(p.concurrency));
+        auto race(std::make_shared<Race>());
+        run(pool, race, ep, path, host, p.concurrency);
 
-        std::lock_guard<std::mutex> lock(mutex);
-        std::cout <<
-            "\tFailed " << method << " attempt " << tried << ": " << path <<
-            std::endl;
+        std::unique_lock<std::mutex> lock(race->mutex);
+        const auto done([&race]() { return race->done(); });
+
+        // The hedge is timed from when the request was actually sent, so
+        // waiting for a slot or a thread never triggers a duplicate.
+        race->cv.wait(lock, [&race]()
+        {
+            return race->started || race->done();
+        });
+
+        if (!race->cv.wait_until(lock, race->start + threshold, done))
+        {
+            lock.unlock();
+
+            // A saturated host would only be slowed further by duplicates.
+            if (pool.running() + pool.queued() < pool.size())
+            {
+                run(pool, race, ep, path, host, p.concurrency);
+            }
+
+            lock.lock();
+        }
+
+        race->cv.wait(lock, done);
+        return std::move(race->data);
     }
+}
 
-    void suicide(std::string method)
+RetryPolicy::RetryPolicy(const Json::Value& json)
+{
+    if (json.isMember("tries")) tries = json["tries"].asUInt64();
+    if (json.isMember("baseDelay")) baseDelay = ms(json["baseDelay"].asInt64());
+    if (json.isMember("maxDelay")) maxDelay = ms(json["maxDelay"].asInt64());
+    if (json.isMember("concurrency"))
+    {
+        concurrency = json["concurrency"].asUInt64();
+    }
+    if (json.isMember("hedgePercentile"))
+    {
+        hedgePercentile = json["hedgePercentile"].asDouble();
+    }
+    if (json.isMember("hedgeMinSamples"))
     {
-        std::lock_guard<std::mutex> lock(mutex);
-        std::cout <<
-            "\tFailed to " << method << " data: persistent failure.\n" <<
-            "\tThis is a non-recoverable error." <<
-            std::endl;
+        hedgeMinSamples = json["hedgeMinSamples"].asUInt64();
+    }
 
-        throw std::runtime_error("Fatal error - could not " + method);
+    if (!tries) throw std::runtime_error("Retry tries must be positive");
+    if (hedgePercentile < 0 || hedgePercentile > 1)
+    {
+        throw std::runtime_error("Invalid hedge percentile");
     }
 }
 
-namespace entwine
+Json::Value RetryPolicy::toJson() const
 {
+    Json::Value json;
+    json["tries"] = (Json::UInt64)tries;
+    json["baseDelay"] = (Json::UInt64)baseDelay.count();
+    json["maxDelay"] = (Json::UInt64)maxDelay.count();
+    json["concurrency"] = (Json::UInt64)concurrency;
+    json["hedgePercentile"] = hedgePercentile;
+    json["hedgeMinSamples"] = (Json::UInt64)hedgeMinSamples;
+    return json;
+}
+
+void backoff(
+        const std::size_t tried,
+        const std::string& method,
+        const std::string path,
+        const RetryPolicy& p)
+{
+    const std::size_t shift(std::min<std::size_t>(tried, 30));
+    const ms cap(std::min(p.maxDelay, ms(p.baseDelay.count() << shift)));
+
+    thread_local std::mt19937_64 gen(std::random_device{}());
+    std::uniform_int_distribution<ms::rep> dist(0, cap.count());
+    const ms delay(dist(gen));
+
+    std::ostringstream ss;
+    ss << "\tFailed " << method << " attempt " << tried << ": " << path <<
+        " - retrying in " << delay.count() << "ms\n";
+    std::cout << ss.str() << std::flush;
+
+    std::this_thread::sleep_for(delay);
+}
+
+void fail(const std::string& method, const std::string& path)
+{
+    std::ostringstream ss;
+    ss << "\tFailed to " << method << " " << path <<
+        ": persistent failure.\n\tThis is a non-recoverable error.\n";
+    std::cout << ss.str() << std::flush;
+
+    throw std::runtime_error("Fatal error - could not " + method);
+}
 
 void ensurePut(
         const arbiter::Endpoint& endpoint,
         const std::string& path,
-        const std::vector<char>& data)
+        const std::vector<char>& data,
+        const RetryPolicy& policy)
 {
-    bool done(false);
-    std::size_t tried(0);
-
-    while (!done)
+#ifndef _WIN32
+    // Local files may be memory-mapped by readers, or by a continued build,
+    // and truncating a mapped file faults its mappings.  So rather than
+    // rewriting a file in place, we replace it with a new one, which leaves
+    // existing mappings referring to the old contents.
+    if (endpoint.isLocal())
     {
-        try
-        {
-            endpoint.put(path, data);
-            done = true;
-        }
-        catch (...)
+        const std::string root(
+                arbiter::fs::expandTilde(endpoint.prefixedRoot()));
+
+        retry("PUT", endpoint.prefixedRoot() + path, [&]()
         {
-            if (++tried < retries)
+            const std::string tmp(staged(path));
+            endpoint.put(tmp, data);
+
+            if (std::rename((root + tmp).c_str(), (root + path).c_str()))
             {
-                sleep(tried, "PUT", endpoint.prefixedRoot() + path);
+                arbiter::fs::remove(root + tmp);
+                throw std::runtime_error("Could not rename " + root + tmp);
             }
-            else suicide("PUT");
-        }
+
+            return true;
+        }, policy);
+
+        return;
     }
+#endif
+
+    Host* host(getHost(endpoint));
+
+    retry("PUT", endpoint.prefixedRoot() + path, [&]()
+    {
+        Slot slot(host, policy.concurrency);
+        endpoint.put(path, data);
+        return true;
+    }, policy);
 }
 
 std::unique_ptr<std::vector<char>> ensureGet(
         const arbiter::Endpoint& endpoint,
-        const std::string& path)
+        const std::string& path,
+        const RetryPolicy& policy)
 {
-    std::unique_ptr<std::vector<char>> data;
+    return retry("GET", endpoint.prefixedRoot() + path, [&]()
+    {
+        return hedgedGet(endpoint, path, policy);
+    }, policy);
+}
 
-    bool done(false);
-    std::size_t tried(0);
+std::unique_ptr<std::vector<char>> ensureGetRange(
+        const arbiter::Endpoint& endpoint,
+        const std::string& path,
+        const uint64_t offset,
+        const uint64_t size,
+        const RetryPolicy& policy)
+{
+    const std::string fullPath(endpoint.prefixedRoot() + path);
 
-    while (!done)
+    if (endpoint.isLocal())
     {
-        data = endpoint.tryGetBinary(path);
-
-        if (data)
+        return retry("GET", fullPath, [&]()
         {
-            done = true;
-        }
-        else
+            Data data;
+
+            std::ifstream stream(
+                    arbiter::fs::expandTilde(fullPath),
+                    std::ios::in | std::ios::binary);
+            if (!stream.good()) return data;
+
+            data = makeUnique<std::vector<char>>(size);
+            stream.seekg(offset);
+            stream.read(data->data(), size);
+            if (static_cast<uint64_t>(stream.gcount()) != size) data.reset();
+            return data;
+        }, policy);
+    }
+
+    Host* host(getHost(endpoint));
+
+    if (endpoint.isHttpDerived())
+    {
+        arbiter::http::Headers headers;
+        headers["Range"] = "bytes=" + std::to_string(offset) + "-" +
+            std::to_string(offset + size - 1);
+
+        return retry("GET", fullPath, [&]()
         {
-            if (++tried < retries)
-            {
-                sleep(tried, "GET", endpoint.prefixedRoot() + path);
-            }
-            else suicide("GET");
-        }
+            Slot slot(host, policy.concurrency);
+            Data data(endpoint.tryGetBinary(path, headers));
+            if (data && data->size() != size) data.reset();
+            return data;
+        }, policy);
     }
 
-    return data;
+    auto data(ensureGet(endpoint, path, policy));
+    if (offset + size > data->size())
+    {
+        throw std::runtime_error("Invalid range for " + fullPath);
+    }
+
+    return makeUnique<std::vector<char>>(
+            data->begin() + offset,
+            data->begin() + offset + size);
 }
 
 std::string ensureGetString(
         const arbiter::Endpoint& endpoint,
-        const std::string& path)
+        const std::string& path,
+        const RetryPolicy& policy)
 {
-    if (auto data = ensureGet(endpoint, path))
+    if (auto data = ensureGet(endpoint, path, policy))
     {
         return std::string(data->begin(), data->end());
     }
     return std::string();
 }
 
-std::string ensureGet(const arbiter::Arbiter& a, const std::string& path)
+std::string ensureGet(
+        const arbiter::Arbiter& a,
+        const std::string& path,
+        const RetryPolicy& policy)
 {
-    std::unique_ptr<std::string> data;
-
-    bool done(false);
-    std::size_t tried(0);
+    return *retry("GET", path, [&]() { return a.tryGet(path); }, policy);
+}
 
-    while (!done)
+std::unique_ptr<arbiter::fs::LocalHandle> ensureLocalHandle(
+        const arbiter::Arbiter& a,
+        const std::string& path,
+        const arbiter::Endpoint& tmp,
+        const RetryPolicy& policy)
+{
+    return retry("GET", path, [&]()
     {
-        data = a.tryGet(path);
-
-        if (data)
-        {
-            done = true;
-        }
-        else
-        {
-            if (++tried < retries)
-            {
-                sleep(tried, "GET", path);
-            }
-            else suicide("GET");
-        }
-    }
-
-    return *data;
+        return a.getLocalHandle(path, tmp);
+    }, policy);
 }
 
 } // namespace entwine
@@ -10,37 +10,137 @@
 
 #pragma once
 
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
 #include <memory>
 #include <string>
 #include <vector>
 
+#include <json/json.h>
+
 #include <entwine/third/arbiter/arbiter.hpp>
 
 namespace entwine
 {
 
+// Settings for the behavior of the ensure* functions, each of which takes a
+// policy explicitly and otherwise uses the defaults below.
+struct RetryPolicy
+{
+    RetryPolicy() = default;
+    explicit RetryPolicy(const Json::Value& json);
+
+    Json::Value toJson() const;
+
+    // Number of attempts before a failure is considered persistent.
+    std::size_t tries = 40;
+
+    // The delay before retry N is drawn uniformly from the range
+    // [0, min(maxDelay, baseDelay * 2^N)].
+    std::chrono::milliseconds baseDelay = std::chrono::milliseconds(250);
+    std::chrono::milliseconds maxDelay = std::chrono::milliseconds(30000);
+
+    // Maximum number of simultaneous requests to a single remote host, or
+    // zero for no limit.
+    std::size_t concurrency = 0;
+
+    // If non-zero, a GET that takes longer than this percentile of recently
+    // observed latencies for its host will be duplicated, and the first
+    // successful response is used.  Latencies are only tracked for remote
+    // endpoints, and hedging does not begin until hedgeMinSamples requests
+    // have completed.  A duplicate is only sent if one of the host's hedging
+    // threads, of which there are as many as its concurrency limit, is idle.
+    double hedgePercentile = 0.95;
+    std::size_t hedgeMinSamples = 32;
+};
+
+// Sleep prior to retry number _tried_, logging the failure.
+void backoff(
+        std::size_t tried,
+        const std::string& method,
+        std::string path,
+        const RetryPolicy& policy = RetryPolicy());
+
+// Throw after a persistent failure.
+void fail(const std::string& method, const std::string& path);
+
+// Call f, which returns something convertible to bool, until its result is
+// truthy or the maximum number of tries is exhausted.  Exceptions thrown by f
+// are treated as failures.
+template<typename F>
+auto retry(
+        const std::string& method,
+        const std::string& path,
+        F f,
+        const RetryPolicy& policy = RetryPolicy()) -> decltype(f())
+{
+    for (std::size_t tried(1); tried < policy.tries; ++tried)
+    {
+        try
+        {
+            if (auto result = f()) return result;
+        }
+        catch (...) { }
+
+        backoff(tried, method, path, policy);
+    }
+
+    // Final attempt - let any exception propagate.
+    if (auto result = f()) return result;
+    fail(method, path);
+    return decltype(f())();
+}
+
 void ensurePut(
         const arbiter::Endpoint& endpoint,
         const std::string& path,
-        const std::vector<char>& data);
+        const std::vector<char>& data,
+        const RetryPolicy& policy = RetryPolicy());
 
 inline void ensurePut(
         const arbiter::Endpoint& endpoint,
         const std::string& path,
-        const std::string& data)
+        const std::string& data,
+        const RetryPolicy& policy = RetryPolicy())
 {
-    ensurePut(endpoint, path, std::vector<char>(data.begin(), data.end()));
+    ensurePut(
+            endpoint,
+            path,
+            std::vector<char>(data.begin(), data.end()),
+            policy);
 }
 
 std::unique_ptr<std::vector<char>> ensureGet(
         const arbiter::Endpoint& endpoint,
-        const std::string& path);
+        const std::string& path,
+        const RetryPolicy& policy = RetryPolicy());
+
+// Get the _size_ bytes beginning at _offset_.  Local files are read directly,
+// and HTTP-derived endpoints use a range request.  Other endpoints fall back
+// to fetching the entire file.
+std::unique_ptr<std::vector<char>> ensureGetRange(
+        const arbiter::Endpoint& endpoint,
+        const std::string& path,
+        uint64_t offset,
+        uint64_t size,
+        const RetryPolicy& policy = RetryPolicy());
 
 std::string ensureGetString(
         const arbiter::Endpoint& endpoint,
-        const std::string& path);
+        const std::string& path,
+        const RetryPolicy& policy = RetryPolicy());
 
-std::string ensureGet(const arbiter::Arbiter& a, const std::string& path);
+std::string ensureGet(
+        const arbiter::Arbiter& a,
+        const std::string& path,
+        const RetryPolicy& policy = RetryPolicy());
+
+std::unique_ptr<arbiter::fs::LocalHandle> ensureLocalHandle(
+        const arbiter::Arbiter& a,
+        const std::string& path,
+        const arbiter::Endpoint& tmp,
+        const RetryPolicy& policy = RetryPolicy());
 
 } // namespace entwine
 
@@ -0,0 +1,294 @@
+/******************************************************************************
+* Copyright (c) 2018, Connor Manning (connor@hobu.co)
+*
+* Entwine -- Point cloud indexing
+*
+* Entwine is available under the terms of the LGPL2 license. See COPYING
+* for specific license text and more information.
+*
+******************************************************************************/
+
+#include <entwine/io/hierarchy-io.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include <entwine/types/node-key.hpp>
+#include <entwine/util/json.hpp>
+
+namespace entwine
+{
+
+namespace
+{
+    // The binary layout, with all integers little-endian:
+    //
+    //  "EHB1"                  magic
+    //  uint32_t                reserved (zero)
+    //  uint64_t                number of nodes N
+    //  uint64_t[N]             locational codes, ascending
+    //  uint64_t[ceil(N/64)]    offset of every 64th count within the counts
+    //  varint[N]               count + 1 for each node (0 marks a subtree)
+    const char magic[] = "EHB1";
+    const std::size_t headerSize(16);
+    const uint64_t blockSize(64);
+
+    const uint64_t maxDepth(binaryHierarchyMaxDepth);
+
+    // Only the low word of a NodeKey is stored.
+    uint64_t toCode(const Dxyz& key)
+    {
+        return NodeKey(key).lo();
+    }
+
+    Dxyz fromCode(const uint64_t code)
+    {
+        return NodeKey(0, code).dxyz();
+    }
+
+    uint64_t readU64(const char* pos)
+    {
+        uint64_t v(0);
+        for (std::size_t i(0); i < 8; ++i)
+        {
+            const uint8_t b(pos[i]);
+            v |= static_cast<uint64_t>(b) << (8 * i);
+        }
+        return v;
+    }
+
+    void writeU64(std::vector<char>& data, uint64_t v)
+    {
+        for (std::size_t i(0); i < 8; ++i)
+        {
+            data.push_back(static_cast<char>(v & 0xff));
+            v >>= 8;
+        }
+    }
+
+    void writeVarint(std::vector<char>& data, uint64_t v)
+    {
+        while (v >= 0x80)
+        {
+            data.push_back(static_cast<char>((v & 0x7f) | 0x80));
+            v >>= 7;
+        }
+        data.push_back(static_cast<char>(v));
+    }
+
+    uint64_t readVarint(const char*& pos, const char* end)
+    {
+        uint64_t v(0);
+        for (uint64_t shift(0); pos < end && shift < 64; shift += 7)
+        {
+            const uint8_t b(*pos++);
+            v |= static_cast<uint64_t>(b & 0x7f) << shift;
+            if (!(b & 0x80)) return v;
+        }
+        throw std::runtime_error("Invalid binary hierarchy count");
+    }
+
+    std::vector<char> encodeBinary(const HierarchyNodes& nodes)
+    {
+        std::vector<uint64_t> codes;
+        codes.reserve(nodes.size());
+
+        for (const auto& p : nodes)
+        {
+            if (p.first.d > maxDepth)
+            {
+                throw std::runtime_error(
+                        "Binary hierarchy does not support node " +
+                        p.first.toString());
+            }
+            codes.push_back(toCode(p.first));
+        }
+
+        // The map order is by depth and then by XYZ, so the locational codes
+        // within each depth must be sorted.
+        std::vector<std::size_t> order(codes.size());
+        for (std::size_t i(0); i < order.size(); ++i) order[i] = i;
+        std::sort(
+                order.begin(),
+                order.end(),
+                [&codes](std::size_t a, std::size_t b)
+                {
+                    return codes[a] < codes[b];
+                });
+
+        std::vector<int64_t> counts;
+        counts.reserve(nodes.size());
+        for (const auto& p : nodes) counts.push_back(p.second);
+
+        std::vector<char> data(magic, magic + 4);
+        data.resize(8, 0);
+        writeU64(data, codes.size());
+
+        for (const std::size_t i : order) writeU64(data, codes[i]);
+
+        std::vector<char> varints;
+        std::vector<uint64_t> blocks;
+
+        for (std::size_t j(0); j < order.size(); ++j)
+        {
+            if (j % blockSize == 0) blocks.push_back(varints.size());
+            const int64_t n(counts[order[j]]);
+            writeVarint(varints, n < 0 ? 0 : static_cast<uint64_t>(n) + 1);
+        }
+
+        for (const uint64_t b : blocks) writeU64(data, b);
+        data.insert(data.end(), varints.begin(), varints.end());
+
+        return data;
+    }
+}
+
+std::vector<char> encodeHierarchy(
+        const HierarchyType type,
+        const HierarchyNodes& nodes)
+{
+    if (type == HierarchyType::binary) return encodeBinary(nodes);
+
+    Json::Value json(Json::objectValue);
+    for (const auto& p : nodes)
+    {
+        json[p.first.toString()] = static_cast<Json::Int64>(p.second);
+    }
+
+    const std::string s(toFastString(json));
+    return std::vector<char>(s.begin(), s.end());
+}
+
+HierarchyNodes decodeHierarchy(
+        const HierarchyType type,
+        const std::vector<char>& data)
+{
+    HierarchyNodes nodes;
+
+    if (type == HierarchyType::json)
+    {
+        const Json::Value json(parse(std::string(data.begin(), data.end())));
+        for (const auto& key : json.getMemberNames())
+        {
+            nodes[Dxyz(key)] = json[key].asInt64();
+        }
+        return nodes;
+    }
+
+    return HierarchyPage(data).nodes();
+}
+
+HierarchyPage::HierarchyPage(HierarchyNodes nodes)
+    : m_nodes(std::move(nodes))
+{ }
+
+HierarchyPage::HierarchyPage(std::vector<char> binary)
+    : m_data(std::move(binary))
+{
+    init(m_data.data(), m_data.size());
+}
+
+HierarchyPage::HierarchyPage(std::unique_ptr<MappedFile> binary)
+    : m_file(std::move(binary))
+{
+    init(m_file->data(), m_file->size());
+}
+
+void HierarchyPage::init(const char* data, const std::size_t size)
+{
+    if (size < headerSize || std::memcmp(data, magic, 4))
+    {
+        throw std::runtime_error("Invalid binary hierarchy");
+    }
+
+    m_binary = true;
+    m_begin = data;
+    m_size = size;
+    m_np = readU64(data + 8);
+
+    const uint64_t blocks((m_np + blockSize - 1) / blockSize);
+    if (m_np > size || headerSize + (m_np + blocks) * 8 > size)
+    {
+        throw std::runtime_error("Invalid binary hierarchy size");
+    }
+
+    m_keys = data + headerSize;
+    m_blocks = m_keys + m_np * 8;
+    m_counts = m_blocks + blocks * 8;
+}
+
+bool HierarchyPage::find(const Dxyz& key, int64_t& count) const
+{
+    if (!m_binary)
+    {
+        const auto it(m_nodes.find(key));
+        if (it == m_nodes.end()) return false;
+        count = it->second;
+        return true;
+    }
+
+    if (key.d > maxDepth) return false;
+    const uint64_t code(toCode(key));
+
+    uint64_t lo(0);
+    uint64_t hi(m_np);
+    while (lo < hi)
+    {
+        const uint64_t mid(lo + (hi - lo) / 2);
+        if (readU64(m_keys + mid * 8) < code) lo = mid + 1;
+        else hi = mid;
+    }
+
+    if (lo == m_np || readU64(m_keys + lo * 8) != code) return false;
+
+    // Decode forward from the start of this node's block of counts.
+    const char* end(m_begin + m_size);
+    const char* pos(m_counts + readU64(m_blocks + (lo / blockSize) * 8));
+    if (pos >= end) throw std::runtime_error("Invalid binary hierarchy");
+
+    uint64_t v(0);
+    for (uint64_t i(lo - lo % blockSize); i <= lo; ++i)
+    {
+        v = readVarint(pos, end);
+    }
+
+    count = v ? static_cast<int64_t>(v - 1) : -1;
+    return true;
+}
+
+HierarchyNodes HierarchyPage::nodes() const
+{
+    if (!m_binary) return m_nodes;
+
+    // The counts are stored in key order, so they are decoded in one pass.
+    HierarchyNodes nodes;
+    const char* end(m_begin + m_size);
+    const char* pos(m_counts);
+
+    for (uint64_t i(0); i < m_np; ++i)
+    {
+        const uint64_t v(readVarint(pos, end));
+        nodes[fromCode(readU64(m_keys + i * 8))] =
+            v ? static_cast<int64_t>(v - 1) : -1;
+    }
+
+    return nodes;
+}
+
+uint64_t HierarchyPage::size() const
+{
+    return m_binary ? m_np : m_nodes.size();
+}
+
+std::size_t HierarchyPage::bytes() const
+{
+    if (m_binary) return m_size;
+
+    // Each node of a std::map also carries its tree pointers and color.
+    return m_nodes.size() *
+        (sizeof(HierarchyNodes::value_type) + 4 * sizeof(void*));
+}
+
+} // namespace entwine
+
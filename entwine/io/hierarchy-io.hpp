@@ -0,0 +1,79 @@
+/******************************************************************************
+* Copyright (c) 2018, Connor Manning (connor@hobu.co)
+*
+* Entwine -- Point cloud indexing
+*
+* Entwine is available under the terms of the LGPL2 license. See COPYING
+* for specific license text and more information.
+*
+******************************************************************************/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <entwine/io/hierarchy-type.hpp>
+#include <entwine/types/key.hpp>
+#include <entwine/util/mapped-file.hpp>
+
+namespace entwine
+{
+
+// The contents of a single hierarchy file.  A negative count marks the root
+// of a further subtree which is stored in its own file.
+using HierarchyNodes = std::map<Dxyz, int64_t>;
+
+std::vector<char> encodeHierarchy(
+        HierarchyType type,
+        const HierarchyNodes& nodes);
+
+HierarchyNodes decodeHierarchy(
+        HierarchyType type,
+        const std::vector<char>& data);
+
+// A read-only hierarchy file for lookups.  Binary files are searched in
+// place, either in memory or memory-mapped, so they are never expanded.
+class HierarchyPage
+{
+public:
+    explicit HierarchyPage(HierarchyNodes nodes);
+    explicit HierarchyPage(std::vector<char> binary);
+    explicit HierarchyPage(std::unique_ptr<MappedFile> binary);
+
+    // Returns false if this node does not exist in this file.
+    bool find(const Dxyz& key, int64_t& count) const;
+
+    // Every node of this file.
+    HierarchyNodes nodes() const;
+
+    uint64_t size() const;
+
+    // Approximate memory usage.
+    std::size_t bytes() const;
+
+private:
+    void init(const char* data, std::size_t size);
+
+    // Parsed JSON.
+    HierarchyNodes m_nodes;
+
+    // Binary, which may be held in either form.
+    std::vector<char> m_data;
+    std::unique_ptr<MappedFile> m_file;
+
+    bool m_binary = false;
+    const char* m_begin = nullptr;
+    std::size_t m_size = 0;
+    uint64_t m_np = 0;
+    const char* m_keys = nullptr;
+    const char* m_blocks = nullptr;
+    const char* m_counts = nullptr;
+};
+
+} // namespace entwine
+
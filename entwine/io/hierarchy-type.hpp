@@ -0,0 +1,56 @@
+/******************************************************************************
+* Copyright (c) 2018, Connor Manning (connor@hobu.co)
+*
+* Entwine -- Point cloud indexing
+*
+* Entwine is available under the terms of the LGPL2 license. See COPYING
+* for specific license text and more information.
+*
+******************************************************************************/
+
+#pragma once
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+namespace entwine
+{
+
+enum class HierarchyType
+{
+    // One JSON object per file, mapping "D-X-Y-Z" keys to point counts.
+    json,
+
+    // Sorted 64-bit locational codes followed by varint-encoded counts, which
+    // may be searched in place without parsing.  Supports depths up to 21.
+    binary
+};
+
+// Binary locational codes are only unique while they fit in a single word.
+const uint64_t binaryHierarchyMaxDepth(21);
+
+inline HierarchyType toHierarchyType(const std::string& s)
+{
+    if (s.empty() || s == "json")   return HierarchyType::json;
+    else if (s == "binary")         return HierarchyType::binary;
+    else throw std::runtime_error("Invalid hierarchy type: " + s);
+}
+
+inline std::string toString(HierarchyType t)
+{
+    switch (t)
+    {
+        case HierarchyType::json: return "json";
+        case HierarchyType::binary: return "binary";
+        default: throw std::runtime_error("Invalid hierarchy type enum");
+    }
+}
+
+inline std::string hierarchyExtension(HierarchyType t)
+{
+    return t == HierarchyType::binary ? ".bin" : ".json";
+}
+
+} // namespace entwine
+
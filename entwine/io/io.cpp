@@ -14,6 +14,7 @@
 
 #include <entwine/io/binary.hpp>
 #include <entwine/io/laszip.hpp>
+#include <entwine/io/null.hpp>
 #include <entwine/io/zstandard.hpp>
 
 #include <entwine/util/unique.hpp>
@@ -25,6 +26,7 @@ std::unique_ptr<DataIo> DataIo::create(const Metadata& m, std::string type)
 {
     if (type == "laszip") return makeUnique<Laz>(m);
     if (type == "binary") return makeUnique<Binary>(m);
+    if (type == "null") return makeUnique<Null>(m);
     /*
     if (type == "zstandard") return makeUnique<Zstandard>(m);
     */
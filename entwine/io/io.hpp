@@ -13,10 +13,13 @@
 #include <cstdint>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include <json/json.h>
 
 #include <entwine/io/ensure.hpp>
+#include <entwine/io/pack.hpp>
+#include <entwine/types/mapped-point-table.hpp>
 #include <entwine/types/metadata.hpp>
 #include <entwine/types/vector-point-table.hpp>
 
@@ -32,21 +35,81 @@ public:
     static std::unique_ptr<DataIo> create(const Metadata& m, std::string type);
 
     virtual std::string type() const = 0;
+    virtual std::string extension() const = 0;
 
-    virtual void write(
+    // Serialize the table and return the resulting data, which should be
+    // stored at filename + extension().  If _out_ is non-null and the data
+    // has already been written to its final destination there, returns null.
+    virtual std::unique_ptr<std::vector<char>> encode(
+            const arbiter::Endpoint* out,
+            const arbiter::Endpoint& tmp,
+            const std::string& filename,
+            const Bounds& bounds,
+            BlockPointTable& table) const = 0;
+
+    // Deserialize data previously produced by encode.
+    virtual void decode(
+            const arbiter::Endpoint& tmp,
+            const std::string& filename,
+            std::vector<char>& data,
+            VectorPointTable& table) const = 0;
+
+    void write(
             const arbiter::Endpoint& out,
             const arbiter::Endpoint& tmp,
             const std::string& filename,
             const Bounds& bounds,
-            BlockPointTable& table) const
-    { }
+            BlockPointTable& table,
+            const RetryPolicy& policy = RetryPolicy()) const
+    {
+        if (auto data = encode(&out, tmp, filename, bounds, table))
+        {
+            ensurePut(out, filename + extension(), *data, policy);
+        }
+    }
 
     virtual void read(
             const arbiter::Endpoint& out,
             const arbiter::Endpoint& tmp,
             const std::string& filename,
-            VectorPointTable& table) const
-    { }
+            VectorPointTable& table,
+            const RetryPolicy& policy) const
+    {
+        decode(
+                tmp,
+                filename,
+                *ensureGet(out, filename + extension(), policy),
+                table);
+    }
+
+    // Access a chunk in place, without copying or converting its points up
+    // front.  Returns null if unsupported for this type or endpoint, in which
+    // case read() should be used.
+    virtual std::unique_ptr<MappedPointTable> map(
+            const arbiter::Endpoint& out,
+            const std::string& filename) const
+    {
+        return std::unique_ptr<MappedPointTable>();
+    }
+
+    // Read a chunk that was appended to a pack file.
+    void read(
+            const arbiter::Endpoint& out,
+            const arbiter::Endpoint& tmp,
+            const std::string& filename,
+            const PackEntry& entry,
+            VectorPointTable& table,
+            const RetryPolicy& policy = RetryPolicy()) const
+    {
+        auto data(
+                ensureGetRange(
+                    out,
+                    entry.pack,
+                    entry.offset,
+                    entry.size,
+                    policy));
+        decode(tmp, filename, *data, table);
+    }
 
 protected:
     const Metadata& m_metadata;
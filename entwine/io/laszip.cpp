@@ -10,29 +10,62 @@
 
 #include <entwine/io/laszip.hpp>
 
-#include <pdal/filters/SortFilter.hpp>
+#include <atomic>
+#include <random>
+
 #include <pdal/io/BufferReader.hpp>
 #include <pdal/io/LasReader.hpp>
 #include <pdal/io/LasWriter.hpp>
 
-#include <entwine/util/executor.hpp>
+#include <entwine/util/unique.hpp>
 
 namespace entwine
 {
 
-void Laz::write(
-        const arbiter::Endpoint& out,
+namespace
+{
+
+// A temporary filename for _filename_ which is unique to this call, since the
+// same chunk may be decoded concurrently by parallel queries, by several
+// readers, or by other processes sharing the tmp directory.
+std::string tmpName(const std::string& filename)
+{
+    static const std::string process(std::to_string(std::random_device()()));
+    static std::atomic<uint64_t> counter(0);
+
+    return arbiter::crypto::encodeAsHex(filename) + "-" + process + "-" +
+        std::to_string(++counter) + ".laz";
+}
+
+void readFile(const std::string& path, VectorPointTable& table)
+{
+    pdal::Options o;
+    o.add("filename", path);
+    o.add("use_eb_vlr", true);
+
+    // Our chunks carry the SRS of the dataset, which is already known, so
+    // skip resolving it from each header.  This needs no Executor lock.
+    o.add("nosrs", true);
+
+    pdal::LasReader reader;
+    reader.setOptions(o);
+    reader.prepare(table);
+    reader.execute(table);
+}
+
+} // unnamed namespace
+
+std::unique_ptr<std::vector<char>> Laz::encode(
+        const arbiter::Endpoint* out,
         const arbiter::Endpoint& tmp,
         const std::string& filename,
         const Bounds& bounds,
         BlockPointTable& table) const
 {
-    const bool local(out.isLocal());
+    const bool local(out && out->isLocal());
     const std::string localDir(
-            local ? out.prefixedRoot() : tmp.prefixedRoot());
-    const std::string localFile(
-            (local ? filename : arbiter::crypto::encodeAsHex(filename)) +
-            ".laz");
+            local ? out->prefixedRoot() : tmp.prefixedRoot());
+    const std::string localFile(local ? filename + ".laz" : tmpName(filename));
 
     const Schema& outSchema(m_metadata.outSchema());
 
@@ -41,6 +74,14 @@ void Laz::write(
     for (std::size_t i(0); i < table.size(); ++i) view->getOrAddPoint(i);
     reader.addView(view);
 
+    // The SRS of the dataset was resolved when its metadata was created, so
+    // pass it along as is rather than as an a_srs string for the writer to
+    // resolve again for every chunk.  This needs no Executor lock.
+    if (m_metadata.srs().exists())
+    {
+        reader.setSpatialReference(m_metadata.srs().ref());
+    }
+
     // See https://www.pdal.io/stages/writers.las.html
     const uint64_t timeMask(outSchema.hasTime() ? 1 : 0);
     const uint64_t colorMask(outSchema.hasColor() ? 2 : 0);
@@ -61,62 +102,56 @@ void Laz::write(
     options.add("offset_y", outSchema.offset().y);
     options.add("offset_z", outSchema.offset().z);
 
-    if (m_metadata.srs().exists()) options.add("a_srs", m_metadata.srs().wkt());
-
-    auto lock(Executor::getLock());
-
-    pdal::Stage* prev(&reader);
-
-    std::unique_ptr<pdal::SortFilter> sort;
-    if (outSchema.contains("GpsTime"))
-    {
-        sort = makeUnique<pdal::SortFilter>();
-
-        pdal::Options so;
-        so.add("dimension", "GpsTime");
-        sort->setOptions(so);
-        sort->setInput(*prev);
-
-        prev = sort.get();
-    }
-
     pdal::LasWriter writer;
     writer.setOptions(options);
-    writer.setInput(*prev);
+    writer.setInput(reader);
     writer.prepare(table);
-
-    lock.unlock();
-
     writer.execute(table);
 
-    if (!local)
-    {
-        ensurePut(out, filename + ".laz", tmp.getBinary(localFile));
-        arbiter::fs::remove(tmp.prefixedRoot() + localFile);
-    }
+    if (local) return std::unique_ptr<std::vector<char>>();
+
+    auto data(makeUnique<std::vector<char>>(tmp.getBinary(localFile)));
+    arbiter::fs::remove(tmp.prefixedRoot() + localFile);
+    return data;
 }
 
 void Laz::read(
         const arbiter::Endpoint& out,
         const arbiter::Endpoint& tmp,
         const std::string& filename,
-        VectorPointTable& table) const
+        VectorPointTable& table,
+        const RetryPolicy& policy) const
 {
-    auto handle(out.getLocalHandle(filename + ".laz"));
+    const std::string path(filename + ".laz");
+    auto handle(retry("GET", out.prefixedRoot() + path, [&]()
+    {
+        return out.getLocalHandle(path);
+    }, policy));
+    readFile(handle->localPath(), table);
+}
 
-    pdal::Options o;
-    o.add("filename", handle->localPath());
-    o.add("use_eb_vlr", true);
+void Laz::decode(
+        const arbiter::Endpoint& tmp,
+        const std::string& filename,
+        std::vector<char>& data,
+        VectorPointTable& table) const
+{
+    const std::string localFile(tmpName(filename));
+    const std::string localPath(tmp.prefixedRoot() + localFile);
 
-    pdal::LasReader reader;
-    reader.setOptions(o);
+    tmp.put(localFile, data);
 
+    try
     {
-        auto lock(Executor::getLock());
-        reader.prepare(table);
+        readFile(localPath, table);
+    }
+    catch (...)
+    {
+        arbiter::fs::remove(localPath);
+        throw;
     }
 
-    reader.execute(table);
+    arbiter::fs::remove(localPath);
 }
 
 } // namespace entwine
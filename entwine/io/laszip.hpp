@@ -29,8 +29,10 @@ public:
 
     virtual std::string type() const override { return "laszip"; }
 
-    virtual void write(
-            const arbiter::Endpoint& out,
+    virtual std::string extension() const override { return ".laz"; }
+
+    virtual std::unique_ptr<std::vector<char>> encode(
+            const arbiter::Endpoint* out,
             const arbiter::Endpoint& tmp,
             const std::string& filename,
             const Bounds& bounds,
@@ -40,6 +42,13 @@ public:
             const arbiter::Endpoint& out,
             const arbiter::Endpoint& tmp,
             const std::string& filename,
+            VectorPointTable& table,
+            const RetryPolicy& policy) const override;
+
+    virtual void decode(
+            const arbiter::Endpoint& tmp,
+            const std::string& filename,
+            std::vector<char>& data,
             VectorPointTable& table) const override;
 };
 
@@ -0,0 +1,163 @@
+/******************************************************************************
+* Copyright (c) 2018, Connor Manning (connor@hobu.co)
+*
+* Entwine -- Point cloud indexing
+*
+* Entwine is available under the terms of the LGPL2 license. See COPYING
+* for specific license text and more information.
+*
+******************************************************************************/
+
+#include <entwine/io/memory-driver.hpp>
+
+#include <map>
+#include <mutex>
+#include <thread>
+
+#include <entwine/util/unique.hpp>
+
+namespace entwine
+{
+
+namespace
+{
+    using Data = std::shared_ptr<const std::vector<char>>;
+
+    // Stored objects are immutable once written, so readers may copy out of
+    // them without holding the lock.
+    struct Store
+    {
+        std::mutex mutex;
+        std::map<std::string, Data> data;
+        uint64_t bytes = 0;
+    };
+
+    Store& store()
+    {
+        static Store s;
+        return s;
+    }
+
+    Data find(const std::string& path)
+    {
+        Store& s(store());
+        std::lock_guard<std::mutex> lock(s.mutex);
+        auto it(s.data.find(path));
+        return it != s.data.end() ? it->second : Data();
+    }
+
+    bool startsWith(const std::string& s, const std::string& prefix)
+    {
+        return s.compare(0, prefix.size(), prefix) == 0;
+    }
+}
+
+MemoryDriver::MemoryDriver(const Json::Value& json)
+    : m_latency(static_cast<int64_t>(json["latency"].asDouble() * 1000.0))
+    , m_bytesPerSecond(json["bandwidth"].asDouble() * 1024.0 * 1024.0)
+{ }
+
+void MemoryDriver::put(std::string path, const std::vector<char>& data) const
+{
+    throttle(data.size());
+
+    Data next(std::make_shared<const std::vector<char>>(data));
+
+    Store& s(store());
+    std::lock_guard<std::mutex> lock(s.mutex);
+
+    Data& current(s.data[path]);
+    if (current) s.bytes -= current->size();
+    s.bytes += next->size();
+    current = next;
+}
+
+bool MemoryDriver::get(std::string path, std::vector<char>& data) const
+{
+    Data current(find(path));
+    throttle(current ? current->size() : 0);
+
+    if (!current) return false;
+    data.assign(current->begin(), current->end());
+    return true;
+}
+
+std::unique_ptr<std::size_t> MemoryDriver::tryGetSize(std::string path) const
+{
+    Data current(find(path));
+    throttle(0);
+
+    if (!current) return std::unique_ptr<std::size_t>();
+    return makeUnique<std::size_t>(current->size());
+}
+
+std::vector<std::string> MemoryDriver::glob(
+        std::string path,
+        bool verbose) const
+{
+    // As with the filesystem driver, a trailing "**" recurses into nested
+    // paths while a single "*" matches only direct children.
+    path.pop_back();
+    const bool recursive(path.size() && path.back() == '*');
+    if (recursive) path.pop_back();
+
+    std::vector<std::string> results;
+
+    Store& s(store());
+    std::lock_guard<std::mutex> lock(s.mutex);
+
+    for (auto it(s.data.lower_bound(path)); it != s.data.end(); ++it)
+    {
+        const std::string& key(it->first);
+        if (!startsWith(key, path)) break;
+
+        if (recursive || key.find('/', path.size()) == std::string::npos)
+        {
+            results.push_back(type() + "://" + key);
+        }
+    }
+
+    return results;
+}
+
+void MemoryDriver::clear(const std::string prefix)
+{
+    Store& s(store());
+    std::lock_guard<std::mutex> lock(s.mutex);
+
+    auto it(s.data.lower_bound(prefix));
+    while (it != s.data.end() && startsWith(it->first, prefix))
+    {
+        s.bytes -= it->second->size();
+        it = s.data.erase(it);
+    }
+}
+
+uint64_t MemoryDriver::bytes()
+{
+    Store& s(store());
+    std::lock_guard<std::mutex> lock(s.mutex);
+    return s.bytes;
+}
+
+void MemoryDriver::throttle(const std::size_t size) const
+{
+    std::chrono::microseconds delay(m_latency);
+    if (m_bytesPerSecond > 0)
+    {
+        delay += std::chrono::microseconds(
+                static_cast<int64_t>(size / m_bytesPerSecond * 1000000.0));
+    }
+
+    if (delay.count()) std::this_thread::sleep_for(delay);
+}
+
+std::shared_ptr<arbiter::Arbiter> makeArbiter(const Json::Value& json)
+{
+    auto a(std::make_shared<arbiter::Arbiter>(json));
+    a->addDriver("mem", makeUnique<MemoryDriver>(json["mem"]));
+    return a;
+}
+
+} // namespace entwine
+
@@ -0,0 +1,79 @@
+/******************************************************************************
+* Copyright (c) 2018, Connor Manning (connor@hobu.co)
+*
+* Entwine -- Point cloud indexing
+*
+* Entwine is available under the terms of the LGPL2 license. See COPYING
+* for specific license text and more information.
+*
+******************************************************************************/
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <json/json.h>
+
+#include <entwine/third/arbiter/arbiter.hpp>
+
+namespace entwine
+{
+
+// An arbiter driver for paths of the form mem://<path>, whose data lives in a
+// process-wide in-memory store, so a build, merge, or read may run end to end
+// with no filesystem or network.  Every arbiter in the process sees the same
+// data.
+//
+// Requests may optionally be throttled to approximate a remote store, via the
+// "mem" member of the arbiter configuration:
+//
+//      { "latency": <milliseconds per request>, "bandwidth": <MB/s> }
+//
+// where bandwidth is applied to each request independently.
+class MemoryDriver : public arbiter::Driver
+{
+public:
+    explicit MemoryDriver(const Json::Value& json = Json::nullValue);
+
+    virtual std::string type() const override { return "mem"; }
+
+    virtual void put(
+            std::string path,
+            const std::vector<char>& data) const override;
+
+    virtual std::unique_ptr<std::size_t> tryGetSize(
+            std::string path) const override;
+
+    // Drop all stored data beneath _prefix_, or everything if empty.
+    static void clear(std::string prefix = "");
+
+    // Total bytes currently stored.
+    static uint64_t bytes();
+
+protected:
+    virtual bool get(std::string path, std::vector<char>& data) const override;
+
+    virtual std::vector<std::string> glob(
+            std::string path,
+            bool verbose) const override;
+
+private:
+    void throttle(std::size_t size) const;
+
+    std::chrono::microseconds m_latency;
+    double m_bytesPerSecond;
+};
+
+// Create an arbiter from its JSON configuration, with the drivers provided by
+// Entwine registered in addition to arbiter's own.  All arbiters within
+// Entwine should be created this way.
+std::shared_ptr<arbiter::Arbiter> makeArbiter(
+        const Json::Value& json = Json::nullValue);
+
+} // namespace entwine
+
@@ -0,0 +1,37 @@
+/******************************************************************************
+* Copyright (c) 2018, Connor Manning (connor@hobu.co)
+*
+* Entwine -- Point cloud indexing
+*
+* Entwine is available under the terms of the LGPL2 license. See COPYING
+* for specific license text and more information.
+*
+******************************************************************************/
+
+#include <entwine/io/null.hpp>
+
+#include <entwine/util/metrics.hpp>
+#include <entwine/util/unique.hpp>
+
+namespace entwine
+{
+
+std::unique_ptr<std::vector<char>> Null::encode(
+        const arbiter::Endpoint* out,
+        const arbiter::Endpoint& tmp,
+        const std::string& filename,
+        const Bounds& bounds,
+        BlockPointTable& table) const
+{
+    metrics::add(
+            metrics::Counter::BytesDiscarded,
+            table.size() * m_metadata.outSchema().pointSize());
+
+    // With a destination, report the data as already written.  Otherwise the
+    // caller needs something to append to its pack, so give it nothing.
+    if (out) return std::unique_ptr<std::vector<char>>();
+    return makeUnique<std::vector<char>>();
+}
+
+} // namespace entwine
+
@@ -0,0 +1,59 @@
+/******************************************************************************
+* Copyright (c) 2018, Connor Manning (connor@hobu.co)
+*
+* Entwine -- Point cloud indexing
+*
+* Entwine is available under the terms of the LGPL2 license. See COPYING
+* for specific license text and more information.
+*
+******************************************************************************/
+
+#pragma once
+
+#include <entwine/io/io.hpp>
+
+namespace entwine
+{
+
+// Accepts chunk data and discards it, for measuring the cost of building the
+// tree apart from serialization and storage.  Everything up to the encoding
+// itself still runs - point ordering, zone maps, hierarchy counts, and the
+// write budget - and the size of each discarded chunk is recorded in the
+// build metrics.
+//
+// Nothing can be read back, so a chunk woken after being written starts
+// empty, and the output is not a readable dataset.
+class Null : public DataIo
+{
+public:
+    Null(const Metadata& m) : DataIo(m) { }
+
+    virtual std::string type() const override { return "null"; }
+
+    virtual std::string extension() const override { return ".null"; }
+
+    virtual std::unique_ptr<std::vector<char>> encode(
+            const arbiter::Endpoint* out,
+            const arbiter::Endpoint& tmp,
+            const std::string& filename,
+            const Bounds& bounds,
+            BlockPointTable& table) const override;
+
+    virtual void read(
+            const arbiter::Endpoint& out,
+            const arbiter::Endpoint& tmp,
+            const std::string& filename,
+            VectorPointTable& table,
+            const RetryPolicy& policy) const override
+    { }
+
+    virtual void decode(
+            const arbiter::Endpoint& tmp,
+            const std::string& filename,
+            std::vector<char>& data,
+            VectorPointTable& table) const override
+    { }
+};
+
+} // namespace entwine
+
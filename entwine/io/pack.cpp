@@ -0,0 +1,223 @@
+/******************************************************************************
+* Copyright (c) 2018, Connor Manning (connor@hobu.co)
+*
+* Entwine -- Point cloud indexing
+*
+* Entwine is available under the terms of the LGPL2 license. See COPYING
+* for specific license text and more information.
+*
+******************************************************************************/
+
+#include <entwine/io/pack.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+
+#include <entwine/io/ensure.hpp>
+#include <entwine/util/json.hpp>
+#include <entwine/util/unique.hpp>
+
+namespace entwine
+{
+
+namespace
+{
+    uint64_t fileSize(const std::string& path)
+    {
+        std::ifstream stream(path, std::ios::in | std::ios::binary);
+        if (!stream.good()) return 0;
+        stream.seekg(0, std::ios::end);
+        return stream.tellg();
+    }
+}
+
+Json::Value toJson(const PackMap& packs)
+{
+    Json::Value json(Json::objectValue);
+    for (const auto& p : packs) json[p.first.toString()] = p.second.toJson();
+    return json;
+}
+
+PackMap loadPackIndex(
+        const arbiter::Endpoint& ep,
+        const Dxyz& root,
+        const std::string& postfix)
+{
+    PackMap packs;
+
+    if (auto data = ep.tryGetBinary(packIndexFilename(root, postfix)))
+    {
+        const Json::Value json(parse(std::string(data->begin(), data->end())));
+        for (const auto& key : json.getMemberNames())
+        {
+            packs[Dxyz(key)] = PackEntry(json[key]);
+        }
+    }
+
+    return packs;
+}
+
+PackWriter::PackWriter(
+        const arbiter::Endpoint& out,
+        const arbiter::Endpoint& tmp,
+        const RetryPolicy& retry,
+        const arbiter::Endpoint* stage)
+    : m_out(out)
+    , m_tmp(tmp)
+    , m_retry(retry)
+    , m_stage(stage)
+{ }
+
+std::string PackWriter::segmentName(const std::string& name, const uint64_t n)
+{
+    if (!n) return name;
+
+    const std::size_t dot(std::min(name.rfind('.'), name.size()));
+    return name.substr(0, dot) + "." + std::to_string(n) + name.substr(dot);
+}
+
+PackWriter::Pack& PackWriter::get(const std::string& name)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    std::unique_ptr<Pack>& pack(m_packs[name]);
+    if (pack) return *pack;
+
+    pack = makeUnique<Pack>();
+
+    if (m_out.isLocal() && !m_stage)
+    {
+        // A local pack is appended in place, even if it was written by a
+        // previous build.
+        pack->segment = name;
+        pack->path = arbiter::fs::expandTilde(m_out.root() + name);
+    }
+    else
+    {
+        // Skip any segments which have already been saved, whether by us or
+        // by a previous build.
+        uint64_t& n(m_segments[name]);
+        while (m_out.tryGetSize(segmentName(name, n))) ++n;
+
+        pack->segment = segmentName(name, n++);
+        pack->path = m_stage ?
+            arbiter::fs::expandTilde(m_stage->root() + pack->segment) :
+            m_tmp.prefixedRoot() +
+                arbiter::crypto::encodeAsHex(
+                    m_out.prefixedRoot() + pack->segment);
+        arbiter::fs::remove(pack->path);
+    }
+
+    pack->size = fileSize(pack->path);
+    m_open[pack->segment] = pack.get();
+    return *pack;
+}
+
+PackWriter::Pack* PackWriter::find(const std::string& segment) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const auto it(m_open.find(segment));
+    return it != m_open.end() ? it->second : nullptr;
+}
+
+PackEntry PackWriter::append(
+        const std::string& name,
+        const std::vector<char>& data)
+{
+    Pack& pack(get(name));
+    std::lock_guard<std::mutex> lock(pack.mutex);
+
+    std::ofstream stream(
+            pack.path,
+            std::ios::out | std::ios::binary | std::ios::app);
+    stream.write(data.data(), data.size());
+    stream.close();
+
+    if (!stream.good())
+    {
+        throw std::runtime_error("Could not write pack " + pack.path);
+    }
+
+    const PackEntry entry(pack.segment, pack.size, data.size());
+    pack.size += data.size();
+    return entry;
+}
+
+std::unique_ptr<std::vector<char>> PackWriter::read(const PackEntry& entry)
+    const
+{
+    Pack* pack(find(entry.pack));
+
+    if (!pack)
+    {
+        return ensureGetRange(
+                m_out,
+                entry.pack,
+                entry.offset,
+                entry.size,
+                m_retry);
+    }
+
+    std::lock_guard<std::mutex> lock(pack->mutex);
+
+    auto data(makeUnique<std::vector<char>>(entry.size));
+    std::ifstream stream(pack->path, std::ios::in | std::ios::binary);
+    stream.seekg(entry.offset);
+    stream.read(data->data(), entry.size);
+
+    if (static_cast<uint64_t>(stream.gcount()) != entry.size)
+    {
+        throw std::runtime_error("Could not read pack " + pack->path);
+    }
+
+    return data;
+}
+
+void PackWriter::save(Pool& pool)
+{
+    if (m_out.isLocal() && !m_stage) return;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (m_stage)
+    {
+        // The checkpoint commit moves these into the output.
+        m_packs.clear();
+        m_open.clear();
+        return;
+    }
+
+    const std::size_t errors(pool.errors().size());
+
+    for (const auto& p : m_packs)
+    {
+        const std::string name(p.second->segment);
+        const std::string path(p.second->path);
+
+        pool.add([this, name, path]()
+        {
+            std::ifstream stream(path, std::ios::in | std::ios::binary);
+            const std::vector<char> data(
+                    (std::istreambuf_iterator<char>(stream)),
+                    std::istreambuf_iterator<char>());
+
+            ensurePut(m_out, name, data, m_retry);
+            arbiter::fs::remove(path);
+        });
+    }
+
+    pool.await();
+
+    if (pool.errors().size() > errors)
+    {
+        throw std::runtime_error("Pack upload failed: " + pool.errors().back());
+    }
+
+    // These segments are now complete, so later appends begin new ones.
+    m_packs.clear();
+    m_open.clear();
+}
+
+} // namespace entwine
+
@@ -0,0 +1,148 @@
+/******************************************************************************
+* Copyright (c) 2018, Connor Manning (connor@hobu.co)
+*
+* Entwine -- Point cloud indexing
+*
+* Entwine is available under the terms of the LGPL2 license. See COPYING
+* for specific license text and more information.
+*
+******************************************************************************/
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <json/json.h>
+
+#include <entwine/io/ensure.hpp>
+#include <entwine/third/arbiter/arbiter.hpp>
+#include <entwine/types/key.hpp>
+#include <entwine/util/pool.hpp>
+
+namespace entwine
+{
+
+// The location of a chunk which has been appended to a pack file rather than
+// written as its own file.  Small chunks at deep levels of the tree are
+// grouped into a pack file per subtree, to reduce the number of objects
+// written and fetched.
+struct PackEntry
+{
+    PackEntry() = default;
+    PackEntry(std::string pack, uint64_t offset, uint64_t size)
+        : pack(pack)
+        , offset(offset)
+        , size(size)
+    { }
+
+    // Serialized as [pack, offset, size].
+    explicit PackEntry(const Json::Value& json)
+        : pack(json[0].asString())
+        , offset(json[1].asUInt64())
+        , size(json[2].asUInt64())
+    { }
+
+    Json::Value toJson() const
+    {
+        Json::Value json;
+        json.append(pack);
+        json.append((Json::UInt64)offset);
+        json.append((Json::UInt64)size);
+        return json;
+    }
+
+    std::string pack;
+    uint64_t offset = 0;
+    uint64_t size = 0;
+};
+
+using PackMap = std::map<Dxyz, PackEntry>;
+
+// The pack index of a dataset is sharded in the same way as its hierarchy:
+// the entries for the nodes of each hierarchy file are stored beside that
+// file, so that readers load them only along with their subtree.
+inline std::string packIndexFilename(
+        const Dxyz& root,
+        const std::string& postfix)
+{
+    return root.toString() + postfix + ".packs.json";
+}
+
+Json::Value toJson(const PackMap& packs);
+
+// Returns an empty index if this shard does not exist.
+PackMap loadPackIndex(
+        const arbiter::Endpoint& ep,
+        const Dxyz& root,
+        const std::string& postfix);
+
+// Appends chunk data to pack files during a build.  Pack files are written
+// directly to a local output, or staged in the temporary directory and
+// uploaded by save() for a remote output.
+//
+// An uploaded pack is never appended to again, since that would mean fetching
+// and uploading it in its entirety each time.  Instead, further appends after
+// a save(), or by a later build continuing this one, begin a new segment of
+// the pack, named by segmentName.  Entries refer to their segment by name, so
+// readers need not be aware of this.
+//
+// If a _stage_ endpoint is given, which must be local, segments are written
+// there instead and save() only closes them, leaving them to be moved into
+// the output by a Checkpoint along with the rest of the staged data.  A pack
+// in the output is then never modified, even if it is local, so the output
+// holds only committed data.
+class PackWriter
+{
+public:
+    PackWriter(
+            const arbiter::Endpoint& out,
+            const arbiter::Endpoint& tmp,
+            const RetryPolicy& retry = RetryPolicy(),
+            const arbiter::Endpoint* stage = nullptr);
+
+    PackEntry append(const std::string& pack, const std::vector<char>& data);
+
+    // Read chunk data, which may not have been uploaded yet.
+    std::unique_ptr<std::vector<char>> read(const PackEntry& entry) const;
+
+    // Upload any staged pack files, or close them if they are staged for a
+    // checkpoint.  Further appends may follow.
+    void save(Pool& pool);
+
+    // The name of segment _n_ of pack _name_, where segment zero is the pack
+    // name itself.
+    static std::string segmentName(const std::string& name, uint64_t n);
+
+private:
+    struct Pack
+    {
+        std::mutex mutex;
+        std::string segment;
+        std::string path;
+        uint64_t size = 0;
+    };
+
+    Pack& get(const std::string& name);
+    Pack* find(const std::string& segment) const;
+
+    const arbiter::Endpoint& m_out;
+    const arbiter::Endpoint& m_tmp;
+    const RetryPolicy m_retry;
+    const arbiter::Endpoint* const m_stage;
+
+    mutable std::mutex m_mutex;
+
+    // Open packs by name and by segment, and the next segment to try for
+    // each name.
+    std::map<std::string, std::unique_ptr<Pack>> m_packs;
+    std::map<std::string, Pack*> m_open;
+    std::map<std::string, uint64_t> m_segments;
+};
+
+} // namespace entwine
+
@@ -0,0 +1,191 @@
+/******************************************************************************
+* Copyright (c) 2018, Connor Manning (connor@hobu.co)
+*
+* Entwine -- Point cloud indexing
+*
+* Entwine is available under the terms of the LGPL2 license. See COPYING
+* for specific license text and more information.
+*
+******************************************************************************/
+
+#include <entwine/io/point-order.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+namespace entwine
+{
+
+namespace
+{
+
+using Entry = std::pair<uint64_t, char*>;
+using Entries = std::vector<Entry>;
+
+const uint64_t mortonBits(21);
+const uint64_t mortonMax((1ULL << mortonBits) - 1);
+
+template<typename T> double readAs(const char* pos)
+{
+    T v;
+    std::memcpy(&v, pos, sizeof(T));
+    return static_cast<double>(v);
+}
+
+double read(const char* pos, const DimType type)
+{
+    switch (type)
+    {
+        case DimType::Double:       return readAs<double>(pos);
+        case DimType::Float:        return readAs<float>(pos);
+        case DimType::Unsigned8:    return readAs<uint8_t>(pos);
+        case DimType::Signed8:      return readAs<int8_t>(pos);
+        case DimType::Unsigned16:   return readAs<uint16_t>(pos);
+        case DimType::Signed16:     return readAs<int16_t>(pos);
+        case DimType::Unsigned32:   return readAs<uint32_t>(pos);
+        case DimType::Signed32:     return readAs<int32_t>(pos);
+        case DimType::Unsigned64:   return readAs<uint64_t>(pos);
+        case DimType::Signed64:     return readAs<int64_t>(pos);
+        default: throw std::runtime_error("Invalid dimension type");
+    }
+}
+
+// Map a double onto an unsigned integer with the same total ordering.
+uint64_t sortable(const double d)
+{
+    uint64_t u;
+    std::memcpy(&u, &d, sizeof(u));
+    const uint64_t sign(1ULL << 63);
+    return (u & sign) ? ~u : (u | sign);
+}
+
+// Spread the low 21 bits of v so that there are two zero bits between each.
+uint64_t spread(uint64_t v)
+{
+    v &= mortonMax;
+    v = (v | v << 32) & 0x001f00000000ffffULL;
+    v = (v | v << 16) & 0x001f0000ff0000ffULL;
+    v = (v | v << 8)  & 0x100f00f00f00f00fULL;
+    v = (v | v << 4)  & 0x10c30c30c30c30c3ULL;
+    v = (v | v << 2)  & 0x1249249249249249ULL;
+    return v;
+}
+
+uint64_t quantize(const double v, const double min, const double width)
+{
+    if (width <= 0) return 0;
+    const double n((v - min) / width * (mortonMax + 1));
+    if (n <= 0) return 0;
+    return std::min<uint64_t>(static_cast<uint64_t>(n), mortonMax);
+}
+
+void radixSort(Entries& entries)
+{
+    Entries swap(entries.size());
+    Entries* src(&entries);
+    Entries* dst(&swap);
+
+    std::array<std::size_t, 256> counts;
+
+    for (std::size_t shift(0); shift < 64; shift += 8)
+    {
+        counts.fill(0);
+        for (const Entry& e : *src) ++counts[(e.first >> shift) & 0xFF];
+
+        // If every key shares this byte, this pass would be a no-op.
+        if (std::any_of(
+                    counts.begin(),
+                    counts.end(),
+                    [&entries](std::size_t n) { return n == entries.size(); }))
+        {
+            continue;
+        }
+
+        std::size_t offset(0);
+        for (std::size_t& n : counts)
+        {
+            const std::size_t current(n);
+            n = offset;
+            offset += current;
+        }
+
+        for (const Entry& e : *src)
+        {
+            (*dst)[counts[(e.first >> shift) & 0xFF]++] = e;
+        }
+
+        std::swap(src, dst);
+    }
+
+    if (src != &entries) entries.swap(*src);
+}
+
+} // unnamed namespace
+
+void order(
+        BlockPointTable& table,
+        const Schema& schema,
+        const Bounds& bounds,
+        const PointOrder pointOrder)
+{
+    if (pointOrder == PointOrder::none) return;
+    if (pointOrder == PointOrder::gpsTime && !schema.hasTime()) return;
+
+    std::vector<char*>& refs(table.refs());
+    if (refs.size() < 2) return;
+
+    const pdal::PointLayout& layout(schema.pdalLayout());
+
+    Entries entries;
+    entries.reserve(refs.size());
+
+    if (pointOrder == PointOrder::gpsTime)
+    {
+        const DimId id(DimId::GpsTime);
+        const std::size_t offset(layout.dimOffset(id));
+        const DimType type(layout.dimType(id));
+
+        for (char* pos : refs)
+        {
+            entries.emplace_back(sortable(read(pos + offset, type)), pos);
+        }
+    }
+    else
+    {
+        const std::size_t xOffset(layout.dimOffset(DimId::X));
+        const std::size_t yOffset(layout.dimOffset(DimId::Y));
+        const std::size_t zOffset(layout.dimOffset(DimId::Z));
+        const DimType xType(layout.dimType(DimId::X));
+        const DimType yType(layout.dimType(DimId::Y));
+        const DimType zType(layout.dimType(DimId::Z));
+
+        const Point& min(bounds.min());
+        const double w(bounds.width());
+        const double d(bounds.depth());
+        const double h(bounds.height());
+
+        for (char* pos : refs)
+        {
+            const uint64_t x(quantize(read(pos + xOffset, xType), min.x, w));
+            const uint64_t y(quantize(read(pos + yOffset, yType), min.y, d));
+            const uint64_t z(quantize(read(pos + zOffset, zType), min.z, h));
+
+            entries.emplace_back(
+                    spread(x) | (spread(y) << 1) | (spread(z) << 2),
+                    pos);
+        }
+    }
+
+    radixSort(entries);
+
+    for (std::size_t i(0); i < entries.size(); ++i)
+    {
+        refs[i] = entries[i].second;
+    }
+}
+
+} // namespace entwine
+
@@ -0,0 +1,61 @@
+/******************************************************************************
+* Copyright (c) 2018, Connor Manning (connor@hobu.co)
+*
+* Entwine -- Point cloud indexing
+*
+* Entwine is available under the terms of the LGPL2 license. See COPYING
+* for specific license text and more information.
+*
+******************************************************************************/
+
+#pragma once
+
+#include <stdexcept>
+#include <string>
+
+#include <entwine/types/bounds.hpp>
+#include <entwine/types/schema.hpp>
+#include <entwine/types/vector-point-table.hpp>
+
+namespace entwine
+{
+
+enum class PointOrder
+{
+    none,
+    gpsTime,
+    morton
+};
+
+inline PointOrder toPointOrder(const std::string& s)
+{
+    if (s == "none")            return PointOrder::none;
+    else if (s == "gpstime")    return PointOrder::gpsTime;
+    else if (s == "morton")     return PointOrder::morton;
+    else throw std::runtime_error("Invalid point order: " + s);
+}
+
+inline std::string toString(PointOrder o)
+{
+    switch (o)
+    {
+        case PointOrder::none: return "none";
+        case PointOrder::gpsTime: return "gpstime";
+        case PointOrder::morton: return "morton";
+        default: throw std::runtime_error("Invalid point order enum");
+    }
+}
+
+// Reorders the point references of a chunk in place prior to serialization.
+// No point data is moved - only the table's reference list is permuted, via
+// an LSD radix sort over 64-bit keys.  For a GpsTime ordering, ties retain
+// their insertion order.  For a Morton ordering, points are quantized to a
+// 2^21 grid within the chunk bounds and sorted by their interleaved XYZ code.
+void order(
+        BlockPointTable& table,
+        const Schema& schema,
+        const Bounds& bounds,
+        PointOrder pointOrder);
+
+} // namespace entwine
+
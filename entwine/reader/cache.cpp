@@ -10,78 +10,456 @@
 
 #include <entwine/reader/cache.hpp>
 
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <stdexcept>
+
 #include <entwine/reader/reader.hpp>
+#include <entwine/util/time.hpp>
+#include <entwine/util/unique.hpp>
 
 namespace entwine
 {
 
-bool operator<(const GlobalId& a, const GlobalId& b)
+namespace
+{
+    // Fraction of each shard used for the admission window of the TinyLFU
+    // policy, and the fraction of the remainder used for protected entries.
+    const double windowRatio(0.01);
+    const double protectRatio(0.8);
+
+    void updateMax(std::atomic<uint64_t>& max, const uint64_t v)
+    {
+        uint64_t prev(max);
+        while (v > prev && !max.compare_exchange_weak(prev, v)) { }
+    }
+}
+
+// A count-min sketch of 4-bit saturating counters, which approximates how
+// often each chunk has been requested.  Counts are periodically halved so
+// that the history favors recent activity.
+class Cache::Sketch
+{
+public:
+    explicit Sketch(const std::size_t width = 4096)
+        : m_width(width)
+        , m_table(width * depth, 0)
+    { }
+
+    void increment(const std::size_t h)
+    {
+        for (std::size_t row(0); row < depth; ++row)
+        {
+            uint8_t& count(m_table[row * m_width + index(h, row)]);
+            if (count < 15) ++count;
+        }
+
+        if (++m_additions >= m_width * 10)
+        {
+            for (uint8_t& count : m_table) count >>= 1;
+            m_additions /= 2;
+        }
+    }
+
+    uint8_t frequency(const std::size_t h) const
+    {
+        uint8_t result(15);
+        for (std::size_t row(0); row < depth; ++row)
+        {
+            result = std::min(result, m_table[row * m_width + index(h, row)]);
+        }
+        return result;
+    }
+
+private:
+    static const std::size_t depth = 4;
+
+    std::size_t index(const std::size_t h, const std::size_t row) const
+    {
+        uint64_t x((h + row * 0x9e3779b97f4a7c15ULL) * 0xbf58476d1ce4e5b9ULL);
+        x ^= x >> 31;
+        return x % m_width;
+    }
+
+    const std::size_t m_width;
+    std::vector<uint8_t> m_table;
+    std::size_t m_additions = 0;
+};
+
+CachePolicy toCachePolicy(const std::string& s)
+{
+    if (s == "lru") return CachePolicy::lru;
+    if (s == "tinylfu") return CachePolicy::tinyLfu;
+    throw std::runtime_error("Invalid cache policy: " + s);
+}
+
+std::string toString(const CachePolicy policy)
 {
-    return a.path < b.path || (a.path == b.path && a.key < b.key);
+    switch (policy)
+    {
+        case CachePolicy::lru:      return "lru";
+        case CachePolicy::tinyLfu:  return "tinylfu";
+        default:                    return "unknown";
+    }
 }
 
+CacheParams::CacheParams(const Json::Value& json)
+{
+    if (json.isMember("maxBytes")) maxBytes = json["maxBytes"].asUInt64();
+    if (json.isMember("shards")) shards = json["shards"].asUInt64();
+    if (json.isMember("policy"))
+    {
+        policy = toCachePolicy(json["policy"].asString());
+    }
+    if (json.isMember("pinDepth")) pinDepth = json["pinDepth"].asUInt64();
+    if (json.isMember("hierarchyBytes"))
+    {
+        hierarchyBytes = json["hierarchyBytes"].asUInt64();
+    }
+}
+
+Json::Value Cache::Stats::toJson() const
+{
+    Json::Value json;
+    json["hits"] = (Json::UInt64)hits;
+    json["misses"] = (Json::UInt64)misses;
+    json["loads"] = (Json::UInt64)loads;
+    json["failures"] = (Json::UInt64)failures;
+    json["bytesLoaded"] = (Json::UInt64)bytesLoaded;
+    json["evictions"] = (Json::UInt64)evictions;
+    json["rejections"] = (Json::UInt64)rejections;
+    json["loadMicros"] = (Json::UInt64)loadMicros;
+    json["maxLoadMicros"] = (Json::UInt64)maxLoadMicros;
+    json["bytes"] = (Json::UInt64)bytes;
+    json["pinnedBytes"] = (Json::UInt64)pinnedBytes;
+    return json;
+}
+
+Cache::Shard::Shard() : sketch(makeUnique<Sketch>()) { }
+Cache::Shard::~Shard() { }
+
+Cache::Order& Cache::Shard::list(const Region r)
+{
+    switch (r)
+    {
+        case Region::window:    return window;
+        case Region::probation: return probation;
+        case Region::protect:   return protect;
+        default:                return pinned;
+    }
+}
+
+std::size_t& Cache::Shard::bytes(const Region r)
+{
+    switch (r)
+    {
+        case Region::window:    return windowBytes;
+        case Region::probation: return probationBytes;
+        case Region::protect:   return protectBytes;
+        default:                return pinnedBytes;
+    }
+}
+
+void Cache::Shard::move(const Map::iterator it, const Region r)
+{
+    Entry& entry(it->second);
+
+    list(entry.region).erase(entry.it);
+    if (entry.loaded) bytes(entry.region) -= entry.bytes;
+
+    entry.region = r;
+    list(r).push_front(it);
+    entry.it = list(r).begin();
+    if (entry.loaded) bytes(r) += entry.bytes;
+}
+
+void Cache::Shard::remove(const Map::iterator it)
+{
+    Entry& entry(it->second);
+    list(entry.region).erase(entry.it);
+    if (entry.loaded) bytes(entry.region) -= entry.bytes;
+    chunks.erase(it);
+}
+
+Cache::Cache(const std::size_t maxBytes, const std::size_t shards)
+    : Cache(
+            [maxBytes, shards]()
+            {
+                CacheParams p;
+                p.maxBytes = maxBytes;
+                p.shards = shards;
+                return p;
+            }())
+{ }
+
+Cache::Cache(const CacheParams& params)
+    : m_params(params)
+    , m_maxShardBytes(
+            m_params.maxBytes / std::max<std::size_t>(m_params.shards, 1))
+    , m_hierarchy(m_params.hierarchyBytes)
+{
+    for (std::size_t i(0); i < std::max<std::size_t>(m_params.shards, 1); ++i)
+    {
+        m_shards.push_back(makeUnique<Shard>());
+    }
+}
+
+Cache::~Cache() { }
+
 std::deque<SharedChunkReader> Cache::acquire(
         const Reader& reader,
         const std::vector<Dxyz>& keys)
 {
     std::deque<SharedChunkReader> block;
-
-    std::lock_guard<std::mutex> lock(m_mutex);
     for (const Dxyz& key : keys) block.push_back(get(reader, key));
+    return block;
+}
 
-    purge();
+Cache::Stats Cache::stats() const
+{
+    Stats s;
+    s.hits = m_hits;
+    s.misses = m_misses;
+    s.loads = m_loads;
+    s.failures = m_failures;
+    s.bytesLoaded = m_bytesLoaded;
+    s.evictions = m_evictions;
+    s.rejections = m_rejections;
+    s.loadMicros = m_loadMicros;
+    s.maxLoadMicros = m_maxLoadMicros;
 
-    return block;
+    for (const auto& shard : m_shards)
+    {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        s.bytes += shard->windowBytes + shard->probationBytes +
+            shard->protectBytes + shard->pinnedBytes;
+        s.pinnedBytes += shard->pinnedBytes;
+    }
+
+    return s;
+}
+
+std::size_t Cache::hash(const GlobalId& id)
+{
+    const Xyz& p(id.key.p);
+    std::size_t h(std::hash<std::string>()(id.path));
+    for (const uint64_t v : { id.key.d, p.x, p.y, p.z })
+    {
+        h ^= std::hash<uint64_t>()(v) + 0x9e3779b9 + (h << 6) + (h >> 2);
+    }
+    return h;
 }
 
 SharedChunkReader Cache::get(const Reader& reader, const Dxyz& key)
 {
     const GlobalId id(reader.path(), key);
+    const std::size_t h(hash(id));
+    Shard& s(*m_shards[h % m_shards.size()]);
+
+    std::unique_lock<std::mutex> lock(s.mutex);
+    s.sketch->increment(h);
+
+    auto it(s.chunks.find(id));
+
+    if (it != s.chunks.end())
+    {
+        // Whether or not this chunk has finished loading, mark it as recently
+        // used and then wait for it outside of the lock.
+        ++m_hits;
+        touch(s, it);
+
+        std::shared_future<SharedChunkReader> chunk(it->second.chunk);
+        lock.unlock();
+        return chunk.get();
+    }
 
-    auto it(m_chunks.find(id));
+    ++m_misses;
+
+    std::promise<SharedChunkReader> promise;
+
+    it = s.chunks.insert(std::make_pair(id, Entry())).first;
+    Entry& entry(it->second);
+    entry.chunk = promise.get_future().share();
+    entry.hash = h;
+    s.window.push_front(it);
+    entry.it = s.window.begin();
+
+    lock.unlock();
+
+    return load(reader, id, s, promise);
+}
+
+SharedChunkReader Cache::load(
+        const Reader& reader,
+        const GlobalId& id,
+        Shard& s,
+        std::promise<SharedChunkReader>& promise)
+{
+    SharedChunkReader chunk;
+    const TimePoint start(now());
 
-    if (it == m_chunks.end())
+    try
+    {
+        chunk = std::make_shared<ChunkReader>(reader, id.key);
+    }
+    catch (...)
     {
-        // std::cout << "\tAdd " << id.key << std::endl;
-        it = m_chunks.insert(std::make_pair(id, ChunkReaderInfo())).first;
+        ++m_failures;
+
+        // Waiters receive this error, and the entry is removed so that a
+        // later request may try again.
+        promise.set_exception(std::current_exception());
 
-        ChunkReaderInfo& info(it->second);
-        info.chunk = std::make_shared<ChunkReader>(reader, key);
-        m_size += info.chunk->bytes();
+        std::lock_guard<std::mutex> lock(s.mutex);
+        auto it(s.chunks.find(id));
+        if (it != s.chunks.end()) s.remove(it);
+        throw;
     }
-    else
+
+    const uint64_t micros(
+            std::chrono::duration_cast<std::chrono::microseconds>(
+                now() - start).count());
+
+    ++m_loads;
+    m_bytesLoaded += chunk->bytes();
+    m_loadMicros += micros;
+    updateMax(m_maxLoadMicros, micros);
+
+    promise.set_value(chunk);
+
+    std::lock_guard<std::mutex> lock(s.mutex);
+    auto it(s.chunks.find(id));
+    if (it != s.chunks.end())
     {
-        ChunkReaderInfo& info(it->second);
-        m_order.erase(info.it);
+        Entry& entry(it->second);
+        entry.loaded = true;
+        entry.bytes = chunk->bytes();
+        s.bytes(entry.region) += entry.bytes;
+
+        if (id.key.d < m_params.pinDepth) s.move(it, Region::pinned);
     }
 
-    m_order.push_front(it);
+    purge(s);
+    return chunk;
+}
 
-    ChunkReaderInfo& info(it->second);
-    info.it = m_order.begin();
+void Cache::touch(Shard& s, const Map::iterator it)
+{
+    Entry& entry(it->second);
 
-    return info.chunk;
+    if (entry.region == Region::probation)
+    {
+        // A second access promotes a probationary entry, and the least
+        // recently used protected entries are demoted to make room.
+        s.move(it, Region::protect);
+
+        const std::size_t mainBytes(
+                m_maxShardBytes - m_maxShardBytes * windowRatio);
+        const std::size_t protectBytes(mainBytes * protectRatio);
+
+        while (s.protectBytes > protectBytes && s.protect.size() > 1)
+        {
+            s.move(s.protect.back(), Region::probation);
+        }
+    }
+    else if (entry.region != Region::pinned)
+    {
+        Order& list(s.list(entry.region));
+        list.splice(list.begin(), list, entry.it);
+    }
 }
 
-void Cache::purge()
+void Cache::evict(Shard& s, const Map::iterator it)
 {
-    const std::size_t start(m_size);
-    while (m_size > m_maxBytes)
+    ++m_evictions;
+    s.remove(it);
+}
+
+void Cache::purge(Shard& s)
+{
+    // Entries which are still loading are not yet counted toward our size,
+    // so they are never chosen.  Callers holding a chunk keep it alive via
+    // its shared pointer even after it is evicted.
+    auto oldest([](Order& list)
+    {
+        for (auto it(list.end()); it != list.begin(); )
+        {
+            --it;
+            if ((*it)->second.loaded) return it;
+        }
+        return list.end();
+    });
+
+    if (m_params.policy == CachePolicy::lru)
     {
-        const auto& it(m_order.back());
-        const GlobalId& id(it->first);
-        const ChunkReaderInfo& info(it->second);
+        while (s.windowBytes > m_maxShardBytes)
+        {
+            const auto it(oldest(s.window));
+            if (it == s.window.end()) break;
+            evict(s, *it);
+        }
+        return;
+    }
+
+    const std::size_t windowBytes(m_maxShardBytes * windowRatio);
+    const std::size_t mainBytes(m_maxShardBytes - windowBytes);
+
+    // Entries overflowing the window become candidates for admission to the
+    // main region.
+    std::vector<Map::iterator> candidates;
+    while (s.windowBytes > windowBytes)
+    {
+        const auto it(oldest(s.window));
+        if (it == s.window.end()) break;
 
-        std::cout << "\tDel " << id.key << std::endl;
-        m_size -= info.chunk->bytes();
-        m_order.pop_back();
-        m_chunks.erase(it);
+        const Map::iterator candidate(*it);
+        s.move(candidate, Region::probation);
+        candidates.push_back(candidate);
     }
 
-    if (start > m_size)
+    while (s.probationBytes + s.protectBytes > mainBytes)
     {
-        std::cout << "\t\tPurged " << (start - m_size) << std::endl;
-        std::cout << "\t\tLeft " << m_size << std::endl;
+        const auto vit(oldest(s.probation));
+        if (vit == s.probation.end())
+        {
+            const auto pit(oldest(s.protect));
+            if (pit == s.protect.end()) break;
+            evict(s, *pit);
+            continue;
+        }
+
+        const Map::iterator victim(*vit);
+        const auto cit(
+                std::find(candidates.begin(), candidates.end(), victim));
+
+        if (cit != candidates.end())
+        {
+            candidates.erase(cit);
+            ++m_rejections;
+            s.remove(victim);
+        }
+        else if (candidates.empty())
+        {
+            evict(s, victim);
+        }
+        else
+        {
+            const Map::iterator candidate(candidates.front());
+            const Sketch& sketch(*s.sketch);
+
+            if (sketch.frequency(candidate->second.hash) >
+                    sketch.frequency(victim->second.hash))
+            {
+                evict(s, victim);
+            }
+            else
+            {
+                candidates.erase(candidates.begin());
+                ++m_rejections;
+                s.remove(candidate);
+            }
+        }
     }
 }
 
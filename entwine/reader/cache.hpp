@@ -10,13 +10,22 @@
 
 #pragma once
 
+#include <atomic>
 #include <cstddef>
+#include <cstdint>
 #include <deque>
+#include <future>
 #include <list>
 #include <map>
+#include <memory>
 #include <mutex>
+#include <string>
+#include <vector>
+
+#include <json/json.h>
 
 #include <entwine/reader/chunk-reader.hpp>
+#include <entwine/reader/hierarchy-cache.hpp>
 #include <entwine/types/key.hpp>
 
 namespace entwine
@@ -24,52 +33,157 @@ namespace entwine
 
 class Reader;
 
-struct GlobalId
+enum class CachePolicy
 {
-    GlobalId(const std::string path, const Dxyz& key)
-        : path(path)
-        , key(key)
-    { }
-
-    const std::string path;
-    const Dxyz key;
+    // Evict the least recently used chunk.
+    lru,
+
+    // Window TinyLFU: new chunks enter a small LRU window, and are admitted
+    // to the main segmented LRU only if they have been requested more
+    // frequently than the chunk they would displace.  This keeps a large
+    // one-off scan from flushing frequently used chunks.
+    tinyLfu
 };
 
-bool operator<(const GlobalId& a, const GlobalId& b);
+CachePolicy toCachePolicy(const std::string& s);
+std::string toString(CachePolicy policy);
 
-struct ChunkReaderInfo
+struct CacheParams
 {
-    using Map = std::map<GlobalId, ChunkReaderInfo>;
-    using Order = std::list<Map::iterator>;
+    CacheParams() = default;
+
+    // Accepts the keys "maxBytes", "shards", "policy", "pinDepth", and
+    // "hierarchyBytes".
+    explicit CacheParams(const Json::Value& json);
+
+    std::size_t maxBytes = 1024 * 1024 * 256; // 256 MB.
+    std::size_t shards = 16;
+    CachePolicy policy = CachePolicy::lru;
 
-    SharedChunkReader chunk;
-    Order::iterator it;
+    // Chunks shallower than this depth are never evicted once loaded, and do
+    // not count against the byte limit.
+    uint64_t pinDepth = 0;
+
+    // Limit for hierarchy subtrees, which are cached separately from chunks.
+    std::size_t hierarchyBytes = 1024 * 1024 * 64; // 64 MB.
 };
 
+// A shared, size-bounded cache of chunk data, which may be used concurrently
+// by any number of readers and queries.  Chunks are loaded outside of any
+// lock, and concurrent requests for a chunk which is being loaded wait on that
+// single load rather than fetching it again.  Entries are distributed over a
+// number of independently locked shards, each of which applies the eviction
+// policy to an even share of the total byte limit.
 class Cache
 {
 public:
-    Cache(std::size_t maxBytes = 1024 * 1024 * 256) // 250 MB.
-        : m_maxBytes(maxBytes)
-    { }
-
-    std::size_t maxBytes() const { return m_maxBytes; }
+    struct Stats
+    {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t loads = 0;
+        uint64_t failures = 0;
+        uint64_t bytesLoaded = 0;
+        uint64_t evictions = 0;
+        uint64_t rejections = 0;
+        uint64_t loadMicros = 0;
+        uint64_t maxLoadMicros = 0;
+        uint64_t bytes = 0;
+        uint64_t pinnedBytes = 0;
+
+        Json::Value toJson() const;
+    };
+
+    Cache(
+            std::size_t maxBytes = CacheParams().maxBytes,
+            std::size_t shards = CacheParams().shards);
+    explicit Cache(const CacheParams& params);
+    ~Cache();
+
+    std::size_t maxBytes() const { return m_params.maxBytes; }
+    const CacheParams& params() const { return m_params; }
+
+    HierarchyCache& hierarchy() { return m_hierarchy; }
 
     std::deque<SharedChunkReader> acquire(
             const Reader& reader,
             const std::vector<Dxyz>& keys);
 
+    Stats stats() const;
+
 private:
-    SharedChunkReader get(const Reader& reader, const Dxyz& id);
-    void purge();
+    class Sketch;
 
-    const std::size_t m_maxBytes;
+    enum class Region { window, probation, protect, pinned };
 
-    mutable std::mutex m_mutex;
-    std::size_t m_size = 0;
+    struct Entry;
+    using Map = std::map<GlobalId, Entry>;
+    using Order = std::list<Map::iterator>;
 
-    ChunkReaderInfo::Map m_chunks;
-    ChunkReaderInfo::Order m_order;
+    struct Entry
+    {
+        std::shared_future<SharedChunkReader> chunk;
+        std::size_t hash = 0;
+        bool loaded = false;
+        std::size_t bytes = 0;
+        Region region = Region::window;
+        Order::iterator it;
+    };
+
+    struct Shard
+    {
+        Shard();
+        ~Shard();
+
+        std::mutex mutex;
+        Map chunks;
+
+        // Most recently used first.
+        Order window;
+        Order probation;
+        Order protect;
+        Order pinned;
+
+        std::size_t windowBytes = 0;
+        std::size_t probationBytes = 0;
+        std::size_t protectBytes = 0;
+        std::size_t pinnedBytes = 0;
+
+        std::unique_ptr<Sketch> sketch;
+
+        Order& list(Region r);
+        std::size_t& bytes(Region r);
+        void move(Map::iterator it, Region r);
+        void remove(Map::iterator it);
+    };
+
+    static std::size_t hash(const GlobalId& id);
+
+    SharedChunkReader get(const Reader& reader, const Dxyz& key);
+    SharedChunkReader load(
+            const Reader& reader,
+            const GlobalId& id,
+            Shard& shard,
+            std::promise<SharedChunkReader>& promise);
+
+    void touch(Shard& shard, Map::iterator it);
+    void purge(Shard& shard);
+    void evict(Shard& shard, Map::iterator it);
+
+    const CacheParams m_params;
+    const std::size_t m_maxShardBytes;
+    std::vector<std::unique_ptr<Shard>> m_shards;
+    HierarchyCache m_hierarchy;
+
+    std::atomic<uint64_t> m_hits{0};
+    std::atomic<uint64_t> m_misses{0};
+    std::atomic<uint64_t> m_loads{0};
+    std::atomic<uint64_t> m_failures{0};
+    std::atomic<uint64_t> m_bytesLoaded{0};
+    std::atomic<uint64_t> m_evictions{0};
+    std::atomic<uint64_t> m_rejections{0};
+    std::atomic<uint64_t> m_loadMicros{0};
+    std::atomic<uint64_t> m_maxLoadMicros{0};
 };
 
 } // namespace entwine
@@ -10,6 +10,8 @@
 
 #include <entwine/reader/chunk-reader.hpp>
 
+#include <pdal/util/Utils.hpp>
+
 #include <entwine/io/io.hpp>
 #include <entwine/reader/reader.hpp>
 
@@ -18,6 +20,18 @@ namespace entwine
 
 ChunkReader::ChunkReader(const Reader& r, const Dxyz& id)
 {
+    const auto dataEp(r.ep().getSubEndpoint("ept-data"));
+    const DataIo& dataIo(r.metadata().dataIo());
+
+    PackEntry entry;
+    const bool packed(r.hierarchy().pack(id, entry));
+
+    if (!packed)
+    {
+        m_mapped = dataIo.map(dataEp, id.toString());
+        if (m_mapped) return;
+    }
+
     std::vector<char> data;
 
     VectorPointTable tmp(r.metadata().schema());
@@ -29,8 +43,11 @@ ChunkReader::ChunkReader(const Reader& r, const Dxyz& id)
                 tmp.data().data() + tmp.numPoints() * tmp.pointSize());
     });
 
-    const auto dataEp(r.ep().getSubEndpoint("ept-data"));
-    r.metadata().dataIo().read(dataEp, r.tmp(), id.toString(), tmp);
+    if (packed)
+    {
+        dataIo.read(dataEp, r.tmp(), id.toString(), entry, tmp, r.retry());
+    }
+    else dataIo.read(dataEp, r.tmp(), id.toString(), tmp, r.retry());
 
     m_table = makeUnique<VectorPointTable>(
             r.metadata().schema(),
@@ -38,5 +55,40 @@ ChunkReader::ChunkReader(const Reader& r, const Dxyz& id)
     m_table->clear(m_table->capacity());
 }
 
+ChunkReader::Column ChunkReader::column(const pdal::Dimension::Id id) const
+{
+    Column c;
+
+    if (m_mapped)
+    {
+        const pdal::PointLayout& layout(m_mapped->rawLayout());
+        if (!layout.hasDim(id)) return c;
+
+        c.data = m_mapped->rawData() + layout.dimOffset(id);
+        c.stride = layout.pointSize();
+        c.type = layout.dimType(id);
+
+        const ScaleOffset* so(m_mapped->scaleOffset());
+        if (so && (id == DimId::X || id == DimId::Y || id == DimId::Z))
+        {
+            const std::size_t pos(pdal::Utils::toNative(id) - 1);
+            c.scaled = true;
+            c.scale = so->scale()[pos];
+            c.offset = so->offset()[pos];
+        }
+    }
+    else
+    {
+        const pdal::PointLayout& layout(*m_table->layout());
+        if (!layout.hasDim(id)) return c;
+
+        c.data = m_table->data().data() + layout.dimOffset(id);
+        c.stride = m_table->pointSize();
+        c.type = layout.dimType(id);
+    }
+
+    return c;
+}
+
 } // namespace entwine
 
@@ -12,7 +12,10 @@
 
 #include <memory>
 
+#include <pdal/PointTable.hpp>
+
 #include <entwine/types/key.hpp>
+#include <entwine/types/mapped-point-table.hpp>
 #include <entwine/types/vector-point-table.hpp>
 #include <entwine/util/unique.hpp>
 
@@ -24,15 +27,46 @@ class Reader;
 class ChunkReader
 {
 public:
+    // The values of a single dimension across all points of the chunk.  The
+    // value of point i is stored, with the given type, at data + i * stride.
+    // If scaled, the value must be unscaled with the given scale and offset.
+    struct Column
+    {
+        const char* data = nullptr;
+        std::size_t stride = 0;
+        pdal::Dimension::Type type = pdal::Dimension::Type::None;
+
+        bool scaled = false;
+        double scale = 1;
+        double offset = 0;
+    };
+
     ChunkReader(const Reader& reader, const Dxyz& id);
 
-    VectorPointTable& table() { return *m_table; }
+    // Points are accessed in place for chunks which may be memory-mapped, and
+    // otherwise are copied into the normalized schema.
+    pdal::BasePointTable& table()
+    {
+        if (m_mapped) return *m_mapped;
+        return *m_table;
+    }
+
+    uint64_t size() const
+    {
+        return m_mapped ? m_mapped->size() : m_table->capacity();
+    }
+
     std::size_t bytes() const
     {
-        return m_table->capacity() + m_table->pointSize();
+        if (m_mapped) return m_mapped->bytes();
+        return m_table->capacity() * m_table->pointSize();
     }
 
+    // Returns a column with null data if this dimension does not exist.
+    Column column(pdal::Dimension::Id id) const;
+
 private:
+    std::unique_ptr<MappedPointTable> m_mapped;
     std::unique_ptr<VectorPointTable> m_table;
 };
 
@@ -15,6 +15,7 @@
 #include <pdal/Dimension.hpp>
 #include <pdal/util/Utils.hpp>
 
+#include <entwine/reader/filter-program.hpp>
 #include <entwine/types/files.hpp>
 #include <entwine/types/metadata.hpp>
 #include <entwine/types/schema.hpp>
@@ -143,16 +144,26 @@ std::unique_ptr<Comparison> Comparison::create(
         std::string dimensionName,
         const Json::Value& val)
 {
-    auto op(ComparisonOperator::create(metadata, dimensionName, val));
-    if (dimensionName == "Path") dimensionName = "OriginId";
+    const bool path(dimensionName == "Path");
 
-    const auto id(metadata.schema().getId(dimensionName));
+    const auto id(metadata.schema().getId(path ? "OriginId" : dimensionName));
     if (id == pdal::Dimension::Id::Unknown)
     {
         throw std::runtime_error("Unknown dimension: " + dimensionName);
     }
 
-    return makeUnique<Comparison>(id, dimensionName, std::move(op));
+    // The lookup above is as lenient as PDAL's, for example ignoring case, so
+    // from here on the dimension is referred to by its name in the schema -
+    // which is also the name under which its zone map is stored.
+    const std::string name(metadata.schema().find(id).name());
+
+    auto op(ComparisonOperator::create(metadata, path ? "Path" : name, val));
+    return makeUnique<Comparison>(id, name, std::move(op));
+}
+
+void Comparison::compile(FilterProgram& program) const
+{
+    program.compare(m_dim, m_op->type(), m_op->values());
 }
 
 std::unique_ptr<ComparisonOperator> ComparisonOperator::create(
@@ -15,6 +15,7 @@
 #include <entwine/reader/filterable.hpp>
 #include <entwine/types/bounds.hpp>
 #include <entwine/types/defs.hpp>
+#include <entwine/types/zone-map.hpp>
 #include <entwine/util/unique.hpp>
 
 namespace Json { class Value; }
@@ -110,8 +111,18 @@ public:
 
     virtual bool operator()(double in) const = 0;
     virtual bool operator()(const Bounds& bounds) const { return true; }
+
+    // Returns false only if no value within _range_ may pass.
+    virtual bool operator()(const ZoneMap::Range& range) const
+    {
+        return true;
+    }
+
     virtual void log(const std::string& pre) const = 0;
 
+    // The operand(s) against which dimension values are compared.
+    virtual std::vector<double> values() const = 0;
+
     virtual std::vector<Origin> origins() const
     {
         return std::vector<Origin>();
@@ -144,6 +155,20 @@ public:
         return !m_bounds || m_bounds->overlaps(bounds.growBy(.005));
     }
 
+    virtual bool operator()(const ZoneMap::Range& range) const override
+    {
+        switch (m_type)
+        {
+            case ComparisonType::eq: return range.mayEqual(m_val);
+            case ComparisonType::ne: return !range.allEqual(m_val);
+            case ComparisonType::gt: return range.max > m_val;
+            case ComparisonType::gte: return range.max >= m_val;
+            case ComparisonType::lt: return range.min < m_val;
+            case ComparisonType::lte: return range.min <= m_val;
+            default: return true;
+        }
+    }
+
     virtual void log(const std::string& pre) const override
     {
         std::cout << pre << toString(m_type) << " " << m_val;
@@ -151,6 +176,11 @@ public:
         std::cout << std::endl;
     }
 
+    virtual std::vector<double> values() const override
+    {
+        return std::vector<double>(1, m_val);
+    }
+
     virtual std::vector<Origin> origins() const override
     {
         std::vector<Origin> o;
@@ -188,6 +218,11 @@ public:
         }
     }
 
+    virtual std::vector<double> values() const override
+    {
+        return m_vals;
+    }
+
 protected:
     std::vector<double> m_vals;
     std::vector<Bounds> m_boundsList;
@@ -223,6 +258,14 @@ public:
             return false;
         }
     }
+
+    virtual bool operator()(const ZoneMap::Range& range) const override
+    {
+        return std::any_of(m_vals.begin(), m_vals.end(), [&range](double val)
+        {
+            return range.mayEqual(val);
+        });
+    }
 };
 
 class ComparisonNone : public ComparisonMulti
@@ -241,6 +284,22 @@ public:
             return in == val;
         });
     }
+
+    virtual bool operator()(const ZoneMap::Range& range) const override
+    {
+        // This chunk may be skipped only if all of its values are excluded.
+        if (!range.exhaustive())
+        {
+            return range.min != range.max || (*this)(range.min);
+        }
+
+        for (const double v : range.values())
+        {
+            if ((*this)(v)) return true;
+        }
+
+        return false;
+    }
 };
 
 template<typename O>
@@ -280,6 +339,14 @@ public:
         return (*m_op)(bounds);
     }
 
+    bool check(const ZoneMap& zones) const override
+    {
+        const ZoneMap::Range* range(zones.find(m_name));
+        return !range || (*m_op)(*range);
+    }
+
+    virtual void compile(FilterProgram& program) const override;
+
     virtual void log(const std::string& pre) const override
     {
         std::cout << pre << m_name << " ";
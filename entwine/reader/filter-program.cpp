@@ -0,0 +1,528 @@
+/******************************************************************************
+* Copyright (c) 2018, Connor Manning (connor@hobu.co)
+*
+* Entwine -- Point cloud indexing
+*
+* Entwine is available under the terms of the LGPL2 license. See COPYING
+* for specific license text and more information.
+*
+******************************************************************************/
+
+#include <entwine/reader/filter-program.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <map>
+#include <stdexcept>
+
+#include <pdal/PointRef.hpp>
+
+#include <entwine/reader/chunk-reader.hpp>
+
+namespace entwine
+{
+
+namespace
+{
+    using Mask = FilterProgram::Mask;
+    using Column = ChunkReader::Column;
+    using Type = pdal::Dimension::Type;
+
+    // The values of one dimension for every point of a chunk, copied out of
+    // the point records into contiguous storage of their stored type.
+    struct Values
+    {
+        Type type = Type::Double;
+        bool scaled = false;
+        double scale = 1;
+        double offset = 0;
+        std::vector<char> data;
+
+        template<typename T> const T* as() const
+        {
+            return reinterpret_cast<const T*>(data.data());
+        }
+    };
+
+    // The only strided access: each column is gathered once per chunk.
+    template<typename T>
+    void gather(const Column& c, const uint64_t np, Values& out)
+    {
+        out.data.resize(np * sizeof(T));
+
+        const char* src(c.data);
+        char* dst(out.data.data());
+
+        for (uint64_t i(0); i < np; ++i)
+        {
+            std::memcpy(dst, src, sizeof(T));
+            src += c.stride;
+            dst += sizeof(T);
+        }
+    }
+
+    void gather(
+            ChunkReader& chunk,
+            const pdal::Dimension::Id dim,
+            Values& out)
+    {
+        const Column c(chunk.column(dim));
+        const uint64_t np(chunk.size());
+
+        if (c.data)
+        {
+            out.type = c.type;
+            out.scaled = c.scaled;
+            out.scale = c.scale;
+            out.offset = c.offset;
+
+            switch (c.type)
+            {
+                case Type::Double: return gather<double>(c, np, out);
+                case Type::Float: return gather<float>(c, np, out);
+                case Type::Unsigned8: return gather<uint8_t>(c, np, out);
+                case Type::Signed8: return gather<int8_t>(c, np, out);
+                case Type::Unsigned16: return gather<uint16_t>(c, np, out);
+                case Type::Signed16: return gather<int16_t>(c, np, out);
+                case Type::Unsigned32: return gather<uint32_t>(c, np, out);
+                case Type::Signed32: return gather<int32_t>(c, np, out);
+                case Type::Unsigned64: return gather<uint64_t>(c, np, out);
+                case Type::Signed64: return gather<int64_t>(c, np, out);
+                default: break;
+            }
+        }
+
+        // For dimensions which cannot be accessed as a column.
+        out = Values();
+        out.data.resize(np * sizeof(double));
+
+        pdal::PointRef pr(chunk.table(), 0);
+        char* dst(out.data.data());
+
+        for (uint64_t i(0); i < np; ++i)
+        {
+            pr.setPointId(i);
+            const double d(pr.getFieldAs<double>(dim));
+            std::memcpy(dst, &d, sizeof(double));
+            dst += sizeof(double);
+        }
+    }
+
+    // The columns referenced by a program, each gathered on first use.  The
+    // bounds comparisons, for example, read each of X, Y, and Z twice.
+    class Columns
+    {
+    public:
+        explicit Columns(ChunkReader& chunk) : m_chunk(chunk) { }
+
+        const Values& get(const pdal::Dimension::Id dim)
+        {
+            auto it(m_values.find(dim));
+            if (it != m_values.end()) return it->second;
+
+            Values& values(m_values[dim]);
+            gather(m_chunk, dim, values);
+            return values;
+        }
+
+    private:
+        ChunkReader& m_chunk;
+        std::map<pdal::Dimension::Id, Values> m_values;
+    };
+
+    template<typename T>
+    class Plain
+    {
+    public:
+        explicit Plain(const Values& v) : m_data(v.as<T>()) { }
+
+        double operator()(uint64_t i) const { return value(m_data[i]); }
+        double value(const T v) const { return v; }
+
+    private:
+        const T* const m_data;
+    };
+
+    template<typename T>
+    class Scaled
+    {
+    public:
+        explicit Scaled(const Values& v)
+            : m_data(v.as<T>())
+            , m_scale(v.scale)
+            , m_offset(v.offset)
+        { }
+
+        double operator()(uint64_t i) const { return value(m_data[i]); }
+        double value(const T v) const { return v * m_scale + m_offset; }
+
+    private:
+        const T* const m_data;
+        const double m_scale;
+        const double m_offset;
+    };
+
+    // The inner loop for floating point values: with the accessor and
+    // operator known at compile time, this contains no indirect calls or type
+    // dispatch.
+    template<typename Get, typename Op>
+    void apply(
+            const uint64_t np,
+            const Get& get,
+            const Op op,
+            const double val,
+            uint8_t* out)
+    {
+        for (uint64_t i(0); i < np; ++i) out[i] = op(get(i), val);
+    }
+
+    template<typename Get>
+    void apply(
+            const Get& get,
+            const ComparisonType type,
+            const double val,
+            Mask& out)
+    {
+        const uint64_t np(out.size());
+        uint8_t* pos(out.data());
+
+        switch (type)
+        {
+            case ComparisonType::eq:
+                return apply(np, get, std::equal_to<double>(), val, pos);
+            case ComparisonType::gt:
+                return apply(np, get, std::greater<double>(), val, pos);
+            case ComparisonType::gte:
+                return apply(np, get, std::greater_equal<double>(), val, pos);
+            case ComparisonType::lt:
+                return apply(np, get, std::less<double>(), val, pos);
+            case ComparisonType::lte:
+                return apply(np, get, std::less_equal<double>(), val, pos);
+            default:
+                throw std::runtime_error("Invalid comparison type");
+        }
+    }
+
+    // An inclusive range of stored values.
+    template<typename T>
+    struct Range
+    {
+        T lo = std::numeric_limits<T>::lowest();
+        T hi = std::numeric_limits<T>::max();
+        bool empty = false;
+    };
+
+    // The least stored value for which _pred_ holds, where _pred_ is false up
+    // to some value and true from then on.  Returns false if it never holds.
+    template<typename T, typename Pred>
+    bool least(const Pred& pred, T& result)
+    {
+        T lo(std::numeric_limits<T>::lowest());
+        T hi(std::numeric_limits<T>::max());
+        if (!pred(hi)) return false;
+
+        while (lo < hi)
+        {
+            // The floor of their average, without overflow.
+            const T mid((lo & hi) + ((lo ^ hi) >> 1));
+            if (pred(mid)) hi = mid;
+            else lo = mid + 1;
+        }
+
+        result = lo;
+        return true;
+    }
+
+    // Since the unscaled value is non-decreasing in the stored value, the
+    // stored values passing a comparison form a range, whose bounds are found
+    // by evaluating the comparison exactly as the per-point path would.
+    template<typename T, typename Get>
+    Range<T> range(const Get& get, const ComparisonType type, const double val)
+    {
+        Range<T> r;
+        T t(0);
+
+        switch (type)
+        {
+            case ComparisonType::eq:
+            {
+                const Range<T> a(range<T>(get, ComparisonType::gte, val));
+                const Range<T> b(range<T>(get, ComparisonType::lte, val));
+                r.lo = a.lo;
+                r.hi = b.hi;
+                r.empty = a.empty || b.empty || r.lo > r.hi;
+                break;
+            }
+            case ComparisonType::gt:
+            case ComparisonType::gte:
+            {
+                const bool inclusive(type == ComparisonType::gte);
+                const auto passes([&](T v)
+                {
+                    const double d(get.value(v));
+                    return inclusive ? d >= val : d > val;
+                });
+
+                r.empty = !least<T>(passes, t);
+                r.lo = t;
+                break;
+            }
+            case ComparisonType::lt:
+            case ComparisonType::lte:
+            {
+                const bool inclusive(type == ComparisonType::lte);
+                const auto fails([&](T v)
+                {
+                    const double d(get.value(v));
+                    return !(inclusive ? d <= val : d < val);
+                });
+
+                if (least<T>(fails, t))
+                {
+                    if (t == r.lo) r.empty = true;
+                    else r.hi = t - 1;
+                }
+                break;
+            }
+            default:
+                throw std::runtime_error("Invalid comparison type");
+        }
+
+        return r;
+    }
+
+    // The inner loop for integral values, which compares them in their stored
+    // type so that it vectorizes without any conversions.
+    template<typename T>
+    void select(const T* data, const Range<T>& r, Mask& out)
+    {
+        if (r.empty)
+        {
+            std::fill(out.begin(), out.end(), 0);
+            return;
+        }
+
+        const T lo(r.lo);
+        const T hi(r.hi);
+        const uint64_t np(out.size());
+        uint8_t* pos(out.data());
+
+        for (uint64_t i(0); i < np; ++i)
+        {
+            pos[i] = (data[i] >= lo) & (data[i] <= hi);
+        }
+    }
+
+    template<typename T>
+    void real(
+            const Values& v,
+            const ComparisonType type,
+            const double val,
+            Mask& out)
+    {
+        if (v.scaled) apply(Scaled<T>(v), type, val, out);
+        else apply(Plain<T>(v), type, val, out);
+    }
+
+    template<typename T>
+    void integral(
+            const Values& v,
+            const ComparisonType type,
+            const double val,
+            Mask& out)
+    {
+        if (!v.scaled)
+        {
+            return select(v.as<T>(), range<T>(Plain<T>(v), type, val), out);
+        }
+
+        // Otherwise the unscaled value may not be non-decreasing.
+        if (!std::isfinite(v.scale) || !std::isfinite(v.offset) || v.scale < 0)
+        {
+            return real<T>(v, type, val, out);
+        }
+
+        select(v.as<T>(), range<T>(Scaled<T>(v), type, val), out);
+    }
+
+    void compare(
+            const Values& v,
+            const ComparisonType type,
+            const double val,
+            Mask& out)
+    {
+        switch (v.type)
+        {
+            case Type::Double: return real<double>(v, type, val, out);
+            case Type::Float: return real<float>(v, type, val, out);
+            case Type::Unsigned8: return integral<uint8_t>(v, type, val, out);
+            case Type::Signed8: return integral<int8_t>(v, type, val, out);
+            case Type::Unsigned16: return integral<uint16_t>(v, type, val, out);
+            case Type::Signed16: return integral<int16_t>(v, type, val, out);
+            case Type::Unsigned32: return integral<uint32_t>(v, type, val, out);
+            case Type::Signed32: return integral<int32_t>(v, type, val, out);
+            case Type::Unsigned64: return integral<uint64_t>(v, type, val, out);
+            case Type::Signed64: return integral<int64_t>(v, type, val, out);
+            default: throw std::runtime_error("Invalid dimension type");
+        }
+    }
+
+    void evaluate(
+            const Values& v,
+            const ComparisonType type,
+            const std::vector<double>& values,
+            Mask& out)
+    {
+        switch (type)
+        {
+            case ComparisonType::eq:
+            case ComparisonType::gt:
+            case ComparisonType::gte:
+            case ComparisonType::lt:
+            case ComparisonType::lte:
+                return compare(v, type, values.at(0), out);
+            case ComparisonType::ne:
+                compare(v, ComparisonType::eq, values.at(0), out);
+                for (std::size_t i(0); i < out.size(); ++i) out[i] ^= 1;
+                return;
+            case ComparisonType::in:
+            case ComparisonType::nin:
+                break;
+            default:
+                throw std::runtime_error("Invalid comparison type");
+        }
+
+        std::fill(out.begin(), out.end(), 0);
+        Mask single(out.size());
+
+        for (const double val : values)
+        {
+            compare(v, ComparisonType::eq, val, single);
+            for (std::size_t i(0); i < out.size(); ++i) out[i] |= single[i];
+        }
+
+        if (type == ComparisonType::nin)
+        {
+            for (std::size_t i(0); i < out.size(); ++i) out[i] ^= 1;
+        }
+    }
+}
+
+void FilterProgram::compare(
+        const pdal::Dimension::Id dim,
+        const ComparisonType type,
+        const std::vector<double>& values)
+{
+    if (isSingle(type) && values.size() != 1)
+    {
+        throw std::runtime_error("Invalid comparison values");
+    }
+
+    Instruction in;
+    in.dim = dim;
+    in.type = type;
+    in.values = values;
+    m_instructions.push_back(in);
+}
+
+void FilterProgram::gate(const LogicalOperator type, const std::size_t count)
+{
+    Instruction in;
+    in.gate = true;
+    in.op = type;
+    in.count = count;
+    m_instructions.push_back(in);
+}
+
+void FilterProgram::within(const Bounds& bounds)
+{
+    if (bounds == Bounds::everything()) return;
+
+    // Any existing program is ANDed with the bounds comparisons.
+    const bool prior(!empty());
+    const std::size_t dims(bounds.is3d() ? 3 : 2);
+    const pdal::Dimension::Id ids[] = {
+        pdal::Dimension::Id::X,
+        pdal::Dimension::Id::Y,
+        pdal::Dimension::Id::Z
+    };
+
+    for (std::size_t i(0); i < dims; ++i)
+    {
+        compare(
+                ids[i],
+                ComparisonType::gte,
+                std::vector<double>(1, bounds.min()[i]));
+        compare(
+                ids[i],
+                ComparisonType::lt,
+                std::vector<double>(1, bounds.max()[i]));
+    }
+
+    gate(LogicalOperator::lAnd, dims * 2 + (prior ? 1 : 0));
+}
+
+Mask FilterProgram::run(ChunkReader& chunk) const
+{
+    const uint64_t np(chunk.size());
+    Columns columns(chunk);
+    std::vector<Mask> stack;
+
+    for (const Instruction& in : m_instructions)
+    {
+        if (!in.gate)
+        {
+            stack.emplace_back(np);
+            evaluate(columns.get(in.dim), in.type, in.values, stack.back());
+            continue;
+        }
+
+        if (in.count > stack.size())
+        {
+            throw std::runtime_error("Invalid filter program");
+        }
+
+        if (!in.count)
+        {
+            // An empty AND selects everything, and an empty OR selects
+            // nothing.
+            const bool all(in.op != LogicalOperator::lOr);
+            stack.emplace_back(np, all ? 1 : 0);
+            continue;
+        }
+
+        const std::size_t first(stack.size() - in.count);
+        Mask& out(stack[first]);
+
+        for (std::size_t j(first + 1); j < stack.size(); ++j)
+        {
+            const Mask& other(stack[j]);
+
+            if (in.op == LogicalOperator::lAnd)
+            {
+                for (std::size_t i(0); i < np; ++i) out[i] &= other[i];
+            }
+            else
+            {
+                for (std::size_t i(0); i < np; ++i) out[i] |= other[i];
+            }
+        }
+
+        if (in.op == LogicalOperator::lNor)
+        {
+            for (std::size_t i(0); i < np; ++i) out[i] ^= 1;
+        }
+
+        stack.resize(first + 1);
+    }
+
+    if (stack.empty()) return Mask(np, 1);
+    if (stack.size() != 1) throw std::runtime_error("Invalid filter program");
+    return std::move(stack.back());
+}
+
+} // namespace entwine
+
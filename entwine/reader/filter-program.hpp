@@ -0,0 +1,74 @@
+/******************************************************************************
+* Copyright (c) 2018, Connor Manning (connor@hobu.co)
+*
+* Entwine -- Point cloud indexing
+*
+* Entwine is available under the terms of the LGPL2 license. See COPYING
+* for specific license text and more information.
+*
+******************************************************************************/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <pdal/Dimension.hpp>
+
+#include <entwine/reader/comparison.hpp>
+#include <entwine/reader/logic-gate.hpp>
+#include <entwine/types/bounds.hpp>
+
+namespace entwine
+{
+
+class ChunkReader;
+
+// A filter tree flattened into a postfix sequence of instructions, which is
+// evaluated over entire chunks rather than per point.  Each dimension used is
+// gathered once per chunk into a contiguous array, and each comparison over it
+// produces a selection mask which logic gates then combine.
+class FilterProgram
+{
+public:
+    using Mask = std::vector<uint8_t>;
+
+    // Push the mask of points whose value for _dim_ satisfies the comparison.
+    void compare(
+            pdal::Dimension::Id dim,
+            ComparisonType type,
+            const std::vector<double>& values);
+
+    // Replace the top _count_ masks with their combination.
+    void gate(LogicalOperator type, std::size_t count);
+
+    // Restrict the top mask to points within _bounds_.
+    void within(const Bounds& bounds);
+
+    bool empty() const { return m_instructions.empty(); }
+
+    // Evaluate this program for every point of _chunk_, returning a mask
+    // which is non-zero for selected points.
+    Mask run(ChunkReader& chunk) const;
+
+private:
+    struct Instruction
+    {
+        bool gate = false;
+
+        // Gates.
+        LogicalOperator op = LogicalOperator::lAnd;
+        std::size_t count = 0;
+
+        // Comparisons.
+        pdal::Dimension::Id dim = pdal::Dimension::Id::Unknown;
+        ComparisonType type = ComparisonType::eq;
+        std::vector<double> values;
+    };
+
+    std::vector<Instruction> m_instructions;
+};
+
+} // namespace entwine
+
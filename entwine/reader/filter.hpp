@@ -15,6 +15,7 @@
 #include <json/json.h>
 
 #include <entwine/reader/comparison.hpp>
+#include <entwine/reader/filter-program.hpp>
 #include <entwine/reader/logic-gate.hpp>
 #include <entwine/reader/query-params.hpp>
 #include <entwine/types/metadata.hpp>
@@ -42,6 +43,17 @@ public:
         {
             throw std::runtime_error("Invalid filter type");
         }
+
+        m_root.compile(m_program);
+
+        m_root.compile(m_bounded);
+        m_bounded.within(m_queryBounds);
+    }
+
+    // True if there are attribute filters in addition to the query bounds.
+    bool filtered() const
+    {
+        return !m_root.empty();
     }
 
     bool check(const pdal::PointRef& pointRef) const
@@ -54,6 +66,38 @@ public:
         return m_queryBounds.overlaps(bounds) && m_root.check(bounds);
     }
 
+    // False if none of the points summarized by _zones_ may pass the filter.
+    bool check(const ZoneMap& zones) const
+    {
+        return m_root.check(zones);
+    }
+
+    // True if every point within _bounds_ is within the query bounds.
+    bool contains(const Bounds& bounds) const
+    {
+        const Point& qmin(m_queryBounds.min());
+        const Point& qmax(m_queryBounds.max());
+        const Point& min(bounds.min());
+        const Point& max(bounds.max());
+
+        // The query bounds are exclusive of their maximum.
+        const bool xy(
+                qmin.x <= min.x && max.x < qmax.x &&
+                qmin.y <= min.y && max.y < qmax.y);
+
+        if (!m_queryBounds.is3d()) return xy;
+        return xy && qmin.z <= min.z && max.z < qmax.z;
+    }
+
+    // Select the points of an entire chunk which are within the query bounds
+    // and pass the filter, which is much faster than checking them one by
+    // one.  If the chunk is known to be _inside_ the query bounds, only the
+    // filter is evaluated.
+    FilterProgram::Mask select(ChunkReader& chunk, bool inside = false) const
+    {
+        return inside ? m_program.run(chunk) : m_bounded.run(chunk);
+    }
+
     void log() const
     {
         m_root.log("");
@@ -125,6 +169,10 @@ private:
     const Metadata& m_metadata;
     const Bounds m_queryBounds;
     LogicalAnd m_root;
+
+    // The filter alone, and the filter combined with the query bounds.
+    FilterProgram m_program;
+    FilterProgram m_bounded;
 };
 
 } // namespace entwine
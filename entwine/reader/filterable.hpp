@@ -16,16 +16,25 @@
 #include <pdal/PointRef.hpp>
 
 #include <entwine/types/bounds.hpp>
+#include <entwine/types/zone-map.hpp>
 
 namespace entwine
 {
 
+class FilterProgram;
+
 class Filterable
 {
 public:
     virtual bool check(const pdal::PointRef& pointRef) const = 0;
     virtual bool check(const Bounds& bounds) const { return true; }
+
+    // Returns false only if no point summarized by _zones_ may pass.
+    virtual bool check(const ZoneMap& zones) const { return true; }
     virtual void log(const std::string& pre) const = 0;
+
+    // Append the instructions which evaluate this filter to _program_.
+    virtual void compile(FilterProgram& program) const = 0;
 };
 
 } // namespace entwine
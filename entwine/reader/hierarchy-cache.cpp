@@ -0,0 +1,131 @@
+/******************************************************************************
+* Copyright (c) 2018, Connor Manning (connor@hobu.co)
+*
+* Entwine -- Point cloud indexing
+*
+* Entwine is available under the terms of the LGPL2 license. See COPYING
+* for specific license text and more information.
+*
+******************************************************************************/
+
+#include <entwine/reader/hierarchy-cache.hpp>
+
+namespace entwine
+{
+
+std::size_t HierarchySubtree::bytes() const
+{
+    // Each node of a std::map also carries its tree pointers and color.
+    const std::size_t node(4 * sizeof(void*));
+
+    std::size_t n(page->bytes());
+    for (const auto& p : packs)
+    {
+        n += sizeof(p) + node + p.second.pack.capacity();
+    }
+    for (const auto& p : zones) n += sizeof(p.first) + node + p.second.bytes();
+    return n;
+}
+
+HierarchyCache::HierarchyCache(const std::size_t maxBytes)
+    : m_maxBytes(maxBytes)
+{ }
+
+std::size_t HierarchyCache::bytes() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_bytes;
+}
+
+bool HierarchyCache::contains(const std::string& path, const Dxyz& root) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_pages.count(GlobalId(path, root));
+}
+
+HierarchyCache::SharedSubtree HierarchyCache::get(
+        const std::string& path,
+        const Dxyz& root,
+        const Load& load)
+{
+    const GlobalId id(path, root);
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto it(m_pages.find(id));
+
+    if (it != m_pages.end())
+    {
+        Entry& entry(it->second);
+        m_order.splice(m_order.begin(), m_order, entry.it);
+
+        std::shared_future<SharedSubtree> page(entry.page);
+        lock.unlock();
+        return page.get();
+    }
+
+    std::promise<SharedSubtree> promise;
+
+    it = m_pages.insert(std::make_pair(id, Entry())).first;
+    Entry& entry(it->second);
+    entry.page = promise.get_future().share();
+    m_order.push_front(it);
+    entry.it = m_order.begin();
+
+    lock.unlock();
+
+    SharedSubtree page;
+
+    try
+    {
+        page = load();
+    }
+    catch (...)
+    {
+        // Waiters receive this error, and the entry is removed so that a
+        // later request may try again.
+        promise.set_exception(std::current_exception());
+
+        lock.lock();
+        it = m_pages.find(id);
+        if (it != m_pages.end())
+        {
+            m_order.erase(it->second.it);
+            m_pages.erase(it);
+        }
+        throw;
+    }
+
+    promise.set_value(page);
+
+    lock.lock();
+    it = m_pages.find(id);
+    if (it != m_pages.end())
+    {
+        it->second.loaded = true;
+        it->second.bytes = page->bytes();
+        m_bytes += it->second.bytes;
+    }
+
+    purge();
+    return page;
+}
+
+void HierarchyCache::purge()
+{
+    // Entries which are still loading are skipped.  Evicted pages remain
+    // valid for any reader which holds them.
+    auto it(m_order.end());
+    while (m_bytes > m_maxBytes && it != m_order.begin())
+    {
+        --it;
+        Entry& entry((*it)->second);
+        if (!entry.loaded) continue;
+
+        m_bytes -= entry.bytes;
+        m_pages.erase(*it);
+        it = m_order.erase(it);
+    }
+}
+
+} // namespace entwine
+
@@ -0,0 +1,95 @@
+/******************************************************************************
+* Copyright (c) 2018, Connor Manning (connor@hobu.co)
+*
+* Entwine -- Point cloud indexing
+*
+* Entwine is available under the terms of the LGPL2 license. See COPYING
+* for specific license text and more information.
+*
+******************************************************************************/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <entwine/io/hierarchy-io.hpp>
+#include <entwine/io/pack.hpp>
+#include <entwine/types/key.hpp>
+#include <entwine/types/zone-map.hpp>
+
+namespace entwine
+{
+
+// A single hierarchy file, along with the pack entries and zone maps of the
+// nodes whose counts it holds.
+struct HierarchySubtree
+{
+    explicit HierarchySubtree(std::unique_ptr<const HierarchyPage> p)
+        : page(std::move(p))
+    { }
+
+    // Approximate memory usage.
+    std::size_t bytes() const;
+
+    std::unique_ptr<const HierarchyPage> page;
+    PackMap packs;
+    ZoneMaps zones;
+};
+
+// A shared, size-bounded LRU cache of hierarchy subtrees, which may be used
+// concurrently by any number of readers.  As with the chunk Cache, subtrees
+// are loaded outside of the lock, and concurrent requests for a subtree which
+// is being loaded wait on that single load.
+class HierarchyCache
+{
+public:
+    using SharedSubtree = std::shared_ptr<const HierarchySubtree>;
+    using Load = std::function<SharedSubtree()>;
+
+    explicit HierarchyCache(std::size_t maxBytes = 1024 * 1024 * 64);
+
+    // Get the subtree rooted at _root_ of the dataset at _path_, calling
+    // _load_ to fetch it if it is not cached.
+    SharedSubtree get(
+            const std::string& path,
+            const Dxyz& root,
+            const Load& load);
+
+    bool contains(const std::string& path, const Dxyz& root) const;
+
+    std::size_t maxBytes() const { return m_maxBytes; }
+    std::size_t bytes() const;
+
+private:
+    struct Entry;
+    using Map = std::map<GlobalId, Entry>;
+    using Order = std::list<Map::iterator>;
+
+    struct Entry
+    {
+        std::shared_future<SharedSubtree> page;
+        bool loaded = false;
+        std::size_t bytes = 0;
+        Order::iterator it;
+    };
+
+    void purge();
+
+    const std::size_t m_maxBytes;
+
+    mutable std::mutex m_mutex;
+    Map m_pages;
+    Order m_order;  // Most recently used first.
+    std::size_t m_bytes = 0;
+};
+
+} // namespace entwine
+
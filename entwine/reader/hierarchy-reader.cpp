@@ -0,0 +1,241 @@
+/******************************************************************************
+* Copyright (c) 2018, Connor Manning (connor@hobu.co)
+*
+* Entwine -- Point cloud indexing
+*
+* Entwine is available under the terms of the LGPL2 license. See COPYING
+* for specific license text and more information.
+*
+******************************************************************************/
+
+#include <entwine/reader/hierarchy-reader.hpp>
+
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+#include <entwine/io/ensure.hpp>
+#include <entwine/util/pool.hpp>
+#include <entwine/util/unique.hpp>
+
+namespace entwine
+{
+
+namespace
+{
+    const std::size_t fetchThreads(8);
+    const std::size_t fetchQueue(64);
+}
+
+HierarchyReader::HierarchyReader(
+        const Metadata& metadata,
+        const arbiter::Endpoint& out,
+        HierarchyCache& cache,
+        const RetryPolicy& retry)
+    : m_ep(out.getSubEndpoint("ept-hierarchy"))
+    , m_path(m_ep.prefixedRoot())
+    , m_cache(cache)
+    , m_type(metadata.hierarchyType())
+    , m_postfix(metadata.postfix())
+    , m_packed(metadata.packThreshold())
+    , m_zoned(metadata.zoneMaps())
+    , m_retry(retry)
+    , m_pool(makeUnique<Pool>(fetchThreads, fetchQueue, false))
+    , m_root(get(Dxyz()))
+{ }
+
+HierarchyReader::Lookup HierarchyReader::lookup(const Dxyz& key) const
+{
+    Lookup result;
+    result.subtree = locate(key, result.count);
+    if (!result.subtree) return result;
+
+    const HierarchySubtree& subtree(*result.subtree);
+
+    if (m_packed)
+    {
+        const auto it(subtree.packs.find(key));
+        if (it != subtree.packs.end()) result.pack = &it->second;
+    }
+
+    if (m_zoned)
+    {
+        const auto it(subtree.zones.find(key));
+        if (it != subtree.zones.end()) result.zones = &it->second;
+    }
+
+    return result;
+}
+
+uint64_t HierarchyReader::count(const Dxyz& key) const
+{
+    uint64_t n(0);
+    locate(key, n);
+    return n;
+}
+
+bool HierarchyReader::pack(const Dxyz& key, PackEntry& entry) const
+{
+    if (!m_packed) return false;
+
+    const Lookup node(lookup(key));
+    if (!node.pack) return false;
+    entry = *node.pack;
+    return true;
+}
+
+std::shared_ptr<const ZoneMap> HierarchyReader::zoneMap(const Dxyz& key) const
+{
+    if (!m_zoned) return std::shared_ptr<const ZoneMap>();
+
+    const Lookup node(lookup(key));
+    if (!node.zones) return std::shared_ptr<const ZoneMap>();
+    return std::shared_ptr<const ZoneMap>(node.subtree, node.zones);
+}
+
+HierarchyReader::SharedSubtree HierarchyReader::locate(
+        const Dxyz& key,
+        uint64_t& count) const
+{
+    SharedSubtree subtree(m_root);
+    Dxyz root;
+
+    while (true)
+    {
+        bool descended(false);
+
+        // Find the nearest node at or above this key within the current
+        // subtree.  If that is the root of a further subtree, continue there.
+        for (uint64_t d(key.d + 1); d-- > root.d; )
+        {
+            const uint64_t shift(key.d - d);
+            const Dxyz node(
+                    d,
+                    key.p.x >> shift,
+                    key.p.y >> shift,
+                    key.p.z >> shift);
+
+            int64_t n(0);
+            if (!subtree->page->find(node, n)) continue;
+
+            if (n >= 0)
+            {
+                if (d != key.d) return SharedSubtree();
+                count = n;
+                return subtree;
+            }
+
+            if (node == root)
+            {
+                throw std::runtime_error(
+                        "Invalid hierarchy subtree: " + node.toString());
+            }
+
+            subtree = descend(*subtree, node);
+            root = node;
+            descended = true;
+            break;
+        }
+
+        if (!descended) return SharedSubtree();
+    }
+}
+
+HierarchyReader::SharedSubtree HierarchyReader::get(const Dxyz& root) const
+{
+    return m_cache.get(m_path, root, [this, &root]() { return fetch(root); });
+}
+
+HierarchyReader::SharedSubtree HierarchyReader::fetch(const Dxyz& root) const
+{
+    const std::string file(root.toString() + hierarchyExtension(m_type));
+    std::unique_ptr<const HierarchyPage> page;
+
+    if (m_type == HierarchyType::json)
+    {
+        page = makeUnique<HierarchyPage>(
+                decodeHierarchy(m_type, *ensureGet(m_ep, file, m_retry)));
+    }
+    else if (m_ep.isLocal())
+    {
+        // Local binary files are searched in place rather than read.
+        if (auto mapped = MappedFile::create(
+                    arbiter::fs::expandTilde(m_ep.prefixedRoot() + file)))
+        {
+            page = makeUnique<HierarchyPage>(std::move(mapped));
+        }
+    }
+
+    if (!page)
+    {
+        page = makeUnique<HierarchyPage>(
+                std::move(*ensureGet(m_ep, file, m_retry)));
+    }
+
+    auto subtree(std::make_shared<HierarchySubtree>(std::move(page)));
+    if (m_packed) subtree->packs = loadPackIndex(m_ep, root, m_postfix);
+    if (m_zoned) subtree->zones = loadZoneMaps(m_ep, root, m_postfix);
+    return subtree;
+}
+
+HierarchyReader::SharedSubtree HierarchyReader::descend(
+        const HierarchySubtree& parent,
+        const Dxyz& root) const
+{
+    std::vector<Dxyz> siblings;
+
+    if (root.d)
+    {
+        const Xyz base(root.p.x & ~1ULL, root.p.y & ~1ULL, root.p.z & ~1ULL);
+
+        for (uint64_t i(0); i < 8; ++i)
+        {
+            const Dxyz s(
+                    root.d,
+                    base.x + (i & 1),
+                    base.y + ((i >> 1) & 1),
+                    base.z + ((i >> 2) & 1));
+
+            if (s == root) continue;
+
+            int64_t n(0);
+            if (
+                    parent.page->find(s, n) &&
+                    n < 0 &&
+                    !m_cache.contains(m_path, s))
+            {
+                siblings.push_back(s);
+            }
+        }
+    }
+
+    // Siblings are fetched in the background, and this lookup does not wait
+    // for them.  A failure here is not fatal, since the cache drops failed
+    // subtrees and one which is actually needed is fetched again - with its
+    // error propagated - but it is reported.
+    for (const Dxyz& s : siblings)
+    {
+        m_pool->add([this, s]()
+        {
+            try
+            {
+                get(s);
+            }
+            catch (std::exception& e)
+            {
+                std::cout << "Failed to prefetch hierarchy " << s <<
+                    ": " << e.what() << std::endl;
+            }
+            catch (...)
+            {
+                std::cout << "Failed to prefetch hierarchy " << s <<
+                    ": unknown error" << std::endl;
+            }
+        });
+    }
+
+    return get(root);
+}
+
+} // namespace entwine
+
@@ -10,12 +10,20 @@
 
 #pragma once
 
-#include <cassert>
 #include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
 
+#include <entwine/io/ensure.hpp>
+#include <entwine/io/hierarchy-io.hpp>
+#include <entwine/io/pack.hpp>
+#include <entwine/reader/hierarchy-cache.hpp>
 #include <entwine/third/arbiter/arbiter.hpp>
 #include <entwine/types/key.hpp>
-#include <entwine/util/json.hpp>
+#include <entwine/types/metadata.hpp>
+#include <entwine/types/zone-map.hpp>
+#include <entwine/util/pool.hpp>
 
 namespace entwine
 {
@@ -25,42 +33,78 @@ class Node
 public:
 };
 
+// Only the root hierarchy file is loaded up front.  Further subtrees are
+// loaded as lookups reach them - along with their siblings, which are fetched
+// concurrently since a traversal is likely to visit them next - and are held
+// in a cache which may be shared between readers.  The pack entries and zone
+// maps of each subtree are loaded along with it.
 class HierarchyReader
 {
+    using SharedSubtree = HierarchyCache::SharedSubtree;
+
 public:
     using Keys = std::map<Dxyz, uint64_t>;
 
-    HierarchyReader(const arbiter::Endpoint& out)
-        : m_ep(out.getSubEndpoint("ept-hierarchy"))
+    // Everything known about a single node.  The node exists if its count is
+    // non-zero.  Its subtree is held, so the pack entry and zone map, each of
+    // which is null if absent, remain valid for the lifetime of this result.
+    struct Lookup
     {
-        load();
-    }
+        uint64_t count = 0;
+        const PackEntry* pack = nullptr;
+        const ZoneMap* zones = nullptr;
 
-    uint64_t count(const Dxyz& p) const
-    {
-        const auto it(m_keys.find(p));
-        if (it != m_keys.end()) return it->second;
-        else return 0;
-    }
+        SharedSubtree subtree;
+    };
+
+    HierarchyReader(
+            const Metadata& metadata,
+            const arbiter::Endpoint& out,
+            HierarchyCache& cache,
+            const RetryPolicy& retry = RetryPolicy());
+
+    // Locates the subtree holding this node only once, for callers which
+    // need more than one of the values below.
+    Lookup lookup(const Dxyz& p) const;
+
+    uint64_t count(const Dxyz& p) const;
+
+    // Returns true if this node is stored within a pack file.
+    bool pack(const Dxyz& p, PackEntry& entry) const;
+
+    // Returns null if no attribute summary exists for this node.  The result
+    // keeps its subtree alive, even if that is evicted from the cache.
+    std::shared_ptr<const ZoneMap> zoneMap(const Dxyz& p) const;
 
 private:
-    // For now, we'll just load everything on init.  This needs to be hooked up
-    // to a caching mechanism.
-    void load(const Dxyz& root = Dxyz())
-    {
-        const auto json(parse(m_ep.get(root.toString() + ".json")));
+    // Get the subtree whose file holds the count of node _p_, along with that
+    // count.  Returns null if the node does not exist.
+    SharedSubtree locate(const Dxyz& p, uint64_t& count) const;
+
+    SharedSubtree get(const Dxyz& root) const;
+    SharedSubtree fetch(const Dxyz& root) const;
 
-        for (const auto str : json.getMemberNames())
-        {
-            const Dxyz key(str);
-            const int64_t n(json[str].asInt64());
-            if (n < 0) load(key);
-            else m_keys[key] = static_cast<uint64_t>(n);
-        }
-    }
+    // Get the subtree rooted at _root_, which is referenced by _parent_, and
+    // start fetching any of its uncached sibling subtrees.
+    SharedSubtree descend(
+            const HierarchySubtree& parent,
+            const Dxyz& root) const;
 
     const arbiter::Endpoint m_ep;
-    Keys m_keys;
+    const std::string m_path;
+    HierarchyCache& m_cache;
+    const HierarchyType m_type;
+    const std::string m_postfix;
+    const bool m_packed;
+    const bool m_zoned;
+    const RetryPolicy m_retry;
+
+    // Fetches sibling subtrees in the background.  Declared after the members
+    // which its tasks use, so that it is joined before they are destroyed.
+    std::unique_ptr<Pool> m_pool;
+
+    // The root subtree is held for the lifetime of this reader.
+    SharedSubtree m_root;
 };
 
 } // namespace entwine
@@ -10,6 +10,7 @@
 
 #include <entwine/reader/logic-gate.hpp>
 
+#include <entwine/reader/filter-program.hpp>
 #include <entwine/util/unique.hpp>
 
 namespace entwine
@@ -23,5 +24,12 @@ std::unique_ptr<LogicGate> LogicGate::create(const LogicalOperator type)
     else throw std::runtime_error("Invalid logic gate type");
 }
 
+void LogicGate::compile(FilterProgram& program, const LogicalOperator type)
+    const
+{
+    for (const auto& f : m_filters) f->compile(program);
+    program.gate(type, m_filters.size());
+}
+
 } // namespace entwine
 
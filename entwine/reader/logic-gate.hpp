@@ -52,7 +52,11 @@ public:
         m_filters.push_back(std::move(f));
     }
 
+    bool empty() const { return m_filters.empty(); }
+
 protected:
+    void compile(FilterProgram& program, LogicalOperator type) const;
+
     std::vector<std::unique_ptr<Filterable>> m_filters;
 };
 
@@ -79,6 +83,21 @@ public:
         return true;
     }
 
+    virtual bool check(const ZoneMap& zones) const override
+    {
+        for (const auto& f : m_filters)
+        {
+            if (!f->check(zones)) return false;
+        }
+
+        return true;
+    }
+
+    virtual void compile(FilterProgram& program) const override
+    {
+        LogicGate::compile(program, LogicalOperator::lAnd);
+    }
+
     virtual void log(const std::string& pre) const override
     {
         if (m_filters.size()) std::cout << pre << "AND" << std::endl;
@@ -109,6 +128,21 @@ public:
         return false;
     }
 
+    virtual bool check(const ZoneMap& zones) const override
+    {
+        for (const auto& f : m_filters)
+        {
+            if (f->check(zones)) return true;
+        }
+
+        return false;
+    }
+
+    virtual void compile(FilterProgram& program) const override
+    {
+        LogicGate::compile(program, LogicalOperator::lOr);
+    }
+
     virtual void log(const std::string& pre) const override
     {
         std::cout << pre << "OR" << std::endl;
@@ -130,6 +164,18 @@ public:
         return !LogicalOr::check(bounds);
     }
 
+    // Knowing that some point may pass an inner filter does not tell us
+    // whether every point does, so this cannot exclude anything.
+    virtual bool check(const ZoneMap& zones) const override
+    {
+        return true;
+    }
+
+    virtual void compile(FilterProgram& program) const override
+    {
+        LogicGate::compile(program, LogicalOperator::lNor);
+    }
+
     virtual void log(const std::string& pre) const override
     {
         std::cout << pre << "NOR" << std::endl;
@@ -10,6 +10,7 @@
 
 #pragma once
 
+#include <algorithm>
 #include <cstddef>
 #include <limits>
 #include <memory>
@@ -55,6 +56,7 @@ public:
         , m_depthBegin(depthBegin)
         , m_depthEnd(depthEnd ? depthEnd : 64)
         , m_filter(filter)
+        , m_threads(4)
     { }
 
     QueryParams(Json::Value q)
@@ -74,6 +76,11 @@ public:
                 throw std::runtime_error("Invalid depth specification");
             }
         }
+
+        if (q.isMember("threads"))
+        {
+            m_threads = std::max<std::size_t>(q["threads"].asUInt64(), 1);
+        }
     }
 
     const Bounds& bounds() const { return m_bounds; }
@@ -81,11 +88,17 @@ public:
     std::size_t de() const { return m_depthEnd; }
     const Json::Value& filter() const { return m_filter; }
 
+    // Number of chunks which may be fetched and filtered concurrently.  These
+    // run on a pool shared by all queries of the same Reader, so this bounds
+    // the share of that pool which a single query may occupy.
+    std::size_t threads() const { return m_threads; }
+
 private:
     const Bounds m_bounds;
     const std::size_t m_depthBegin;
     const std::size_t m_depthEnd;
     const Json::Value m_filter;
+    std::size_t m_threads;
 };
 
 } // namespace entwine
@@ -10,7 +10,13 @@
 
 #include <entwine/reader/query.hpp>
 
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+
 #include <entwine/reader/reader.hpp>
+#include <entwine/util/pool.hpp>
+#include <entwine/util/unique.hpp>
 
 namespace entwine
 {
@@ -21,69 +27,255 @@ Query::Query(const Reader& r, const Json::Value& j)
     , m_hierarchy(r.hierarchy())
     , m_params(j)
     , m_filter(m_metadata, m_params)
-    , m_overlaps(overlaps())
-{ }
-
-HierarchyReader::Keys Query::overlaps() const
 {
-    HierarchyReader::Keys keys;
-    ChunkKey c(m_metadata);
-    overlaps(keys, c);
-    return keys;
+    overlaps(ChunkKey(m_metadata), false);
 }
 
-void Query::overlaps(HierarchyReader::Keys& keys, const ChunkKey& c) const
+void Query::overlaps(const ChunkKey& c, bool inside)
 {
     if (!m_filter.check(c.bounds())) return;
 
     const auto k(c.get());
-    const auto count(m_hierarchy.count(k));
+    const HierarchyReader::Lookup node(m_hierarchy.lookup(k));
+    const auto count(node.count);
     if (!count) return;
 
-    if (c.depth() >= m_params.db()) keys[k] = count;
+    // Once a chunk is entirely within the query bounds, so are all of its
+    // descendants.
+    inside = inside || m_filter.contains(c.bounds());
+
+    // A chunk whose attribute summary rules out the filter is not selected,
+    // but its descendants may still contain matching points.
+    const bool possible(!node.zones || m_filter.check(*node.zones));
+
+    if (c.depth() >= m_params.db() && possible)
+    {
+        m_overlaps[k] = count;
+        if (inside) m_inside.insert(k);
+    }
 
     if (c.depth() + 1 >= m_params.de()) return;
 
     for (std::size_t i(0); i < dirEnd(); ++i)
     {
-        overlaps(keys, c.getStep(toDir(i)));
+        overlaps(c.getStep(toDir(i)), inside);
     }
 }
 
 void Query::run()
 {
-    for (const auto& k : m_overlaps)
+    std::vector<Dxyz> keys;
+    for (const auto& k : m_overlaps) keys.push_back(k.first);
+
+    const std::size_t threads(
+            std::min<std::size_t>(m_params.threads(), keys.size()));
+
+    if (threads <= 1)
+    {
+        for (const Dxyz& key : keys)
+        {
+            Result result;
+            select(key, result);
+            merge(result);
+        }
+        return;
+    }
+
+    // Chunks are processed out of order, but merged in order.  The number of
+    // chunks which are in flight or awaiting their merge is bounded.
+    const std::size_t window(threads * 2);
+
+    std::vector<std::unique_ptr<Result>> results(keys.size());
+    std::vector<bool> done(keys.size(), false);
+    std::size_t next(0);
+    std::size_t active(0);
+    std::mutex mutex;
+    std::condition_variable cv;
+
+    auto mergeReady([&](std::unique_lock<std::mutex>& lock)
+    {
+        while (next < keys.size() && done[next])
+        {
+            std::unique_ptr<Result> result(std::move(results[next++]));
+            lock.unlock();
+            merge(*result);
+            lock.lock();
+        }
+    });
+
+    Pool& pool(m_reader.pool());
+
+    try
     {
-        // For now we're doing one at a time.
-        std::vector<Dxyz> keys;
-        keys.push_back(k.first);
+        for (std::size_t i(0); i < keys.size(); ++i)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                mergeReady(lock);
+                while (i - next >= window)
+                {
+                    cv.wait(lock, [&]() { return done[next]; });
+                    mergeReady(lock);
+                }
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                ++active;
+            }
+
+            const Dxyz& key(keys[i]);
+            pool.add([this, i, &key, &results, &done, &active, &mutex, &cv]()
+            {
+                // Selection captures its own errors into the result.
+                std::unique_ptr<Result> result(makeUnique<Result>());
+                select(key, *result);
+
+                std::lock_guard<std::mutex> lock(mutex);
+                results[i] = std::move(result);
+                done[i] = true;
+                --active;
+                cv.notify_all();
+            });
+        }
+
+        std::unique_lock<std::mutex> lock(mutex);
+        while (next < keys.size())
+        {
+            cv.wait(lock, [&]() { return done[next]; });
+            mergeReady(lock);
+        }
+    }
+    catch (...)
+    {
+        // Let outstanding tasks finish before our shared state goes away.  The
+        // pool is shared, so we wait for our own tasks rather than joining.
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [&]() { return !active; });
+        throw;
+    }
+}
+
+void Query::select(const Dxyz& key, Result& result) const
+{
+    try
+    {
+        // The hierarchy tells us the maximum possible size of our output.
+        const auto it(m_overlaps.find(key));
+        if (it != m_overlaps.end()) reserve(result.data, it->second);
+
+        // Every point of a chunk within the query bounds is selected, unless
+        // there is also an attribute filter.
+        const bool inside(m_inside.count(key));
+        const bool all(inside && !m_filter.filtered());
+
+        if (all && !needsPoints() && it != m_overlaps.end())
+        {
+            result.points = it->second;
+            return;
+        }
+
+        std::vector<Dxyz> keys(1, key);
         auto block(m_reader.cache().acquire(m_reader, keys));
 
         for (auto& chunk : block)
         {
-            for (const auto& pr : chunk->table())
+            if (all)
             {
-                maybeProcess(pr);
+                pdal::PointRef pr(chunk->table(), 0);
+                for (uint64_t i(0); i < chunk->size(); ++i)
+                {
+                    pr.setPointId(i);
+                    process(pr, result.data);
+                }
+
+                result.points += chunk->size();
+                continue;
+            }
+
+            const FilterProgram::Mask mask(m_filter.select(*chunk, inside));
+
+            pdal::PointRef pr(chunk->table(), 0);
+            for (uint64_t i(0); i < mask.size(); ++i)
+            {
+                if (!mask[i]) continue;
+
+                pr.setPointId(i);
+                process(pr, result.data);
+                ++result.points;
             }
         }
     }
+    catch (...)
+    {
+        result.error = std::current_exception();
+    }
+}
+
+void Query::merge(Result& result)
+{
+    if (result.error) std::rethrow_exception(result.error);
+    m_points += result.points;
+    merge(result.data);
+}
+
+void ReadQuery::run(Callback cb, const std::size_t blockPoints)
+{
+    m_callback = cb;
+    m_blockBytes = std::max<std::size_t>(blockPoints, 1) * m_schema.pointSize();
+    m_data.clear();
+
+    Query::run();
+    if (!m_data.empty()) emit();
+
+    m_callback = Callback();
+}
+
+void ReadQuery::merge(std::vector<char>& data)
+{
+    if (!m_callback)
+    {
+        if (m_data.empty()) m_data = std::move(data);
+        else m_data.insert(m_data.end(), data.begin(), data.end());
+        return;
+    }
+
+    if (m_data.empty() && data.size() <= m_blockBytes)
+    {
+        m_data = std::move(data);
+        if (m_data.size() == m_blockBytes) emit();
+        return;
+    }
+
+    std::size_t offset(0);
+    while (offset < data.size())
+    {
+        if (m_data.capacity() < m_blockBytes) m_data.reserve(m_blockBytes);
+
+        const std::size_t n(
+                std::min(m_blockBytes - m_data.size(), data.size() - offset));
+
+        m_data.insert(
+                m_data.end(),
+                data.begin() + offset,
+                data.begin() + offset + n);
+        offset += n;
+
+        if (m_data.size() == m_blockBytes) emit();
+    }
 }
 
-void Query::maybeProcess(const pdal::PointRef& pr)
+void ReadQuery::emit()
 {
-    const Point point(
-            pr.getFieldAs<double>(DimId::X),
-            pr.getFieldAs<double>(DimId::Y),
-            pr.getFieldAs<double>(DimId::Z));
-    if (!m_params.bounds().contains(point) || !m_filter.check(pr)) return;
-    process(pr);
-    ++m_points;
+    m_callback(m_data);
+    m_data.clear();
 }
 
-void ReadQuery::process(const pdal::PointRef& pr)
+void ReadQuery::process(const pdal::PointRef& pr, std::vector<char>& data)
+    const
 {
-    m_data.resize(m_data.size() + m_schema.pointSize(), 0);
-    char* pos(m_data.data() + m_data.size() - m_schema.pointSize());
+    data.resize(data.size() + m_schema.pointSize(), 0);
+    char* pos(data.data() + data.size() - m_schema.pointSize());
 
     for (const auto& dimInfo : m_schema.dims())
     {
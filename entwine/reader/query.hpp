@@ -10,6 +10,12 @@
 
 #pragma once
 
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <set>
+#include <vector>
+
 #include <entwine/reader/query-params.hpp>
 
 #include <entwine/reader/filter.hpp>
@@ -30,12 +36,30 @@ public:
     Query(const Reader& reader, const Json::Value& params);
     virtual ~Query() { }
 
+    // Fetch and filter overlapping chunks, concurrently if the query allows
+    // multiple threads.  Results are merged in the same order as a serial
+    // traversal.
     void run();
 
     uint64_t points() const { return m_points; }
 
 protected:
-    virtual void process(const pdal::PointRef& pr) { }
+    // Called concurrently, for each selected point of a chunk, with an output
+    // buffer which is specific to that chunk.
+    virtual void process(const pdal::PointRef& pr, std::vector<char>& data)
+        const
+    { }
+
+    // Called serially, in chunk order, with each chunk's output buffer.
+    virtual void merge(std::vector<char>& data) { }
+
+    // Prepare the output buffer for a chunk containing _np_ points, of which
+    // any number may be selected.
+    virtual void reserve(std::vector<char>& data, uint64_t np) const { }
+
+    // If false, selected points are only counted, so chunks whose points are
+    // all selected need not be fetched.
+    virtual bool needsPoints() const { return true; }
 
     const Reader& m_reader;
     const Metadata& m_metadata;
@@ -44,14 +68,23 @@ protected:
     const Filter m_filter;
 
 private:
-    HierarchyReader::Keys overlaps() const;
-    void overlaps(HierarchyReader::Keys& keys, const ChunkKey& c) const;
+    // Traverse the hierarchy, recording the chunks which overlap the query
+    // and which of those lie entirely within the query bounds.
+    void overlaps(const ChunkKey& c, bool inside);
 
-    void maybeProcess(const pdal::PointRef& pr);
+    struct Result
+    {
+        uint64_t points = 0;
+        std::vector<char> data;
+        std::exception_ptr error;
+    };
+
+    void select(const Dxyz& key, Result& result) const;
+    void merge(Result& result);
 
     HierarchyReader::Keys m_overlaps;
+    std::set<Dxyz> m_inside;
     uint64_t m_points = 0;
-    std::deque<SharedChunkReader> m_chunks;
 };
 
 class CountQuery : public Query
@@ -60,24 +93,47 @@ public:
     CountQuery(const Reader& reader, const Json::Value& json)
         : Query(reader, json)
     { }
+
+protected:
+    virtual bool needsPoints() const override { return false; }
 };
 
 class ReadQuery : public Query
 {
 public:
+    // Receives a block of results laid out according to the query schema.
+    // The callback may take the contents of the block.
+    using Callback = std::function<void(std::vector<char>& block)>;
+
     ReadQuery(const Reader& reader, const Json::Value& json)
         : Query(reader, json)
         , m_schema(json.isMember("schema") ?
                 Schema(json["schema"]) : m_metadata.outSchema())
     { }
 
+    // Accumulate all results, which are then available via data().
+    using Query::run;
+
+    // Stream results to _cb_ in blocks of at most _blockPoints_ points as the
+    // query progresses, rather than accumulating them.  Each block but the
+    // last is full.
+    void run(Callback cb, std::size_t blockPoints = 65536);
+
     const std::vector<char>& data() const { return m_data; }
 
 protected:
-    virtual void process(const pdal::PointRef& pr) override;
+    virtual void process(const pdal::PointRef& pr, std::vector<char>& data)
+        const override;
+
+    virtual void merge(std::vector<char>& data) override;
+
+    virtual void reserve(std::vector<char>& data, uint64_t np) const override
+    {
+        data.reserve(np * m_schema.pointSize());
+    }
 
 private:
-    void setAs(char* dst, double d, pdal::Dimension::Type t)
+    void setAs(char* dst, double d, pdal::Dimension::Type t) const
     {
         switch (t)
         {
@@ -106,16 +162,21 @@ private:
         }
     }
 
-    template<typename T> void setAs(char* dst, double d)
+    template<typename T> void setAs(char* dst, double d) const
     {
         const T v(static_cast<T>(d));
         auto src(reinterpret_cast<const char*>(&v));
         std::copy(src, src + sizeof(T), dst);
     }
 
+    void emit();
+
     const Schema m_schema;
 
     std::vector<char> m_data;
+
+    Callback m_callback;
+    std::size_t m_blockBytes = 0;
 };
 
 } // namespace entwine
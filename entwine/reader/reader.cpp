@@ -10,23 +10,47 @@
 
 #include <entwine/reader/reader.hpp>
 
+#include <algorithm>
+#include <thread>
+
+#include <entwine/io/memory-driver.hpp>
 #include <entwine/util/unique.hpp>
 
 namespace entwine
 {
 
+namespace
+{
+    std::size_t poolSize()
+    {
+        return std::min<std::size_t>(
+                std::max<std::size_t>(std::thread::hardware_concurrency(), 1),
+                8);
+    }
+
+    Config retryConfig(const RetryPolicy& retry)
+    {
+        Json::Value json;
+        json["retry"] = retry.toJson();
+        return Config(json);
+    }
+}
+
 Reader::Reader(
         std::string out,
         std::string tmp,
         std::shared_ptr<Cache> cache,
-        std::shared_ptr<arbiter::Arbiter> a)
-    : m_arbiter(maybeDefault(a))
+        std::shared_ptr<arbiter::Arbiter> a,
+        const RetryPolicy& retry)
+    : m_arbiter(a ? a : makeArbiter())
     , m_ep(m_arbiter->getEndpoint(out))
     , m_tmp(m_arbiter->getEndpoint(
                 tmp.size() ? tmp : arbiter::fs::getTempPath()))
-    , m_metadata(m_ep)
-    , m_hierarchy(m_ep)
-    , m_cache(makeUnique<Cache>())
+    , m_retry(retry)
+    , m_metadata(m_ep, retryConfig(m_retry))
+    , m_cache(cache ? cache : std::make_shared<Cache>())
+    , m_hierarchy(m_metadata, m_ep, m_cache->hierarchy(), m_retry)
+    , m_pool(makeUnique<Pool>(poolSize(), poolSize(), false))
 { }
 
 std::unique_ptr<CountQuery> Reader::count(const Json::Value& j) const
@@ -13,6 +13,7 @@
 #include <memory>
 #include <string>
 
+#include <entwine/io/ensure.hpp>
 #include <entwine/reader/cache.hpp>
 #include <entwine/reader/hierarchy-reader.hpp>
 #include <entwine/reader/query.hpp>
@@ -20,6 +21,7 @@
 #include <entwine/types/key.hpp>
 #include <entwine/types/metadata.hpp>
 #include <entwine/util/json.hpp>
+#include <entwine/util/pool.hpp>
 
 namespace entwine
 {
@@ -32,7 +34,8 @@ public:
             std::string tmp = "",
             std::shared_ptr<Cache> cache = std::shared_ptr<Cache>(),
             std::shared_ptr<arbiter::Arbiter> a =
-                std::shared_ptr<arbiter::Arbiter>());
+                std::shared_ptr<arbiter::Arbiter>(),
+            const RetryPolicy& retry = RetryPolicy());
 
     std::unique_ptr<CountQuery> count(const Json::Value& json) const;
     std::unique_ptr<ReadQuery> read(const Json::Value& json) const;
@@ -43,17 +46,24 @@ public:
     const arbiter::Endpoint& tmp() const { return m_tmp; }
     Cache& cache() const { return *m_cache; }
 
+    // Governs every fetch of this reader's metadata, hierarchy, and data.
+    const RetryPolicy& retry() const { return m_retry; }
+
+    // Shared by this reader's queries to fetch and filter chunks.
+    Pool& pool() const { return *m_pool; }
+
     std::string path() const { return ep().prefixedRoot(); }
 
 private:
     std::shared_ptr<arbiter::Arbiter> m_arbiter;
     arbiter::Endpoint m_ep;
     arbiter::Endpoint m_tmp;
+    const RetryPolicy m_retry;
 
     const Metadata m_metadata;
+    std::shared_ptr<Cache> m_cache;
     const HierarchyReader m_hierarchy;
-
-    std::unique_ptr<Cache> m_cache;
+    std::unique_ptr<Pool> m_pool;
 };
 
 } // namespace entwine
@@ -89,11 +89,12 @@ Files::Files(const FileInfoList& files)
 FileInfoList Files::extract(
         const arbiter::Endpoint& top,
         const bool primary,
-        const std::string postfix)
+        const std::string postfix,
+        const RetryPolicy& retry)
 {
     const auto ep(top.getSubEndpoint("ept-sources"));
     const std::string filename("list" + postfix + ".json");
-    FileInfoList list(toFileInfo(parse(ensureGetString(ep, filename))));
+    FileInfoList list(toFileInfo(parse(ensureGetString(ep, filename, retry))));
 
     if (!primary) return list;
 
@@ -109,7 +110,7 @@ FileInfoList Files::extract(
 
     for (const auto url : urls)
     {
-        const auto meta(parse(ensureGetString(ep, url)));
+        const auto meta(parse(ensureGetString(ep, url, retry)));
         for (const std::string id : meta.getMemberNames())
         {
             const Origin o(idMap.at(id));
@@ -130,19 +131,24 @@ void Files::save(
         const bool detailed) const
 {
     const auto ep(top.getSubEndpoint("ept-sources"));
-    writeList(ep, postfix);
+    writeList(ep, postfix, config.retry());
     if (detailed) writeFull(ep, config);
 }
 
 void Files::writeList(
         const arbiter::Endpoint& ep,
-        const std::string& postfix) const
+        const std::string& postfix,
+        const RetryPolicy& retry) const
 {
     Json::Value json;
     for (const FileInfo& f : list()) json.append(f.toListJson());
 
     const bool styled(size() <= 1000);
-    ensurePut(ep, "list" + postfix + ".json", toPreciseString(json, styled));
+    ensurePut(
+            ep,
+            "list" + postfix + ".json",
+            toPreciseString(json, styled),
+            retry);
 }
 
 void Files::writeFull(
@@ -150,6 +156,7 @@ void Files::writeFull(
         const Config& config) const
 {
     Pool pool(config.totalThreads());
+    const RetryPolicy retry(config.retry());
 
     std::map<std::string, Json::Value> meta;
     for (const auto& f : m_files)
@@ -161,11 +168,11 @@ void Files::writeFull(
 
     for (const auto& p : meta)
     {
-        pool.add([this, &ep, &p, styled]()
+        pool.add([this, &ep, &p, &retry, styled]()
         {
             const std::string& filename(p.first);
             const Json::Value& json(p.second);
-            ensurePut(ep, filename, toPreciseString(json, styled));
+            ensurePut(ep, filename, toPreciseString(json, styled), retry);
         });
     }
 
@@ -40,7 +40,8 @@ public:
     static FileInfoList extract(
             const arbiter::Endpoint& top,
             bool primary,
-            std::string postfix = "");
+            std::string postfix = "",
+            const RetryPolicy& retry = RetryPolicy());
 
     void save(
             const arbiter::Endpoint& ep,
@@ -124,8 +125,10 @@ public:
     }
 
 private:
-    void writeList(const arbiter::Endpoint& ep, const std::string& postfix)
-        const;
+    void writeList(
+            const arbiter::Endpoint& ep,
+            const std::string& postfix,
+            const RetryPolicy& retry) const;
 
     void writeFull(const arbiter::Endpoint& ep, const Config& config) const;
 
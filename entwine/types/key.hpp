@@ -70,6 +70,10 @@ struct Dxyz
         : Dxyz(d, p.x, p.y, p.z)
     { }
 
+    Dxyz(const Dxyz& other)
+        : Dxyz(other.d, other.p)
+    { }
+
     Dxyz(std::string v)
         : Dxyz()
     {
@@ -134,6 +138,23 @@ inline bool operator!=(const Dxyz& a, const Dxyz& b)
     return !(a == b);
 }
 
+// A node of a particular dataset, for caches shared between datasets.
+struct GlobalId
+{
+    GlobalId(const std::string path, const Dxyz& key)
+        : path(path)
+        , key(key)
+    { }
+
+    const std::string path;
+    const Dxyz key;
+};
+
+inline bool operator<(const GlobalId& a, const GlobalId& b)
+{
+    return a.path < b.path || (a.path == b.path && a.key < b.key);
+}
+
 struct Key
 {
     Key(const Metadata& metadata)
@@ -0,0 +1,208 @@
+/******************************************************************************
+* Copyright (c) 2018, Connor Manning (connor@hobu.co)
+*
+* Entwine -- Point cloud indexing
+*
+* Entwine is available under the terms of the LGPL2 license. See COPYING
+* for specific license text and more information.
+*
+******************************************************************************/
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include <pdal/PointRef.hpp>
+#include <pdal/PointTable.hpp>
+
+#include <entwine/types/point.hpp>
+#include <entwine/types/scale-offset.hpp>
+#include <entwine/types/schema.hpp>
+#include <entwine/util/mapped-file.hpp>
+
+namespace entwine
+{
+
+// A read-only table over serialized binary point data, laid out according to
+// the output schema, which is typically memory-mapped.  The points are not
+// copied: each field is converted to the normalized schema as it is accessed,
+// so for example scaled XYZ values are unscaled only when they are read.
+class MappedPointTable : public pdal::SimplePointTable
+{
+public:
+    MappedPointTable(
+            const Schema& schema,
+            const Schema& outSchema,
+            std::unique_ptr<MappedFile> file)
+        : MappedPointTable(
+                schema,
+                outSchema,
+                file->data(),
+                file->size())
+    {
+        m_file = std::move(file);
+    }
+
+    MappedPointTable(
+            const Schema& schema,
+            const Schema& outSchema,
+            std::vector<char>&& data)
+        : MappedPointTable(schema, outSchema, data.data(), data.size())
+    {
+        m_data = std::move(data);
+    }
+
+    uint64_t size() const { return m_np; }
+    uint64_t bytes() const { return m_bytes; }
+
+    // Direct access to the serialized data, for callers which operate on
+    // entire dimensions rather than point by point.
+    const char* rawData() const { return m_raw.data(); }
+    const pdal::PointLayout& rawLayout() const { return *m_raw.layout(); }
+    const ScaleOffset* scaleOffset() const { return m_so.get(); }
+
+    virtual char* getPoint(pdal::PointId index) override
+    {
+        throw std::runtime_error("MappedPointTable has no normalized points");
+    }
+
+    virtual pdal::PointId addPoint() override
+    {
+        throw std::runtime_error("MappedPointTable is read-only");
+    }
+
+protected:
+    virtual void setFieldInternal(
+            pdal::Dimension::Id id,
+            pdal::PointId index,
+            const void* value) override
+    {
+        throw std::runtime_error("MappedPointTable is read-only");
+    }
+
+    virtual void getFieldInternal(
+            pdal::Dimension::Id id,
+            pdal::PointId index,
+            void* value) const override
+    {
+        const pdal::PointLayout& raw(*m_raw.layout());
+        const pdal::Dimension::Type type(raw.dimType(id));
+        const char* pos(
+                m_raw.data() + index * m_pointSize + raw.dimOffset(id));
+
+        // Normalized XYZ values are always doubles, and every other dimension
+        // has the same type in both layouts.
+        if (id == DimId::X || id == DimId::Y || id == DimId::Z)
+        {
+            double v(toDouble(pos, type));
+            if (m_so)
+            {
+                v = Point::unscale(
+                        v,
+                        pick(m_so->scale(), id),
+                        pick(m_so->offset(), id));
+            }
+            std::memcpy(value, &v, sizeof(double));
+        }
+        else
+        {
+            std::memcpy(value, pos, pdal::Dimension::size(type));
+        }
+    }
+
+private:
+    MappedPointTable(
+            const Schema& schema,
+            const Schema& outSchema,
+            const char* data,
+            const uint64_t bytes)
+        : pdal::SimplePointTable(schema.pdalLayout())
+        , m_raw(outSchema, data)
+        , m_so(outSchema.scaleOffset())
+        , m_bytes(bytes)
+        , m_np(bytes / outSchema.pointSize())
+        , m_pointSize(outSchema.pointSize())
+    {
+        if (bytes % outSchema.pointSize() != 0)
+        {
+            throw std::runtime_error("Invalid MappedPointTable data");
+        }
+    }
+
+    // The serialized data, in the output layout.
+    class Raw : public pdal::SimplePointTable
+    {
+    public:
+        Raw(const Schema& outSchema, const char* data)
+            : pdal::SimplePointTable(outSchema.pdalLayout())
+            , m_data(data)
+            , m_pointSize(outSchema.pointSize())
+        { }
+
+        virtual char* getPoint(pdal::PointId index) override
+        {
+            return const_cast<char*>(m_data + index * m_pointSize);
+        }
+
+        virtual pdal::PointId addPoint() override
+        {
+            throw std::runtime_error("MappedPointTable is read-only");
+        }
+
+        const char* data() const { return m_data; }
+
+    private:
+        const char* const m_data;
+        const uint64_t m_pointSize;
+    };
+
+    static double pick(const Point& p, pdal::Dimension::Id id)
+    {
+        return id == DimId::X ? p.x : id == DimId::Y ? p.y : p.z;
+    }
+
+    template <typename T>
+    static double as(const char* pos)
+    {
+        T v;
+        std::memcpy(&v, pos, sizeof(T));
+        return v;
+    }
+
+    static double toDouble(const char* pos, pdal::Dimension::Type type)
+    {
+        using Type = pdal::Dimension::Type;
+
+        switch (type)
+        {
+            case Type::Signed8: return as<int8_t>(pos);
+            case Type::Signed16: return as<int16_t>(pos);
+            case Type::Signed32: return as<int32_t>(pos);
+            case Type::Signed64: return as<int64_t>(pos);
+            case Type::Unsigned8: return as<uint8_t>(pos);
+            case Type::Unsigned16: return as<uint16_t>(pos);
+            case Type::Unsigned32: return as<uint32_t>(pos);
+            case Type::Unsigned64: return as<uint64_t>(pos);
+            case Type::Float: return as<float>(pos);
+            case Type::Double: return as<double>(pos);
+            default: throw std::runtime_error("Invalid XYZ type");
+        }
+    }
+
+    // One of these owns the underlying data.
+    std::unique_ptr<MappedFile> m_file;
+    std::vector<char> m_data;
+
+    mutable Raw m_raw;
+    std::unique_ptr<ScaleOffset> m_so;
+    const uint64_t m_bytes;
+    const uint64_t m_np;
+    const uint64_t m_pointSize;
+};
+
+} // namespace entwine
+
@@ -8,11 +8,15 @@
 *
 ******************************************************************************/
 
+#include <algorithm>
 #include <cassert>
+#include <cmath>
 
 #include <entwine/io/io.hpp>
 #include <entwine/types/files.hpp>
+#include <entwine/types/key.hpp>
 #include <entwine/types/metadata.hpp>
+#include <entwine/types/node-key.hpp>
 #include <entwine/types/reprojection.hpp>
 #include <entwine/types/schema.hpp>
 #include <entwine/types/srs.hpp>
@@ -23,6 +27,17 @@
 namespace entwine
 {
 
+namespace
+{
+
+PointOrder resolvePointOrder(const std::string& s, const Schema& schema)
+{
+    if (s.size()) return toPointOrder(s);
+    return schema.hasTime() ? PointOrder::gpsTime : PointOrder::none;
+}
+
+} // unnamed namespace
+
 Metadata::Metadata(const Config& config, const bool exists)
     : m_outSchema(makeUnique<Schema>(config.schema()))
     , m_schema(makeUnique<Schema>(Schema::makeAbsolute(*m_outSchema)))
@@ -48,6 +63,11 @@ Metadata::Metadata(const Config& config, const bool exists)
     , m_sharedDepth(m_subset ? m_subset->splits() : 0)
     , m_overflowDepth(std::max(config.overflowDepth(), m_sharedDepth))
     , m_overflowThreshold(config.overflowThreshold())
+    , m_pointOrder(resolvePointOrder(config.pointOrder(), *m_outSchema))
+    , m_hierarchyType(toHierarchyType(config.hierType()))
+    , m_packThreshold(config.packThreshold())
+    , m_packDepth(config.packDepth())
+    , m_zoneMaps(config.zoneMaps())
 {
     if (1ULL << m_startDepth != m_ticks)
     {
@@ -90,6 +110,44 @@ Metadata::Metadata(const Config& config, const bool exists)
                     "Bounds are too large for the selected scale");
         }
     }
+
+    if (m_hierarchyType == HierarchyType::binary)
+    {
+        // Nodes deeper than the depth at which voxels become finer than the
+        // point resolution can only hold duplicate points.  If that depth is
+        // beyond what a binary hierarchy can store, reject the build now
+        // rather than failing as its hierarchy is saved.
+        if (!m_outSchema->isScaled())
+        {
+            throw std::runtime_error(
+                    "A binary hierarchy requires a scaled schema");
+        }
+
+        const Scale scale(m_outSchema->scale());
+        const double resolution(
+                std::min(scale.x, std::min(scale.y, scale.z)));
+        const double finest(
+                m_boundsCubic->width() / m_ticks /
+                std::pow(2.0, binaryHierarchyMaxDepth));
+
+        if (finest > resolution)
+        {
+            throw std::runtime_error(
+                    "A binary hierarchy supports depths up to " +
+                    std::to_string(binaryHierarchyMaxDepth) +
+                    ", which is too shallow for these bounds and scale - " +
+                    "use a json hierarchy");
+        }
+    }
+}
+
+uint64_t Metadata::maxDepth() const
+{
+    if (m_hierarchyType == HierarchyType::binary)
+    {
+        return binaryHierarchyMaxDepth;
+    }
+    return NodeKey::maxDepth;
 }
 
 Metadata::Metadata(const arbiter::Endpoint& ep, const Config& config)
@@ -97,11 +155,18 @@ Metadata::Metadata(const arbiter::Endpoint& ep, const Config& config)
             entwine::merge(
                 config.json(),
                 entwine::merge(
-                    parse(ep.get("ept" + config.postfix() + ".json")),
-                    parse(ep.get("ept-build" + config.postfix() + ".json")))),
+                    parse(ensureGetString(
+                            ep,
+                            "ept" + config.postfix() + ".json",
+                            config.retry())),
+                    parse(ensureGetString(
+                            ep,
+                            "ept-build" + config.postfix() + ".json",
+                            config.retry())))),
             true)
 {
-    Files files(Files::extract(ep, primary(), config.postfix()));
+    Files files(
+            Files::extract(ep, primary(), config.postfix(), config.retry()));
     files.append(m_files->list());
     m_files = makeUnique<Files>(files.list());
 }
@@ -119,7 +184,7 @@ Json::Value Metadata::toJson() const
     json["ticks"] = (Json::UInt64)m_ticks;
     json["points"] = (Json::UInt64)m_files->totalInserts();
     json["dataType"] = m_dataIo->type();
-    json["hierarchyType"] = "json"; // TODO.
+    json["hierarchyType"] = toString(m_hierarchyType);
     json["srs"] = m_srs->toJson();
 
     return json;
@@ -133,6 +198,13 @@ Json::Value Metadata::toBuildParamsJson() const
     json["trustHeaders"] = m_trustHeaders;
     json["overflowDepth"] = (Json::UInt64)m_overflowDepth;
     json["overflowThreshold"] = (Json::UInt64)m_overflowThreshold;
+    json["pointOrder"] = toString(m_pointOrder);
+    if (m_packThreshold)
+    {
+        json["packThreshold"] = (Json::UInt64)m_packThreshold;
+        json["packDepth"] = (Json::UInt64)m_packDepth;
+    }
+    if (m_zoneMaps) json["zoneMaps"] = true;
     json["software"] = "Entwine";
     if (m_subset) json["subset"] = m_subset->toJson();
     if (m_reprojection) json["reprojection"] = m_reprojection->toJson();
@@ -146,13 +218,13 @@ void Metadata::save(const arbiter::Endpoint& endpoint, const Config& config)
     {
         const auto json(toJson());
         const std::string f("ept" + postfix() + ".json");
-        ensurePut(endpoint, f, toPreciseString(json));
+        ensurePut(endpoint, f, toPreciseString(json), config.retry());
     }
 
     {
         const auto json(toBuildParamsJson());
         const std::string f("ept-build" + postfix() + ".json");
-        ensurePut(endpoint, f, toPreciseString(json));
+        ensurePut(endpoint, f, toPreciseString(json), config.retry());
     }
 
     const bool detailed(!m_merged && primary());
@@ -189,6 +261,19 @@ std::string Metadata::postfix(const uint64_t depth) const
     return "";
 }
 
+std::string Metadata::packName(const Dxyz& key, const uint64_t np) const
+{
+    if (!m_packThreshold || np > m_packThreshold || key.d < m_packDepth)
+    {
+        return "";
+    }
+
+    const uint64_t shift(key.d - m_packDepth);
+    const Xyz& p(key.p);
+    const Dxyz root(m_packDepth, p.x >> shift, p.y >> shift, p.z >> shift);
+    return root.toString() + postfix() + ".pack";
+}
+
 Bounds Metadata::makeConformingBounds(Bounds b) const
 {
     Point pmin(b.min());
@@ -17,6 +17,8 @@
 #include <pdal/Dimension.hpp>
 
 #include <entwine/builder/config.hpp>
+#include <entwine/io/hierarchy-type.hpp>
+#include <entwine/io/point-order.hpp>
 #include <entwine/types/bounds.hpp>
 #include <entwine/types/defs.hpp>
 #include <entwine/types/subset.hpp>
@@ -29,6 +31,7 @@ namespace entwine
 namespace arbiter { class Endpoint; }
 
 class DataIo;
+struct Dxyz;
 class Files;
 class Point;
 class Reprojection;
@@ -65,6 +68,11 @@ public:
     const Files& files() const { return *m_files; }
 
     const DataIo& dataIo() const { return *m_dataIo; }
+    PointOrder pointOrder() const { return m_pointOrder; }
+    HierarchyType hierarchyType() const { return m_hierarchyType; }
+
+    // The deepest node which the hierarchy of this build can store.
+    uint64_t maxDepth() const;
 
     const Reprojection* reprojection() const { return m_reprojection.get(); }
     const Subset* subset() const { return m_subset.get(); }
@@ -80,6 +88,13 @@ public:
     uint64_t sharedDepth() const { return m_sharedDepth; }
     uint64_t overflowDepth() const { return m_overflowDepth; }
     uint64_t overflowThreshold() const { return m_overflowThreshold; }
+    uint64_t packThreshold() const { return m_packThreshold; }
+    uint64_t packDepth() const { return m_packDepth; }
+    bool zoneMaps() const { return m_zoneMaps; }
+
+    // If this chunk should be appended to a pack file rather than written as
+    // its own file, returns the name of that pack.  Otherwise returns empty.
+    std::string packName(const Dxyz& key, uint64_t np) const;
 
     void makeWhole();
 
@@ -120,6 +135,14 @@ private:
     const uint64_t m_overflowDepth;
     const uint64_t m_overflowThreshold;
 
+    const PointOrder m_pointOrder;
+    const HierarchyType m_hierarchyType;
+
+    const uint64_t m_packThreshold;
+    const uint64_t m_packDepth;
+
+    const bool m_zoneMaps;
+
     bool m_merged = false;
 };
 
@@ -0,0 +1,111 @@
+/******************************************************************************
+* Copyright (c) 2018, Connor Manning (connor@hobu.co)
+*
+* Entwine -- Point cloud indexing
+*
+* Entwine is available under the terms of the LGPL2 license. See COPYING
+* for specific license text and more information.
+*
+******************************************************************************/
+
+#include <entwine/types/node-key.hpp>
+
+#include <stdexcept>
+
+namespace entwine
+{
+
+namespace
+{
+    // Each word holds 21 bits of each of X, Y, and Z.
+    const uint64_t wordDepth(21);
+    const uint64_t wordMask((1ULL << wordDepth) - 1);
+
+    uint64_t spread(uint64_t v)
+    {
+        // Spread the low 21 bits of v so there are two zero bits between
+        // each of them.
+        v &= wordMask;
+        v = (v | v << 32) & 0x1f00000000ffffULL;
+        v = (v | v << 16) & 0x1f0000ff0000ffULL;
+        v = (v | v << 8) & 0x100f00f00f00f00fULL;
+        v = (v | v << 4) & 0x10c30c30c30c30c3ULL;
+        v = (v | v << 2) & 0x1249249249249249ULL;
+        return v;
+    }
+
+    uint64_t compact(uint64_t v)
+    {
+        v &= 0x1249249249249249ULL;
+        v = (v ^ (v >> 2)) & 0x10c30c30c30c30c3ULL;
+        v = (v ^ (v >> 4)) & 0x100f00f00f00f00fULL;
+        v = (v ^ (v >> 8)) & 0x1f0000ff0000ffULL;
+        v = (v ^ (v >> 16)) & 0x1f00000000ffffULL;
+        v = (v ^ (v >> 32)) & wordMask;
+        return v;
+    }
+
+    uint64_t interleave(uint64_t x, uint64_t y, uint64_t z)
+    {
+        return spread(x) | spread(y) << 1 | spread(z) << 2;
+    }
+
+    // The depth marked by the leading 1 bit of a word.
+    uint64_t markedDepth(const uint64_t v)
+    {
+        uint64_t d(0);
+        while (d < wordDepth && v >> (3 * (d + 1))) ++d;
+        return d;
+    }
+}
+
+NodeKey::NodeKey(const Dxyz& key)
+{
+    const uint64_t d(key.d);
+    if (d > maxDepth)
+    {
+        throw std::runtime_error("Node too deep: " + key.toString());
+    }
+
+    if (d <= wordDepth)
+    {
+        m_hi = 0;
+        m_lo = (1ULL << (3 * d)) | interleave(key.p.x, key.p.y, key.p.z);
+    }
+    else
+    {
+        m_hi = (1ULL << (3 * (d - wordDepth))) |
+            interleave(
+                    key.p.x >> wordDepth,
+                    key.p.y >> wordDepth,
+                    key.p.z >> wordDepth);
+        m_lo = interleave(key.p.x, key.p.y, key.p.z);
+    }
+}
+
+uint64_t NodeKey::depth() const
+{
+    if (m_hi) return wordDepth + markedDepth(m_hi);
+    return markedDepth(m_lo);
+}
+
+Dxyz NodeKey::dxyz() const
+{
+    const uint64_t d(depth());
+
+    if (d <= wordDepth)
+    {
+        const uint64_t v(m_lo & ((1ULL << (3 * d)) - 1));
+        return Dxyz(d, compact(v), compact(v >> 1), compact(v >> 2));
+    }
+
+    const uint64_t h(m_hi & ((1ULL << (3 * (d - wordDepth))) - 1));
+    return Dxyz(
+            d,
+            compact(h) << wordDepth | compact(m_lo),
+            compact(h >> 1) << wordDepth | compact(m_lo >> 1),
+            compact(h >> 2) << wordDepth | compact(m_lo >> 2));
+}
+
+} // namespace entwine
+
@@ -0,0 +1,73 @@
+/******************************************************************************
+* Copyright (c) 2018, Connor Manning (connor@hobu.co)
+*
+* Entwine -- Point cloud indexing
+*
+* Entwine is available under the terms of the LGPL2 license. See COPYING
+* for specific license text and more information.
+*
+******************************************************************************/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <entwine/types/key.hpp>
+
+namespace entwine
+{
+
+// A compact representation of a Dxyz as a 128-bit locational code: a leading
+// 1 bit at position 3D marks the depth, beneath which the bits of X, Y, and Z
+// are interleaved.  Keys therefore sort by depth and then in Morton order.
+// Depths up to 21 fit entirely in the low word.
+class NodeKey
+{
+public:
+    static const uint64_t maxDepth = 42;
+
+    // The root node, 0-0-0-0.
+    NodeKey() { }
+    NodeKey(uint64_t hi, uint64_t lo) : m_hi(hi), m_lo(lo) { }
+    explicit NodeKey(const Dxyz& key);
+
+    uint64_t depth() const;
+    Dxyz dxyz() const;
+
+    uint64_t hi() const { return m_hi; }
+    uint64_t lo() const { return m_lo; }
+
+    std::size_t hash() const
+    {
+        uint64_t h(m_lo ^ (m_hi * 0x9e3779b97f4a7c15ULL));
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+        return h;
+    }
+
+private:
+    uint64_t m_hi = 0;
+    uint64_t m_lo = 1;
+};
+
+inline bool operator<(const NodeKey& a, const NodeKey& b)
+{
+    return a.hi() < b.hi() || (a.hi() == b.hi() && a.lo() < b.lo());
+}
+
+inline bool operator==(const NodeKey& a, const NodeKey& b)
+{
+    return a.hi() == b.hi() && a.lo() == b.lo();
+}
+
+inline bool operator!=(const NodeKey& a, const NodeKey& b)
+{
+    return !(a == b);
+}
+
+} // namespace entwine
+
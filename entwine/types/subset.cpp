@@ -16,16 +16,72 @@
 namespace entwine
 {
 
+namespace
+{
+    std::vector<uint64_t> extractCells(const Json::Value& json)
+    {
+        std::vector<uint64_t> cells;
+        if (!json.isMember("cells")) return cells;
+
+        const Json::Value& j(json["cells"]);
+        if (!j.isArray() || j.size() != 4)
+        {
+            throw std::runtime_error("Subset cells must be a 4-element array");
+        }
+
+        for (const auto& v : j) cells.push_back(v.asUInt64());
+        return cells;
+    }
+
+    uint64_t extractSplits(const Json::Value& json, const uint64_t of)
+    {
+        if (json.isMember("cells"))
+        {
+            if (!json.isMember("splits"))
+            {
+                throw std::runtime_error("Subset cells require splits");
+            }
+
+            return json["splits"].asUInt64();
+        }
+
+        return std::log2(of) / std::log2(4);
+    }
+}
+
 Subset::Subset(const Metadata& m, const Json::Value& json)
     : m_id(json["id"].asUInt64())
     , m_of(json["of"].asUInt64())
-    , m_splits(std::log2(m_of) / std::log2(4))
+    , m_cells(extractCells(json))
+    , m_splits(extractSplits(json, m_of))
     , m_bounds(m.boundsCubic())
 {
     if (!m_id) throw std::runtime_error("Subset IDs should be 1-based.");
     if (m_of <= 1) throw std::runtime_error("Invalid subset range");
     if (m_id > m_of) throw std::runtime_error("Invalid subset ID - too large.");
 
+    if (!m_cells.empty())
+    {
+        // An explicit partition from a Plan - its cells may be of any shape
+        // and count, so the power-of-four constraints do not apply.
+        const uint64_t n(1ULL << m_splits);
+        if (m_splits > 16 ||
+                m_cells[0] >= m_cells[2] || m_cells[2] > n ||
+                m_cells[1] >= m_cells[3] || m_cells[3] > n)
+        {
+            throw std::runtime_error("Invalid subset cells");
+        }
+
+        const std::vector<Point> e(edges(m_bounds, m_splits));
+        const Point& min(m_bounds.min());
+        const Point& max(m_bounds.max());
+
+        m_bounds = Bounds(
+                Point(e[m_cells[0]].x, e[m_cells[1]].y, min.z),
+                Point(e[m_cells[2]].x, e[m_cells[3]].y, max.z));
+        return;
+    }
+
     if (std::pow(2, static_cast<uint64_t>(std::log2(m_of))) != m_of)
     {
         throw std::runtime_error("Subset range must be a power of 2");
@@ -51,5 +107,28 @@ std::unique_ptr<Subset> Subset::create(const Metadata& m, const Json::Value& j)
     else return makeUnique<Subset>(m, j);
 }
 
+std::vector<Point> Subset::edges(const Bounds& cube, const uint64_t splits)
+{
+    const uint64_t n(1ULL << splits);
+    std::vector<Point> result;
+    result.reserve(n + 1);
+
+    // Descend along the diagonal so that cell i supplies both the X and Y
+    // edge i.
+    for (uint64_t i(0); i < n; ++i)
+    {
+        Bounds b(cube);
+        for (uint64_t level(splits); level-- > 0; )
+        {
+            const unsigned int bit((i >> level) & 1);
+            b.go(toDir(bit * (EwBit | NsBit)), true);
+        }
+        result.push_back(b.min());
+    }
+
+    result.push_back(cube.max());
+    return result;
+}
+
 } // namespace entwine
 
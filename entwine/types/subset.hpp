@@ -13,6 +13,7 @@
 #include <cstddef>
 #include <cstdint>
 #include <memory>
+#include <vector>
 
 #include <json/json.h>
 
@@ -24,6 +25,11 @@ namespace entwine
 
 class Metadata;
 
+// A subset covers either one tile of an equal-area power-of-four grid, given
+// by _id_ and _of_, or an explicit rectangle of _cells_ - [xBegin, yBegin,
+// xEnd, yEnd) - of the XY grid at depth _splits_, as produced by a Plan.  In
+// both cases the subset is aligned to the nodes at its split depth, so deeper
+// nodes belong to exactly one subset.
 class Subset
 {
 public:
@@ -46,13 +52,30 @@ public:
         Json::Value json;
         json["id"] = (Json::UInt64)m_id;
         json["of"] = (Json::UInt64)m_of;
+
+        if (!m_cells.empty())
+        {
+            json["splits"] = (Json::UInt64)m_splits;
+            for (const uint64_t c : m_cells)
+            {
+                json["cells"].append((Json::UInt64)c);
+            }
+        }
+
         return json;
     }
 
+    // Returns the 2^splits + 1 grid edges of the cube at the given depth,
+    // where the X and Y values of each point are the X and Y edges.  These are
+    // derived by subdividing the cube just as the tree does, so they match
+    // node bounds exactly.
+    static std::vector<Point> edges(const Bounds& cube, uint64_t splits);
+
 private:
     const uint64_t m_id;
     const uint64_t m_of;
 
+    const std::vector<uint64_t> m_cells;
     const uint64_t m_splits;
     Bounds m_bounds;
 };
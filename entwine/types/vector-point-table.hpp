@@ -36,6 +36,21 @@ public:
         m_refs.reserve(m_pointsPerBlock);
     }
 
+    // Steal the data of another block, leaving it empty.  Since the
+    // underlying buffers are moved rather than copied, references to points
+    // remain valid.
+    MemBlock(MemBlock&& other)
+        : m_pointSize(other.m_pointSize)
+        , m_pointsPerBlock(other.m_pointsPerBlock)
+        , m_bytesPerBlock(other.m_bytesPerBlock)
+        , m_blocks(std::move(other.m_blocks))
+        , m_pos(other.m_pos)
+        , m_end(other.m_end)
+        , m_refs(std::move(other.m_refs))
+    {
+        other.clear();
+    }
+
     char* next()
     {
         if (m_pos == m_end)
@@ -94,6 +109,8 @@ public:
     virtual bool supportsView() const override { return true; }
     uint64_t size() const { return m_refs.size(); }
 
+    std::vector<char*>& refs() { return m_refs; }
+
 private:
     std::vector<char*> m_refs;
     uint64_t m_index = 0;
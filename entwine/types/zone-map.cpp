@@ -0,0 +1,157 @@
+/******************************************************************************
+* Copyright (c) 2018, Connor Manning (connor@hobu.co)
+*
+* Entwine -- Point cloud indexing
+*
+* Entwine is available under the terms of the LGPL2 license. See COPYING
+* for specific license text and more information.
+*
+******************************************************************************/
+
+#include <entwine/types/zone-map.hpp>
+
+#include <pdal/PointRef.hpp>
+
+#include <entwine/types/schema.hpp>
+#include <entwine/util/json.hpp>
+
+namespace entwine
+{
+
+ZoneMap::Range::Range(const Json::Value& json)
+    : min(json[0].asDouble())
+    , max(json[1].asDouble())
+    , m_exhaustive(json.size() > 2)
+{
+    if (m_exhaustive)
+    {
+        for (const Json::Value& v : json[2]) m_values.insert(v.asDouble());
+    }
+}
+
+void ZoneMap::Range::add(const double v)
+{
+    if (v < min) min = v;
+    if (v > max) max = v;
+
+    if (m_exhaustive)
+    {
+        m_values.insert(v);
+        if (m_values.size() > maxValues)
+        {
+            m_values.clear();
+            m_exhaustive = false;
+        }
+    }
+}
+
+bool ZoneMap::Range::mayEqual(const double v) const
+{
+    if (m_exhaustive) return m_values.count(v);
+    return min <= v && v <= max;
+}
+
+Json::Value ZoneMap::Range::toJson() const
+{
+    Json::Value json;
+    json.append(min);
+    json.append(max);
+
+    if (m_exhaustive)
+    {
+        Json::Value& values(json.append(Json::arrayValue));
+        for (const double v : m_values) values.append(v);
+    }
+
+    return json;
+}
+
+ZoneMap::ZoneMap(const Json::Value& json)
+{
+    for (const std::string& name : json.getMemberNames())
+    {
+        m_ranges[name] = Range(json[name]);
+    }
+}
+
+ZoneMap::ZoneMap(
+        const Schema& schema,
+        pdal::BasePointTable& table,
+        const uint64_t np)
+{
+    if (!np) return;
+
+    pdal::PointRef pr(table, 0);
+
+    for (const DimInfo& dim : schema.dims())
+    {
+        const DimId id(dim.id());
+        if (id == DimId::X || id == DimId::Y || id == DimId::Z) continue;
+
+        Range& range(m_ranges[dim.name()]);
+
+        for (uint64_t i(0); i < np; ++i)
+        {
+            pr.setPointId(i);
+            range.add(pr.getFieldAs<double>(id));
+        }
+    }
+}
+
+const ZoneMap::Range* ZoneMap::find(const std::string& name) const
+{
+    const auto it(m_ranges.find(name));
+    if (it != m_ranges.end()) return &it->second;
+    return nullptr;
+}
+
+Json::Value ZoneMap::toJson() const
+{
+    Json::Value json(Json::objectValue);
+    for (const auto& p : m_ranges) json[p.first] = p.second.toJson();
+    return json;
+}
+
+std::size_t ZoneMap::bytes() const
+{
+    // Each node of a std::map or std::set also carries its tree pointers and
+    // color.
+    const std::size_t node(4 * sizeof(void*));
+
+    std::size_t n(sizeof(ZoneMap));
+    for (const auto& p : m_ranges)
+    {
+        n += sizeof(p) + node + p.first.capacity();
+        n += p.second.values().size() * (sizeof(double) + node);
+    }
+    return n;
+}
+
+Json::Value toJson(const ZoneMaps& zones)
+{
+    Json::Value json(Json::objectValue);
+    for (const auto& p : zones) json[p.first.toString()] = p.second.toJson();
+    return json;
+}
+
+ZoneMaps loadZoneMaps(
+        const arbiter::Endpoint& ep,
+        const Dxyz& root,
+        const std::string& postfix)
+{
+    ZoneMaps zones;
+
+    if (auto data = ep.tryGetBinary(zoneMapFilename(root, postfix)))
+    {
+        const Json::Value json(parse(std::string(data->begin(), data->end())));
+        for (const auto& key : json.getMemberNames())
+        {
+            zones[Dxyz(key)] = ZoneMap(json[key]);
+        }
+    }
+
+    return zones;
+}
+
+} // namespace entwine
+
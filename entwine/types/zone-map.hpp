@@ -0,0 +1,108 @@
+/******************************************************************************
+* Copyright (c) 2018, Connor Manning (connor@hobu.co)
+*
+* Entwine -- Point cloud indexing
+*
+* Entwine is available under the terms of the LGPL2 license. See COPYING
+* for specific license text and more information.
+*
+******************************************************************************/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <set>
+#include <string>
+
+#include <json/json.h>
+
+#include <pdal/PointTable.hpp>
+
+#include <entwine/third/arbiter/arbiter.hpp>
+#include <entwine/types/key.hpp>
+
+namespace entwine
+{
+
+class Schema;
+
+// A summary of the values of each attribute within a single chunk, which lets
+// queries skip chunks that cannot contain any points matching their filter.
+// Spatial dimensions are not recorded, since the chunk bounds cover them.
+class ZoneMap
+{
+public:
+    // Distinct values are only recorded for dimensions with at most this many
+    // values in a chunk, for example Classification.
+    static const std::size_t maxValues = 16;
+
+    struct Range
+    {
+        Range() = default;
+
+        // Serialized as [min, max] or [min, max, [values...]].
+        explicit Range(const Json::Value& json);
+
+        void add(double v);
+
+        // True if some point may have the value _v_.
+        bool mayEqual(double v) const;
+
+        // True if every point has the value _v_.
+        bool allEqual(double v) const { return min == v && max == v; }
+
+        // If exhaustive, every distinct value within this chunk.
+        bool exhaustive() const { return m_exhaustive; }
+        const std::set<double>& values() const { return m_values; }
+
+        Json::Value toJson() const;
+
+        double min = std::numeric_limits<double>::max();
+        double max = std::numeric_limits<double>::lowest();
+
+    private:
+        std::set<double> m_values;
+        bool m_exhaustive = true;
+    };
+
+    ZoneMap() = default;
+    explicit ZoneMap(const Json::Value& json);
+
+    // Summarize the first _np_ points of _table_.
+    ZoneMap(const Schema& schema, pdal::BasePointTable& table, uint64_t np);
+
+    // Returns null if this dimension was not recorded.
+    const Range* find(const std::string& name) const;
+
+    Json::Value toJson() const;
+
+    // Approximate memory usage.
+    std::size_t bytes() const;
+
+private:
+    std::map<std::string, Range> m_ranges;
+};
+
+using ZoneMaps = std::map<Dxyz, ZoneMap>;
+
+// As with the pack index, zone maps are sharded by hierarchy file.
+inline std::string zoneMapFilename(
+        const Dxyz& root,
+        const std::string& postfix)
+{
+    return root.toString() + postfix + ".zones.json";
+}
+
+Json::Value toJson(const ZoneMaps& zones);
+
+// Returns no zone maps if this shard does not exist.
+ZoneMaps loadZoneMaps(
+        const arbiter::Endpoint& ep,
+        const Dxyz& root,
+        const std::string& postfix);
+
+} // namespace entwine
+
@@ -11,6 +11,8 @@
 #include <entwine/util/executor.hpp>
 
 #include <sstream>
+#include <string>
+#include <vector>
 
 #include <pdal/Dimension.hpp>
 #include <pdal/QuickInfo.hpp>
@@ -23,11 +25,47 @@
 #include <entwine/types/schema.hpp>
 #include <entwine/types/vector-point-table.hpp>
 #include <entwine/util/json.hpp>
+#include <entwine/util/metrics.hpp>
 #include <entwine/util/unique.hpp>
 
 namespace entwine
 {
 
+namespace
+{
+    // The caller must hold Executor::getLock(), since creating stages by name
+    // may load plugins into PDAL's process-wide driver registry.
+    void readPipeline(pdal::PipelineManager& pm, const Json::Value& pipeline)
+    {
+        std::istringstream iss(pipeline.toStyledString());
+        pm.readPipeline(iss);
+    }
+
+    // True if preparing this pipeline resolves a user-supplied spatial
+    // reference or sets up a reprojection, which goes through GDAL and PROJ
+    // and so must be done under Executor::getLock().
+    bool resolvesSrs(const Json::Value& pipeline)
+    {
+        static const std::vector<std::string> keys{
+            "override_srs", "default_srs", "spatialreference",
+            "a_srs", "in_srs", "out_srs"
+        };
+
+        for (const Json::Value& stage : ensureArray(pipeline))
+        {
+            if (!stage.isObject()) continue;
+            if (stage["type"].asString() == "filters.reprojection") return true;
+
+            for (const std::string& key : keys)
+            {
+                if (stage.isMember(key)) return true;
+            }
+        }
+
+        return false;
+    }
+}
+
 Executor::Executor()
     : m_stageFactory(makeUnique<pdal::StageFactory>())
 { }
@@ -101,16 +139,15 @@ std::unique_ptr<ScanInfo> Executor::preview(
     std::unique_ptr<ScanInfo> result;
     Json::Value readerJson(pipeline[0]);
 
-    auto lock(getLock());
-
     pdal::SpatialReference activeSrs;
     {
         // First get the active SRS from a fully-specified reader - it may be
         // overridden or defaulted here.  We'll need this SRS result to
         // reproject our extents later.
         pdal::PipelineManager pm;
-        std::istringstream readStream(ensureArray(readerJson).toStyledString());
-        pm.readPipeline(readStream);
+        auto lock(getLock());
+        readPipeline(pm, ensureArray(readerJson));
+        if (!resolvesSrs(readerJson)) lock.unlock();
         pdal::Stage* reader(pm.getStage());
 
         pdal::FixedPointTable table(0);
@@ -131,22 +168,19 @@ std::unique_ptr<ScanInfo> Executor::preview(
         }
 
         pdal::PipelineManager pm;
-        std::istringstream readStream(ensureArray(readerJson).toStyledString());
-        pm.readPipeline(readStream);
+        auto lock(getLock());
+        readPipeline(pm, ensureArray(readerJson));
+        lock.unlock();
         pdal::Stage* reader(pm.getStage());
 
         result = ScanInfo::create(*reader);
     }
 
-    lock.unlock();
-
     if (!result) return result;
 
     const Json::Value filters(slice(pipeline, 1));
     if (filters.isNull()) return result;
 
-    lock.lock();
-
     // We've gotten our initial ScanInfo - but our bounds might not be accurate
     // to the output.  For example, a reprojection filter will mean our bounds
     // are in the wrong SRS.  We'll run the 8 corners of our extents through
@@ -154,9 +188,12 @@ std::unique_ptr<ScanInfo> Executor::preview(
     // pipelines where this assumption does not hold, the onus is on the user
     // to specify a deep scan which will pipeline every point.
 
+    // A reprojection runs while the corners are executed, so in that case the
+    // lock is held to the end.
     pdal::PipelineManager pm;
-    std::istringstream filterStream(filters.toStyledString());
-    pm.readPipeline(filterStream);
+    auto lock(getLock());
+    readPipeline(pm, filters);
+    if (!resolvesSrs(filters)) lock.unlock();
     pdal::Stage* last(pm.getStage());
     pdal::Stage* first(last);
     while (first->getInputs().size())
@@ -252,33 +289,47 @@ std::unique_ptr<ScanInfo> Executor::deepScan(Json::Value pipeline) const
 
 bool Executor::run(pdal::StreamPointTable& table, const Json::Value& pipeline)
 {
-    std::istringstream iss(pipeline.toStyledString());
-
-    auto lock(getLock());
     pdal::PipelineManager pm;
-    pm.readPipeline(iss);
+    pdal::Stage* s(nullptr);
+    bool streamable(false);
 
-    if (pm.pipelineStreamable())
     {
-        pm.validateStageOptions();
-        pdal::Stage *s = pm.getStage();
-        if (!s) return false;
-        s->prepare(table);
+        // Everything before the first point is read, including any wait for
+        // the lock.
+        metrics::ScopedTimer timer(metrics::Timer::FileStart);
 
-        lock.unlock();
+        // Stage creation is always serialized, but preparation only if it
+        // resolves a spatial reference.
+        auto lock(getLock());
+        readPipeline(pm, pipeline);
+        if (!resolvesSrs(pipeline)) lock.unlock();
+
+        streamable = pm.pipelineStreamable();
+
+        if (streamable)
+        {
+            pm.validateStageOptions();
+            s = pm.getStage();
+            if (!s) return false;
+            s->prepare(table);
+        }
+        else
+        {
+            static std::once_flag logged;
+            std::call_once(logged, []()
+            {
+                std::cout << "Using non-streaming mode" << std::endl;
+            });
+            pm.prepare();
+        }
+    }
+
+    if (streamable)
+    {
         s->execute(table);
     }
     else
     {
-        static bool logged(false);
-        if (!logged)
-        {
-            logged = true;
-            std::cout << "Using non-streaming mode" << std::endl;
-        }
-        pm.prepare();
-        lock.unlock();
-
         pm.execute();
 
         pdal::PointRef pr(table, 0);
@@ -90,6 +90,12 @@ public:
             Json::Value pipeline,
             bool trustHeaders = true) const;
 
+    // Serializes PDAL work which is not safe to run concurrently: creating
+    // stages by name, which may load plugins into PDAL's driver registry, and
+    // preparing stages which resolve a user-supplied spatial reference or a
+    // reprojection through GDAL and PROJ.  Stages constructed directly with
+    // no such options, like those reading and writing our own chunks, need
+    // no lock.
     static std::unique_lock<std::mutex> getLock();
 
 private:
@@ -0,0 +1,347 @@
+/******************************************************************************
+* Copyright (c) 2018, Connor Manning (connor@hobu.co)
+*
+* Entwine -- Point cloud indexing
+*
+* Entwine is available under the terms of the LGPL2 license. See COPYING
+* for specific license text and more information.
+*
+******************************************************************************/
+
+#include <entwine/util/generator.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+
+#include <pdal/PointTable.hpp>
+#include <pdal/PointView.hpp>
+#include <pdal/io/BufferReader.hpp>
+#include <pdal/io/LasWriter.hpp>
+
+#include <entwine/io/ensure.hpp>
+#include <entwine/io/memory-driver.hpp>
+#include <entwine/third/arbiter/arbiter.hpp>
+#include <entwine/types/defs.hpp>
+#include <entwine/types/version.hpp>
+#include <entwine/util/json.hpp>
+#include <entwine/util/pool.hpp>
+#include <entwine/util/unique.hpp>
+
+namespace entwine
+{
+
+namespace
+{
+    // ASPRS classifications.
+    const uint8_t clsGround(2);
+    const uint8_t clsHighVegetation(5);
+    const uint8_t clsBuilding(6);
+
+    Generator::Type toType(const std::string& s)
+    {
+        if (s == "terrain") return Generator::Type::Terrain;
+        if (s == "urban") return Generator::Type::Urban;
+        if (s == "forest") return Generator::Type::Forest;
+        throw std::runtime_error("Invalid generator type: " + s);
+    }
+
+    uint64_t mix(uint64_t v)
+    {
+        v += 0x9e3779b97f4a7c15ULL;
+        v = (v ^ (v >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        v = (v ^ (v >> 27)) * 0x94d049bb133111ebULL;
+        return v ^ (v >> 31);
+    }
+
+    // A value in [0, 1) determined entirely by its arguments, so that the
+    // features of a grid cell are identical no matter which tile asks.
+    double cellValue(uint64_t seed, int64_t x, int64_t y, uint64_t salt)
+    {
+        const uint64_t h(mix(seed ^ mix(x ^ mix(y ^ mix(salt)))));
+        return (h >> 11) * (1.0 / (1ULL << 53));
+    }
+
+    double ground(const double x, const double y)
+    {
+        return 100 +
+            30 * std::sin(x / 487.0) * std::cos(y / 531.0) +
+            8 * std::sin((x + y) / 173.0) +
+            2 * std::sin(x / 37.0) * std::sin(y / 41.0);
+    }
+
+    struct Sample
+    {
+        double z;
+        uint8_t cls;
+        uint16_t intensity;
+    };
+
+    using Gen = std::mt19937_64;
+
+    double uniform(Gen& gen, double lo, double hi)
+    {
+        return std::uniform_real_distribution<double>(lo, hi)(gen);
+    }
+
+    double noise(Gen& gen, double sd)
+    {
+        return std::normal_distribution<double>(0, sd)(gen);
+    }
+
+    Sample bare(double x, double y, Gen& gen)
+    {
+        return Sample {
+            ground(x, y) + noise(gen, 0.05),
+            clsGround,
+            static_cast<uint16_t>(uniform(gen, 200, 800))
+        };
+    }
+
+    // Square blocks separated by streets, most of which hold one building
+    // with a flat roof at a height fixed per block.
+    Sample urban(uint64_t seed, double x, double y, Gen& gen)
+    {
+        const double block(80);
+        const double street(15);
+
+        const int64_t cx(std::floor(x / block));
+        const int64_t cy(std::floor(y / block));
+        const double fx(x - cx * block);
+        const double fy(y - cy * block);
+
+        if (fx < street || fy < street) return bare(x, y, gen);
+        if (cellValue(seed, cx, cy, 1) > 0.75) return bare(x, y, gen);
+
+        const double margin(3 + 10 * cellValue(seed, cx, cy, 2));
+        const double lo(street + margin);
+        const double hi(block - margin);
+        if (fx < lo || fx > hi || fy < lo || fy > hi) return bare(x, y, gen);
+
+        const double h(cellValue(seed, cx, cy, 3));
+        const double base(ground((cx + 0.5) * block, (cy + 0.5) * block));
+
+        return Sample {
+            base + 6 + 60 * h * h + noise(gen, 0.03),
+            clsBuilding,
+            static_cast<uint16_t>(uniform(gen, 1000, 2000))
+        };
+    }
+
+    // Trees at irregular positions within a small grid, each with a crown
+    // whose surface falls away from the trunk.  Most pulses are returned by
+    // the canopy, and the remainder reach the ground.
+    Sample forest(uint64_t seed, double x, double y, Gen& gen)
+    {
+        const double cell(7);
+
+        const int64_t cx(std::floor(x / cell));
+        const int64_t cy(std::floor(y / cell));
+
+        if (cellValue(seed, cx, cy, 4) > 0.85) return bare(x, y, gen);
+
+        const double tx((cx + 0.25 + 0.5 * cellValue(seed, cx, cy, 5)) * cell);
+        const double ty((cy + 0.25 + 0.5 * cellValue(seed, cx, cy, 6)) * cell);
+        const double height(12 + 18 * cellValue(seed, cx, cy, 7));
+        const double radius(2 + 1.5 * cellValue(seed, cx, cy, 8));
+
+        const double d(std::hypot(x - tx, y - ty) / radius);
+        if (d >= 1 || uniform(gen, 0, 1) > 0.8) return bare(x, y, gen);
+
+        return Sample {
+            ground(x, y) + height - 0.4 * height * d * d -
+                uniform(gen, 0, 1.5),
+            clsHighVegetation,
+            static_cast<uint16_t>(uniform(gen, 300, 900))
+        };
+    }
+}
+
+Generator::Generator(
+        const Json::Value& json,
+        std::shared_ptr<arbiter::Arbiter> a)
+    : m_json(merge(defaults(), json))
+    , m_arbiter(a ? a : makeArbiter(m_json["arbiter"]))
+    , m_type(toType(m_json["type"].asString()))
+    , m_bounds(m_json["bounds"])
+    , m_density(m_json["density"].asDouble())
+    , m_seed(m_json["seed"].asUInt64())
+    , m_verbose(m_json["verbose"].asBool())
+    , m_retry(m_json["retry"])
+    , m_span(1)
+{
+    const std::string output(m_json["output"].asString());
+    if (output.empty()) throw std::runtime_error("Output path required");
+    if (m_density <= 0) throw std::runtime_error("Invalid density");
+
+    m_out = makeUnique<arbiter::Endpoint>(m_arbiter->getEndpoint(output));
+    m_tmp = makeUnique<arbiter::Endpoint>(
+            m_arbiter->getEndpoint(m_json["tmp"].asString()));
+
+    if (m_out->isLocal() && !arbiter::fs::mkdirp(m_out->root()))
+    {
+        throw std::runtime_error("Couldn't create " + output);
+    }
+
+    // Split the bounds into a square grid of tiles, as few as possible while
+    // keeping each at or below the requested size.
+    const double total(m_density * m_bounds.width() * m_bounds.depth());
+    const double filePoints(m_json["filePoints"].asDouble());
+    if (filePoints > 0)
+    {
+        m_span = std::max<uint64_t>(
+                1,
+                std::ceil(std::sqrt(total / filePoints)));
+    }
+}
+
+Json::Value Generator::defaults()
+{
+    Json::Value json;
+    json["type"] = "terrain";
+    json["bounds"] = Bounds(0, 0, 1000, 1000).toJson();
+    json["density"] = 10;
+    json["filePoints"] = 2000000;
+    json["seed"] = 42;
+    json["threads"] = 8;
+    json["tmp"] = arbiter::fs::getTempPath();
+    return json;
+}
+
+Bounds Generator::tile(const uint64_t i) const
+{
+    const double w(m_bounds.width() / m_span);
+    const double d(m_bounds.depth() / m_span);
+    const double x(m_bounds.min().x + w * (i % m_span));
+    const double y(m_bounds.min().y + d * (i / m_span));
+    return Bounds(x, y, x + w, y + d);
+}
+
+uint64_t Generator::tilePoints(const uint64_t i) const
+{
+    const Bounds b(tile(i));
+    return std::llround(m_density * b.width() * b.depth());
+}
+
+uint64_t Generator::go()
+{
+    const uint64_t threads(
+            std::max<uint64_t>(1, m_json["threads"].asUInt64()));
+
+    if (m_verbose)
+    {
+        std::cout << "Generating " << m_json["type"].asString() << " in " <<
+            tiles() << " tiles of " << tilePoints(0) << " points to " <<
+            m_out->prefixedRoot() << std::endl;
+    }
+
+    Pool pool(threads, 1);
+    for (uint64_t i(0); i < tiles(); ++i)
+    {
+        pool.add([this, i]() { write(i); });
+    }
+    pool.join();
+
+    // The pool only logs the failures of its tasks, and a partial set of
+    // tiles must not be reported as generated.
+    if (pool.errors().size())
+    {
+        throw std::runtime_error(
+                "Failed to generate " +
+                std::to_string(pool.errors().size()) + " tiles: " +
+                pool.errors().front());
+    }
+
+    uint64_t points(0);
+    for (uint64_t i(0); i < tiles(); ++i) points += tilePoints(i);
+    return points;
+}
+
+void Generator::write(const uint64_t i) const
+{
+    const Bounds bounds(tile(i));
+    const uint64_t np(tilePoints(i));
+
+    pdal::PointTable table;
+    pdal::PointLayoutPtr layout(table.layout());
+    layout->registerDim(DimId::X);
+    layout->registerDim(DimId::Y);
+    layout->registerDim(DimId::Z);
+    layout->registerDim(DimId::Intensity);
+    layout->registerDim(DimId::Classification);
+
+    auto view(std::make_shared<pdal::PointView>(table));
+
+    Gen gen(mix(m_seed ^ mix(i)));
+    std::uniform_real_distribution<double> xd(bounds.min().x, bounds.max().x);
+    std::uniform_real_distribution<double> yd(bounds.min().y, bounds.max().y);
+
+    for (uint64_t p(0); p < np; ++p)
+    {
+        const double x(xd(gen));
+        const double y(yd(gen));
+
+        Sample s;
+        switch (m_type)
+        {
+            case Type::Urban: s = urban(m_seed, x, y, gen); break;
+            case Type::Forest: s = forest(m_seed, x, y, gen); break;
+            default: s = bare(x, y, gen); break;
+        }
+
+        view->setField(DimId::X, p, x);
+        view->setField(DimId::Y, p, y);
+        view->setField(DimId::Z, p, s.z);
+        view->setField(DimId::Intensity, p, s.intensity);
+        view->setField(DimId::Classification, p, s.cls);
+    }
+
+    // Remote output is written locally first, as PDAL writes only to files.
+    const std::string filename(std::to_string(i) + ".laz");
+    const std::string tmpFile(
+            arbiter::crypto::encodeAsHex(m_out->prefixedRoot() + filename) +
+            ".laz");
+    const bool local(m_out->isLocal());
+    const std::string localPath(local ?
+            m_out->prefixedRoot() + filename :
+            m_tmp->prefixedRoot() + tmpFile);
+
+    pdal::BufferReader reader;
+    reader.addView(view);
+
+    pdal::Options options;
+    options.add("filename", localPath);
+    options.add("minor_version", 2);
+    options.add("software_id", "Entwine " + currentEntwineVersion().toString());
+    options.add("compression", "laszip");
+    options.add("scale_x", 0.01);
+    options.add("scale_y", 0.01);
+    options.add("scale_z", 0.01);
+    options.add("offset_x", bounds.min().x);
+    options.add("offset_y", bounds.min().y);
+    options.add("offset_z", 0);
+
+    // No SRS is involved, so this needs no Executor lock.
+    pdal::LasWriter writer;
+    writer.setOptions(options);
+    writer.setInput(reader);
+    writer.prepare(table);
+    writer.execute(table);
+
+    if (!local)
+    {
+        ensurePut(*m_out, filename, m_tmp->getBinary(tmpFile), m_retry);
+        arbiter::fs::remove(localPath);
+    }
+
+    if (m_verbose)
+    {
+        std::cout << "\tWrote " << filename << ": " << np << " points" <<
+            std::endl;
+    }
+}
+
+} // namespace entwine
+
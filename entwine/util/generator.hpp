@@ -0,0 +1,86 @@
+/******************************************************************************
+* Copyright (c) 2018, Connor Manning (connor@hobu.co)
+*
+* Entwine -- Point cloud indexing
+*
+* Entwine is available under the terms of the LGPL2 license. See COPYING
+* for specific license text and more information.
+*
+******************************************************************************/
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include <json/json.h>
+
+#include <entwine/io/ensure.hpp>
+#include <entwine/types/bounds.hpp>
+
+namespace entwine
+{
+
+namespace arbiter
+{
+    class Arbiter;
+    class Endpoint;
+}
+
+// Generates a synthetic point cloud as a grid of LAZ tiles, for benchmarking
+// builds and reads at arbitrary scale without real data.  Output depends only
+// on the configuration, so a given seed always produces the same points, and
+// features spanning tile edges are continuous across them.
+//
+// Three distributions are supported, each over rolling ground:
+//      - terrain: bare earth only.
+//      - urban: a grid of streets and flat-roofed buildings.
+//      - forest: a dense stand of trees with rounded crowns.
+//
+// Points are classified per ASPRS conventions, and carry an Intensity.
+class Generator
+{
+public:
+    enum class Type { Terrain, Urban, Forest };
+
+    explicit Generator(
+            const Json::Value& json,
+            std::shared_ptr<arbiter::Arbiter> a = nullptr);
+
+    static Json::Value defaults();
+
+    // Write every tile, returning the total number of points written.  Throws
+    // if any tile could not be written.
+    uint64_t go();
+
+    // The XY extents of tile _i_, in row-major order.
+    Bounds tile(uint64_t i) const;
+
+    uint64_t tiles() const { return m_span * m_span; }
+    uint64_t tilePoints(uint64_t i) const;
+
+    Type type() const { return m_type; }
+    const Bounds& bounds() const { return m_bounds; }
+
+private:
+    void write(uint64_t i) const;
+
+    const Json::Value m_json;
+    std::shared_ptr<arbiter::Arbiter> m_arbiter;
+    std::unique_ptr<arbiter::Endpoint> m_out;
+    std::unique_ptr<arbiter::Endpoint> m_tmp;
+
+    const Type m_type;
+    const Bounds m_bounds;
+    const double m_density;
+    const uint64_t m_seed;
+    const bool m_verbose;
+    const RetryPolicy m_retry;
+
+    // Tiles per side.
+    uint64_t m_span;
+};
+
+} // namespace entwine
+
@@ -0,0 +1,52 @@
+/******************************************************************************
+* Copyright (c) 2018, Connor Manning (connor@hobu.co)
+*
+* Entwine -- Point cloud indexing
+*
+* Entwine is available under the terms of the LGPL2 license. See COPYING
+* for specific license text and more information.
+*
+******************************************************************************/
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+namespace entwine
+{
+
+// A read-only memory mapping of an entire local file.
+//
+// A mapped file must not be truncated while it is mapped, or accessing the
+// missing pages raises SIGBUS.  Entwine never rewrites a local file in place -
+// see ensurePut - so a mapping keeps referring to the complete contents of the
+// file as it was when mapped, even if that file is replaced during a
+// continued build.
+class MappedFile
+{
+public:
+    // Returns null if the file could not be mapped, for example if it does
+    // not exist, is empty, or mapping is unsupported on this platform.
+    static std::unique_ptr<MappedFile> create(const std::string& path);
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile();
+
+    const char* data() const { return m_data; }
+    std::size_t size() const { return m_size; }
+
+private:
+    MappedFile(const char* data, std::size_t size)
+        : m_data(data)
+        , m_size(size)
+    { }
+
+    const char* const m_data;
+    const std::size_t m_size;
+};
+
+} // namespace entwine
+
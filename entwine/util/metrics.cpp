@@ -0,0 +1,251 @@
+/******************************************************************************
+* Copyright (c) 2018, Connor Manning (connor@hobu.co)
+*
+* Entwine -- Point cloud indexing
+*
+* Entwine is available under the terms of the LGPL2 license. See COPYING
+* for specific license text and more information.
+*
+******************************************************************************/
+
+#include <entwine/util/metrics.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+#include <json/json.h>
+
+namespace entwine
+{
+namespace metrics
+{
+
+namespace
+{
+    // Only the owning thread writes to a cell, so a relaxed load and store is
+    // sufficient and avoids a locked read-modify-write on the hot path.
+    // Readers may see a slightly stale value, but never a torn one.
+    using Cell = std::atomic<uint64_t>;
+
+    void bump(Cell& cell, const uint64_t n)
+    {
+        cell.store(
+                cell.load(std::memory_order_relaxed) + n,
+                std::memory_order_relaxed);
+    }
+
+    uint64_t get(const Cell& cell)
+    {
+        return cell.load(std::memory_order_relaxed);
+    }
+
+    std::size_t bucketOf(uint64_t micros)
+    {
+        std::size_t b(0);
+        while (micros && b < Histogram::size - 1)
+        {
+            micros >>= 1;
+            ++b;
+        }
+        return b;
+    }
+
+    struct AtomicHistogram
+    {
+        Cell count { 0 };
+        Cell sum { 0 };
+        std::array<Cell, Histogram::size> buckets;
+
+        AtomicHistogram()
+        {
+            for (auto& b : buckets) b.store(0, std::memory_order_relaxed);
+        }
+
+        void record(const uint64_t micros)
+        {
+            bump(count, 1);
+            bump(sum, micros);
+            bump(buckets[bucketOf(micros)], 1);
+        }
+
+        void addTo(Histogram& h) const
+        {
+            h.count += get(count);
+            h.sum += get(sum);
+            for (std::size_t i(0); i < Histogram::size; ++i)
+            {
+                h.buckets[i] += get(buckets[i]);
+            }
+        }
+    };
+
+    struct Shard
+    {
+        Shard()
+        {
+            for (auto& c : counters) c.store(0, std::memory_order_relaxed);
+        }
+
+        std::array<Cell, counterCount> counters;
+        std::array<AtomicHistogram, timerCount> timers;
+
+        void addTo(Snapshot& s) const
+        {
+            for (std::size_t i(0); i < counterCount; ++i)
+            {
+                s.counters[i] += get(counters[i]);
+            }
+            for (std::size_t i(0); i < timerCount; ++i)
+            {
+                timers[i].addTo(s.timers[i]);
+            }
+        }
+    };
+
+    // Live shards, and the accumulated totals of shards whose threads have
+    // exited.  Build threads come and go with each pool cycle, so folding
+    // their shards on exit keeps snapshots from growing over a long build.
+    std::mutex mutex;
+    std::vector<std::shared_ptr<Shard>> shards;
+    Snapshot retired;
+
+    class Local
+    {
+    public:
+        Local()
+            : m_shard(std::make_shared<Shard>())
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            shards.push_back(m_shard);
+        }
+
+        ~Local()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            m_shard->addTo(retired);
+            shards.erase(
+                    std::remove(shards.begin(), shards.end(), m_shard),
+                    shards.end());
+        }
+
+        Shard& shard() { return *m_shard; }
+
+    private:
+        std::shared_ptr<Shard> m_shard;
+    };
+
+    Shard& local()
+    {
+        thread_local Local l;
+        return l.shard();
+    }
+}
+
+std::string name(const Counter c)
+{
+    switch (c)
+    {
+        case Counter::PointsRead: return "points_read";
+        case Counter::PointsInserted: return "points_inserted";
+        case Counter::PointsRejected: return "points_rejected";
+        case Counter::PointsWoken: return "points_woken";
+        case Counter::PointsEncoded: return "points_encoded";
+        case Counter::ChunksCreated: return "chunks_created";
+        case Counter::ChunksDestroyed: return "chunks_destroyed";
+        case Counter::ChunksWoken: return "chunks_woken";
+        case Counter::ChunksWritten: return "chunks_written";
+        case Counter::BytesEncoded: return "bytes_encoded";
+        case Counter::BytesUploaded: return "bytes_uploaded";
+        case Counter::BytesDiscarded: return "bytes_discarded";
+        default: throw std::runtime_error("Invalid counter");
+    }
+}
+
+std::string name(const Timer t)
+{
+    switch (t)
+    {
+        case Timer::Encode: return "encode";
+        case Timer::Upload: return "upload";
+        case Timer::Wakeup: return "wakeup";
+        case Timer::WriteWait: return "write_wait";
+        case Timer::BudgetWait: return "budget_wait";
+        case Timer::SpinWait: return "spin_wait";
+        case Timer::FileStart: return "file_start";
+        default: throw std::runtime_error("Invalid timer");
+    }
+}
+
+uint64_t Histogram::quantile(const double q) const
+{
+    if (!count) return 0;
+
+    const uint64_t target(std::max<uint64_t>(1, q * count + 0.5));
+    uint64_t seen(0);
+    for (std::size_t i(0); i < size; ++i)
+    {
+        seen += buckets[i];
+        if (seen >= target) return upper(i);
+    }
+    return upper(size - 1);
+}
+
+Histogram& Histogram::operator-=(const Histogram& other)
+{
+    count -= other.count;
+    sum -= other.sum;
+    for (std::size_t i(0); i < size; ++i) buckets[i] -= other.buckets[i];
+    return *this;
+}
+
+Json::Value Histogram::toJson() const
+{
+    Json::Value json;
+    json["count"] = (Json::UInt64)count;
+    json["sumUs"] = (Json::UInt64)sum;
+    json["p50Us"] = (Json::UInt64)quantile(0.5);
+    json["p90Us"] = (Json::UInt64)quantile(0.9);
+    json["p99Us"] = (Json::UInt64)quantile(0.99);
+    return json;
+}
+
+Snapshot Snapshot::operator-(const Snapshot& other) const
+{
+    Snapshot result(*this);
+    for (std::size_t i(0); i < counterCount; ++i)
+    {
+        result.counters[i] -= other.counters[i];
+    }
+    for (std::size_t i(0); i < timerCount; ++i)
+    {
+        result.timers[i] -= other.timers[i];
+    }
+    return result;
+}
+
+void add(const Counter c, const uint64_t n)
+{
+    bump(local().counters[static_cast<std::size_t>(c)], n);
+}
+
+void record(const Timer t, const uint64_t micros)
+{
+    local().timers[static_cast<std::size_t>(t)].record(micros);
+}
+
+Snapshot snapshot()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    Snapshot s(retired);
+    for (const auto& shard : shards) shard->addTo(s);
+    return s;
+}
+
+} // namespace metrics
+} // namespace entwine
+
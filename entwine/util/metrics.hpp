@@ -0,0 +1,139 @@
+/******************************************************************************
+* Copyright (c) 2018, Connor Manning (connor@hobu.co)
+*
+* Entwine -- Point cloud indexing
+*
+* Entwine is available under the terms of the LGPL2 license. See COPYING
+* for specific license text and more information.
+*
+******************************************************************************/
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace Json
+{
+    class Value;
+}
+
+namespace entwine
+{
+namespace metrics
+{
+
+// Process-wide build metrics.  Each thread records into its own shard, so the
+// hot paths never contend with each other: an increment is a relaxed load and
+// store to memory owned by the calling thread.  Readers sum all shards, along
+// with the totals of threads which have since exited, with snapshot().
+
+enum class Counter
+{
+    PointsRead,         // Read from input files.
+    PointsInserted,     // Inserted into the tree from input files.
+    PointsRejected,     // Discarded as too deep for the hierarchy.
+    PointsWoken,        // Reinserted from previously written chunks.
+    PointsEncoded,      // Serialized by the chunk writer.
+    ChunksCreated,
+    ChunksDestroyed,
+    ChunksWoken,        // Previously written chunks read back into memory.
+    ChunksWritten,
+    BytesEncoded,
+    BytesUploaded,
+    BytesDiscarded,     // Raw chunk data dropped by the null data type.
+    Count
+};
+
+// Durations, in microseconds.
+enum class Timer
+{
+    Encode,             // Ordering and encoding a chunk.
+    Upload,             // Writing an encoded chunk.
+    Wakeup,             // Reading a chunk back into memory.
+    WriteWait,          // Waiting for an in-flight write of a woken chunk.
+    BudgetWait,         // Waiting for space in the in-flight write budget.
+    SpinWait,           // Waiting for a contended spin lock.
+    FileStart,          // Creating and preparing an input file's pipeline.
+    Count
+};
+
+constexpr std::size_t counterCount(static_cast<std::size_t>(Counter::Count));
+constexpr std::size_t timerCount(static_cast<std::size_t>(Timer::Count));
+
+std::string name(Counter c);
+std::string name(Timer t);
+
+// Latencies bucketed by powers of two: bucket i holds durations below 2^i
+// microseconds, and the last bucket holds everything larger.
+struct Histogram
+{
+    static constexpr std::size_t size = 32;
+
+    uint64_t count = 0;
+    uint64_t sum = 0;
+    std::array<uint64_t, size> buckets { };
+
+    static uint64_t upper(std::size_t bucket) { return 1ULL << bucket; }
+
+    // An upper bound on the _q_ quantile, for 0 <= q <= 1.
+    uint64_t quantile(double q) const;
+
+    Histogram& operator-=(const Histogram& other);
+    Json::Value toJson() const;
+};
+
+struct Snapshot
+{
+    std::array<uint64_t, counterCount> counters { };
+    std::array<Histogram, timerCount> timers;
+
+    uint64_t operator[](Counter c) const
+    {
+        return counters[static_cast<std::size_t>(c)];
+    }
+    const Histogram& operator[](Timer t) const
+    {
+        return timers[static_cast<std::size_t>(t)];
+    }
+
+    // The activity between _other_ and this snapshot.
+    Snapshot operator-(const Snapshot& other) const;
+};
+
+void add(Counter c, uint64_t n = 1);
+void record(Timer t, uint64_t micros);
+
+Snapshot snapshot();
+
+// Records its lifetime into a timer.
+class ScopedTimer
+{
+public:
+    explicit ScopedTimer(Timer t)
+        : m_timer(t)
+        , m_start(std::chrono::steady_clock::now())
+    { }
+
+    ~ScopedTimer()
+    {
+        record(
+                m_timer,
+                std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - m_start).count());
+    }
+
+private:
+    const Timer m_timer;
+    const std::chrono::steady_clock::time_point m_start;
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+};
+
+} // namespace metrics
+} // namespace entwine
+
@@ -122,6 +122,19 @@ public:
     std::size_t size() const { return m_numThreads; }
     std::size_t numThreads() const { return m_numThreads; }
 
+    // Number of tasks waiting for a thread, and currently running.
+    std::size_t queued() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_tasks.size();
+    }
+
+    std::size_t running() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_outstanding;
+    }
+
 private:
     // Worker thread function.  Wait for a task and run it - or if stop() is
     // called, complete any outstanding task and return.
@@ -14,6 +14,9 @@
 #include <mutex>
 #else
 #include <atomic>
+#include <chrono>
+
+#include <entwine/util/metrics.hpp>
 #endif
 
 namespace entwine
@@ -30,7 +33,20 @@ class SpinLock
 public:
     SpinLock() = default;
 
-    void lock() { while (m_flag.test_and_set()) ; }
+    // Contended acquisitions are timed, which costs nothing for the common
+    // uncontended case.
+    void lock()
+    {
+        if (!m_flag.test_and_set()) return;
+
+        const auto start(std::chrono::steady_clock::now());
+        while (m_flag.test_and_set()) ;
+        metrics::record(
+                metrics::Timer::SpinWait,
+                std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - start).count());
+    }
+
     void unlock() { m_flag.clear(); }
 
 private:
@@ -2,9 +2,25 @@
 #include "config.hpp"
 #include "verify.hpp"
 
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
 #include <entwine/builder/builder.hpp>
+#include <entwine/builder/checkpoint.hpp>
+#include <entwine/builder/clipper.hpp>
+#include <entwine/builder/coordinator.hpp>
 #include <entwine/builder/merger.hpp>
+#include <entwine/builder/plan.hpp>
+#include <entwine/builder/registry.hpp>
 #include <entwine/builder/scan.hpp>
+#include <entwine/builder/thread-pools.hpp>
+#include <entwine/types/key.hpp>
+#include <entwine/types/metadata.hpp>
+#include <entwine/types/node-key.hpp>
+#include <entwine/types/voxel.hpp>
+#include <entwine/util/metrics.hpp>
 
 using namespace entwine;
 
@@ -142,6 +158,103 @@ TEST(build, continued)
     checkSources(outPath);
 }
 
+TEST(build, checkpointed)
+{
+    const std::string outPath(test::dataPath() + "out/checkpointed/");
+
+    Config c;
+    c["input"] = test::dataPath() + "ellipsoid-multi/";
+    c["output"] = outPath;
+    c["force"] = true;
+    c["ticks"] = static_cast<Json::UInt64>(v.ticks());
+    c["hierarchyStep"] = static_cast<Json::UInt64>(v.hierarchyStep());
+    c["checkpointFiles"] = 3;
+
+    {
+        // One checkpoint after three files, and another for the final save.
+        Config partial(c);
+        partial["run"] = 5;
+        Builder builder(partial);
+        builder.go();
+        EXPECT_EQ(builder.checkpoints().count(), 2u);
+    }
+
+    {
+        Config c;
+        c["output"] = outPath;
+        c["checkpointFiles"] = 3;
+
+        Builder builder(c);
+        EXPECT_TRUE(builder.isContinuation());
+        builder.go();
+    }
+
+    const auto info(parse(a.get(outPath + "ept.json")));
+    EXPECT_EQ(info["points"].asUInt64(), v.points());
+    EXPECT_EQ(info["ticks"].asUInt64(), v.ticks());
+
+    checkSources(outPath);
+}
+
+TEST(build, checkpointRecovery)
+{
+    const std::string outPath(test::dataPath() + "out/checkpoint-recovery/");
+
+    Config c;
+    c["input"] = test::dataPath() + "ellipsoid-multi/";
+    c["output"] = outPath;
+    c["force"] = true;
+    c["ticks"] = static_cast<Json::UInt64>(v.ticks());
+    c["hierarchyStep"] = static_cast<Json::UInt64>(v.hierarchyStep());
+    c["checkpointFiles"] = 3;
+
+    std::string stage;
+
+    {
+        Config partial(c);
+        partial["run"] = 3;
+        Builder builder(partial);
+        builder.go();
+        stage = builder.checkpoints().stage().root();
+    }
+
+    // Leave behind a manifest as if we died partway through a commit, along
+    // with a file which was staged after it and never committed.
+    const std::string manifest(stage.substr(0, stage.size() - 1) + ".json");
+    const std::string listed("ept-data/recovered.bin");
+    const std::string unlisted("ept-data/uncommitted.bin");
+
+    a.put(stage + listed, std::string("listed"));
+    a.put(stage + unlisted, std::string("unlisted"));
+
+    Json::Value files;
+    files.append(listed);
+    a.put(manifest, toFastString(files));
+
+    {
+        Config next;
+        next["output"] = outPath;
+        next["checkpointFiles"] = 3;
+
+        // Constructing the builder completes the interrupted commit.
+        Builder builder(next);
+        EXPECT_TRUE(builder.isContinuation());
+
+        EXPECT_EQ(a.get(outPath + listed), "listed");
+        EXPECT_FALSE(a.tryGetSize(outPath + unlisted));
+        EXPECT_FALSE(a.tryGetSize(stage + listed));
+        EXPECT_FALSE(a.tryGetSize(stage + unlisted));
+        EXPECT_FALSE(a.tryGetSize(manifest));
+
+        builder.go();
+    }
+
+    const auto info(parse(a.get(outPath + "ept.json")));
+    EXPECT_EQ(info["points"].asUInt64(), v.points());
+
+    checkSources(outPath);
+}
+
 TEST(build, fromScan)
 {
     const std::string scanPath(test::dataPath() + "out/prebuild-scan/");
@@ -362,6 +475,154 @@ TEST(build, subsetFromScan)
     checkSources(outPath);
 }
 
+TEST(build, plannedSubset)
+{
+    const std::string scanPath(test::dataPath() + "out/plan-scan/");
+
+    {
+        Json::Value c;
+        c["input"] = test::dataPath() + "ellipsoid-multi";
+        c["output"] = scanPath;
+        Scan(c).go();
+    }
+
+    const std::string outPath(test::dataPath() + "out/planned-subset/");
+
+    Config base;
+    base["input"] = scanPath + "scan.json";
+    base["output"] = outPath;
+    base["force"] = true;
+    base["ticks"] = static_cast<Json::UInt64>(v.ticks());
+    base["hierarchyStep"] = static_cast<Json::UInt64>(v.hierarchyStep());
+
+    // Three subsets cannot be expressed as an equal-area grid.
+    const Config prepared(
+            merge(
+                Config::defaults(),
+                Config::defaultBuildParams(),
+                base.prepare().json()));
+    const Plan plan(Metadata(prepared), 3);
+    ASSERT_EQ(plan.parts().size(), 3u);
+
+    for (Json::UInt64 i(0); i < 3u; ++i)
+    {
+        Config c(base);
+        c["bounds"] = prepared["bounds"];
+        c["subset"] = plan.subset(i + 1);
+
+        Builder(c).go();
+    }
+
+    {
+        Config c;
+        c["output"] = outPath;
+
+        Merger(c).go();
+    }
+
+    const auto info(parse(a.get(outPath + "ept.json")));
+    EXPECT_EQ(info["points"].asUInt64(), v.points());
+
+    checkSources(outPath);
+}
+
+TEST(build, coordinated)
+{
+    const std::string scanPath(test::dataPath() + "out/coordinated-scan/");
+    const std::string outPath(test::dataPath() + "out/coordinated/");
+    const std::string workPath(test::dataPath() + "out/coordinated-work/");
+    const std::string planPath(test::dataPath() + "out/coordinated-plan.json");
+
+    const uint64_t of(4);
+
+    for (const std::string name : { "1", "2", "3", "4", "merge" })
+    {
+        arbiter::fs::remove(workPath + name + ".claim");
+        arbiter::fs::remove(workPath + name + ".done");
+    }
+
+    {
+        Json::Value c;
+        c["input"] = test::dataPath() + "ellipsoid-multi";
+        c["output"] = scanPath;
+        Scan(c).go();
+    }
+
+    Config c;
+    c["input"] = scanPath + "scan.json";
+    c["output"] = outPath;
+    c["ticks"] = static_cast<Json::UInt64>(v.ticks());
+    c["hierarchyStep"] = static_cast<Json::UInt64>(v.hierarchyStep());
+    c["threads"] = 2;
+
+    {
+        const Config prepared(
+                merge(
+                    Config::defaults(),
+                    Config::defaultBuildParams(),
+                    c.prepare().json()));
+        Json::Value plan(Plan(Metadata(prepared), of).toJson());
+        plan["bounds"] = prepared["bounds"];
+        a.put(planPath, plan.toStyledString());
+    }
+
+    c["plan"] = planPath;
+    c["work"] = workPath;
+
+    // Each worker is its own process, sharing only the work directory.  A
+    // worker reports the number of subsets it built, and whether it merged,
+    // through its exit status.
+    std::vector<pid_t> workers;
+
+    for (std::size_t i(0); i < 3; ++i)
+    {
+        const pid_t pid(::fork());
+        ASSERT_GE(pid, 0);
+
+        if (!pid)
+        {
+            int status(255);
+            try
+            {
+                Coordinator coordinator(c);
+                const bool merged(coordinator.go());
+                status = static_cast<int>(coordinator.built() << 1) | merged;
+            }
+            catch (...) { }
+            ::_exit(status);
+        }
+
+        workers.push_back(pid);
+    }
+
+    uint64_t built(0);
+    uint64_t merges(0);
+
+    for (const pid_t pid : workers)
+    {
+        int status(0);
+        ASSERT_EQ(::waitpid(pid, &status, 0), pid);
+        ASSERT_TRUE(WIFEXITED(status));
+        ASSERT_NE(WEXITSTATUS(status), 255);
+
+        built += WEXITSTATUS(status) >> 1;
+        merges += WEXITSTATUS(status) & 1;
+    }
+
+    EXPECT_EQ(built, of);
+    EXPECT_EQ(merges, 1u);
+
+    const auto info(parse(a.get(outPath + "ept.json")));
+    EXPECT_EQ(info["points"].asUInt64(), v.points());
+
+    checkSources(outPath);
+
+    // Everything is done, so another worker has nothing to do.
+    Coordinator late(c);
+    EXPECT_FALSE(late.go());
+    EXPECT_EQ(late.built(), 0u);
+}
+
 TEST(build, reprojected)
 {
     const std::string outPath(test::dataPath() + "out/ellipsoid-re/");
@@ -409,3 +670,155 @@ TEST(build, reprojected)
     checkSources(outPath);
 }
 
+
+TEST(build, unwritableMetrics)
+{
+    const std::string outPath(test::dataPath() + "out/unwritable-metrics/");
+
+    Config c;
+    c["input"] = test::dataPath() + "ellipsoid-multi/";
+    c["output"] = outPath;
+    c["force"] = true;
+    c["ticks"] = static_cast<Json::UInt64>(v.ticks());
+    c["hierarchyStep"] = static_cast<Json::UInt64>(v.hierarchyStep());
+    c["metrics"] = outPath + "missing/metrics.prom";
+    c["metricsFormat"] = "prometheus";
+
+    // Failing to write metrics must not fail the build.
+    EXPECT_NO_THROW(Builder(c).go());
+
+    const auto info(parse(a.get(outPath + "ept.json")));
+    EXPECT_EQ(info["points"].asUInt64(), v.points());
+}
+
+TEST(build, nullData)
+{
+    using metrics::Counter;
+
+    const std::string outPath(test::dataPath() + "out/null/");
+    const metrics::Snapshot before(metrics::snapshot());
+
+    Config c;
+    c["input"] = test::dataPath() + "ellipsoid-multi/";
+    c["output"] = outPath;
+    c["force"] = true;
+    c["ticks"] = static_cast<Json::UInt64>(v.ticks());
+    c["hierarchyStep"] = static_cast<Json::UInt64>(v.hierarchyStep());
+    c["dataType"] = "null";
+    c["run"] = 4;
+
+    Builder(c).go();
+
+    // Continuing wakes the chunks written by the first run, which start empty
+    // since nothing can be read back.
+    Config next;
+    next["output"] = outPath;
+
+    const metrics::Snapshot between(metrics::snapshot());
+
+    Builder builder(next);
+    builder.go();
+
+    const metrics::Snapshot first(between - before);
+    const metrics::Snapshot second(metrics::snapshot() - between);
+    const metrics::Snapshot delta(metrics::snapshot() - before);
+    EXPECT_EQ(first[Counter::ChunksWoken], 0u);
+    EXPECT_GT(second[Counter::ChunksWoken], 0u);
+    EXPECT_GT(second[Counter::PointsWoken], 0u);
+
+    const auto info(parse(a.get(outPath + "ept.json")));
+    EXPECT_EQ(info["dataType"].asString(), "null");
+    EXPECT_EQ(info["points"].asUInt64(), v.points());
+
+    // Every point is discarded exactly once, when the chunk holding it is
+    // written, whether or not that chunk is later woken.
+    const uint64_t pointSize(builder.metadata().outSchema().pointSize());
+    EXPECT_EQ(delta[Counter::BytesDiscarded], v.points() * pointSize);
+
+    // The points held by woken chunks are lost from the hierarchy counts.
+    const Registry& registry(static_cast<const Builder&>(builder).registry());
+
+    uint64_t counted(0);
+    for (const auto& node : registry.hierarchy().snapshot())
+    {
+        counted += node.second;
+    }
+    EXPECT_EQ(counted, v.points() - delta[Counter::PointsWoken]);
+}
+
+TEST(build, duplicatesBeyondMaxDepth)
+{
+    const std::string outPath(test::dataPath() + "out/duplicates/");
+    for (const std::string dir : { "ept-data", "ept-hierarchy" })
+    {
+        arbiter::fs::mkdirp(outPath + dir);
+    }
+
+    Json::Value json;
+    json["output"] = outPath;
+    json["bounds"] = Bounds(0, 0, 0, 100, 100, 100).toJson();
+    json["schema"] = Schema(DimList {
+            DimInfo(DimId::X, DimType::Signed32, 0.01, 50),
+            DimInfo(DimId::Y, DimType::Signed32, 0.01, 50),
+            DimInfo(DimId::Z, DimType::Signed32, 0.01, 50)
+        }).toJson();
+    json["dataType"] = "null";
+    json["ticks"] = 4;
+    json["overflowThreshold"] = 4;
+
+    const Config config(
+            entwine::merge(
+                Config::defaults(),
+                Config::defaultBuildParams(),
+                json));
+    const Metadata metadata(config);
+    const arbiter::Endpoint out(a.getEndpoint(outPath));
+    const arbiter::Endpoint tmp(a.getEndpoint(config.tmp()));
+    ThreadPools pools(2);
+
+    // Identical points are never separated, so they reach the deepest node
+    // the hierarchy can describe, where those which do not fit are rejected
+    // rather than failing the build.
+    const uint64_t np(500);
+    uint64_t accepted(0);
+
+    {
+        Registry registry(metadata, out, tmp, pools, config.maxWriteBytes());
+
+        {
+            VectorPointTable table(metadata.schema(), np);
+            for (uint64_t i(0); i < np; ++i)
+            {
+                pdal::PointRef pr(table, i);
+                pr.setField(DimId::X, 12.34);
+                pr.setField(DimId::Y, 56.78);
+                pr.setField(DimId::Z, 90.12);
+            }
+
+            Clipper clipper(registry, 0);
+            Voxel voxel;
+            Key key(metadata);
+
+            for (uint64_t i(0); i < np; ++i)
+            {
+                pdal::PointRef pr(table, i);
+                voxel.initShallow(pr, table.getPoint(i));
+                key.init(voxel.point());
+                if (registry.addPoint(voxel, key, clipper)) ++accepted;
+            }
+        }
+
+        pools.cycle();
+
+        const Hierarchy::Snapshot nodes(registry.hierarchy().snapshot());
+        ASSERT_FALSE(nodes.empty());
+        EXPECT_EQ(nodes.back().first.dxyz().d, NodeKey::maxDepth);
+
+        uint64_t stored(0);
+        for (const auto& node : nodes) stored += node.second;
+        EXPECT_EQ(stored, accepted);
+    }
+
+    EXPECT_GT(accepted, 0u);
+    EXPECT_LT(accepted, np);
+}
@@ -0,0 +1,275 @@
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <entwine/io/ensure.hpp>
+#include <entwine/util/mapped-file.hpp>
+#include <entwine/util/time.hpp>
+#include <entwine/util/unique.hpp>
+
+using namespace entwine;
+
+namespace
+{
+    using ms = std::chrono::milliseconds;
+
+    // An in-memory driver that fails or stalls requests on demand.
+    class FaultyDriver : public arbiter::Driver
+    {
+    public:
+        virtual std::string type() const override { return "faulty"; }
+
+        virtual void put(std::string path, const std::vector<char>& data)
+            const override
+        {
+            Active active(*this);
+            ++puts;
+            if (consumeFailure()) throw std::runtime_error("Injected fault");
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_data[path] = data;
+        }
+
+        virtual std::unique_ptr<std::size_t> tryGetSize(std::string path)
+            const override
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            const auto it(m_data.find(path));
+            if (it == m_data.end()) return std::unique_ptr<std::size_t>();
+            return makeUnique<std::size_t>(it->second.size());
+        }
+
+        // Wait for any abandoned requests to complete.
+        void drain() const
+        {
+            while (active) std::this_thread::sleep_for(ms(1));
+        }
+
+        mutable std::atomic<std::size_t> failures{0};
+        mutable std::atomic<std::size_t> stalls{0};
+        mutable std::atomic<int> delay{0};
+        ms stallTime = ms(300);
+
+        mutable std::atomic<std::size_t> puts{0};
+        mutable std::atomic<std::size_t> gets{0};
+        mutable std::atomic<std::size_t> active{0};
+        mutable std::atomic<std::size_t> maxActive{0};
+
+    protected:
+        virtual bool get(std::string path, std::vector<char>& data)
+            const override
+        {
+            Active a(*this);
+            ++gets;
+            if (consumeFailure()) return false;
+
+            if (consume(stalls)) std::this_thread::sleep_for(stallTime);
+            else if (delay) std::this_thread::sleep_for(ms(delay));
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            const auto it(m_data.find(path));
+            if (it == m_data.end()) return false;
+            data = it->second;
+            return true;
+        }
+
+    private:
+        struct Active
+        {
+            Active(const FaultyDriver& d) : d(d)
+            {
+                const std::size_t n(++d.active);
+                std::size_t prev(d.maxActive);
+                while (n > prev && !d.maxActive.compare_exchange_weak(prev, n))
+                { }
+            }
+
+            ~Active() { --d.active; }
+
+            const FaultyDriver& d;
+        };
+
+        bool consumeFailure() const { return consume(failures); }
+
+        static bool consume(std::atomic<std::size_t>& n)
+        {
+            std::size_t current(n);
+            while (current && !n.compare_exchange_weak(current, current - 1))
+            { }
+            return current > 0;
+        }
+
+        mutable std::mutex m_mutex;
+        mutable std::map<std::string, std::vector<char>> m_data;
+    };
+
+    RetryPolicy fastPolicy()
+    {
+        RetryPolicy p;
+        p.tries = 5;
+        p.baseDelay = ms(1);
+        p.maxDelay = ms(4);
+        p.hedgePercentile = 0;
+        return p;
+    }
+
+    class EnsureTest : public ::testing::Test
+    {
+    protected:
+        EnsureTest()
+        {
+            auto driver(makeUnique<FaultyDriver>());
+            m_driver = driver.get();
+            m_arbiter.addDriver("faulty", std::move(driver));
+        }
+
+        ~EnsureTest()
+        {
+            m_driver->drain();
+        }
+
+        // Use a unique host per test so that tracked latencies are isolated.
+        arbiter::Endpoint endpoint(const std::string host)
+        {
+            return m_arbiter.getEndpoint("faulty://" + host + "/data");
+        }
+
+        arbiter::Arbiter m_arbiter;
+        FaultyDriver* m_driver;
+        const RetryPolicy m_policy = fastPolicy();
+    };
+
+    const std::vector<char> payload { 'e', 'p', 't' };
+}
+
+TEST_F(EnsureTest, putRetriesTransientFailures)
+{
+    const auto ep(endpoint("put-transient"));
+    m_driver->failures = 3;
+
+    ensurePut(ep, "a", payload, m_policy);
+    EXPECT_EQ(m_driver->puts.load(), 4u);
+    EXPECT_EQ(*ep.getBinary("a").data(), 'e');
+}
+
+TEST_F(EnsureTest, getRetriesTransientFailures)
+{
+    const auto ep(endpoint("get-transient"));
+    ep.put("a", payload);
+    m_driver->failures = 2;
+
+    const auto data(ensureGet(ep, "a", m_policy));
+    ASSERT_TRUE(data);
+    EXPECT_EQ(*data, payload);
+    EXPECT_EQ(m_driver->gets.load(), 3u);
+}
+
+TEST_F(EnsureTest, persistentFailure)
+{
+    const auto ep(endpoint("persistent"));
+    m_driver->failures = 100;
+
+    EXPECT_THROW(ensurePut(ep, "a", payload, m_policy), std::runtime_error);
+    EXPECT_EQ(m_driver->puts.load(), m_policy.tries);
+
+    EXPECT_THROW(ensureGet(ep, "missing", m_policy), std::runtime_error);
+}
+
+TEST_F(EnsureTest, concurrencyLimit)
+{
+    RetryPolicy p(m_policy);
+    p.concurrency = 2;
+
+    const auto ep(endpoint("concurrency"));
+    ep.put("a", payload);
+    m_driver->maxActive = 0;
+    m_driver->delay = 10;
+
+    std::vector<std::thread> threads;
+    for (std::size_t i(0); i < 8; ++i)
+    {
+        threads.emplace_back([&ep, &p]() { ensureGet(ep, "a", p); });
+    }
+    for (auto& t : threads) t.join();
+
+    EXPECT_EQ(m_driver->gets.load(), 8u);
+    EXPECT_LE(m_driver->maxActive.load(), 2u);
+}
+
+TEST_F(EnsureTest, hedgedGet)
+{
+    RetryPolicy p(m_policy);
+    p.hedgePercentile = 0.5;
+    p.hedgeMinSamples = 8;
+
+    const auto ep(endpoint("hedge"));
+    ep.put("a", payload);
+
+    // Establish a baseline latency.
+    m_driver->delay = 2;
+    for (std::size_t i(0); i < p.hedgeMinSamples; ++i) ensureGet(ep, "a", p);
+    const std::size_t baseline(m_driver->gets);
+
+    // Now stall the next request - a duplicate should be issued and win.
+    m_driver->stalls = 1;
+    const TimePoint start(now());
+    const auto data(ensureGet(ep, "a", p));
+    const auto elapsed(since<ms>(start));
+
+    ASSERT_TRUE(data);
+    EXPECT_EQ(*data, payload);
+    EXPECT_EQ(m_driver->gets.load(), baseline + 2);
+    EXPECT_LT(elapsed, m_driver->stallTime.count());
+}
+
+
+TEST_F(EnsureTest, hedgeIgnoresQueueing)
+{
+    RetryPolicy p(m_policy);
+    p.concurrency = 1;
+    p.hedgePercentile = 0.5;
+    p.hedgeMinSamples = 8;
+
+    const auto ep(endpoint("hedge-queue"));
+    ep.put("a", payload);
+
+    m_driver->delay = 2;
+    for (std::size_t i(0); i < p.hedgeMinSamples; ++i) ensureGet(ep, "a", p);
+    const std::size_t baseline(m_driver->gets);
+
+    // Each request waits well beyond the hedge threshold for the single
+    // slot, but none is slow once sent, so none should be duplicated.
+    std::vector<std::thread> threads;
+    for (std::size_t i(0); i < 8; ++i)
+    {
+        threads.emplace_back([&ep, &p]() { ensureGet(ep, "a", p); });
+    }
+    for (auto& t : threads) t.join();
+
+    EXPECT_EQ(m_driver->gets.load(), baseline + 8);
+    EXPECT_LE(m_driver->maxActive.load(), 1u);
+}
+
+TEST(ensure, localPutReplaces)
+{
+    arbiter::Arbiter a;
+    const std::string dir(arbiter::fs::getTempPath() + "entwine-ensure/");
+    arbiter::fs::mkdirp(dir);
+    const arbiter::Endpoint ep(a.getEndpoint(dir));
+
+    ensurePut(ep, "file", std::vector<char>(8192, 'a'));
+    const auto mapped(MappedFile::create(dir + "file"));
+    ASSERT_TRUE(mapped.get());
+
+    // Rewriting a mapped file must not truncate it beneath its mapping.
+    ensurePut(ep, "file", std::vector<char>(1, 'b'));
+    EXPECT_EQ(*ep.tryGetSize("file"), 1u);
+    EXPECT_EQ(mapped->data()[8191], 'a');
+    EXPECT_EQ(arbiter::fs::glob(dir + "*").size(), 1u);
+}
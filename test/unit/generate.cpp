@@ -0,0 +1,97 @@
+#include "gtest/gtest.h"
+#include "config.hpp"
+
+#include <entwine/builder/builder.hpp>
+#include <entwine/io/memory-driver.hpp>
+#include <entwine/reader/query.hpp>
+#include <entwine/reader/reader.hpp>
+#include <entwine/util/generator.hpp>
+#include <entwine/util/time.hpp>
+
+using namespace entwine;
+
+TEST(memory, store)
+{
+    auto a(makeArbiter());
+    a->put("mem://memory-test/a/0.txt", "zero");
+    a->put("mem://memory-test/a/1.txt", "one");
+    a->put("mem://memory-test/a/b/2.txt", "two");
+
+    EXPECT_EQ(a->get("mem://memory-test/a/1.txt"), "one");
+    EXPECT_FALSE(a->tryGet("mem://memory-test/a/3.txt"));
+    ASSERT_TRUE(a->tryGetSize("mem://memory-test/a/0.txt"));
+    EXPECT_EQ(*a->tryGetSize("mem://memory-test/a/0.txt"), 4u);
+
+    EXPECT_EQ(a->resolve("mem://memory-test/a/*").size(), 2u);
+    EXPECT_EQ(a->resolve("mem://memory-test/a/**").size(), 3u);
+
+    // Every arbiter shares the same store.
+    EXPECT_EQ(makeArbiter()->get("mem://memory-test/a/b/2.txt"), "two");
+
+    MemoryDriver::clear("memory-test/");
+    EXPECT_FALSE(a->tryGetSize("mem://memory-test/a/0.txt"));
+}
+
+TEST(memory, throttled)
+{
+    Json::Value json;
+    json["mem"]["latency"] = 50;
+    auto a(makeArbiter(json));
+
+    const auto start(now());
+    a->put("mem://memory-test/slow", "data");
+    EXPECT_EQ(a->get("mem://memory-test/slow"), "data");
+    EXPECT_GE(since<std::chrono::milliseconds>(start), 100);
+
+    MemoryDriver::clear("memory-test/");
+}
+
+TEST(generate, buildInMemory)
+{
+    Json::Value g;
+    g["output"] = "mem://generate-test/forest/";
+    g["type"] = "forest";
+    g["bounds"] = Bounds(0, 0, 100, 100).toJson();
+    g["density"] = 4;
+    g["filePoints"] = 10000;
+
+    Generator generator(g);
+    ASSERT_EQ(generator.tiles(), 4u);
+    ASSERT_EQ(generator.go(), 40000u);
+
+    auto a(makeArbiter());
+    ASSERT_EQ(a->resolve("mem://generate-test/forest/*").size(), 4u);
+
+    {
+        Config c;
+        c["input"] = "mem://generate-test/forest/";
+        c["output"] = "mem://generate-test/ept/";
+        c["force"] = true;
+
+        Builder b(c);
+        b.go();
+    }
+
+    Reader r("mem://generate-test/ept/");
+    auto count(r.count(Json::Value()));
+    count->run();
+    EXPECT_EQ(count->points(), 40000u);
+
+    MemoryDriver::clear("generate-test/");
+}
+
+
+TEST(generate, failedTiles)
+{
+    Json::Value g;
+    g["output"] = "mem://generate-test/failed/";
+    g["tmp"] = test::dataPath() + "out/generate-missing/tmp/";
+    g["bounds"] = Bounds(0, 0, 100, 100).toJson();
+    g["density"] = 1;
+
+    // Remote tiles are written to tmp first, which does not exist.
+    Generator generator(g);
+    EXPECT_THROW(generator.go(), std::runtime_error);
+
+    MemoryDriver::clear("generate-test/");
+}
@@ -0,0 +1,256 @@
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <set>
+#include <vector>
+
+#include <entwine/builder/hierarchy.hpp>
+#include <entwine/types/key.hpp>
+#include <entwine/types/node-key.hpp>
+
+using namespace entwine;
+
+namespace
+{
+    const uint64_t maxDepth(NodeKey::maxDepth);
+
+    // A random node at depth _d_.
+    Dxyz random(std::mt19937_64& gen, uint64_t d)
+    {
+        const uint64_t mask(d ? (1ULL << d) - 1 : 0);
+        return Dxyz(d, gen() & mask, gen() & mask, gen() & mask);
+    }
+
+    void expectEq(const Dxyz& a, const Dxyz& b)
+    {
+        EXPECT_EQ(a.d, b.d) << a.toString() << " != " << b.toString();
+        EXPECT_EQ(a.p, b.p) << a.toString() << " != " << b.toString();
+    }
+}
+
+TEST(nodeKey, root)
+{
+    const NodeKey root;
+    EXPECT_EQ(root.depth(), 0u);
+    expectEq(root.dxyz(), Dxyz());
+    EXPECT_EQ(NodeKey(Dxyz()), root);
+    EXPECT_EQ(NodeKey(Dxyz(0, 0, 0, 0)).lo(), 1u);
+    EXPECT_EQ(NodeKey(Dxyz(0, 0, 0, 0)).hi(), 0u);
+}
+
+TEST(nodeKey, roundTrip)
+{
+    std::mt19937_64 gen(42);
+
+    for (uint64_t d(0); d <= maxDepth; ++d)
+    {
+        const uint64_t last(d ? (1ULL << d) - 1 : 0);
+
+        // The extremes of each depth, and mixtures of them.
+        const std::vector<Dxyz> keys = {
+            Dxyz(d, 0, 0, 0),
+            Dxyz(d, last, last, last),
+            Dxyz(d, last, 0, 0),
+            Dxyz(d, 0, last, 0),
+            Dxyz(d, 0, 0, last)
+        };
+
+        for (const Dxyz& k : keys)
+        {
+            const NodeKey key(k);
+            EXPECT_EQ(key.depth(), d);
+            expectEq(key.dxyz(), k);
+            EXPECT_EQ(NodeKey(key.hi(), key.lo()), key);
+        }
+
+        for (int i(0); i < 100; ++i)
+        {
+            const Dxyz k(random(gen, d));
+            const NodeKey key(k);
+            EXPECT_EQ(key.depth(), d);
+            expectEq(key.dxyz(), k);
+        }
+    }
+}
+
+TEST(nodeKey, words)
+{
+    // Depths through 21 fit in the low word.
+    const uint64_t last21((1ULL << 21) - 1);
+    EXPECT_EQ(NodeKey(Dxyz(21, last21, last21, last21)).hi(), 0u);
+    EXPECT_EQ(NodeKey(Dxyz(21, 0, 0, 0)).lo(), 1ULL << 63);
+
+    const uint64_t last22((1ULL << 22) - 1);
+    const NodeKey deep(Dxyz(22, last22, last22, last22));
+    EXPECT_EQ(deep.hi(), 0xfu);
+    EXPECT_EQ(deep.lo(), (1ULL << 63) - 1);
+
+    const uint64_t last42((1ULL << 42) - 1);
+    const NodeKey deepest(Dxyz(42, last42, last42, last42));
+    EXPECT_EQ(deepest.hi(), ~0ULL);
+    EXPECT_EQ(deepest.lo(), (1ULL << 63) - 1);
+}
+
+TEST(nodeKey, tooDeep)
+{
+    EXPECT_THROW(NodeKey(Dxyz(maxDepth + 1, 0, 0, 0)), std::runtime_error);
+}
+
+TEST(nodeKey, ordering)
+{
+    std::mt19937_64 gen(42);
+
+    std::vector<Dxyz> keys;
+    for (uint64_t d(0); d <= maxDepth; ++d)
+    {
+        for (int i(0); i < 20; ++i) keys.push_back(random(gen, d));
+    }
+    std::shuffle(keys.begin(), keys.end(), gen);
+
+    std::vector<NodeKey> sorted;
+    for (const Dxyz& k : keys) sorted.emplace_back(k);
+    std::sort(sorted.begin(), sorted.end());
+
+    // Keys sort by depth, and then by the interleaved bits of their position
+    // from the most significant, X lowest.
+    const auto less([](const Dxyz& a, const Dxyz& b)
+    {
+        if (a.d != b.d) return a.d < b.d;
+        for (uint64_t bit(a.d); bit-- > 0; )
+        {
+            const uint64_t va[] = {
+                a.p.z >> bit & 1, a.p.y >> bit & 1, a.p.x >> bit & 1 };
+            const uint64_t vb[] = {
+                b.p.z >> bit & 1, b.p.y >> bit & 1, b.p.x >> bit & 1 };
+
+            for (int i(0); i < 3; ++i)
+            {
+                if (va[i] != vb[i]) return va[i] < vb[i];
+            }
+        }
+        return false;
+    });
+
+    for (std::size_t i(1); i < sorted.size(); ++i)
+    {
+        const Dxyz a(sorted[i - 1].dxyz());
+        const Dxyz b(sorted[i].dxyz());
+        EXPECT_FALSE(less(b, a)) << a.toString() << " > " << b.toString();
+        if (sorted[i - 1] != sorted[i])
+        {
+            EXPECT_TRUE(less(a, b)) << a.toString() << " ~ " << b.toString();
+        }
+    }
+}
+
+TEST(dxyz, copy)
+{
+    // Copies must reference their own position rather than that of their
+    // source.
+    Dxyz a(3, 1, 2, 3);
+    const Dxyz b(a);
+    a.p = Xyz(4, 5, 6);
+
+    EXPECT_EQ(&b.x, &b.p.x);
+    EXPECT_EQ(&b.y, &b.p.y);
+    EXPECT_EQ(&b.z, &b.p.z);
+    EXPECT_EQ(b.x, 1u);
+    EXPECT_EQ(b.y, 2u);
+    EXPECT_EQ(b.z, 3u);
+}
+
+TEST(hierarchy, growth)
+{
+    // Enough nodes that every shard grows well beyond its initial size.
+    std::mt19937_64 gen(42);
+    std::vector<Dxyz> keys;
+    std::set<NodeKey> unique;
+
+    while (keys.size() < 20000)
+    {
+        const Dxyz k(random(gen, gen() % (maxDepth + 1)));
+        if (unique.insert(NodeKey(k)).second) keys.push_back(k);
+    }
+
+    Hierarchy h;
+    EXPECT_EQ(h.size(), 0u);
+    EXPECT_EQ(h.get(Dxyz()), 0u);
+
+    for (std::size_t i(0); i < keys.size(); ++i)
+    {
+        h.set(keys[i], i + 1);
+        ASSERT_EQ(h.size(), i + 1);
+
+        // Earlier entries survive each resize.
+        if (i % 1000 == 999)
+        {
+            for (std::size_t j(0); j <= i; ++j)
+            {
+                ASSERT_EQ(h.get(keys[j]), j + 1) << keys[j].toString();
+            }
+        }
+    }
+
+    // Overwrites don't change the size.
+    for (std::size_t i(0); i < keys.size(); i += 2) h.set(keys[i], i + 7);
+    EXPECT_EQ(h.size(), keys.size());
+
+    for (std::size_t i(0); i < keys.size(); ++i)
+    {
+        EXPECT_EQ(h.get(keys[i]), i % 2 ? i + 1 : i + 7);
+    }
+
+    // Absent nodes read as zero.
+    for (int i(0); i < 1000; ++i)
+    {
+        const Dxyz k(random(gen, gen() % (maxDepth + 1)));
+        if (!unique.count(NodeKey(k)))
+        {
+            EXPECT_EQ(h.get(k), 0u);
+        }
+    }
+}
+
+TEST(hierarchy, snapshot)
+{
+    std::mt19937_64 gen(42);
+    Hierarchy h;
+
+    std::vector<Hierarchy::Node> expected;
+    std::set<NodeKey> unique;
+    while (expected.size() < 5000)
+    {
+        const Dxyz k(random(gen, gen() % (maxDepth + 1)));
+        const NodeKey key(k);
+        if (!unique.insert(key).second) continue;
+
+        const uint64_t val(gen() % 1000 + 1);
+        h.set(k, val);
+        expected.emplace_back(key, val);
+    }
+
+    std::sort(
+            expected.begin(),
+            expected.end(),
+            [](const Hierarchy::Node& a, const Hierarchy::Node& b)
+            {
+                return a.first < b.first;
+            });
+
+    const Hierarchy::Snapshot nodes(h.snapshot());
+    ASSERT_EQ(nodes.size(), expected.size());
+    for (std::size_t i(0); i < nodes.size(); ++i)
+    {
+        EXPECT_EQ(nodes[i].first, expected[i].first) << "At " << i;
+        EXPECT_EQ(nodes[i].second, expected[i].second) << "At " << i;
+    }
+
+    // The snapshot is a copy, unaffected by later writes.
+    Dxyz extra(random(gen, maxDepth));
+    while (unique.count(NodeKey(extra))) extra = random(gen, maxDepth);
+    h.set(extra, 1);
+    EXPECT_EQ(h.snapshot().size(), nodes.size() + 1);
+    EXPECT_EQ(nodes.size(), expected.size());
+}
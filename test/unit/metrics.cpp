@@ -0,0 +1,56 @@
+#include "gtest/gtest.h"
+
+#include <thread>
+#include <vector>
+
+#include <entwine/util/metrics.hpp>
+
+using namespace entwine;
+
+TEST(metrics, countersAcrossThreads)
+{
+    using metrics::Counter;
+
+    const metrics::Snapshot before(metrics::snapshot());
+
+    // Shards of exited threads must still be counted.
+    std::vector<std::thread> threads;
+    for (std::size_t i(0); i < 4; ++i)
+    {
+        threads.emplace_back([]()
+        {
+            for (std::size_t j(0); j < 1000; ++j)
+            {
+                metrics::add(Counter::PointsRead);
+            }
+            metrics::add(Counter::BytesUploaded, 10);
+        });
+    }
+    for (auto& t : threads) t.join();
+
+    metrics::add(Counter::PointsRead, 5);
+
+    const metrics::Snapshot delta(metrics::snapshot() - before);
+    EXPECT_EQ(delta[Counter::PointsRead], 4005u);
+    EXPECT_EQ(delta[Counter::BytesUploaded], 40u);
+}
+
+TEST(metrics, histogram)
+{
+    using metrics::Timer;
+
+    const metrics::Snapshot before(metrics::snapshot());
+
+    for (std::size_t i(0); i < 90; ++i) metrics::record(Timer::Upload, 3);
+    for (std::size_t i(0); i < 10; ++i) metrics::record(Timer::Upload, 1000);
+
+    const metrics::Histogram h((metrics::snapshot() - before)[Timer::Upload]);
+    EXPECT_EQ(h.count, 100u);
+    EXPECT_EQ(h.sum, 90u * 3 + 10u * 1000);
+
+    // Quantiles are upper bounds of power-of-two buckets.
+    EXPECT_EQ(h.quantile(0.5), 4u);
+    EXPECT_EQ(h.quantile(0.9), 4u);
+    EXPECT_EQ(h.quantile(0.99), 1024u);
+}
+
@@ -0,0 +1,179 @@
+#include "gtest/gtest.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <entwine/io/ensure.hpp>
+#include <entwine/io/memory-driver.hpp>
+#include <entwine/io/pack.hpp>
+#include <entwine/util/pool.hpp>
+
+using namespace entwine;
+
+namespace
+{
+    const std::string outPath(arbiter::fs::getTempPath() + "entwine-pack/");
+
+    std::vector<char> bytes(const std::string s)
+    {
+        return std::vector<char>(s.begin(), s.end());
+    }
+
+    class PackTest : public ::testing::Test
+    {
+    protected:
+        PackTest()
+            : m_out(m_arbiter.getEndpoint(outPath))
+            , m_tmp(m_arbiter.getEndpoint(arbiter::fs::getTempPath()))
+        {
+            arbiter::fs::mkdirp(outPath);
+            arbiter::fs::remove(outPath + "a.pack");
+            arbiter::fs::remove(outPath + "b.pack");
+        }
+
+        arbiter::Arbiter m_arbiter;
+        const arbiter::Endpoint m_out;
+        const arbiter::Endpoint m_tmp;
+    };
+}
+
+TEST_F(PackTest, appendAndRead)
+{
+    PackMap packs;
+
+    {
+        PackWriter writer(m_out, m_tmp);
+        packs[Dxyz(9, 0, 0, 0)] = writer.append("a.pack", bytes("first"));
+        packs[Dxyz(9, 0, 0, 1)] = writer.append("b.pack", bytes("other"));
+        packs[Dxyz(9, 0, 1, 0)] = writer.append("a.pack", bytes("second"));
+
+        const PackEntry& entry(packs[Dxyz(9, 0, 1, 0)]);
+        EXPECT_EQ(entry.pack, "a.pack");
+        EXPECT_EQ(entry.offset, 5u);
+        EXPECT_EQ(entry.size, 6u);
+        EXPECT_EQ(*writer.read(entry), bytes("second"));
+
+        Pool pool(2);
+        writer.save(pool);
+    }
+
+    EXPECT_EQ(*m_out.tryGetSize("a.pack"), 11u);
+
+    for (const auto& p : packs)
+    {
+        const PackEntry& entry(p.second);
+        const auto data(
+                ensureGetRange(m_out, entry.pack, entry.offset, entry.size));
+        ASSERT_TRUE(data);
+        EXPECT_EQ(data->size(), entry.size);
+    }
+
+    const auto data(ensureGetRange(m_out, "a.pack", 0, 5));
+    EXPECT_EQ(*data, bytes("first"));
+}
+
+TEST_F(PackTest, continuation)
+{
+    {
+        PackWriter writer(m_out, m_tmp);
+        writer.append("a.pack", bytes("first"));
+    }
+
+    // A new writer appends to the existing pack.
+    PackWriter writer(m_out, m_tmp);
+    const PackEntry entry(writer.append("a.pack", bytes("second")));
+    EXPECT_EQ(entry.offset, 5u);
+    EXPECT_EQ(*writer.read(entry), bytes("second"));
+}
+
+TEST_F(PackTest, index)
+{
+    PackMap packs;
+    packs[Dxyz(9, 1, 2, 3)] = PackEntry("8-0-1-1.pack", 100, 20);
+    packs[Dxyz(10, 2, 4, 6)] = PackEntry("8-0-1-1.pack", 120, 7);
+
+    const Dxyz root(5, 0, 0, 0);
+    m_out.put(packIndexFilename(root, ""), toJson(packs).toStyledString());
+
+    const PackMap loaded(loadPackIndex(m_out, root, ""));
+    ASSERT_EQ(loaded.size(), packs.size());
+
+    const PackEntry& entry(loaded.at(Dxyz(10, 2, 4, 6)));
+    EXPECT_EQ(entry.pack, "8-0-1-1.pack");
+    EXPECT_EQ(entry.offset, 120u);
+    EXPECT_EQ(entry.size, 7u);
+
+    EXPECT_TRUE(loadPackIndex(m_out, root, "-1").empty());
+    EXPECT_TRUE(loadPackIndex(m_out, Dxyz(), "").empty());
+}
+
+TEST(pack, remoteSegments)
+{
+    auto a(makeArbiter());
+    MemoryDriver::clear("pack-segments/");
+    const arbiter::Endpoint out(a->getEndpoint("mem://pack-segments/"));
+    const arbiter::Endpoint tmp(a->getEndpoint(arbiter::fs::getTempPath()));
+    Pool pool(2);
+
+    PackWriter writer(out, tmp);
+    const PackEntry first(writer.append("a.pack", bytes("first")));
+    writer.save(pool);
+    EXPECT_EQ(*out.tryGetSize("a.pack"), 5u);
+
+    // Appending after a save begins a new segment, rather than fetching and
+    // rewriting the uploaded one.
+    const PackEntry second(writer.append("a.pack", bytes("second")));
+    EXPECT_EQ(second.pack, "a.1.pack");
+    EXPECT_EQ(second.offset, 0u);
+    EXPECT_EQ(*writer.read(first), bytes("first"));
+    EXPECT_EQ(*writer.read(second), bytes("second"));
+    writer.save(pool);
+
+    EXPECT_EQ(*out.tryGetSize("a.pack"), 5u);
+    EXPECT_EQ(*out.tryGetSize("a.1.pack"), 6u);
+
+    // A later build skips the existing segments.
+    PackWriter next(out, tmp);
+    EXPECT_EQ(next.append("a.pack", bytes("third")).pack, "a.2.pack");
+}
+
+TEST_F(PackTest, staged)
+{
+    const std::string stagePath(
+            arbiter::fs::getTempPath() + "entwine-pack-stage/");
+    arbiter::fs::mkdirp(stagePath);
+    arbiter::fs::remove(stagePath + "a.pack");
+    arbiter::fs::remove(stagePath + "a.1.pack");
+    arbiter::fs::remove(outPath + "a.1.pack");
+    const arbiter::Endpoint stage(m_arbiter.getEndpoint(stagePath));
+    Pool pool(2);
+
+    {
+        PackWriter writer(m_out, m_tmp);
+        writer.append("a.pack", bytes("first"));
+    }
+
+    // Staged appends never touch the packs in the output, even locally.
+    PackWriter writer(m_out, m_tmp, RetryPolicy(), &stage);
+    const PackEntry second(writer.append("a.pack", bytes("second")));
+    EXPECT_EQ(second.pack, "a.1.pack");
+    EXPECT_EQ(second.offset, 0u);
+    EXPECT_EQ(*writer.read(second), bytes("second"));
+    EXPECT_EQ(*m_out.tryGetSize("a.pack"), 5u);
+    EXPECT_FALSE(m_out.tryGetSize("a.1.pack"));
+
+    // Saving leaves the segment for a checkpoint to commit.
+    writer.save(pool);
+    EXPECT_EQ(*stage.tryGetSize("a.1.pack"), 6u);
+    EXPECT_FALSE(m_out.tryGetSize("a.1.pack"));
+
+    ASSERT_EQ(
+            std::rename(
+                (stagePath + "a.1.pack").c_str(),
+                (outPath + "a.1.pack").c_str()),
+            0);
+
+    EXPECT_EQ(*writer.read(second), bytes("second"));
+    EXPECT_EQ(writer.append("a.pack", bytes("third")).pack, "a.2.pack");
+}
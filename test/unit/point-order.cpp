@@ -0,0 +1,217 @@
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include <entwine/io/point-order.hpp>
+#include <entwine/types/bounds.hpp>
+#include <entwine/types/key.hpp>
+#include <entwine/types/schema.hpp>
+#include <entwine/types/vector-point-table.hpp>
+
+using namespace entwine;
+
+namespace
+{
+    const Schema timed{
+        DimInfo(DimId::X, DimType::Double),
+        DimInfo(DimId::Y, DimType::Double),
+        DimInfo(DimId::Z, DimType::Double),
+        DimInfo(DimId::GpsTime, DimType::Double)
+    };
+
+    const Schema untimed{
+        DimInfo(DimId::X, DimType::Double),
+        DimInfo(DimId::Y, DimType::Double),
+        DimInfo(DimId::Z, DimType::Double)
+    };
+
+    void set(const Schema& schema, char* pos, DimId id, double v)
+    {
+        const pdal::PointLayout& layout(schema.pdalLayout());
+        std::memcpy(pos + layout.dimOffset(id), &v, sizeof(double));
+    }
+
+    // Points are split between two blocks, as a chunk's table is formed from
+    // its own points and those of its overflow.
+    class Points
+    {
+    public:
+        explicit Points(const Schema& schema)
+            : m_schema(schema)
+            , m_a(schema.pointSize(), 16)
+            , m_b(schema.pointSize(), 16)
+        { }
+
+        char* add(const Point& p, double time = 0)
+        {
+            char* pos(++m_n % 2 ? m_a.next() : m_b.next());
+            set(m_schema, pos, DimId::X, p.x);
+            set(m_schema, pos, DimId::Y, p.y);
+            set(m_schema, pos, DimId::Z, p.z);
+            if (m_schema.hasTime()) set(m_schema, pos, DimId::GpsTime, time);
+            return pos;
+        }
+
+        // The table's refs, as ordered.
+        std::vector<char*> order(PointOrder o, const Bounds& bounds)
+        {
+            BlockPointTable table(m_schema, m_a, m_b);
+            entwine::order(table, m_schema, bounds, o);
+            return table.refs();
+        }
+
+        // The table's refs without any ordering.
+        std::vector<char*> refs()
+        {
+            BlockPointTable table(m_schema, m_a, m_b);
+            return table.refs();
+        }
+
+    private:
+        const Schema& m_schema;
+        MemBlock m_a;
+        MemBlock m_b;
+        uint64_t m_n = 0;
+    };
+
+    const Bounds bounds(0, 0, 0, 8, 8, 8);
+
+    // Positions are quantized to a 2^21 grid within the bounds.
+    const uint64_t gridMax((1ULL << 21) - 1);
+
+    // Interleave the bits of a grid position, X lowest.
+    uint64_t interleave(uint64_t x, uint64_t y, uint64_t z)
+    {
+        uint64_t code(0);
+        for (uint64_t b(0); b < 21; ++b)
+        {
+            code |= ((x >> b) & 1) << (3 * b);
+            code |= ((y >> b) & 1) << (3 * b + 1);
+            code |= ((z >> b) & 1) << (3 * b + 2);
+        }
+        return code;
+    }
+}
+
+TEST(pointOrder, gpsTime)
+{
+    Points points(timed);
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<int> dist(-50, 50);
+
+    // Times are negative, positive, and zero, of very different magnitudes,
+    // with many equal to one another.
+    std::vector<double> times = { 1e12, -1e12, 1e-9, -1e-9, 0 };
+    for (int i(0); i < 500; ++i) times.push_back(dist(gen) * 0.5);
+    std::shuffle(times.begin(), times.end(), gen);
+
+    std::map<const char*, double> timeAt;
+    for (const double t : times) timeAt[points.add(Point(1, 1, 1), t)] = t;
+
+    // Equal times retain their prior order in the table.
+    std::vector<std::pair<double, char*>> expected;
+    for (char* pos : points.refs()) expected.emplace_back(timeAt[pos], pos);
+
+    std::stable_sort(
+            expected.begin(),
+            expected.end(),
+            [](const std::pair<double, char*>& a,
+                const std::pair<double, char*>& b)
+            {
+                return a.first < b.first;
+            });
+
+    const std::vector<char*> refs(points.order(PointOrder::gpsTime, bounds));
+    ASSERT_EQ(refs.size(), expected.size());
+    for (std::size_t i(0); i < refs.size(); ++i)
+    {
+        EXPECT_EQ(refs[i], expected[i].second) << "At " << i;
+    }
+}
+
+TEST(pointOrder, gpsTimeWithoutTime)
+{
+    Points points(untimed);
+    for (int i(0); i < 10; ++i) points.add(Point(8 - i * 0.5, 1, 1));
+
+    const std::vector<char*> before(points.refs());
+    EXPECT_EQ(points.order(PointOrder::gpsTime, bounds), before);
+}
+
+TEST(pointOrder, morton)
+{
+    Points points(untimed);
+
+    // The center of each cell of a 4x4x4 grid over the bounds, whose grid
+    // position is therefore its cell position * 2^19 + 2^18.
+    std::vector<Xyz> cells;
+    for (uint64_t x(0); x < 4; ++x)
+    {
+        for (uint64_t y(0); y < 4; ++y)
+        {
+            for (uint64_t z(0); z < 4; ++z)
+            {
+                cells.emplace_back(x, y, z);
+            }
+        }
+    }
+
+    std::mt19937 gen(42);
+    std::shuffle(cells.begin(), cells.end(), gen);
+
+    const uint64_t cell(1ULL << 19);
+    const uint64_t half(1ULL << 18);
+
+    std::map<const char*, uint64_t> codeAt;
+    for (const Xyz& c : cells)
+    {
+        const Point p(c.x * 2 + 1, c.y * 2 + 1, c.z * 2 + 1);
+        const uint64_t code(
+                interleave(
+                    c.x * cell + half,
+                    c.y * cell + half,
+                    c.z * cell + half));
+        codeAt[points.add(p)] = code;
+    }
+
+    // Points on or outside of the bounds are clamped to the edges of the
+    // grid, and equal codes retain their prior order in the table.
+    const uint64_t last(interleave(gridMax, gridMax, gridMax));
+    codeAt[points.add(Point(0, 0, 0))] = 0;
+    codeAt[points.add(Point(-5, -5, -5))] = 0;
+    codeAt[points.add(Point(20, 20, 20))] = last;
+    codeAt[points.add(Point(8, 8, 8))] = last;
+
+    std::vector<std::pair<uint64_t, char*>> expected;
+    for (char* pos : points.refs()) expected.emplace_back(codeAt[pos], pos);
+
+    std::stable_sort(
+            expected.begin(),
+            expected.end(),
+            [](const std::pair<uint64_t, char*>& a,
+                const std::pair<uint64_t, char*>& b)
+            {
+                return a.first < b.first;
+            });
+
+    const std::vector<char*> refs(points.order(PointOrder::morton, bounds));
+    ASSERT_EQ(refs.size(), expected.size());
+    for (std::size_t i(0); i < refs.size(); ++i)
+    {
+        EXPECT_EQ(refs[i], expected[i].second) << "At " << i;
+    }
+}
+
+TEST(pointOrder, none)
+{
+    Points points(timed);
+    for (int i(0); i < 10; ++i) points.add(Point(8 - i, 1, 1), 10 - i);
+
+    const std::vector<char*> before(points.refs());
+    EXPECT_EQ(points.order(PointOrder::none, bounds), before);
+}
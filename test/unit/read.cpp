@@ -4,6 +4,7 @@
 #include "verify.hpp"
 
 #include <entwine/builder/builder.hpp>
+#include <entwine/io/io.hpp>
 #include <entwine/reader/reader.hpp>
 
 namespace
@@ -120,7 +121,428 @@ TEST(read, data)
     ASSERT_EQ(counts.size(), v.points());
 }
 
+TEST(read, binary)
+{
+    // Local binary data is read in place via memory mapping.
+    const std::string out(test::dataPath() + "out/ellipsoid/ellipsoid-binary");
+
+    {
+        Config c;
+        c["input"] = test::dataPath() + "ellipsoid.laz";
+        c["output"] = out;
+        c["force"] = true;
+        c["dataType"] = "binary";
+        c["hierarchyStep"] = static_cast<Json::UInt64>(v.hierarchyStep());
+        c["ticks"] = static_cast<Json::UInt64>(v.ticks());
+
+        Builder b(c);
+        b.go();
+    }
+
+    Reader r(out);
+    const Metadata& m(r.metadata());
+    ASSERT_EQ(m.dataIo().type(), "binary");
+
+    uint64_t np(0);
+    for (std::size_t i(0); i < 8; ++i)
+    {
+        Json::Value q;
+        q["bounds"] = m.boundsCubic().get(toDir(i)).toJson();
+
+        auto readQuery = r.read(q);
+        readQuery->run();
+        np += readQuery->points();
+        EXPECT_EQ(
+                readQuery->data().size(),
+                readQuery->points() * m.outSchema().pointSize());
+    }
+
+    EXPECT_EQ(np, v.points());
+}
+
+TEST(read, parallel)
+{
+    const std::string out(test::dataPath() + "out/ellipsoid/ellipsoid");
+
+    {
+        Config c;
+        c["input"] = test::dataPath() + "ellipsoid.laz";
+        c["output"] = out;
+        c["force"] = true;
+        c["hierarchyStep"] = static_cast<Json::UInt64>(v.hierarchyStep());
+        c["ticks"] = static_cast<Json::UInt64>(v.ticks());
+
+        Builder b(c);
+        b.go();
+    }
+
+    Reader r(out);
+
+    // Results are merged in chunk order regardless of the thread count.
+    Json::Value q;
+    q["threads"] = 1;
+    auto serial(r.read(q));
+    serial->run();
+
+    q["threads"] = 4;
+    auto parallel(r.read(q));
+    parallel->run();
+
+    EXPECT_EQ(serial->points(), v.points());
+    EXPECT_EQ(parallel->points(), v.points());
+    EXPECT_TRUE(serial->data() == parallel->data());
+}
+
+TEST(read, stream)
+{
+    const std::string out(test::dataPath() + "out/ellipsoid/ellipsoid");
+
+    {
+        Config c;
+        c["input"] = test::dataPath() + "ellipsoid.laz";
+        c["output"] = out;
+        c["force"] = true;
+        c["hierarchyStep"] = static_cast<Json::UInt64>(v.hierarchyStep());
+        c["ticks"] = static_cast<Json::UInt64>(v.ticks());
+
+        Builder b(c);
+        b.go();
+    }
+
+    Reader r(out);
+
+    auto whole(r.read(Json::Value()));
+    whole->run();
+
+    const std::size_t blockPoints(1000);
+    const std::size_t blockBytes(
+            blockPoints * r.metadata().outSchema().pointSize());
+
+    std::vector<char> streamed;
+    std::vector<std::size_t> sizes;
+
+    auto stream(r.read(Json::Value()));
+    stream->run([&](std::vector<char>& block)
+    {
+        sizes.push_back(block.size());
+        streamed.insert(streamed.end(), block.begin(), block.end());
+    }, blockPoints);
+
+    ASSERT_FALSE(sizes.empty());
+    for (std::size_t i(0); i + 1 < sizes.size(); ++i)
+    {
+        EXPECT_EQ(sizes[i], blockBytes);
+    }
+    EXPECT_LE(sizes.back(), blockBytes);
+
+    EXPECT_EQ(stream->points(), v.points());
+    EXPECT_TRUE(stream->data().empty());
+    EXPECT_TRUE(streamed == whole->data());
+}
+
+TEST(read, cache)
+{
+    const std::string out(test::dataPath() + "out/ellipsoid/ellipsoid");
+
+    {
+        Config c;
+        c["input"] = test::dataPath() + "ellipsoid.laz";
+        c["output"] = out;
+        c["force"] = true;
+        c["hierarchyStep"] = static_cast<Json::UInt64>(v.hierarchyStep());
+        c["ticks"] = static_cast<Json::UInt64>(v.ticks());
+
+        Builder b(c);
+        b.go();
+    }
+
+    Json::Value params;
+    params["policy"] = "tinylfu";
+    params["pinDepth"] = 2;
+    auto cache(std::make_shared<Cache>(CacheParams(params)));
+
+    Reader r(out, "", cache);
+
+    auto first(r.read(Json::Value()));
+    first->run();
+
+    const Cache::Stats cold(cache->stats());
+    EXPECT_EQ(cold.hits, 0u);
+    EXPECT_GT(cold.misses, 0u);
+    EXPECT_EQ(cold.loads, cold.misses);
+    EXPECT_GT(cold.bytesLoaded, 0u);
+    EXPECT_GT(cold.pinnedBytes, 0u);
+
+    // Everything fits, so a repeated query is served entirely from cache.
+    auto second(r.read(Json::Value()));
+    second->run();
+
+    const Cache::Stats warm(cache->stats());
+    EXPECT_EQ(warm.misses, cold.misses);
+    EXPECT_EQ(warm.hits, cold.misses);
+    EXPECT_EQ(warm.evictions, 0u);
+    EXPECT_EQ(second->points(), first->points());
+}
+
+TEST(read, contained)
+{
+    const std::string out(test::dataPath() + "out/ellipsoid/ellipsoid");
+
+    {
+        Config c;
+        c["input"] = test::dataPath() + "ellipsoid.laz";
+        c["output"] = out;
+        c["force"] = true;
+        c["hierarchyStep"] = static_cast<Json::UInt64>(v.hierarchyStep());
+        c["ticks"] = static_cast<Json::UInt64>(v.ticks());
+
+        Builder b(c);
+        b.go();
+    }
+
+    auto cache(std::make_shared<Cache>());
+    Reader r(out, "", cache);
+
+    // Without an attribute filter, chunks within the query bounds are counted
+    // from the hierarchy alone.
+    auto count(r.count(Json::Value()));
+    count->run();
+    EXPECT_EQ(count->points(), v.points());
+    EXPECT_EQ(cache->stats().misses, 0u);
+
+    auto read(r.read(Json::Value()));
+    read->run();
+    EXPECT_EQ(read->points(), v.points());
+    EXPECT_GT(cache->stats().misses, 0u);
+
+    // Chunks which are only partially covered are still checked per point.
+    const Metadata& m(r.metadata());
+    uint64_t np(0);
+    for (std::size_t i(0); i < 8; ++i)
+    {
+        Json::Value q;
+        q["bounds"] = m.boundsCubic().get(toDir(i)).toJson();
+
+        auto bounded(r.count(q));
+        bounded->run();
+        np += bounded->points();
+    }
+
+    EXPECT_EQ(np, v.points());
+}
+
+TEST(read, hierarchy)
+{
+    const std::string out(test::dataPath() + "out/ellipsoid/ellipsoid");
+
+    {
+        Config c;
+        c["input"] = test::dataPath() + "ellipsoid.laz";
+        c["output"] = out;
+        c["force"] = true;
+        c["hierarchyStep"] = static_cast<Json::UInt64>(v.hierarchyStep());
+        c["ticks"] = static_cast<Json::UInt64>(v.ticks());
+
+        Builder b(c);
+        b.go();
+    }
+
+    // Only the root hierarchy file is loaded when the reader is created.
+    Json::Value params;
+    params["hierarchyBytes"] = 1024 * 1024;
+    auto cache(std::make_shared<Cache>(CacheParams(params)));
+
+    Reader a(out, "", cache);
+    const std::size_t initial(cache->hierarchy().bytes());
+    EXPECT_GT(initial, 0u);
+
+    auto first(a.count(Json::Value()));
+    first->run();
+    EXPECT_EQ(first->points(), v.points());
+    EXPECT_GT(cache->hierarchy().bytes(), initial);
+
+    // Subtrees are shared by readers of the same dataset.
+    const std::size_t loaded(cache->hierarchy().bytes());
+    Reader b(out, "", cache);
+    auto second(b.count(Json::Value()));
+    second->run();
+    EXPECT_EQ(second->points(), v.points());
+    EXPECT_EQ(cache->hierarchy().bytes(), loaded);
+
+    // Subtrees are reloaded as needed if they do not all fit.
+    params["hierarchyBytes"] = 1;
+    Reader c(out, "", std::make_shared<Cache>(CacheParams(params)));
+    auto third(c.count(Json::Value()));
+    third->run();
+    EXPECT_EQ(third->points(), v.points());
+}
+
+TEST(read, binaryHierarchy)
+{
+    const std::string out(test::dataPath() + "out/ellipsoid/ellipsoid-bin");
+
+    {
+        Config c;
+        c["input"] = test::dataPath() + "ellipsoid.laz";
+        c["output"] = out;
+        c["force"] = true;
+        c["hierarchyType"] = "binary";
+        c["hierarchyStep"] = static_cast<Json::UInt64>(v.hierarchyStep());
+        c["ticks"] = static_cast<Json::UInt64>(v.ticks());
+
+        Builder b(c);
+        b.go();
+    }
+
+    arbiter::Arbiter a;
+    EXPECT_TRUE(a.tryGetSize(out + "/ept-hierarchy/0-0-0-0.bin"));
+    EXPECT_FALSE(a.tryGetSize(out + "/ept-hierarchy/0-0-0-0.json"));
+
+    Reader r(out);
+    EXPECT_EQ(r.metadata().hierarchyType(), HierarchyType::binary);
+
+    auto count(r.count(Json::Value()));
+    count->run();
+    EXPECT_EQ(count->points(), v.points());
+}
+
+TEST(read, binaryHierarchyDepth)
+{
+    Config c;
+    c["input"] = test::dataPath() + "ellipsoid.laz";
+    c["output"] = test::dataPath() + "out/ellipsoid/ellipsoid-bin-deep";
+    c["force"] = true;
+    c["hierarchyType"] = "binary";
+    c["ticks"] = 16;
+
+    // These bounds fit this scale, but resolving them takes more depths than
+    // a binary hierarchy can store, which is rejected before building.
+    c["scale"] = 0.000001;
+
+    EXPECT_THROW(Builder(c).go(), std::runtime_error);
+}
+
 TEST(read, filter)
 {
+    const std::string out(test::dataPath() + "out/ellipsoid/ellipsoid");
+
+    {
+        Config c;
+        c["input"] = test::dataPath() + "ellipsoid.laz";
+        c["output"] = out;
+        c["force"] = true;
+        c["hierarchyStep"] = static_cast<Json::UInt64>(v.hierarchyStep());
+        c["ticks"] = static_cast<Json::UInt64>(v.ticks());
+
+        Builder b(c);
+        b.go();
+    }
+
+    Reader r(out);
+
+    auto count([&r](const Json::Value& filter)
+    {
+        Json::Value q;
+        q["filter"] = filter;
+        auto query(r.count(q));
+        query->run();
+        return query->points();
+    });
+
+    Json::Value below;
+    below["Z"]["$lt"] = 0;
+
+    Json::Value above;
+    above["Z"]["$gte"] = 0;
+
+    const uint64_t b(count(below));
+    const uint64_t a(count(above));
+    EXPECT_GT(b, 0u);
+    EXPECT_GT(a, 0u);
+    EXPECT_EQ(a + b, v.points());
+
+    Json::Value either;
+    either["$or"].append(below);
+    either["$or"].append(above);
+    EXPECT_EQ(count(either), v.points());
+
+    Json::Value neither;
+    neither["$nor"] = either["$or"];
+    EXPECT_EQ(count(neither), 0u);
+
+    Json::Value origin;
+    origin["OriginId"]["$in"].append(0);
+    EXPECT_EQ(count(origin), v.points());
+
+    // Filters are combined with the query bounds.
+    const Metadata& m(r.metadata());
+    Json::Value q;
+    q["bounds"] = m.boundsCubic().get(toDir(0)).toJson();
+    q["filter"] = below;
+    auto bounded(r.count(q));
+    bounded->run();
+    EXPECT_GT(bounded->points(), 0u);
+    EXPECT_LE(bounded->points(), b);
 }
 
+TEST(read, zoneMaps)
+{
+    const std::string out(test::dataPath() + "out/ellipsoid/ellipsoid-zones");
+
+    {
+        Config c;
+        c["input"] = test::dataPath() + "ellipsoid.laz";
+        c["output"] = out;
+        c["force"] = true;
+        c["hierarchyStep"] = static_cast<Json::UInt64>(v.hierarchyStep());
+        c["ticks"] = static_cast<Json::UInt64>(v.ticks());
+        c["zoneMaps"] = true;
+
+        Builder b(c);
+        b.go();
+    }
+
+    // Zone maps are sharded by hierarchy file.
+    arbiter::Arbiter a;
+    EXPECT_TRUE(a.tryGetSize(out + "/ept-hierarchy/0-0-0-0.zones.json"));
+    EXPECT_FALSE(a.tryGetSize(out + "/ept-hierarchy/zones.json"));
+
+    auto cache(std::make_shared<Cache>());
+    Reader r(out, "", cache);
+    EXPECT_TRUE(r.metadata().zoneMaps());
+
+    auto count([&r](const Json::Value& filter)
+    {
+        Json::Value q;
+        q["filter"] = filter;
+        auto query(r.read(q));
+        query->run();
+        return query->points();
+    });
+
+    // No chunk may contain a matching point, so nothing is fetched.
+    Json::Value none;
+    none["Intensity"]["$gt"] = 65535;
+    EXPECT_EQ(count(none), 0u);
+    EXPECT_EQ(cache->stats().misses, 0u);
+
+    // Dimension names are matched without regard to case, and their zone
+    // maps are found regardless.
+    Json::Value lower;
+    lower["intensity"]["$gt"] = 65535;
+    EXPECT_EQ(count(lower), 0u);
+    EXPECT_EQ(cache->stats().misses, 0u);
+
+    // Pruning never discards matching points.
+    Json::Value low;
+    low["Intensity"]["$lt"] = 100;
+
+    Json::Value high;
+    high["Intensity"]["$gte"] = 100;
+
+    EXPECT_EQ(count(low) + count(high), v.points());
+
+    Json::Value origin;
+    origin["OriginId"] = 0;
+    EXPECT_EQ(count(origin), v.points());
+}